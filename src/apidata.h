@@ -38,6 +38,7 @@
 #endif
 #include "dd_types.h"
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <iostream>
 #include <sstream>
@@ -84,6 +85,119 @@ namespace dd
     std::string _s;
   };
 
+  /**
+   * \brief key / value container of APIData, stored flat in insertion order
+   * Lookups are linear while there are few keys, which is the common case,
+   * and go through a hash index beyond.
+   */
+  template <typename V> class ad_map
+  {
+  public:
+    typedef std::pair<std::string, V> value_type;
+    typedef typename std::vector<value_type>::iterator iterator;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+    iterator begin()
+    {
+      return _items.begin();
+    }
+    iterator end()
+    {
+      return _items.end();
+    }
+    const_iterator begin() const
+    {
+      return _items.begin();
+    }
+    const_iterator end() const
+    {
+      return _items.end();
+    }
+
+    size_t size() const
+    {
+      return _items.size();
+    }
+
+    bool empty() const
+    {
+      return _items.empty();
+    }
+
+    iterator find(const std::string &key)
+    {
+      return _items.begin() + index_of(key);
+    }
+
+    const_iterator find(const std::string &key) const
+    {
+      return _items.begin() + index_of(key);
+    }
+
+    /**
+     * \brief sets the value of a key, inserted if not present
+     */
+    template <typename T> void assign(const std::string &key, T &&val)
+    {
+      size_t i = index_of(key);
+      if (i < _items.size())
+        {
+          _items[i].second = std::forward<T>(val);
+          return;
+        }
+      _items.emplace_back(key, std::forward<T>(val));
+      if (!_index.empty())
+        _index.emplace(key, i);
+      else if (_items.size() > index_min_size())
+        build_index();
+    }
+
+    iterator erase(const_iterator it)
+    {
+      auto next = _items.erase(it);
+      _index.clear();
+      if (_items.size() > index_min_size())
+        build_index();
+      return next;
+    }
+
+    void clear()
+    {
+      _items.clear();
+      _index.clear();
+    }
+
+  private:
+    static size_t index_min_size()
+    {
+      return 16;
+    }
+
+    size_t index_of(const std::string &key) const
+    {
+      if (_index.empty())
+        {
+          for (size_t i = 0; i < _items.size(); ++i)
+            if (_items[i].first == key)
+              return i;
+          return _items.size();
+        }
+      auto hit = _index.find(key);
+      return hit == _index.end() ? _items.size() : (*hit).second;
+    }
+
+    void build_index()
+    {
+      _index.reserve(_items.size());
+      for (size_t i = 0; i < _items.size(); ++i)
+        _index.emplace(_items[i].first, i);
+    }
+
+    std::vector<value_type> _items;
+    std::unordered_map<std::string, size_t> _index; /**< key positions, once
+                                                       there are many keys */
+  };
+
   /**
    * \brief object for visitor output
    */
@@ -156,10 +270,17 @@ namespace dd
      */
     inline void add(const std::string &key, const ad_variant_type &val)
     {
-      auto hit = _data.begin();
-      if ((hit = _data.find(key)) != _data.end())
-        _data.erase(hit);
-      _data.insert(std::pair<std::string, ad_variant_type>(key, val));
+      _data.assign(key, val);
+    }
+
+    /**
+     * \brief add key / object to data object, moving the value in
+     * @param key string unique key
+     * @param val variant value
+     */
+    inline void add(const std::string &key, ad_variant_type &&val)
+    {
+      _data.assign(key, std::move(val));
     }
 
     /**
@@ -168,8 +289,8 @@ namespace dd
      */
     inline void erase(const std::string &key)
     {
-      auto hit = _data.begin();
-      if ((hit = _data.find(key)) != _data.end())
+      auto hit = _data.find(key);
+      if (hit != _data.end())
         _data.erase(hit);
     }
 
@@ -182,13 +303,35 @@ namespace dd
      */
     inline ad_variant_type get(const std::string &key) const
     {
-      std::unordered_map<std::string, ad_variant_type>::const_iterator hit;
-      if ((hit = _data.find(key)) != _data.end())
+      auto hit = _data.find(key);
+      if (hit != _data.end())
         return (*hit).second;
       else
         return std::string(); // beware
     }
 
+    /**
+     * \brief get typed value from data object, without copy
+     * @param key string unique key
+     * @return reference to the value, valid until the key is modified
+     */
+    template <typename T> inline const T &get_ref(const std::string &key) const
+    {
+      auto hit = _data.find(key);
+      if (hit == _data.end())
+        throw DataConversionException("no value for key " + key);
+      return (*hit).second.template get<T>();
+    }
+
+    /**
+     * \brief get data object value, without copy
+     *        objects stored as DTOs are not supported, see getobj
+     * @param key string unique key
+     * @return reference to the object, or to the first object of a vector,
+     *         empty if there is no such key
+     */
+    inline const APIData &getobj_ref(const std::string &key) const;
+
     /**
      * \brief get vector container as variant value
      * @param key string unique value
@@ -239,17 +382,13 @@ namespace dd
      */
     inline bool has(const std::string &key) const
     {
-      std::unordered_map<std::string, ad_variant_type>::const_iterator hit;
-      if ((hit = _data.find(key)) != _data.end())
-        return true;
-      else
-        return false;
+      return _data.find(key) != _data.end();
     }
 
     std::vector<std::string> list_keys() const
     {
       std::vector<std::string> keys;
-      for (auto kv : _data)
+      for (const auto &kv : _data)
         {
           keys.push_back(kv.first);
         }
@@ -356,10 +495,29 @@ namespace dd
       return _data.empty();
     }
 
-    std::unordered_map<std::string, ad_variant_type>
-        _data; /**< data as hashtable of variant types. */
+    ad_map<ad_variant_type> _data; /**< data as map of variant types. */
   };
 
+  inline const APIData &APIData::getobj_ref(const std::string &key) const
+  {
+    static const APIData empty_ad;
+    auto hit = _data.find(key);
+    if (hit == _data.end())
+      return empty_ad;
+    const ad_variant_type &val = (*hit).second;
+    if (val.is<APIData>())
+      return val.get<APIData>();
+    if (val.is<std::vector<APIData>>())
+      {
+        const std::vector<APIData> &vad = val.get<std::vector<APIData>>();
+        return vad.empty() ? empty_ad : vad.front();
+      }
+    if (val.is<oatpp::Any>())
+      throw DataConversionException("object " + key
+                                    + " is a DTO, use getobj");
+    return empty_ad;
+  }
+
   /**
    * \brief visitor class for conversion to JSON
    */
@@ -530,7 +688,7 @@ namespace dd
         {
           JVal jv(rapidjson::kObjectType);
           visitor_rjson vrj(_jd, &jv);
-          APIData ad = vad.at(i);
+          const APIData &ad = vad.at(i);
           auto hit = ad._data.begin();
           while (hit != ad._data.end())
             {
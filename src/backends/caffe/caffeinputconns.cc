@@ -2529,83 +2529,74 @@ namespace dd
     return 0;
   }
 
-  void SVMCaffeInputFileConn::add_train_svmline(
-      const int &label, const std::unordered_map<int, double> &vals,
-      const int &count)
+  void SVMCaffeInputFileConn::put_svm_datum(caffe::db::Transaction *txn,
+                                            const SparseDatum &d,
+                                            const int &count)
   {
-    if (!_db || !_train)
-      {
-        SVMInputFileConn::add_train_svmline(label, vals, count);
-        return;
-      }
-
     const int kMaxKeyLength = 256;
     char key_cstr[kMaxKeyLength];
 
-    SparseDatum d = to_sparse_datum(SVMline(label, vals));
-
     // sequential
     int length = snprintf(
         key_cstr, kMaxKeyLength, "%s",
-        std::to_string(count).c_str()); // XXX: using appeared to confuse the
-                                        // training (maybe because sorted)
+        std::to_string(count).c_str()); // XXX: using id appeared to confuse
+                                        // the training (maybe because sorted)
 
     // put in db
     std::string out;
     if (!d.SerializeToString(&out))
       {
-        _logger->info("Failed serialization of datum for db storage");
+        _logger->error("Failed serialization of datum for db storage");
         return;
       }
-    _txn->Put(std::string(key_cstr, length), out);
-    _db_batchsize++;
-
-    if (count % 10000 == 0)
-      {
-        // commit db
-        _txn->Commit();
-        _txn.reset(_tdb->NewTransaction());
-        _logger->info("Processed {} records", count);
-      }
+    txn->Put(std::string(key_cstr, length), out);
   }
 
-  void SVMCaffeInputFileConn::add_test_svmline(
-      const int &label, const std::unordered_map<int, double> &vals,
-      const int &count)
+  void SVMCaffeInputFileConn::add_train_svm(SVMCSR &rows, const int &count)
   {
     if (!_db || !_train)
       {
-        SVMInputFileConn::add_test_svmline(label, vals, count);
+        SVMInputFileConn::add_train_svm(rows, count);
         return;
       }
 
-    const int kMaxKeyLength = 256;
-    char key_cstr[kMaxKeyLength];
-
-    SparseDatum d = to_sparse_datum(SVMline(label, vals));
+    for (size_t r = 0; r < rows.rows(); ++r)
+      {
+        int c = count + r;
+        put_svm_datum(_txn.get(), to_sparse_datum(rows, r), c);
+        _db_batchsize++;
 
-    // sequential
-    int length = snprintf(
-        key_cstr, kMaxKeyLength, "%s",
-        std::to_string(count).c_str()); // XXX: using id appeared to confuse
-                                        // the training (maybe because sorted)
+        if (c % 10000 == 0)
+          {
+            // commit db
+            _txn->Commit();
+            _txn.reset(_tdb->NewTransaction());
+            _logger->info("Processed {} records", c);
+          }
+      }
+  }
 
-    // put in db
-    std::string out;
-    if (!d.SerializeToString(&out))
+  void SVMCaffeInputFileConn::add_test_svm(SVMCSR &rows, const int &count)
+  {
+    if (!_db || !_train)
       {
-        _logger->error("Failed serialization of datum for db storage");
+        SVMInputFileConn::add_test_svm(rows, count);
         return;
       }
-    _ttxn->Put(std::string(key_cstr, length), out);
-    _db_testbatchsize++;
 
-    if (count % 10000 == 0)
+    for (size_t r = 0; r < rows.rows(); ++r)
       {
-        // commit db
-        _ttxn->Commit();
-        _ttxn.reset(_ttdb->NewTransaction());
-        _logger->info("Processed {} records", count);
+        int c = count + r;
+        put_svm_datum(_ttxn.get(), to_sparse_datum(rows, r), c);
+        _db_testbatchsize++;
+
+        if (c % 10000 == 0)
+          {
+            // commit db
+            _ttxn->Commit();
+            _ttxn.reset(_ttdb->NewTransaction());
+            _logger->info("Processed {} records", c);
+          }
       }
   }
 
@@ -1520,12 +1520,8 @@ namespace dd
         return _dv_test_sparse.size();
     }
 
-    virtual void add_train_svmline(const int &label,
-                                   const std::unordered_map<int, double> &vals,
-                                   const int &count);
-    virtual void add_test_svmline(const int &label,
-                                  const std::unordered_map<int, double> &vals,
-                                  const int &count);
+    virtual void add_train_svm(SVMCSR &rows, const int &count);
+    virtual void add_test_svm(SVMCSR &rows, const int &count);
 
     void transform(const APIData &ad)
     {
@@ -1567,14 +1563,10 @@ namespace dd
           if (_train)
             {
               write_class_weights(_model_repo, ad_mllib);
-              int n = 0;
-              auto hit = _svmdata.begin();
-              while (hit != _svmdata.end())
+              for (size_t r = 0; r < _svmdata.rows(); ++r)
                 {
-                  _dv_sparse.push_back(to_sparse_datum((*hit)));
-                  this->_ids.push_back(std::to_string(n));
-                  ++n;
-                  ++hit;
+                  _dv_sparse.push_back(to_sparse_datum(_svmdata, r));
+                  this->_ids.push_back(std::to_string(r));
                 }
             }
           if (!_train)
@@ -1589,33 +1581,25 @@ namespace dd
             }
           else
             _svmdata.clear();
-          int n = 0;
-          auto hit = _svmdata_test.begin();
-          while (hit != _svmdata_test.end())
+          for (size_t r = 0; r < _svmdata_test.rows(); ++r)
             {
-              _dv_test_sparse.push_back(to_sparse_datum((*hit)));
+              _dv_test_sparse.push_back(to_sparse_datum(_svmdata_test, r));
               if (!_train)
-                this->_ids.push_back(std::to_string(n));
-              ++n;
-              ++hit;
+                this->_ids.push_back(std::to_string(r));
             }
         }
     }
 
-    caffe::SparseDatum to_sparse_datum(const SVMline &svml)
+    caffe::SparseDatum to_sparse_datum(const SVMCSR &rows, const size_t &r)
     {
       caffe::SparseDatum datum;
-      datum.set_label(svml._label);
-      auto hit = svml._v.begin();
-      int nelts = 0;
-      while (hit != svml._v.end())
+      datum.set_label(rows._labels[r]);
+      for (size_t k = rows._indptr[r]; k < rows._indptr[r + 1]; ++k)
         {
-          datum.add_data(static_cast<float>((*hit).second));
-          datum.add_indices((*hit).first);
-          ++nelts;
-          ++hit;
+          datum.add_data(static_cast<float>(rows._values[k]));
+          datum.add_indices(rows._indices[k]);
         }
-      datum.set_nnz(nelts);
+      datum.set_nnz(rows.row_nnz(r));
       datum.set_size(channels());
       return datum;
     }
@@ -1651,6 +1635,9 @@ namespace dd
                              const APIData &ad_input,
                              const std::string &backend = "lmdb");
 
+    void put_svm_datum(caffe::db::Transaction *txn,
+                       const caffe::SparseDatum &d, const int &count);
+
   public:
     std::vector<caffe::SparseDatum>::const_iterator _dt_vit;
     int _db_batchsize = -1;
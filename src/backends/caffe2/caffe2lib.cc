@@ -39,6 +39,7 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #include "outputconnectorstrategy.h"
+#include "utils/cv_utils.hpp"
 #pragma GCC diagnostic pop
 
 namespace dd
@@ -1082,6 +1083,9 @@ namespace dd
 
     _state.set_bbox(ad_output);
     _state.set_mask(ad_output);
+    bool mask_rle
+        = ad_output.has("mask_format")
+          && ad_output.get("mask_format").get<std::string>() == "rle";
 
     // XXX More informations could be fetched in the future (bbox, rois, etc.)
 
@@ -1229,12 +1233,22 @@ namespace dd
                         img(cv::Rect(scaled_coords[0], scaled_coords[1], width,
                                      height))
                             .copyTo(mask);
-                        ad_mask.add("format", std::string("HW"));
                         ad_mask.add("width", width);
                         ad_mask.add("height", height);
-                        ad_mask.add("data",
-                                    std::vector<int>(
-                                        mask.data, mask.data + mask.total()));
+                        if (mask_rle)
+                          {
+                            ad_mask.add("format", std::string("RLE"));
+                            ad_mask.add("counts",
+                                        cv_utils::rle_to_string(
+                                            cv_utils::mask_to_rle(mask)));
+                          }
+                        else
+                          {
+                            ad_mask.add("format", std::string("HW"));
+                            ad_mask.add("data", std::vector<int>(
+                                                    mask.data,
+                                                    mask.data + mask.total()));
+                          }
                       }
                   }
 
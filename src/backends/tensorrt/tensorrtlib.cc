@@ -548,6 +548,11 @@ namespace dd
     cudaSetDevice(_gpuid);
 
     auto output_params = predict_dto->parameters->output;
+    std::string nms = output_params->nms;
+    if (nms != "greedy" && nms != "soft_linear" && nms != "soft_gaussian")
+      throw MLLibBadParamException(
+          "unknown nms " + nms + ", expects greedy, soft_linear or "
+          "soft_gaussian");
 
     std::string out_blob = "prob";
     std::string extract_layer = predict_dto->parameters->mllib->extract_layer;
@@ -1114,7 +1119,10 @@ namespace dd
                     bbox_utils::nms_sorted_bboxes(
                         bboxes, probs, cats,
                         (double)output_params->nms_threshold,
-                        (int)output_params->best_bbox);
+                        (int)output_params->best_bbox, nms,
+                        output_params->nms_per_class,
+                        (double)output_params->nms_sigma,
+                        (double)output_params->confidence_threshold);
                   }
 
                 if (leave)
@@ -32,6 +32,39 @@
 namespace dd
 {
 
+  /**
+   * \brief per-call parameters for adaptive inference, ie skipping
+   * computation on easy inputs. Supported by vit and visformer templates.
+   */
+  struct AdaptiveInferenceParams
+  {
+    double _exit_confidence = 0.0; /**< a sample exits as soon as its top
+                                      softmax probability at an intermediate
+                                      block reaches this value, 0 disables */
+    int _exit_min_depth = 1;   /**< number of blocks to run before allowing
+                                  early exit */
+    double _token_keep_rate = 1.0; /**< fraction of patch tokens kept at each
+                                      pruning stage, 1 disables pruning */
+
+    bool enabled() const
+    {
+      return _exit_confidence > 0.0 || _token_keep_rate < 1.0;
+    }
+  };
+
+  /**
+   * \brief what adaptive inference did on a batch, for measuring the
+   * accuracy/latency trade-off
+   */
+  struct AdaptiveInferenceStats
+  {
+    std::vector<int> _exit_depths; /**< number of blocks run per sample */
+    std::vector<double>
+        _token_ratios; /**< per sample ratio of processed tokens over the
+                          full network, summed over blocks */
+    int _depth = 0;    /**< total number of blocks of the network */
+  };
+
   class NativeModule : public virtual torch::nn::Module
   {
   public:
@@ -74,6 +107,30 @@ namespace dd
     virtual torch::Tensor loss(std::string loss, torch::Tensor input,
                                torch::Tensor output, torch::Tensor target)
         = 0;
+
+    /**
+     * \brief whether forward_adaptive is implemented by the template
+     */
+    virtual bool supports_adaptive() const
+    {
+      return false;
+    }
+
+    /**
+     * \brief inference pass with early exit and/or token pruning
+     * @param input tensor
+     * @param params adaptive inference parameters
+     * @param stats filled with per sample depth and token usage
+     * @return logits, as forward()
+     */
+    virtual torch::Tensor
+    forward_adaptive(torch::Tensor x, const AdaptiveInferenceParams &params,
+                     AdaptiveInferenceStats &stats)
+    {
+      (void)params;
+      (void)stats;
+      return forward(x);
+    }
   };
 
   template <typename T>
@@ -20,6 +20,7 @@
  */
 
 #include "visformer.h"
+#include <numeric>
 #include <iostream>
 
 namespace dd
@@ -311,6 +312,99 @@ namespace dd
     return x;
   }
 
+  torch::Tensor
+  Visformer::forward_adaptive(torch::Tensor x,
+                              const AdaptiveInferenceParams &params,
+                              AdaptiveInferenceStats &stats)
+  {
+    if (params._token_keep_rate < 1.0)
+      throw MLLibBadParamException(
+          "token pruning is not supported by visformer");
+
+    int64_t B = x.size(0);
+    x = _stem->forward(x);
+
+    x = _patch_embed1(x);
+    x = x + _pos_embed1;
+    x = _pos_drop(x);
+    for (const auto &blk : *_stage1_blocks)
+      x = blk->as<Block>()->forward(x);
+
+    x = _patch_embed2(x);
+    x = x + _pos_embed2;
+    x = _pos_drop(x);
+    for (const auto &blk : *_stage2_blocks)
+      x = blk->as<Block>()->forward(x);
+
+    x = _patch_embed3(x);
+    x = x + _pos_embed3;
+    x = _pos_drop(x);
+
+    // exits are only possible in stage 3, where features match the head
+    const unsigned int depth = _stage1_blocks->size() + _stage2_blocks->size()
+                               + _stage3_blocks->size();
+    const unsigned int stage3_start = depth - _stage3_blocks->size();
+    stats._depth = depth;
+    stats._exit_depths.assign(B, depth);
+    stats._token_ratios.assign(B, 1.0);
+
+    auto head = [&](const torch::Tensor &f) {
+      torch::Tensor h = _global_pooling(_norm(f));
+      return _head(h.view({ h.size(0), -1 }));
+    };
+
+    torch::Tensor out;
+    torch::Tensor active
+        = torch::arange(B, torch::TensorOptions(torch::kLong).device(
+                               x.device()));
+    std::vector<int64_t> active_ids(B);
+    std::iota(active_ids.begin(), active_ids.end(), 0);
+
+    for (size_t d = 0; d < _stage3_blocks->size(); ++d)
+      {
+        x = (*_stage3_blocks)[d]->as<Block>()->forward(x);
+        unsigned int done_depth = stage3_start + d + 1;
+        if (d == _stage3_blocks->size() - 1 || params._exit_confidence <= 0.0
+            || static_cast<int>(done_depth) < params._exit_min_depth)
+          continue;
+
+        torch::Tensor logits = head(x);
+        if (!out.defined())
+          out = torch::zeros({ B, logits.size(1) }, logits.options());
+        torch::Tensor done = std::get<0>(torch::softmax(logits, 1).max(1))
+                             >= params._exit_confidence;
+        if (!done.any().item<bool>())
+          continue;
+
+        out.index_copy_(0, active.index({ done }), logits.index({ done }));
+        torch::Tensor keep = torch::nonzero(~done).squeeze(1);
+        auto done_acc = done.to(torch::kCPU).accessor<bool, 1>();
+        std::vector<int64_t> still_active;
+        for (size_t i = 0; i < active_ids.size(); ++i)
+          {
+            if (done_acc[i])
+              {
+                stats._exit_depths[active_ids[i]] = done_depth;
+                stats._token_ratios[active_ids[i]]
+                    = static_cast<double>(done_depth) / depth;
+              }
+            else
+              still_active.push_back(active_ids[i]);
+          }
+        active_ids = still_active;
+        if (active_ids.empty())
+          return out;
+        x = x.index_select(0, keep);
+        active = active.index_select(0, keep);
+      }
+
+    torch::Tensor logits = head(x);
+    if (!out.defined())
+      return logits;
+    out.index_copy_(0, active, logits);
+    return out;
+  }
+
   void
   Visformer::get_params_and_init_block(const ImgTorchInputFileConn &inputc,
                                        const APIData &ad_params)
@@ -327,6 +327,20 @@ namespace dd
 
     torch::Tensor forward(torch::Tensor x);
 
+    bool supports_adaptive() const override
+    {
+      return true;
+    }
+
+    /**
+     * \brief early exit uses the final norm, pooling and head on the feature
+     * map of intermediate stage 3 blocks. Token pruning is not supported,
+     * since stage blocks operate on spatial feature maps.
+     */
+    torch::Tensor forward_adaptive(torch::Tensor x,
+                                   const AdaptiveInferenceParams &params,
+                                   AdaptiveInferenceStats &stats) override;
+
     torch::Tensor extract(torch::Tensor x, std::string extract_layer) override
     {
       (void)x;
@@ -21,6 +21,8 @@
 
 #include "vit.h"
 #include <iostream>
+#include <numeric>
+#include <set>
 
 namespace dd
 {
@@ -312,4 +314,106 @@ namespace dd
     x = x.reshape({ x.size(0), _num_classes }); // custom
     return x;
   }
+
+  torch::Tensor ViT::forward_adaptive(torch::Tensor x,
+                                      const AdaptiveInferenceParams &params,
+                                      AdaptiveInferenceStats &stats)
+  {
+    if (params._token_keep_rate < 1.0 && _realformer)
+      throw MLLibBadParamException(
+          "token pruning is not supported with realformer");
+
+    int64_t B = x.size(0);
+    x = _patch_embed(x);
+
+    auto cls_tokens = _cls_token.expand({ B, -1, -1 });
+    x = torch::cat({ cls_tokens, x }, 1);
+    x = x + _pos_embed;
+    x = _pos_drop(x);
+
+    const double full_tokens = x.size(1);
+    torch::Tensor logits;
+    torch::Tensor out;
+    // ids of samples that are still running, in the original batch
+    torch::Tensor active
+        = torch::arange(B, torch::TensorOptions(torch::kLong).device(
+                               x.device()));
+    stats._depth = _depth;
+    stats._exit_depths.assign(B, _depth);
+    stats._token_ratios.assign(B, 0.0);
+    std::vector<int64_t> active_ids(B);
+    std::iota(active_ids.begin(), active_ids.end(), 0);
+
+    std::set<unsigned int> prune_after;
+    if (params._token_keep_rate < 1.0)
+      prune_after = { _depth / 4, _depth / 2, 3 * _depth / 4 };
+
+    torch::Tensor prev_x;
+    for (unsigned int d = 0; d < _depth; ++d)
+      {
+        x = (*_blocks)[d]->as<Block>()->forward(x, prev_x);
+        for (int64_t id : active_ids)
+          stats._token_ratios[id] += x.size(1) / full_tokens / _depth;
+
+        if (d == _depth - 1)
+          break;
+
+        if (params._exit_confidence > 0.0
+            && static_cast<int>(d) + 1 >= params._exit_min_depth)
+          {
+            logits = _head(_norm(torch::narrow(x, 1, 0, 1)))
+                         .reshape({ x.size(0), _num_classes });
+            if (!out.defined())
+              out = torch::zeros({ B, _num_classes }, logits.options());
+            torch::Tensor done = std::get<0>(torch::softmax(logits, 1).max(1))
+                                 >= params._exit_confidence;
+            if (done.any().item<bool>())
+              {
+                out.index_copy_(0, active.index({ done }),
+                                logits.index({ done }));
+                torch::Tensor keep = torch::nonzero(~done).squeeze(1);
+                auto done_acc = done.to(torch::kCPU).accessor<bool, 1>();
+                std::vector<int64_t> still_active;
+                for (size_t i = 0; i < active_ids.size(); ++i)
+                  {
+                    if (done_acc[i])
+                      stats._exit_depths[active_ids[i]] = d + 1;
+                    else
+                      still_active.push_back(active_ids[i]);
+                  }
+                active_ids = still_active;
+                if (active_ids.empty())
+                  return out;
+                x = x.index_select(0, keep);
+                active = active.index_select(0, keep);
+                if (prev_x.defined())
+                  prev_x = prev_x.index_select(0, keep);
+              }
+          }
+
+        if (prune_after.count(d + 1))
+          {
+            int64_t N = x.size(1) - 1;
+            int64_t nkeep = std::max<int64_t>(
+                1, std::lround(N * params._token_keep_rate));
+            if (nkeep < N)
+              {
+                auto cls = torch::narrow(x, 1, 0, 1);
+                auto patches = torch::narrow(x, 1, 1, N);
+                auto scores = (patches * cls).sum(-1);
+                auto idx = std::get<1>(scores.topk(nkeep, 1));
+                patches = patches.gather(
+                    1, idx.unsqueeze(-1).expand({ -1, -1, x.size(2) }));
+                x = torch::cat({ cls, patches }, 1);
+              }
+          }
+      }
+
+    logits = _head(_norm(torch::narrow(x, 1, 0, 1)))
+                 .reshape({ x.size(0), _num_classes });
+    if (!out.defined())
+      return logits;
+    out.index_copy_(0, active, logits);
+    return out;
+  }
 }
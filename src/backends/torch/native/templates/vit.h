@@ -376,6 +376,20 @@ namespace dd
 
     torch::Tensor forward_features(torch::Tensor x);
 
+    bool supports_adaptive() const override
+    {
+      return true;
+    }
+
+    /**
+     * \brief early exit uses the final norm and head on the class token of
+     * intermediate blocks. Token pruning keeps the patch tokens most similar
+     * to the class token after blocks depth/4, depth/2 and 3*depth/4.
+     */
+    torch::Tensor forward_adaptive(torch::Tensor x,
+                                   const AdaptiveInferenceParams &params,
+                                   AdaptiveInferenceStats &stats) override;
+
     torch::Tensor extract(torch::Tensor x, std::string extract_layer) override
     {
       (void)x;
@@ -24,6 +24,11 @@
 #include "torchdataset.h"
 #include "torchinputconns.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <thread>
+
 namespace dd
 {
   void TorchDataset::db_finalize()
@@ -136,8 +141,306 @@ namespace dd
         param = { cv::IMWRITE_PNG_COMPRESSION, 1 };
       }
     cv::imencode(ext, img, buffer, param);
-    for (uint8_t c : buffer)
-      dstream << c;
+    dstream.write(reinterpret_cast<const char *>(buffer.data()),
+                  buffer.size());
+  }
+
+  size_t
+  TorchDataset::db_list_fingerprint(const std::vector<std::string> &uris,
+                                    long seed)
+  {
+    size_t fingerprint = uris.size() ^ std::hash<long>()(seed);
+    for (const std::string &uri : uris)
+      fingerprint ^= std::hash<std::string>()(uri) + 0x9e3779b9
+                     + (fingerprint << 6) + (fingerprint >> 2);
+    return fingerprint;
+  }
+
+  void TorchDataset::write_to_db_parallel(
+      const std::vector<std::string> &uris,
+      const std::function<int(size_t, std::string &, std::string &)>
+          &serialize)
+  {
+    const size_t n = uris.size();
+    const std::string progress_fname = _dbFullName + ".progress";
+
+    // a build can only be resumed on the same list, in the same order
+    const size_t fingerprint = db_list_fingerprint(uris, _db_list_seed);
+
+    auto save_progress = [&](size_t consumed) {
+      std::ofstream progressf(progress_fname, std::ios::trunc);
+      progressf << fingerprint << " " << consumed << std::endl;
+    };
+
+    size_t start = 0;
+    if (_dbData == nullptr)
+      {
+        if (db_complete(_dbFullName))
+          {
+            _logger->warn("db {} already exists, not rebuilding it",
+                          _dbFullName);
+            return;
+          }
+        if (fileops::file_exists(progress_fname)
+            && fileops::file_exists(_dbFullName))
+          {
+            std::ifstream progressf(progress_fname);
+            size_t prev_fingerprint = 0;
+            size_t consumed = 0;
+            progressf >> prev_fingerprint >> consumed;
+            if (!db_resumable())
+              _logger->warn("db {} was interrupted on a data list shuffled "
+                            "without a seed, rebuilding it",
+                            _dbFullName);
+            else if (progressf && prev_fingerprint == fingerprint
+                     && consumed <= n)
+              start = consumed;
+            else
+              _logger->warn("db {} was interrupted on a different data "
+                            "list, rebuilding it",
+                            _dbFullName);
+            if (start == 0)
+              {
+                fileops::clear_directory(_dbFullName);
+                fileops::remove_dir(_dbFullName);
+              }
+          }
+        save_progress(start);
+
+        _dbData = std::shared_ptr<db::DB>(db::GetDB(_backend));
+        if (start > 0)
+          {
+            _dbData->Open(_dbFullName, db::WRITE);
+            _current_index = _dbData->Count() / 2;
+            _logger->info("resuming db {} at {}/{} elements", _dbFullName,
+                          start, n);
+          }
+        else
+          _dbData->Open(_dbFullName, db::NEW);
+        _txn = std::shared_ptr<db::Transaction>(_dbData->NewTransaction());
+      }
+
+    struct DbElt
+    {
+      int _res = -1;
+      std::string _data;
+      std::string _target;
+    };
+
+    const size_t nthreads
+        = _db_threads > 0
+              ? _db_threads
+              : std::max(1u, std::thread::hardware_concurrency());
+    const size_t capacity = 4 * nthreads; // bounds memory of pending elts
+    const size_t txn_bytes_max
+        = static_cast<size_t>(std::max(1, _db_transaction_mb)) << 20;
+
+    std::mutex mutex;
+    std::condition_variable cv_ready;
+    std::condition_variable cv_space;
+    std::map<size_t, DbElt> ready;
+    std::atomic<size_t> next_job(start);
+    size_t next_write = start;
+    bool abort = false;
+    std::exception_ptr eptr;
+
+    _logger->info("building db {} with {} decoding threads", _dbFullName,
+                  nthreads);
+
+    auto worker = [&]() {
+      while (true)
+        {
+          size_t i = next_job++;
+          if (i >= n)
+            return;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_space.wait(lock, [&]() {
+              return abort || i < next_write + capacity;
+            });
+            if (abort)
+              return;
+          }
+          DbElt elt;
+          try
+            {
+              elt._res = serialize(i, elt._data, elt._target);
+            }
+          catch (...)
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              if (!eptr)
+                eptr = std::current_exception();
+              abort = true;
+              cv_ready.notify_all();
+              cv_space.notify_all();
+              return;
+            }
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.emplace(i, std::move(elt));
+          }
+          cv_ready.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    auto join_workers = [&]() {
+      for (std::thread &w : workers)
+        if (w.joinable())
+          w.join();
+    };
+
+    size_t txn_bytes = 0;
+    try
+      {
+        for (size_t t = 0; t < nthreads; ++t)
+          workers.emplace_back(worker);
+
+        while (next_write < n)
+          {
+            DbElt elt;
+            {
+              std::unique_lock<std::mutex> lock(mutex);
+              cv_ready.wait(lock, [&]() {
+                return abort || ready.find(next_write) != ready.end();
+              });
+              if (abort)
+                break;
+              auto it = ready.find(next_write);
+              elt = std::move(it->second);
+              ready.erase(it);
+              ++next_write;
+            }
+            cv_space.notify_all();
+
+            if (elt._res == 0)
+              {
+                txn_bytes += elt._data.size() + elt._target.size();
+                _txn->Put(std::to_string(_current_index) + "_data",
+                          elt._data);
+                _txn->Put(std::to_string(_current_index) + "_target",
+                          elt._target);
+                ++_current_index;
+              }
+
+            if (txn_bytes >= txn_bytes_max)
+              {
+                _txn->Commit();
+                _txn.reset(_dbData->NewTransaction());
+                txn_bytes = 0;
+                save_progress(next_write);
+                _logger->info("Put {} images in db ({}/{} processed)",
+                              _current_index, next_write, n);
+              }
+          }
+      }
+    catch (...)
+      {
+        // workers must be joined before the exception leaves, joinable
+        // threads terminate the process when destroyed
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          abort = true;
+        }
+        cv_ready.notify_all();
+        cv_space.notify_all();
+        join_workers();
+        throw;
+      }
+
+    join_workers();
+    if (eptr)
+      std::rethrow_exception(eptr);
+
+    _txn->Commit();
+    _txn.reset(_dbData->NewTransaction());
+    _logger->info("Put {} images in db", _current_index);
+    remove(progress_fname.c_str());
+  }
+
+  template <typename T>
+  void TorchDataset::add_labeled_image_files_db(
+      const std::vector<std::pair<std::string, T>> &lfiles)
+  {
+    std::vector<std::string> uris;
+    uris.reserve(lfiles.size());
+    for (const auto &lfile : lfiles)
+      uris.push_back(lfile.first);
+
+    write_to_db_parallel(
+        uris, [&](size_t i, std::string &data, std::string &target) {
+          cv::Mat img;
+          int res = read_image_file(lfiles[i].first, img);
+          if (res != 0)
+            return res;
+          std::ostringstream dstream;
+          image_to_stringstream(img, dstream, true);
+          std::ostringstream tstream;
+          std::vector<at::Tensor> targett{ target_to_tensor(
+              lfiles[i].second) };
+          torch::save(targett, tstream);
+          data = dstream.str();
+          target = tstream.str();
+          return 0;
+        });
+  }
+
+  void TorchDataset::add_image_files_db(
+      const std::vector<std::pair<std::string, int>> &lfiles)
+  {
+    add_labeled_image_files_db(lfiles);
+  }
+
+  void TorchDataset::add_image_files_db(
+      const std::vector<std::pair<std::string, std::vector<double>>> &lfiles)
+  {
+    add_labeled_image_files_db(lfiles);
+  }
+
+  void TorchDataset::add_image_files_db(
+      const std::vector<std::pair<std::string, std::string>> &lfiles)
+  {
+    if (!_bbox && !_segmentation)
+      throw InputConnectorInternalException(
+          "file to file db building requires bbox or segmentation");
+
+    std::vector<std::string> uris;
+    uris.reserve(lfiles.size());
+    for (const auto &lfile : lfiles)
+      uris.push_back(lfile.first);
+
+    write_to_db_parallel(
+        uris, [&](size_t i, std::string &data, std::string &target) {
+          cv::Mat img;
+          std::ostringstream dstream;
+          std::ostringstream tstream;
+          if (_bbox)
+            {
+              std::vector<at::Tensor> targett;
+              int res = read_image_bbox_file(lfiles[i].first,
+                                             lfiles[i].second, img, targett);
+              if (res != 0)
+                return res;
+              image_to_stringstream(img, dstream, true);
+              torch::save(targett, tstream);
+            }
+          else
+            {
+              int res = read_image_file(lfiles[i].first, img);
+              if (res != 0)
+                return res;
+              cv::Mat img_tgt;
+              res = read_image_file(lfiles[i].second, img_tgt, true);
+              if (res != 0)
+                return res;
+              image_to_stringstream(img, dstream, false);
+              image_to_stringstream(img_tgt, tstream, true);
+            }
+          data = dstream.str();
+          target = tstream.str();
+          return 0;
+        });
   }
 
   void
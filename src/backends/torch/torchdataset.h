@@ -39,6 +39,8 @@
 #include <opencv2/opencv.hpp>
 #include <random>
 
+#define TORCH_DB_TRANSACTION_MB 64
+
 namespace dd
 {
 
@@ -65,6 +67,13 @@ namespace dd
     bool _db = false;     /**< is data in db ? */
     int32_t _batches_per_transaction
         = 10; /**< number of batches per db transaction */
+    int _db_threads
+        = 0; /**< number of decoding threads when building image db, 0 means
+                all cores */
+    int _db_transaction_mb
+        = TORCH_DB_TRANSACTION_MB; /**< size of parallel db transactions */
+    long _db_list_seed = 0; /**< seed of the shuffle of the list written to
+                               db, -1 if random */
     std::shared_ptr<db::Transaction> _txn;   /**< db transaction pointer */
     std::shared_ptr<spdlog::logger> _logger; /**< dd logger */
 
@@ -113,8 +122,10 @@ namespace dd
     TorchDataset(const TorchDataset &d)
         : _seed(d._seed), _rng(d._rng), _current_index(d._current_index),
           _backend(d._backend), _db(d._db),
-          _batches_per_transaction(d._batches_per_transaction), _txn(d._txn),
-          _logger(d._logger), _shuffle(d._shuffle), _dbData(d._dbData),
+          _batches_per_transaction(d._batches_per_transaction),
+          _db_threads(d._db_threads), _db_transaction_mb(d._db_transaction_mb),
+          _db_list_seed(d._db_list_seed), _txn(d._txn), _logger(d._logger),
+          _shuffle(d._shuffle), _dbData(d._dbData),
           _indices(d._indices), _lfiles(d._lfiles), _lfilesseg(d._lfilesseg),
           _lfilesbbox(d._lfilesbbox), _batches(d._batches),
           _dbFullName(d._dbFullName), _inputc(d._inputc),
@@ -241,11 +252,57 @@ namespace dd
       _batches_per_transaction = tsize;
     }
 
+    /**
+     * \brief setter for parallel db building parameters
+     * \param threads number of decoding threads, 0 for all cores
+     * \param transaction_mb size of db transactions in MB
+     */
+    void set_db_build_params(int threads, int transaction_mb)
+    {
+      _db_threads = threads;
+      _db_transaction_mb = transaction_mb;
+    }
+
+    /**
+     * \brief setter for the seed of the shuffle of the list written to db,
+     * -1 if it was shuffled at random, in which case an interrupted build
+     * can't be resumed
+     */
+    void set_db_list_seed(long seed)
+    {
+      _db_list_seed = seed;
+    }
+
+    /**
+     * \brief whether an interrupted build of the db can be resumed
+     */
+    bool db_resumable() const
+    {
+      return _db_list_seed >= 0;
+    }
+
+    /**
+     * \brief fingerprint of a list written to db, saved along the progress
+     * of a build to check that it is resumed on the same list
+     */
+    static size_t db_list_fingerprint(const std::vector<std::string> &uris,
+                                      long seed);
+
     /**
      * \brief commits final db transactions
      */
     void db_finalize();
 
+    /**
+     * \brief whether db exists and has been fully built, ie it is not the
+     * leftover of an interrupted parallel build
+     */
+    static bool db_complete(const std::string &dbfullname)
+    {
+      return fileops::file_exists(dbfullname)
+             && !fileops::file_exists(dbfullname + ".progress");
+    }
+
     /**
      * \brief setter for db metadata
      */
@@ -345,6 +402,27 @@ namespace dd
                             std::unordered_map<uint32_t, int> &alphabet,
                             int max_ocr_length);
 
+    /**
+     * \brief adds images with an int target to db, images are decoded in
+     * parallel and written in list order by a single writer
+     */
+    void
+    add_image_files_db(const std::vector<std::pair<std::string, int>> &lfiles);
+
+    /**
+     * \brief adds images with a set of regression targets to db, in parallel
+     */
+    void add_image_files_db(
+        const std::vector<std::pair<std::string, std::vector<double>>>
+            &lfiles);
+
+    /**
+     * \brief adds images with a bbox list file or a segmentation image as
+     * target to db, in parallel
+     */
+    void add_image_files_db(
+        const std::vector<std::pair<std::string, std::string>> &lfiles);
+
     /**
      * \brief turns an image into a torch::Tensor
      * \param bgr input image
@@ -371,6 +449,27 @@ namespace dd
     void write_tensors_to_db(const std::vector<at::Tensor> &data,
                              const std::vector<at::Tensor> &target);
 
+    /**
+     * \brief serializes elements with _db_threads threads and writes them
+     *        to db in order from the calling thread, through a bounded
+     *        queue. Progress is saved at every commit so that an interrupted
+     *        build can be resumed on the same list of uris.
+     * \param uris ordered list of element uris, used to fingerprint the build
+     * \param serialize fills data and target of element i, returns non-zero
+     *        if the element should be skipped
+     */
+    void write_to_db_parallel(
+        const std::vector<std::string> &uris,
+        const std::function<int(size_t, std::string &, std::string &)>
+            &serialize);
+
+    /**
+     * \brief adds images with an int or regression target to db, in parallel
+     */
+    template <typename T>
+    void add_labeled_image_files_db(
+        const std::vector<std::pair<std::string, T>> &lfiles);
+
     /**
      * \brief converts and image to a serialized string
      */
@@ -427,7 +526,8 @@ namespace dd
           _test(d._test), _db(d._db), _backend(d._backend),
           _dbPrefix(d._dbPrefix), _logger(d._logger),
           _batches_per_transaction(d._batches_per_transaction),
-          _datasets(d._datasets)
+          _db_threads(d._db_threads), _db_transaction_mb(d._db_transaction_mb),
+          _db_list_seed(d._db_list_seed), _datasets(d._datasets)
     {
     }
 
@@ -458,6 +558,35 @@ namespace dd
       _batches_per_transaction = tsize;
     }
 
+    /**
+     * \brief setter for parallel db building parameters
+     */
+    void set_db_build_params(int threads, int transaction_mb)
+    {
+      _db_threads = threads;
+      _db_transaction_mb = transaction_mb;
+      for (auto &d : _datasets)
+        d.set_db_build_params(threads, transaction_mb);
+    }
+
+    /**
+     * \brief setter for the seed of the shuffle of the lists written to db
+     */
+    void set_db_list_seed(long seed)
+    {
+      _db_list_seed = seed;
+      for (auto &d : _datasets)
+        d.set_db_list_seed(seed);
+    }
+
+    /**
+     * \brief whether interrupted builds of the dbs can be resumed
+     */
+    bool db_resumable() const
+    {
+      return _db_list_seed >= 0;
+    }
+
     /**
      * \brief sets image data augmenter across test datasets
      */
@@ -598,6 +727,8 @@ namespace dd
                                   _dbPrefix + "_" + std::to_string(id));
       _datasets[id].set_logger(_logger);
       _datasets[id].set_db_transaction_size(_batches_per_transaction);
+      _datasets[id].set_db_build_params(_db_threads, _db_transaction_mb);
+      _datasets[id].set_db_list_seed(_db_list_seed);
     }
 
   public:
@@ -618,6 +749,11 @@ namespace dd
     std::shared_ptr<spdlog::logger> _logger; /**< dd logger */
     int32_t _batches_per_transaction
         = 10; /**< number of batches per db transaction */
+    int _db_threads = 0; /**< number of decoding threads for db building */
+    int _db_transaction_mb
+        = TORCH_DB_TRANSACTION_MB; /**< size of parallel db transactions */
+    long _db_list_seed = 0; /**< seed of the shuffle of the lists written to
+                               db, -1 if random */
     std::vector<TorchDataset> _datasets;
   };
 }
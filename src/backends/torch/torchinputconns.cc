@@ -24,6 +24,7 @@
 
 #include "utils/utils.hpp"
 #include "utils/oatpp.hpp"
+#include <numeric>
 
 namespace dd
 {
@@ -101,12 +102,26 @@ namespace dd
             _test_datasets.add_tests_names(testnames);
           }
       }
-    if (fileops::file_exists(_dataset._dbFullName))
+    if (TorchDataset::db_complete(_dataset._dbFullName))
       {
         _tilogger->warn("db {} already exists, not rebuilding it",
                         _dataset._dbFullName);
-        if (!fileops::file_exists(_test_datasets.dbFullName(0)))
+        if (!TorchDataset::db_complete(_test_datasets.dbFullName(0)))
           {
+            if (fileops::file_exists(_test_datasets.dbFullName(0)))
+              {
+                // interrupted build, resume it, unless the test db was
+                // split from a list shuffled at random: the rebuilt one
+                // would overlap the train db
+                if (_test_datasets.db_resumable())
+                  return true;
+                _tilogger->warn("db {} was split from a data list shuffled "
+                                "without a seed, rebuilding it",
+                                _dataset._dbFullName);
+                fileops::clear_directory(_dataset._dbFullName);
+                fileops::remove_dir(_dataset._dbFullName);
+                return true;
+              }
             if (test_split != 0.0)
               {
                 build_test_datadb_from_full_datadb(test_split);
@@ -118,7 +133,7 @@ namespace dd
       return true;
     for (size_t i = 1; i < uris.size(); ++i)
       {
-        if (fileops::file_exists(_test_datasets.dbFullName(i - 1)))
+        if (TorchDataset::db_complete(_test_datasets.dbFullName(i - 1)))
           _tilogger->warn("test db {} already exists, not rebuilding it",
                           _test_datasets.dbFullName(i - 1));
         else
@@ -302,6 +317,11 @@ namespace dd
         // Read all parsed files and create tensor datasets
         auto data_vec = oatpp_utils::dtoVecToVec<oatpp::String, std::string>(
             predict_dto->data);
+        // interrupted db builds are resumed on the same shuffled lists only,
+        // test lists are shuffled when split from the train list
+        long list_seed = _dataset._shuffle ? _seed : 0;
+        _dataset.set_db_list_seed(list_seed);
+        _test_datasets.set_db_list_seed(data_vec.size() == 1 ? list_seed : 0);
         bool createDb
             = _db
               && TorchInputInterface::has_to_create_db(data_vec, _test_split);
@@ -363,10 +383,13 @@ namespace dd
                     split_dataset<int>(lfiles, tests_lfiles[0]);
                   }
 
-                  // Read data
+                // Read data
+                if (_db)
+                  _dataset.add_image_files_db(lfiles);
+                else
 #pragma omp parallel for ordered schedule(static, 1)
-                for (const std::pair<std::string, int> &lfile : lfiles)
-                  _dataset.add_image_file(lfile.first, lfile.second);
+                  for (const std::pair<std::string, int> &lfile : lfiles)
+                    _dataset.add_image_file(lfile.first, lfile.second);
 
                 if (!_db)
                   // in case of db, test sets are already allocated in
@@ -396,11 +419,16 @@ namespace dd
                   }
 
                 for (size_t i = 0; i < tests_lfiles.size(); ++i)
+                  {
+                    if (_db)
+                      _test_datasets[i].add_image_files_db(tests_lfiles[i]);
+                    else
 #pragma omp parallel for ordered schedule(static, 1)
-                  for (const std::pair<std::string, int> &lfile :
-                       tests_lfiles[i])
-                    _test_datasets[i].add_image_file(lfile.first,
-                                                     lfile.second);
+                      for (const std::pair<std::string, int> &lfile :
+                           tests_lfiles[i])
+                        _test_datasets[i].add_image_file(lfile.first,
+                                                         lfile.second);
+                  }
 
                 // Write corresp file
                 std::ofstream correspf(_model_repo + "/" + _correspname,
@@ -444,11 +472,15 @@ namespace dd
                     split_dataset<std::string>(lfiles, tests_lfiles[0]);
                   }
 
+                if (_db)
+                  _dataset.add_image_files_db(lfiles);
+                else
 #pragma omp parallel for ordered schedule(static, 1)
-                for (const std::pair<std::string, std::string> &lfile : lfiles)
-                  {
-                    _dataset.add_image_bbox_file(lfile.first, lfile.second);
-                  }
+                  for (const std::pair<std::string, std::string> &lfile :
+                       lfiles)
+                    {
+                      _dataset.add_image_bbox_file(lfile.first, lfile.second);
+                    }
 
                 // in case of db, alloc of test sets already done in
                 // has_to_create_db
@@ -458,11 +490,16 @@ namespace dd
                   }
 
                 for (size_t i = 0; i < tests_lfiles.size(); ++i)
+                  {
+                    if (_db)
+                      _test_datasets[i].add_image_files_db(tests_lfiles[i]);
+                    else
 #pragma omp parallel for ordered schedule(static, 1)
-                  for (const std::pair<std::string, std::string> &lfile :
-                       tests_lfiles[i])
-                    _test_datasets[i].add_image_bbox_file(lfile.first,
-                                                          lfile.second);
+                      for (const std::pair<std::string, std::string> &lfile :
+                           tests_lfiles[i])
+                        _test_datasets[i].add_image_bbox_file(lfile.first,
+                                                              lfile.second);
+                  }
               }
             else if (_segmentation) // expects a file list of image filepath
                                     // and target image filepath
@@ -495,11 +532,16 @@ namespace dd
                     split_dataset<std::string>(lfiles, tests_lfiles[0]);
                   }
 
+                if (_db)
+                  _dataset.add_image_files_db(lfiles);
+                else
 #pragma omp parallel for ordered schedule(static, 1)
-                for (const std::pair<std::string, std::string> &lfile : lfiles)
-                  {
-                    _dataset.add_image_image_file(lfile.first, lfile.second);
-                  }
+                  for (const std::pair<std::string, std::string> &lfile :
+                       lfiles)
+                    {
+                      _dataset.add_image_image_file(lfile.first,
+                                                    lfile.second);
+                    }
 
                 // in case of db, alloc of test sets already done in
                 // has_to_create_db
@@ -509,11 +551,16 @@ namespace dd
                   }
 
                 for (size_t i = 0; i < tests_lfiles.size(); ++i)
+                  {
+                    if (_db)
+                      _test_datasets[i].add_image_files_db(tests_lfiles[i]);
+                    else
 #pragma omp parallel for ordered schedule(static, 1)
-                  for (const std::pair<std::string, std::string> &lfile :
-                       tests_lfiles[i])
-                    _test_datasets[i].add_image_image_file(lfile.first,
-                                                           lfile.second);
+                      for (const std::pair<std::string, std::string> &lfile :
+                           tests_lfiles[i])
+                        _test_datasets[i].add_image_image_file(lfile.first,
+                                                               lfile.second);
+                  }
               }
             else if (_ctc)
               {
@@ -631,22 +678,13 @@ namespace dd
                 // Read data
                 if (_db)
                   {
-#pragma omp parallel for ordered schedule(static, 1)
-                    for (const std::pair<std::string, std::vector<double>>
-                             &lfile : lfiles)
-                      {
-                        _dataset.add_image_file(lfile.first, lfile.second);
-                      }
+                    _dataset.add_image_files_db(lfiles);
 
                     // in case of db, alloc of test sets already done in
                     // has_to_create_db
 
                     for (size_t i = 0; i < tests_lfiles.size(); ++i)
-#pragma omp parallel for ordered schedule(static, 1)
-                      for (const std::pair<std::string, std::vector<double>>
-                               &lfile : tests_lfiles[i])
-                        _test_datasets[i].add_image_file(lfile.first,
-                                                         lfile.second);
+                      _test_datasets[i].add_image_files_db(tests_lfiles[i]);
                   }
                 else
                   {
@@ -725,6 +763,8 @@ namespace dd
     TxtInputFileConn::fillup_parameters(ad_input);
     if (ad_input.has("db"))
       _db = ad_input.get("db").get<bool>();
+    if (ad_input.has("sequence_packing"))
+      _sequence_packing = ad_input.get("sequence_packing").get<bool>();
   }
 
   void TxtTorchInputFileConn::push_to_db(int test_id)
@@ -890,6 +930,11 @@ namespace dd
   void TxtTorchInputFileConn::fill_dataset(
       TorchDataset &dataset, const std::vector<TxtEntry<double> *> &entries)
   {
+    if (_sequence_packing)
+      {
+        fill_dataset_packed(dataset, entries);
+        return;
+      }
 
     _ndbed = 0;
     for (auto *te : entries)
@@ -986,6 +1031,74 @@ namespace dd
       }
   }
 
+  void TxtTorchInputFileConn::fill_dataset_packed(
+      TorchDataset &dataset, const std::vector<TxtEntry<double> *> &entries)
+  {
+    if (_input_format != "bert" || !_masked_lm)
+      throw InputConnectorBadParamException(
+          "sequence_packing is only supported for bert masked lm training");
+    if (_width < 3)
+      throw InputConnectorBadParamException(
+          "sequence_packing requires a sequence length of at least 3");
+
+    // sequences are [CLS] doc1 [SEP] doc2 [SEP] ... [PAD], documents longer
+    // than a sequence are truncated. Targets, if any, are not used by
+    // masked lm training.
+    _ndbed = 0;
+    std::vector<int64_t> ids{ _cls_pos };
+    std::vector<int64_t> doc_ids;
+
+    for (auto *te : entries)
+      {
+        TxtOrderedWordsEntry *tow = static_cast<TxtOrderedWordsEntry *>(te);
+        tow->reset();
+        std::string word;
+        double val;
+        doc_ids.clear();
+
+        while (tow->has_elt() && doc_ids.size() < _width - 2)
+          {
+            tow->get_next_elt(word, val);
+            auto it = _vocab.find(word);
+            doc_ids.push_back(it != _vocab.end() ? it->second._pos
+                                                 : _unk_pos);
+          }
+        if (doc_ids.empty())
+          continue;
+
+        if (ids.size() + doc_ids.size() + 1 > _width)
+          add_packed_sequence(dataset, ids);
+
+        ids.insert(ids.end(), doc_ids.begin(), doc_ids.end());
+        ids.push_back(_sep_pos);
+      }
+
+    if (ids.size() > 1)
+      add_packed_sequence(dataset, ids);
+  }
+
+  void TxtTorchInputFileConn::add_packed_sequence(TorchDataset &dataset,
+                                                  std::vector<int64_t> &ids)
+  {
+    int64_t seq_len = ids.size();
+    int64_t padding_size = _width - seq_len;
+    _lengths.push_back(seq_len);
+
+    at::Tensor ids_tensor = torch_utils::toLongTensor(ids);
+    at::Tensor mask_tensor = torch::ones_like(ids_tensor);
+    ids_tensor = torch::constant_pad_nd(ids_tensor,
+                                        at::IntList{ 0, padding_size }, 0);
+    mask_tensor = torch::constant_pad_nd(mask_tensor,
+                                         at::IntList{ 0, padding_size }, 0);
+    at::Tensor token_type_ids_tensor = torch::zeros_like(ids_tensor);
+
+    dataset.add_batch({ ids_tensor, token_type_ids_tensor, mask_tensor }, {});
+    _ndbed++;
+
+    ids.clear();
+    ids.push_back(_cls_pos);
+  }
+
   void CSVTSTorchInputFileConn::set_datadim(bool is_test_data)
   {
     if ((_forecast_timesteps < 0 || _backcast_timesteps < 0) && _timesteps < 0)
@@ -1193,46 +1306,46 @@ namespace dd
       }
   }
 
+  at::Tensor
+  CSVTSTorchInputFileConn::series_to_tensor(const std::vector<CSVline> &seq,
+                                            const std::vector<int> &cols)
+  {
+    at::Tensor series = torch::empty({ static_cast<long int>(seq.size()),
+                                       static_cast<long int>(cols.size()) },
+                                     torch::kFloat32);
+    auto acc = series.accessor<float, 2>();
+    for (size_t ti = 0; ti < seq.size(); ++ti)
+      for (size_t ci = 0; ci < cols.size(); ++ci)
+        acc[ti][ci] = static_cast<float>(seq[ti]._v[cols[ci]]);
+    return series;
+  }
+
+  at::Tensor CSVTSTorchInputFileConn::window(const at::Tensor &series,
+                                             const long int tstart,
+                                             const long int len)
+  {
+    at::Tensor w = series.narrow(0, tstart, len);
+    // serialized views would hold the whole series storage
+    if (_db)
+      return w.clone();
+    return w;
+  }
+
   void CSVTSTorchInputFileConn::add_data_instance_forecast(
       const unsigned long int tstart, const int vecindex,
-      TorchDataset &dataset, const std::vector<CSVline> &seq)
+      TorchDataset &dataset, const at::Tensor &series)
   {
-    std::vector<at::Tensor> data_sequence;
     if (_fnames.size() > static_cast<unsigned int>(vecindex))
       _ids.push_back(_fnames[vecindex] + " #" + std::to_string(tstart) + "_"
                      + std::to_string(tstart + _forecast_timesteps
                                       + _backcast_timesteps - 1));
-    for (size_t ti = tstart; ti < tstart + _backcast_timesteps; ++ti)
-      {
-        std::vector<double> datavec;
-        for (int di = 0; di < this->_datadim; ++di)
-          datavec.push_back(seq[ti]._v[di]);
-        at::Tensor data
-            = torch::from_blob(&datavec[0], at::IntList{ _datadim },
-                               torch::kFloat64)
-                  .clone()
-                  .to(torch::kFloat32);
-        data_sequence.push_back(data);
-      }
-    at::Tensor dst = torch::stack(data_sequence);
+    at::Tensor dst = window(series, tstart, _backcast_timesteps);
 
-    if (seq.size() >= _backcast_timesteps + _forecast_timesteps + tstart)
+    if (series.size(0) >= static_cast<long int>(
+            _backcast_timesteps + _forecast_timesteps + tstart))
       {
-        std::vector<at::Tensor> pred_sequence;
-        for (size_t ti = tstart + _backcast_timesteps;
-             ti < tstart + _backcast_timesteps + _forecast_timesteps; ++ti)
-          {
-            std::vector<double> predvec;
-            for (int di = 0; di < this->_datadim; ++di)
-              predvec.push_back(seq[ti]._v[di]);
-            at::Tensor pred
-                = torch::from_blob(&predvec[0], at::IntList{ _datadim },
-                                   torch::kFloat64)
-                      .clone()
-                      .to(torch::kFloat32);
-            pred_sequence.push_back(pred);
-          }
-        at::Tensor pst = torch::stack(pred_sequence);
+        at::Tensor pst = window(series, tstart + _backcast_timesteps,
+                                _forecast_timesteps);
         dataset.add_batch({ dst }, { pst });
       }
     else // we are in inference mode, not forecast available
@@ -1278,6 +1391,8 @@ namespace dd
       int test_id)
   {
     int vecindex = -1;
+    std::vector<int> cols(_datadim);
+    std::iota(cols.begin(), cols.end(), 0);
 
     for (const std::vector<CSVline> &seq : data)
       {
@@ -1294,78 +1409,30 @@ namespace dd
           {
             _tilogger->info("Add sequence of size {}", seq.size());
           }
+        // the series is stored once, windows are views over it
+        at::Tensor series = series_to_tensor(seq, cols);
         for (; tstart + timesteps < static_cast<long int>(seq.size());
              tstart += _offset)
           {
-            add_data_instance_forecast(tstart, vecindex, dataset, seq);
+            add_data_instance_forecast(tstart, vecindex, dataset, series);
           }
         if (tstart < static_cast<long int>(seq.size()) - 1)
           add_data_instance_forecast(seq.size() - timesteps, vecindex, dataset,
-                                     seq);
+                                     series);
       }
   }
 
-  void
-  CSVTSTorchInputFileConn::add_seq(const size_t ti,
-                                   const std::vector<CSVline> &seq,
-                                   std::vector<at::Tensor> &data_sequence,
-                                   std::vector<at::Tensor> &label_sequence)
-  {
-    std::vector<double> datavec;
-    std::vector<double> labelvec;
-    size_t label_size = _label_pos.size();
-    size_t data_size = _datadim - label_size;
-
-    for (size_t li = 0; li < label_size; ++li)
-      labelvec.push_back(seq[ti]._v[_label_pos[li]]);
-    for (int di = 0; di < this->_datadim; ++di)
-      if (std::find(_label_pos.begin(), _label_pos.end(), di)
-          == _label_pos.end())
-        datavec.push_back(seq[ti]._v[di]);
-
-    at::Tensor data
-        = torch::from_blob(&datavec[0],
-                           at::IntList{ static_cast<long int>(data_size) },
-                           torch::kFloat64)
-              .clone()
-              .to(torch::kFloat32);
-    at::Tensor label
-        = torch::from_blob(&labelvec[0],
-                           at::IntList{ static_cast<long int>(label_size) },
-                           torch::kFloat64)
-              .clone()
-              .to(torch::kFloat32);
-    data_sequence.push_back(data);
-    label_sequence.push_back(label);
-  }
-
   void CSVTSTorchInputFileConn::add_data_instance_labels(
       const unsigned long int tstart, const int vecindex,
-      TorchDataset &dataset, const std::vector<CSVline> &seq,
-      const size_t seq_len)
+      TorchDataset &dataset, const at::Tensor &data_series,
+      const at::Tensor &label_series, const size_t seq_len)
   {
-    unsigned int label_size = _label_pos.size();
-    if (static_cast<int>(label_size) >= _datadim)
-      {
-        std::string errmsg
-            = "label_size (output dim) " + std::to_string(label_size)
-              + " is larger than datadim " + std::to_string(_datadim)
-              + " leading to invalid input dim";
-        this->_logger->error(errmsg);
-        throw InputConnectorBadParamException(errmsg);
-      }
-    std::vector<at::Tensor> data_sequence;
-    std::vector<at::Tensor> label_sequence;
     if (_fnames.size() > static_cast<unsigned int>(vecindex))
       _ids.push_back(_fnames[vecindex] + " #" + std::to_string(tstart) + "_"
                      + std::to_string(tstart + seq_len - 1));
 
-    for (size_t ti = tstart;
-         ti < static_cast<unsigned long int>(tstart + seq_len); ++ti)
-      add_seq(ti, seq, data_sequence, label_sequence);
-
-    at::Tensor dst = torch::stack(data_sequence);
-    at::Tensor lst = torch::stack(label_sequence);
+    at::Tensor dst = window(data_series, tstart, seq_len);
+    at::Tensor lst = window(label_series, tstart, seq_len);
     dataset.add_batch({ dst }, { lst });
   }
 
@@ -1375,33 +1442,53 @@ namespace dd
   {
     int vecindex = -1;
 
-    if (_train)
+    unsigned int label_size = _label_pos.size();
+    if (static_cast<int>(label_size) >= _datadim)
       {
-        for (const std::vector<CSVline> &seq : data)
+        std::string errmsg
+            = "label_size (output dim) " + std::to_string(label_size)
+              + " is larger than datadim " + std::to_string(_datadim)
+              + " leading to invalid input dim";
+        this->_logger->error(errmsg);
+        throw InputConnectorBadParamException(errmsg);
+      }
+    std::vector<int> data_cols;
+    for (int di = 0; di < _datadim; ++di)
+      if (std::find(_label_pos.begin(), _label_pos.end(), di)
+          == _label_pos.end())
+        data_cols.push_back(di);
+
+    for (const std::vector<CSVline> &seq : data)
+      {
+        vecindex++;
+        if (_train && static_cast<long int>(seq.size()) < _timesteps)
           {
-            vecindex++;
-            long int tstart = 0;
-            if (static_cast<long int>(seq.size()) < _timesteps)
-              {
-                discard_warn(vecindex, seq.size(), test_id);
-                continue;
-              }
-            for (; tstart + _timesteps < static_cast<long int>(seq.size());
-                 tstart += _offset)
-              add_data_instance_labels(tstart, vecindex, dataset, seq,
-                                       static_cast<unsigned int>(_timesteps));
-            if (tstart < static_cast<long int>(seq.size()) - 1)
-              add_data_instance_labels(seq.size() - _timesteps, vecindex,
-                                       dataset, seq,
-                                       static_cast<unsigned int>(_timesteps));
+            discard_warn(vecindex, seq.size(), test_id);
+            continue;
           }
+
+        // input and label series are stored once, windows are views over
+        // them
+        at::Tensor data_series = series_to_tensor(seq, data_cols);
+        at::Tensor label_series = series_to_tensor(seq, _label_pos);
+        if (!_train) // do not split
+          {
+            add_data_instance_labels(0, vecindex, dataset, data_series,
+                                     label_series, seq.size());
+            continue;
+          }
+
+        long int tstart = 0;
+        for (; tstart + _timesteps < static_cast<long int>(seq.size());
+             tstart += _offset)
+          add_data_instance_labels(tstart, vecindex, dataset, data_series,
+                                   label_series,
+                                   static_cast<unsigned int>(_timesteps));
+        if (tstart < static_cast<long int>(seq.size()) - 1)
+          add_data_instance_labels(seq.size() - _timesteps, vecindex, dataset,
+                                   data_series, label_series,
+                                   static_cast<unsigned int>(_timesteps));
       }
-    else // do not split
-      for (const std::vector<CSVline> &seq : data)
-        {
-          vecindex++;
-          add_data_instance_labels(0, vecindex, dataset, seq, seq.size());
-        }
   }
 
   void CSVTSTorchInputFileConn::fill_dataset(
@@ -73,8 +73,9 @@ namespace dd
     TorchInputInterface(const TorchInputInterface &i)
         : _lm_params(i._lm_params), _dataset(i._dataset),
           _test_datasets(i._test_datasets), _input_format(i._input_format),
-          _ctc(i._ctc), _nclasses(i._nclasses), _ntargets(i._ntargets),
-          _alphabet_size(i._alphabet_size), _tilogger(i._tilogger), _db(i._db)
+          _masked_lm(i._masked_lm), _ctc(i._ctc), _nclasses(i._nclasses),
+          _ntargets(i._ntargets), _alphabet_size(i._alphabet_size),
+          _tilogger(i._tilogger), _db(i._db)
     {
     }
 
@@ -112,6 +113,18 @@ namespace dd
         _dataset.set_shuffle(ad_in.get("shuffle").get<bool>());
       if (ad_in.has("db"))
         _db = ad_in.get("db").get<bool>();
+      if (ad_in.has("db_threads") || ad_in.has("db_transaction_mb"))
+        {
+          int db_threads = ad_in.has("db_threads")
+                               ? ad_in.get("db_threads").get<int>()
+                               : 0;
+          int db_transaction_mb
+              = ad_in.has("db_transaction_mb")
+                    ? ad_in.get("db_transaction_mb").get<int>()
+                    : TORCH_DB_TRANSACTION_MB;
+          _dataset.set_db_build_params(db_threads, db_transaction_mb);
+          _test_datasets.set_db_build_params(db_threads, db_transaction_mb);
+        }
       _dataset.set_db_params(_db, _backend, model_repo + "/train");
       _dataset.set_logger(logger);
       _test_datasets.set_db_params(_db, _backend, model_repo + "/test");
@@ -186,10 +199,22 @@ namespace dd
      */
     std::vector<c10::IValue> get_input_example(torch::Device device);
 
+    /**
+     * \brief holder for a dummy input batch, for connectors that know their
+     * input dimensions before reading any data
+     */
+    std::vector<c10::IValue>
+    get_dummy_input_example(__attribute__((unused)) torch::Device device,
+                            __attribute__((unused)) int batch_size) const
+    {
+      return {};
+    }
+
     MaskedLMParams _lm_params;           /**< mlm data generation params */
     TorchDataset _dataset;               /**< train dataset */
     TorchMultipleDataset _test_datasets; /**< test datasets */
     std::string _input_format;           /**< for text, "bert" or nothing */
+    bool _masked_lm = false;             /**< whether masked lm training */
 
     bool _ctc = false;          /**< whether this is a CTC service */
     unsigned int _nclasses = 0; /**< number of classes for classification /
@@ -256,6 +281,17 @@ namespace dd
       return _height;
     }
 
+    /**
+     * \brief dummy batch of blank images, e.g. for predict calibration
+     */
+    std::vector<c10::IValue> get_dummy_input_example(torch::Device device,
+                                                     int batch_size) const
+    {
+      int channels = _bw && _supports_bw ? 1 : 3;
+      return { torch::zeros({ batch_size, channels, _height, _width },
+                            torch::TensorOptions(device)) };
+    }
+
     /**
      * \brief init the connector given APIdata
      */
@@ -406,7 +442,7 @@ namespace dd
      */
     TxtTorchInputFileConn(const TxtTorchInputFileConn &i)
         : TxtInputFileConn(i), TorchInputInterface(i), _width(i._width),
-          _height(i._height)
+          _height(i._height), _sequence_packing(i._sequence_packing)
     {
       _dataset._inputc = this;
       _test_datasets._inputc = this;
@@ -448,6 +484,25 @@ namespace dd
       return _height;
     }
 
+    /**
+     * \brief dummy batch of full length sequences, e.g. for predict
+     * calibration
+     */
+    std::vector<c10::IValue> get_dummy_input_example(torch::Device device,
+                                                     int batch_size) const
+    {
+      auto options = torch::TensorOptions(device).dtype(torch::kLong);
+      int64_t width = _width;
+      if (_input_format == "bert")
+        return { torch::zeros({ batch_size, width }, options),
+                 torch::zeros({ batch_size, width }, options),
+                 torch::ones({ batch_size, width }, options) };
+      else if (_input_format == "gpt2")
+        return { torch::zeros({ batch_size, width }, options),
+                 torch::arange(width, options).repeat({ batch_size, 1 }) };
+      return {};
+    }
+
     /**
      * \brief value of mask for MLM data generation
      */
@@ -498,6 +553,13 @@ namespace dd
     void fill_dataset(TorchDataset &dataset,
                       const std::vector<TxtEntry<double> *> &entries);
 
+    /**
+     * \brief put txt data into data set, packing several documents into
+     * each sequence of size _width (bert only, for self-supervised training)
+     */
+    void fill_dataset_packed(TorchDataset &dataset,
+                             const std::vector<TxtEntry<double> *> &entries);
+
     /**
      * \brief override txtinputconn parse content in order to put data in db on
      * the fly if needed
@@ -513,9 +575,17 @@ namespace dd
      */
     void push_to_db(int test);
 
+    /**
+     * \brief adds one packed sequence to the dataset, padded to _width
+     */
+    void add_packed_sequence(TorchDataset &dataset,
+                             std::vector<int64_t> &ids);
+
   public:
     unsigned int _width = 512; /**< width of the input tensor */
     unsigned int _height = 0;  /**< default height */
+    bool _sequence_packing
+        = false; /**< whether to pack several documents per sequence */
     std::mt19937 _rng;         /**< random number generator for MLM */
     std::map<int, std::string> _inv_vocab; /**< token id to vocabulary word */
 
@@ -734,18 +804,29 @@ namespace dd
                                int test_id);
     void add_data_instance_forecast(const unsigned long int tstart,
                                     const int vecindex, TorchDataset &dataset,
-                                    const std::vector<CSVline> &seq);
+                                    const at::Tensor &series);
     void fill_dataset_labels(TorchDataset &dataset,
                              const std::vector<std::vector<CSVline>> &data,
                              int test_id);
     void add_data_instance_labels(const unsigned long int tstart,
                                   const int vecindex, TorchDataset &dataset,
-                                  const std::vector<CSVline> &seq,
+                                  const at::Tensor &data_series,
+                                  const at::Tensor &label_series,
                                   size_t seq_len);
 
-    void add_seq(const size_t ti, const std::vector<CSVline> &seq,
-                 std::vector<at::Tensor> &data_sequence,
-                 std::vector<at::Tensor> &label_sequence);
+    /**
+     * \brief copies the given columns of a sequence into a contiguous
+     * [timesteps x columns] float tensor
+     */
+    at::Tensor series_to_tensor(const std::vector<CSVline> &seq,
+                                const std::vector<int> &cols);
+
+    /**
+     * \brief window of a series starting at tstart, a view sharing the
+     * series storage unless data is written to a db
+     */
+    at::Tensor window(const at::Tensor &series, const long int tstart,
+                      const long int len);
 
     void discard_warn(int vecindex, unsigned int seq_size, int test_id);
 
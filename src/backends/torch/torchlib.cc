@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <iomanip>
 
 #include "native/native.h"
 #include "torchsolver.h"
@@ -38,6 +39,8 @@
 
 #include "dto/mllib.hpp"
 #include "utils/bbox.hpp"
+#include "utils/cv_utils.hpp"
+#include "utils/threadpool.hpp"
 
 using namespace torch;
 
@@ -182,6 +185,244 @@ namespace dd
     this->_model_frozen_params = _module._frozen_params_count;
   }
 
+  template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
+            class TMLModel>
+  void TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy,
+                TMLModel>::build_feature_cache(TInputConnectorStrategy &inputc,
+                                               const APIData &ad_input,
+                                               TorchDataset &features,
+                                               int batch_size)
+  {
+    std::string cache_name
+        = this->_mlmodel._repo + "/" + TORCH_FEATURE_CACHE_NAME;
+    features.set_db_params(true, "lmdb", cache_name);
+    features.set_logger(this->_logger);
+    bool shuffle = inputc._dataset._shuffle;
+    features._shuffle = shuffle;
+
+    // features are computed once, on non augmented samples
+    TorchImgRandAugCV img_rand_aug_cv = inputc._dataset._img_rand_aug_cv;
+    inputc._dataset._img_rand_aug_cv = TorchImgRandAugCV();
+
+    // samples are keyed by their index in the training set, so the cache is
+    // only valid for the same samples, preprocessing and traced weights
+    std::string fingerprint = feature_cache_fingerprint(inputc, ad_input);
+    inputc._dataset.reset(false);
+    std::string fingerprint_file = features._dbFullName + ".fingerprint";
+    std::string cached_fingerprint;
+    if (fileops::file_exists(features._dbFullName))
+      {
+        std::ifstream fin(fingerprint_file);
+        std::getline(fin, cached_fingerprint);
+      }
+
+    if (cached_fingerprint == fingerprint)
+      {
+        this->_logger->info("Using cached features from {}",
+                            features._dbFullName);
+      }
+    else
+      {
+        if (fileops::file_exists(features._dbFullName))
+          {
+            this->_logger->info("Features cache {} is outdated, rebuilding",
+                                features._dbFullName);
+            fileops::clear_directory(features._dbFullName);
+            fileops::remove_dir(features._dbFullName);
+          }
+        this->_logger->info("Computing features of {} samples into {}",
+                            inputc._dataset._indices.size(),
+                            features._dbFullName);
+
+        _module.eval();
+        torch::NoGradGuard no_grad;
+
+        while (true)
+          {
+            auto batch = inputc._dataset.get_batch(
+                { static_cast<size_t>(batch_size) });
+            if (!batch)
+              break;
+
+            std::vector<c10::IValue> in_vals;
+            for (Tensor tensor : batch->data)
+              in_vals.push_back(tensor.to(_main_device));
+            Tensor feats = torch_utils::to_tensor_safe(
+                               _module.forward_backbone(in_vals))
+                               .to(torch::kCPU);
+
+            for (int64_t i = 0; i < feats.size(0); ++i)
+              {
+                std::vector<Tensor> targets;
+                for (Tensor target : batch->target)
+                  targets.push_back(target[i]);
+                features.add_batch({ feats[i] }, targets);
+              }
+          }
+        features.db_finalize();
+
+        std::ofstream fout(fingerprint_file);
+        fout << fingerprint << std::endl;
+      }
+    features.reset();
+    inputc._dataset._img_rand_aug_cv = img_rand_aug_cv;
+    inputc._dataset.set_shuffle(shuffle);
+  }
+
+  template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
+            class TMLModel>
+  std::string
+  TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy, TMLModel>::
+      feature_cache_fingerprint(TInputConnectorStrategy &inputc,
+                                const APIData &ad_input)
+  {
+    TorchDataset &dataset = inputc._dataset;
+    dataset.reset(false);
+    std::ostringstream fingerprint;
+    fingerprint << dataset._indices.size() << " " << this->_mlmodel._traced
+                << " " << fileops::file_last_modif(this->_mlmodel._traced);
+
+    // data source
+    if (dataset._db)
+      fingerprint << " " << dataset._dbFullName << " "
+                  << fileops::file_last_modif(dataset._dbFullName
+                                              + "/data.mdb");
+    else
+      {
+        size_t h = 0;
+        auto combine = [&h](const std::string &v) {
+          h ^= std::hash<std::string>()(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        };
+        for (auto &f : dataset._lfiles)
+          {
+            combine(f.first);
+            for (double l : f.second)
+              combine(std::to_string(l));
+          }
+        for (auto &f : dataset._lfilesseg)
+          combine(f.first + " " + f.second);
+        for (auto &f : dataset._lfilesbbox)
+          combine(f.first + " " + f.second);
+        // in memory samples have no name, their contents are hashed
+        for (const TorchBatch &b : dataset._batches)
+          for (const std::vector<Tensor> *tensors : { &b.data, &b.target })
+            for (Tensor t : *tensors)
+              {
+                t = t.to(torch::kCPU).contiguous();
+                combine(std::string(static_cast<const char *>(t.data_ptr()),
+                                    t.nbytes()));
+              }
+        fingerprint << " " << std::hex << h << std::dec;
+      }
+
+    // preprocessing, from the parameters and from the first sample
+    fingerprint << " " << ad_input.toJSONString();
+    auto batch = dataset.get_batch({ 1 });
+    if (batch)
+      for (Tensor tensor : batch->data)
+        {
+          Tensor t = tensor.to(torch::kCPU).to(torch::kDouble);
+          fingerprint << " " << t.sizes() << " " << std::setprecision(17)
+                      << t.sum().item<double>() << " "
+                      << (t * t).sum().item<double>();
+        }
+    return fingerprint.str();
+  }
+
+  template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
+            class TMLModel>
+  void TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy,
+                TMLModel>::calibrate_predict_batch_size(int memory_budget_mb,
+                                                        int max_batch_size)
+  {
+    using namespace std::chrono;
+
+    if (!_module.is_ready(_template))
+      {
+        this->_logger->warn("model is allocated at train or first predict, "
+                            "skipping predict batch size calibration");
+        return;
+      }
+    if (this->_inputc.get_dummy_input_example(_main_device, 1).empty())
+      {
+        this->_logger->warn("input connector does not know its input size "
+                            "before data, skipping predict batch size "
+                            "calibration");
+        return;
+      }
+
+    torch::NoGradGuard no_grad;
+    _module.to(_dtype);
+    _module.eval();
+
+    // memory is measured on top of what the loaded model already uses
+    const double mb = 1024.0 * 1024.0;
+    torch_utils::free_gpu_memory();
+    torch_utils::reset_peak_memory(_main_device);
+    int64_t base_memory = torch_utils::peak_memory(_main_device);
+
+    this->_batch_profile.clear();
+    double best_throughput = 0.0;
+    int best_batch_size = 1;
+    for (int batch_size = 1; batch_size <= max_batch_size; batch_size *= 2)
+      {
+        BatchProfilePoint point;
+        point._batch_size = batch_size;
+        torch_utils::reset_peak_memory(_main_device);
+        try
+          {
+            std::vector<c10::IValue> in_vals
+                = this->_inputc.get_dummy_input_example(_main_device,
+                                                        batch_size);
+            for (c10::IValue &in_val : in_vals)
+              if (in_val.toTensor().scalar_type() == torch::kFloat32)
+                in_val = in_val.toTensor().to(_dtype);
+
+            // warmup pass, then timed passes
+            _module.forward(in_vals);
+            torch_utils::synchronize(_main_device);
+            auto tstart = steady_clock::now();
+            for (int r = 0; r < TORCH_CALIBRATION_RUNS; ++r)
+              _module.forward(in_vals);
+            torch_utils::synchronize(_main_device);
+            point._latency_ms
+                = duration_cast<microseconds>(steady_clock::now() - tstart)
+                      .count()
+                  / (1000.0 * TORCH_CALIBRATION_RUNS);
+            point._peak_memory_mb
+                = std::max(int64_t(0),
+                           torch_utils::peak_memory(_main_device)
+                               - base_memory)
+                  / mb;
+          }
+        catch (std::exception &e)
+          {
+            // most likely out of memory
+            this->_logger->info("batch size {} failed: {}", batch_size,
+                                e.what());
+            break;
+          }
+
+        this->_batch_profile.push_back(point);
+        this->_logger->info("batch size {}: {} ms, {} MB", batch_size,
+                            point._latency_ms, point._peak_memory_mb);
+        if (point._peak_memory_mb > memory_budget_mb)
+          break;
+        double throughput = batch_size / point._latency_ms;
+        if (throughput > best_throughput)
+          {
+            best_throughput = throughput;
+            best_batch_size = batch_size;
+          }
+      }
+    torch_utils::free_gpu_memory();
+
+    this->_predict_batch_size = best_batch_size;
+    this->_logger->info("predict batch size calibrated to {} for a {} MB "
+                        "memory budget",
+                        best_batch_size, memory_budget_mb);
+  }
+
   /*- from mllib -*/
   template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
             class TMLModel>
@@ -328,6 +569,7 @@ namespace dd
               }
             this->_logger->info("Masked Language model");
             _masked_lm = true;
+            this->_inputc._masked_lm = true;
             _seq_training = true;
           }
         else if (!_classification)
@@ -510,6 +752,10 @@ namespace dd
         compute_and_print_model_info();
       }
 
+    if (mllib_dto->predict_memory_budget_mb > 0)
+      calibrate_predict_batch_size(mllib_dto->predict_memory_budget_mb,
+                                   mllib_dto->predict_max_batch_size);
+
     _best_metrics = { "map", "meaniou",  "mlacc", "delta_score_0.1", "bacc",
                       "f1",  "net_meas", "acc",   "L1_mean_error",   "eucll" };
     _best_metric_values.resize(1, std::numeric_limits<double>::infinity());
@@ -523,6 +769,16 @@ namespace dd
   {
     std::vector<std::string> extensions{ ".json", ".pt", ".ptw" };
     fileops::remove_directory_files(this->_mlmodel._repo, extensions);
+    std::string feature_cache
+        = this->_mlmodel._repo + "/" + TORCH_FEATURE_CACHE_NAME + ".lmdb";
+    if (fileops::file_exists(feature_cache))
+      {
+        fileops::clear_directory(feature_cache);
+        fileops::remove_dir(feature_cache);
+        fileops::remove_file(this->_mlmodel._repo,
+                             std::string(TORCH_FEATURE_CACHE_NAME)
+                                 + ".lmdb.fingerprint");
+      }
     this->_logger->info("Torchlib service cleared");
   }
 
@@ -930,6 +1186,18 @@ namespace dd
                 class_weights_i, _reg_weight, *r.module, this->_logger);
           }
       }
+    // train the head only, from cached features of the frozen traced net
+    bool feature_cache = ad_mllib.has("feature_cache")
+                         && ad_mllib.get("feature_cache").get<bool>();
+    TorchDataset feature_dataset;
+    if (feature_cache)
+      {
+        if (!_module.can_cache_features())
+          throw MLLibBadParamException(
+              "feature_cache requires a traced model with freeze_traced and "
+              "a linear or crnn head");
+        build_feature_cache(inputc, ad_input, feature_dataset, batch_size);
+      }
     _module.train();
 
     // create dataloader
@@ -938,9 +1206,10 @@ namespace dd
     this->_logger->info("Init dataloader with {} threads and {} prefetch size",
                         dataloader_threads, dataloader_max_jobs);
     auto dataloader = torch::data::make_data_loader(
-        inputc._dataset, data::DataLoaderOptions(batch_size)
-                             .workers(dataloader_threads)
-                             .max_jobs(dataloader_max_jobs));
+        feature_cache ? feature_dataset : inputc._dataset,
+        data::DataLoaderOptions(batch_size)
+            .workers(dataloader_threads)
+            .max_jobs(dataloader_max_jobs));
 
     int batch_id = 0;
     double last_it_time = 0;
@@ -1030,7 +1299,10 @@ namespace dd
                   targets.push_back(target.to(device));
 
                 // Prediction
-                out_val = rank_module.forward(in_vals);
+                if (feature_cache)
+                  out_val = rank_module.forward_head(in_vals.at(0));
+                else
+                  out_val = rank_module.forward(in_vals);
 
                 // Compute loss
                 Tensor loss = rank_tloss.loss(out_val, targets, in_vals);
@@ -1417,7 +1689,11 @@ namespace dd
     auto output_params = params->output;
     auto mllib_params = params->mllib;
 
-    int64_t predict_batch_size = mllib_params->net->test_batch_size;
+    int64_t predict_batch_size = 1;
+    if (mllib_params->net->test_batch_size != nullptr)
+      predict_batch_size = mllib_params->net->test_batch_size;
+    else if (this->_predict_batch_size > 0)
+      predict_batch_size = this->_predict_batch_size;
     std::string extract_layer = mllib_params->extract_layer;
 
     bool extract_last = false;
@@ -1425,6 +1701,11 @@ namespace dd
       extract_last = true;
     std::string forward_method = mllib_params->forward_method;
 
+    AdaptiveInferenceParams adaptive_params;
+    adaptive_params._exit_confidence = mllib_params->exit_confidence;
+    adaptive_params._exit_min_depth = mllib_params->exit_min_depth;
+    adaptive_params._token_keep_rate = mllib_params->token_keep_rate;
+
     std::string dt = mllib_params->datatype;
     if (dt == "fp32")
       _dtype = torch::kFloat32;
@@ -1459,6 +1740,14 @@ namespace dd
         for (oatpp::String conf : *output_params->confidences)
           confidences.push_back(conf);
       }
+    std::string mask_format;
+    if (output_params->mask_format != nullptr)
+      {
+        mask_format = output_params->mask_format;
+        if (mask_format != "png" && mask_format != "rle")
+          throw MLLibBadParamException("unknown mask_format " + mask_format
+                                       + ", expects png or rle");
+      }
 
     bool lstm_continuation = input_params->continuation;
     TInputConnectorStrategy inputc(this->_inputc);
@@ -1545,7 +1834,13 @@ namespace dd
         Tensor output;
         try
           {
-            if (extract_layer.empty() || extract_last)
+            if (adaptive_params.enabled() && extract_layer.empty())
+              {
+                AdaptiveInferenceStats adaptive_stats;
+                out_ivalue = _module.forward_adaptive(
+                    in_vals, adaptive_params, adaptive_stats);
+              }
+            else if (extract_layer.empty() || extract_last)
               out_ivalue = _module.forward(in_vals, forward_method);
             else
               out_ivalue = _module.extract(in_vals, extract_layer);
@@ -1573,12 +1868,14 @@ namespace dd
 
                 // XXX: why is (!_timeserie) needed here? Aren't _timeserie and
                 // _classification mutually exclusive?
+                // classification outputs stay on device until the best
+                // classes are selected
                 if (extract_layer.empty() && !_timeserie && _classification)
                   {
                     if (_multi_label)
-                      output = torch::sigmoid(output).to(cpu);
+                      output = torch::sigmoid(output);
                     else
-                      output = torch::softmax(output, 1).to(cpu);
+                      output = torch::softmax(output, 1);
                   }
                 else if (extract_layer.empty() && !_timeserie && ctc)
                   output = torch::softmax(output, 2).to(cpu);
@@ -1596,7 +1893,17 @@ namespace dd
 
         if (!extract_layer.empty())
           {
-            for (int j = 0; j < batch_size; j++)
+            // one row of features per sample, as a whole on the cpu
+            Tensor features = output.to(torch::Device("cpu"))
+                                  .to(torch::kFloat64)
+                                  .contiguous();
+            int nsamples = features.dim() > 0 ? features.size(0) : 1;
+            std::vector<int> shape;
+            for (int d = 1; d < features.dim(); ++d)
+              shape.push_back(features.size(d));
+            int64_t row_size = nsamples > 0 ? features.numel() / nsamples : 0;
+            double *startout = features.data_ptr<double>();
+            for (int j = 0; j < nsamples; j++)
               {
                 APIData rad;
                 if (!inputc._ids.empty())
@@ -1610,17 +1917,11 @@ namespace dd
                   rad.add("index_uri",
                           inputc._index_uris.at(results_ads.size()));
                 rad.add("loss", static_cast<double>(0.0));
-                torch::Tensor fo = torch::flatten(output)
-                                       .contiguous()
-                                       .to(torch::kFloat64)
-                                       .to(torch::Device("cpu"));
-
-                double *startout = fo.data_ptr<double>();
-                std::vector<double> vals(startout,
-                                         startout + torch::numel(fo));
-
-                rad.add("vals", vals);
-                results_ads.push_back(rad);
+                std::vector<double> vals(startout + j * row_size,
+                                         startout + (j + 1) * row_size);
+                rad.add("vals", std::move(vals));
+                rad.add("vals_shape", shape);
+                results_ads.push_back(std::move(rad));
               }
           }
         else
@@ -1771,47 +2072,33 @@ namespace dd
               }
             else if (_classification)
               {
-                std::tuple<Tensor, Tensor> sorted_output
-                    = output.sort(1, true);
-                Tensor probsf = std::get<0>(sorted_output).to(torch::kFloat);
-                auto probs_acc = probsf.accessor<float, 2>();
-                auto indices_acc
-                    = std::get<1>(sorted_output).accessor<int64_t, 2>();
-
-                for (int i = 0; i < output.size(0); ++i)
-                  {
-                    APIData results_ad;
-                    std::vector<double> probs;
-                    std::vector<std::string> cats;
-
-                    for (int j = 0; j < best_count; ++j)
-                      {
-                        if (probs_acc[i][j] < confidence_threshold)
-                          {
-                            // break because probs are sorted
-                            break;
-                          }
-
-                        probs.push_back(probs_acc[i][j]);
-                        int index = indices_acc[i][j];
-                        if (_seq_training)
-                          {
-                            cats.push_back(inputc.get_word(index));
-                          }
-                        else
-                          {
-                            cats.push_back(this->_mlmodel.get_hcorresp(index));
-                          }
-                      }
-
-                    results_ad.add("uri", inputc._uris.at(results_ads.size()));
-                    results_ad.add("loss", 0.0);
-                    results_ad.add("cats", cats);
-                    results_ad.add("probs", probs);
-                    results_ad.add("nclasses", (int)_nclasses);
-
-                    results_ads.push_back(results_ad);
-                  }
+                // best classes are selected on device, so that only they
+                // are copied back
+                int64_t k = std::min(static_cast<int64_t>(best_count),
+                                     output.size(1));
+                if (confidence_threshold > 0.0 && k > 0)
+                  k = std::min(k, (output >= confidence_threshold)
+                                      .sum(1)
+                                      .max()
+                                      .item<int64_t>());
+                auto topk = torch::topk(output, k, 1);
+                Tensor probsf = std::get<0>(topk)
+                                    .to(torch::kFloat)
+                                    .to(cpu)
+                                    .contiguous();
+                Tensor indices = std::get<1>(topk).to(cpu).contiguous();
+                std::vector<std::string> uris(
+                    inputc._uris.begin() + nsample,
+                    inputc._uris.begin() + nsample + output.size(0));
+                nsample += output.size(0);
+                outputc.add_topk_results(
+                    uris, probsf.data_ptr<float>(),
+                    indices.data_ptr<int64_t>(), k, confidence_threshold,
+                    [&](int index) {
+                      return _seq_training
+                                 ? inputc.get_word(index)
+                                 : this->_mlmodel.get_hcorresp(index);
+                    });
               }
             else if (_segmentation)
               {
@@ -1825,26 +2112,20 @@ namespace dd
                 output = torch::softmax(output, 1);
 
                 int imgsize = inputc.width() * inputc.height();
-                torch::Tensor segmap;
+                torch::Tensor labels;
                 torch::Tensor confmap;
-                std::tuple<torch::Tensor, torch::Tensor> maxmap;
                 if (!confidences.empty()) // applies "best" confidence lookup
                   {
-                    maxmap = torch::max(output.clone().squeeze(), 0, false);
+                    auto maxmap
+                        = torch::max(output.clone().squeeze(), 0, false);
                     confmap = torch::flatten(std::get<0>(maxmap))
                                   .contiguous()
                                   .to(torch::kFloat64)
                                   .to(cpu);
-                    segmap = torch::flatten(std::get<1>(maxmap))
-                                 .contiguous()
-                                 .to(torch::kFloat64)
-                                 .to(cpu);
+                    labels = std::get<1>(maxmap);
                   }
-                else
-                  segmap = torch::flatten(torch::argmax(output.squeeze(), 0))
-                               .contiguous()
-                               .to(torch::kFloat64)
-                               .to(cpu); // squeeze removes the batch size
+                else // squeeze removes the batch size
+                  labels = torch::argmax(output.squeeze(), 0);
 
                 APIData rad;
                 std::string uri;
@@ -1854,13 +2135,10 @@ namespace dd
                   uri = std::to_string(results_ads.size());
                 rad.add("uri", uri);
                 rad.add("loss", static_cast<double>(0.0));
-                double *startout = segmap.data_ptr<double>();
-                std::vector<double> vals(startout,
-                                         startout + torch::numel(segmap));
                 std::vector<double> confs;
                 if (!confidences.empty())
                   {
-                    startout = confmap.data_ptr<double>();
+                    double *startout = confmap.data_ptr<double>();
                     confs = std::vector<double>(
                         startout, startout + torch::numel(confmap));
                   }
@@ -1870,22 +2148,62 @@ namespace dd
                 ad_imgsize.add("height", (*bit).second.first);
                 ad_imgsize.add("width", (*bit).second.second);
                 rad.add("imgsize", ad_imgsize);
+                bool resize = imgsize
+                              != (*bit).second.first * (*bit).second.second;
 
-                if (imgsize
-                    != (*bit).second.first
-                           * (*bit).second.second) // resizing output
-                  // segmentation array
+                if (!mask_format.empty())
                   {
-                    vals = ImgInputFileConn::img_resize_vector(
-                        vals, inputc.height(), inputc.width(),
-                        (*bit).second.first, (*bit).second.second, true);
-                    if (!confidences.empty())
-                      confs = ImgInputFileConn::img_resize_vector(
-                          confs, inputc.height(), inputc.width(),
-                          (*bit).second.first, (*bit).second.second, false);
+                    // label map encoded from integer labels, at the original
+                    // image size
+                    labels = labels.to(torch::kInt32).to(cpu).contiguous();
+                    cv::Mat segimg(inputc.height(), inputc.width(), CV_32SC1,
+                                   labels.data_ptr<int>());
+                    if (resize)
+                      cv::resize(segimg, segimg,
+                                 cv::Size((*bit).second.second,
+                                          (*bit).second.first),
+                                 0, 0, cv::INTER_NEAREST);
+                    if (mask_format == "png")
+                      {
+                        segimg.convertTo(segimg,
+                                         _nclasses <= 256 ? CV_8U : CV_16U);
+                        rad.add("vals", std::vector<cv::Mat>{ segimg });
+                      }
+                    else
+                      {
+                        APIData rle;
+                        for (auto &r : cv_utils::labels_to_rle(segimg))
+                          {
+                            APIData mask;
+                            mask.add("height", segimg.rows);
+                            mask.add("width", segimg.cols);
+                            mask.add("counts",
+                                     cv_utils::rle_to_string(r.second));
+                            rle.add(std::to_string(r.first), std::move(mask));
+                          }
+                        rad.add("rle", std::move(rle));
+                        rad.add("vals", std::vector<double>());
+                      }
                   }
-
-                rad.add("vals", vals);
+                else
+                  {
+                    torch::Tensor segmap = torch::flatten(labels)
+                                               .contiguous()
+                                               .to(torch::kFloat64)
+                                               .to(cpu);
+                    double *startout = segmap.data_ptr<double>();
+                    std::vector<double> vals(startout,
+                                             startout + torch::numel(segmap));
+                    if (resize)
+                      vals = ImgInputFileConn::img_resize_vector(
+                          vals, inputc.height(), inputc.width(),
+                          (*bit).second.first, (*bit).second.second, true);
+                    rad.add("vals", vals);
+                  }
+                if (resize && !confidences.empty())
+                  confs = ImgInputFileConn::img_resize_vector(
+                      confs, inputc.height(), inputc.width(),
+                      (*bit).second.first, (*bit).second.second, false);
                 if (!confidences.empty())
                   {
                     APIData vconfs;
@@ -2004,9 +2322,47 @@ namespace dd
                                TorchMultipleDataset &testsets, int batch_size,
                                APIData &out)
   {
+    // inference runs test set after test set on the model, while measures
+    // are computed in parallel, each test set into its own output
+    std::vector<TorchTestResults> results(testsets.size());
+    std::vector<APIData> test_outs(testsets.size());
+    std::vector<double> measure_times(testsets.size(), 0.0);
+    auto measure_testset = [&](size_t i) {
+      auto tstart = std::chrono::steady_clock::now();
+      measure_test_results(results[i], test_outs[i], i, testsets.name(i));
+      measure_times[i] = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - tstart)
+                             .count();
+      results[i] = TorchTestResults();
+    };
+
+    std::vector<size_t> accumulated;
     for (size_t i = 0; i < testsets.size(); ++i)
-      test(ad, inputc, testsets[i], batch_size, out, i, testsets.name(i));
+      {
+        test_results(ad, inputc, testsets[i], batch_size, results[i]);
+        // per sample results are turned into measures right away, so that
+        // a single test set is held in memory
+        if (results[i]._accumulate)
+          accumulated.push_back(i);
+        else
+          measure_testset(i);
+      }
+    ThreadPool::instance().parallel_for(accumulated.size(), [&](size_t a) {
+      measure_testset(accumulated[a]);
+    });
 
+    // merged in test set order, so that the output does not depend on
+    // threads scheduling
+    std::vector<APIData> measures = out.has("measures")
+                                        ? out.getv("measures")
+                                        : std::vector<APIData>();
+    for (size_t i = 0; i < testsets.size(); ++i)
+      {
+        APIData meas = test_outs[i].getv("measures").at(0);
+        meas.add("measure_time_ms", measure_times[i]);
+        measures.push_back(meas);
+      }
+    out.add("measures", measures);
     SupervisedOutput::aggregate_multiple_testsets(out);
     return 0;
   }
@@ -2020,9 +2376,39 @@ namespace dd
                                APIData &out, size_t test_id,
                                const std::string &test_name)
   {
-    APIData ad_res;
+    TorchTestResults res;
+    test_results(ad, inputc, dataset, batch_size, res);
+    measure_test_results(res, out, test_id, test_name);
+    return 0;
+  }
+
+  template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
+            class TMLModel>
+  void TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy,
+                TMLModel>::measure_test_results(const TorchTestResults &res,
+                                                APIData &out, size_t test_id,
+                                                const std::string &test_name)
+  {
+    if (res._accumulate)
+      SupervisedOutput::measure(res._macc, res._ad_res, out, test_id,
+                                test_name);
+    else
+      SupervisedOutput::measure(res._ad_res, res._ad_out, out, test_id,
+                                test_name);
+  }
+
+  template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
+            class TMLModel>
+  void TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy,
+                TMLModel>::test_results(const APIData &ad,
+                                        TInputConnectorStrategy &inputc,
+                                        TorchDataset &dataset, int batch_size,
+                                        TorchTestResults &res)
+  {
+    APIData &ad_res = res._ad_res;
     APIData ad_bbox;
-    APIData ad_out = ad.getobj("parameters").getobj("output");
+    APIData &ad_out = res._ad_out;
+    ad_out = ad.getobj("parameters").getobj("output");
     int nclasses = _masked_lm ? inputc.vocab_size() : _nclasses;
 
     // reset data aug test random generator
@@ -2051,6 +2437,39 @@ namespace dd
           ad_bbox_per_iou[i] = APIData();
       }
 
+    // results are accumulated batch after batch, unless some requested
+    // measures require per sample results
+    std::vector<std::string> measures;
+    if (ad_out.has("measure"))
+      measures = ad_out.get("measure").get<std::vector<std::string>>();
+    MeasureAccumulator::Task task = MeasureAccumulator::CLASSIFICATION;
+    if (_bbox)
+      task = MeasureAccumulator::DETECTION;
+    else if (_segmentation)
+      task = MeasureAccumulator::SEGMENTATION;
+    else if (_regression)
+      task = MeasureAccumulator::REGRESSION;
+    MeasureAccumulator &macc = res._macc;
+    macc = MeasureAccumulator(measures, nclasses, task);
+    bool &accumulate = res._accumulate;
+    accumulate = !_timeserie && !_ctc && macc.supported();
+
+    // adaptive inference, measured along with accuracy
+    AdaptiveInferenceParams adaptive_params;
+    APIData ad_mllib = ad.getobj("parameters").getobj("mllib");
+    if (ad_mllib.has("exit_confidence"))
+      adaptive_params._exit_confidence
+          = ad_mllib.get("exit_confidence").get<double>();
+    if (ad_mllib.has("exit_min_depth"))
+      adaptive_params._exit_min_depth
+          = ad_mllib.get("exit_min_depth").get<int>();
+    if (ad_mllib.has("token_keep_rate"))
+      adaptive_params._token_keep_rate
+          = ad_mllib.get("token_keep_rate").get<double>();
+    double adaptive_depth_sum = 0.0;
+    double adaptive_token_sum = 0.0;
+    double forward_time_ms = 0.0;
+
     auto dataloader = torch::data::make_data_loader(
         dataset, data::DataLoaderOptions(batch_size));
     torch::Device cpu("cpu");
@@ -2071,7 +2490,26 @@ namespace dd
         c10::IValue out_ivalue;
         try
           {
-            out_ivalue = _module.forward(in_vals);
+            if (adaptive_params.enabled())
+              {
+                auto tstart = std::chrono::steady_clock::now();
+                AdaptiveInferenceStats adaptive_stats;
+                out_ivalue = _module.forward_adaptive(
+                    in_vals, adaptive_params, adaptive_stats);
+                torch_utils::synchronize(_main_device);
+                forward_time_ms
+                    += std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - tstart)
+                           .count();
+                for (size_t j = 0; j < adaptive_stats._exit_depths.size();
+                     ++j)
+                  {
+                    adaptive_depth_sum += adaptive_stats._exit_depths[j];
+                    adaptive_token_sum += adaptive_stats._token_ratios[j];
+                  }
+              }
+            else
+              out_ivalue = _module.forward(in_vals);
             if (!_bbox && !_segmentation)
               {
                 output = torch_utils::to_tensor_safe(out_ivalue);
@@ -2132,18 +2570,22 @@ namespace dd
             Tensor targ_bboxes = batch.target.at(1);
             Tensor targ_labels = batch.target.at(2);
 
+            // per image outputs and targets
+            size_t nimgs = out_dicts.size();
+            std::vector<Tensor> img_bboxes(nimgs), img_labels(nimgs),
+                bboxes_tensors(nimgs), labels_tensors(nimgs),
+                score_tensors(nimgs);
             int stop = 0;
-
-            for (size_t i = 0; i < out_dicts.size(); ++i)
+            for (size_t i = 0; i < nimgs; ++i)
               {
                 auto out_dict = out_dicts.get(i).toGenericDict();
-                Tensor bboxes_tensor
+                bboxes_tensors[i]
                     = torch_utils::to_tensor_safe(out_dict.at("boxes"))
                           .to(cpu);
-                Tensor labels_tensor
+                labels_tensors[i]
                     = torch_utils::to_tensor_safe(out_dict.at("labels"))
                           .to(cpu);
-                Tensor score_tensor
+                score_tensors[i]
                     = torch_utils::to_tensor_safe(out_dict.at("scores"))
                           .to(cpu);
 
@@ -2153,17 +2595,44 @@ namespace dd
                   {
                     ++stop;
                   }
+                img_bboxes[i] = targ_bboxes.index(
+                    { torch::indexing::Slice(start, stop) });
+                img_labels[i] = targ_labels.index(
+                    { torch::indexing::Slice(start, stop) });
+              }
+
+            // images of the batch are matched in parallel, at every iou
+            // threshold, results are then added in image and threshold
+            // order
+            std::vector<std::vector<std::vector<DetectionStats>>> img_stats(
+                nimgs);
+            ThreadPool::instance().parallel_for(nimgs, [&](size_t i) {
+              img_stats[i].resize(iou_thresholds.size());
+              for (size_t t = 0; t < iou_thresholds.size(); ++t)
+                {
+                  double iou_thres_d
+                      = static_cast<double>(iou_thresholds[t]) / 100;
+                  img_stats[i][t] = get_bbox_stats(
+                      img_bboxes[i], img_labels[i], bboxes_tensors[i],
+                      labels_tensors[i], score_tensors[i], iou_thres_d);
+                }
+            });
 
-                for (int iou_thres : iou_thresholds)
+            for (size_t i = 0; i < nimgs; ++i)
+              {
+                for (size_t t = 0; t < iou_thresholds.size(); ++t)
                   {
-                    double iou_thres_d = static_cast<double>(iou_thres) / 100;
-                    std::vector<APIData> vbad = get_bbox_stats(
-                        targ_bboxes.index(
-                            { torch::indexing::Slice(start, stop) }),
-                        targ_labels.index(
-                            { torch::indexing::Slice(start, stop) }),
-                        bboxes_tensor, labels_tensor, score_tensor,
-                        iou_thres_d);
+                    int iou_thres = iou_thresholds[t];
+                    const std::vector<DetectionStats> &stats
+                        = img_stats[i][t];
+                    if (accumulate)
+                      {
+                        macc.add_detection(iou_thres, stats);
+                        continue;
+                      }
+                    std::vector<APIData> vbad;
+                    for (const DetectionStats &s : stats)
+                      vbad.push_back(s.to_apidata());
                     ad_bbox_per_iou[iou_thres].add(std::to_string(entry_id),
                                                    vbad);
                   }
@@ -2238,6 +2707,15 @@ namespace dd
 
             for (int j = 0; j < output.size(0); ++j)
               {
+                if (accumulate)
+                  {
+                    macc.add_segmentation(startout, target_arr,
+                                          tensormap_size);
+                    startout += tensormap_size;
+                    target_arr += tensormap_size;
+                    ++entry_id;
+                    continue;
+                  }
                 APIData bad;
                 std::vector<double> vals(
                     startout,
@@ -2263,7 +2741,7 @@ namespace dd
             if (_classification || _seq_training)
               {
                 labels = batch.target[0].view(IntList{ -1 });
-                output = torch::softmax(output, 1).to(cpu);
+                output = torch::softmax(output, 1).to(cpu).contiguous();
                 auto output_acc = output.accessor<float, 2>();
                 auto labels_acc = labels.accessor<int64_t, 1>();
 
@@ -2272,6 +2750,14 @@ namespace dd
                     if (_masked_lm && labels_acc[j] == -1)
                       continue;
 
+                    if (accumulate)
+                      {
+                        macc.add_classification(
+                            output.data_ptr<float>() + j * output.size(1),
+                            static_cast<double>(labels_acc[j]));
+                        ++entry_id;
+                        continue;
+                      }
                     APIData bad;
                     std::vector<double> predictions;
                     for (int c = 0; c < nclasses; ++c)
@@ -2286,13 +2772,22 @@ namespace dd
               }
             else if (_regression)
               {
-                output = output.to(cpu);
-                labels = batch.target[0];
+                output = output.to(cpu).contiguous();
+                labels = batch.target[0].to(cpu).contiguous();
                 unsigned int ntargets = nclasses;
                 auto output_acc = output.accessor<float, 2>();
                 auto labels_acc = labels.accessor<float, 2>();
                 for (int j = 0; j < labels.size(0); ++j)
                   {
+                    if (accumulate)
+                      {
+                        macc.add_regression(
+                            output.data_ptr<float>() + j * output.size(1),
+                            labels.data_ptr<float>() + j * labels.size(1),
+                            ntargets);
+                        ++entry_id;
+                        continue;
+                      }
                     APIData bad;
                     std::vector<double> predictions;
                     if (ntargets == 1)
@@ -2337,7 +2832,7 @@ namespace dd
         ad_res.add("clnames", clnames);
         ad_res.add("nclasses", nclasses);
       }
-    if (_bbox)
+    if (_bbox && !accumulate)
       {
         ad_res.add("bbox", true);
         ad_res.add("pos_count", entry_id);
@@ -2351,16 +2846,20 @@ namespace dd
       }
     else if (_segmentation)
       ad_res.add("segmentation", true);
+    if (adaptive_params.enabled() && entry_id > 0)
+      {
+        ad_res.add("exit_depth", adaptive_depth_sum / entry_id);
+        ad_res.add("token_ratio", adaptive_token_sum / entry_id);
+        ad_res.add("forward_time_ms_per_sample", forward_time_ms / entry_id);
+      }
     ad_res.add("batch_size",
                entry_id); // here batch_size = tested entries count
-    SupervisedOutput::measure(ad_res, ad_out, out, test_id, test_name);
     _module.train();
-    return 0;
   }
 
   template <class TInputConnectorStrategy, class TOutputConnectorStrategy,
             class TMLModel>
-  std::vector<APIData>
+  std::vector<DetectionStats>
   TorchLib<TInputConnectorStrategy, TOutputConnectorStrategy,
            TMLModel>::get_bbox_stats(const at::Tensor &targ_bboxes,
                                      const at::Tensor &targ_labels,
@@ -2375,28 +2874,18 @@ namespace dd
     auto labels_acc = labels_tensor.accessor<int64_t, 1>();
     auto score_acc = score_tensor.accessor<float, 1>();
 
-    APIData bad; // see caffe
     const int targ_bbox_count = targ_labels.size(0);
     const int pred_bbox_count = labels_tensor.size(0);
     std::vector<bool> match_used(targ_bbox_count, false);
 
-    struct eval_info
-    {
-      // every positive score
-      std::vector<double> tp_d;
-      // 1 if true pos, 0 otherwise
-      std::vector<int> tp_i;
-      // every positive score
-      std::vector<double> fp_d;
-      // 1 if false pos, 0 otherwise
-      std::vector<int> fp_i;
-      int num_pos;
-      // XXX: fp variables are useless since tp_d == fp_d & tp_i == !fp_i
-      // This could be refactored along with supervised output
-      // connector
-    };
+    std::vector<DetectionStats> eval_infos(_nclasses);
 
-    std::vector<eval_info> eval_infos(_nclasses);
+    bbox_utils::Boxes<double> targ_boxes;
+    targ_boxes.reserve(targ_bbox_count);
+    for (int k = 0; k < targ_bbox_count; ++k)
+      targ_boxes.add(targ_bboxes_acc[k][0], targ_bboxes_acc[k][1],
+                     targ_bboxes_acc[k][2], targ_bboxes_acc[k][3]);
+    std::vector<double> overlaps(targ_bbox_count);
 
     for (int j = 0; j < pred_bbox_count; ++j)
       {
@@ -2410,12 +2899,14 @@ namespace dd
                 + " is invalid for nclasses = " + std::to_string(_nclasses));
           }
 
-        std::vector<double> bbox{
+        const double bbox[] = {
           bboxes_acc[j][0],
           bboxes_acc[j][1],
           bboxes_acc[j][2],
           bboxes_acc[j][3],
         };
+        bbox_utils::iou_row(bbox, targ_boxes, 0, targ_bbox_count,
+                            overlaps.data());
 
         bool has_cls = false;
         float overlap_max = -1.0;
@@ -2430,14 +2921,7 @@ namespace dd
 
             if (!match_used[k])
               {
-                std::vector<double> targ_bbox{
-                  targ_bboxes_acc[k][0],
-                  targ_bboxes_acc[k][1],
-                  targ_bboxes_acc[k][2],
-                  targ_bboxes_acc[k][3],
-                };
-
-                float overlap = bbox_utils::iou(bbox, targ_bbox);
+                float overlap = overlaps[k];
                 if (overlap > overlap_max)
                   {
                     overlap_max = overlap;
@@ -2452,38 +2936,26 @@ namespace dd
                 && overlap_max >= overlap_threshold)
               {
                 match_used[bmax] = true;
-                eval_infos[cls].tp_d.push_back(score);
-                eval_infos[cls].tp_i.push_back(1);
-                eval_infos[cls].fp_d.push_back(score);
-                eval_infos[cls].fp_i.push_back(0);
+                eval_infos[cls]._tp.emplace_back(score, 1);
+                eval_infos[cls]._fp.emplace_back(score, 0);
               }
             else
               {
-                eval_infos[cls].tp_d.push_back(score);
-                eval_infos[cls].tp_i.push_back(0);
-                eval_infos[cls].fp_d.push_back(score);
-                eval_infos[cls].fp_i.push_back(1);
+                eval_infos[cls]._tp.emplace_back(score, 0);
+                eval_infos[cls]._fp.emplace_back(score, 1);
               }
           }
       }
 
     for (int k = 0; k < targ_bbox_count; ++k)
       {
-        eval_infos[targ_labels_acc[k]].num_pos++;
-      }
-    std::vector<APIData> vbad;
-    for (size_t label = 1; label < _nclasses; ++label)
-      {
-        APIData lbad;
-        lbad.add("tp_d", eval_infos[label].tp_d);
-        lbad.add("tp_i", eval_infos[label].tp_i);
-        lbad.add("fp_d", eval_infos[label].fp_d);
-        lbad.add("fp_i", eval_infos[label].fp_i);
-        lbad.add("num_pos", eval_infos[label].num_pos);
-        lbad.add("label", static_cast<int>(label));
-        vbad.push_back(lbad);
+        eval_infos[targ_labels_acc[k]]._num_pos++;
       }
-    return vbad;
+    // background is not evaluated
+    for (size_t label = 0; label < _nclasses; ++label)
+      eval_infos[label]._label = label;
+    eval_infos.erase(eval_infos.begin());
+    return eval_infos;
   }
 
   template class TorchLib<ImgTorchInputFileConn, SupervisedOutput, TorchModel>;
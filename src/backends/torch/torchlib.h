@@ -33,6 +33,7 @@
 
 #include "apidata.h"
 #include "mllibstrategy.h"
+#include "measureaccumulator.h"
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
@@ -46,8 +47,21 @@
 #include "torchmodule.h"
 #include "torchsolver.h"
 
+#define TORCH_FEATURE_CACHE_NAME "train_features"
+#define TORCH_CALIBRATION_RUNS 3
+
 namespace dd
 {
+  /**
+   * \brief results of a test set, from which its measures are computed
+   */
+  struct TorchTestResults
+  {
+    APIData _ad_res; /**< test information, and per sample results */
+    APIData _ad_out; /**< output parameters */
+    MeasureAccumulator _macc;
+    bool _accumulate = false; /**< whether results are in the accumulator */
+  };
 
   /**
    * \brief core torchlib mllib wrapper
@@ -86,12 +100,26 @@ namespace dd
              TorchDataset &dataset, int batch_size, APIData &out,
              size_t test_id = 0, const std::string &test_name = "");
 
-    std::vector<APIData> get_bbox_stats(const at::Tensor &targ_bboxes,
-                                        const at::Tensor &targ_labels,
-                                        const at::Tensor &bboxes_tensor,
-                                        const at::Tensor &labels_tensor,
-                                        const at::Tensor &score_tensor,
-                                        float overlap_threshold);
+    /**
+     * \brief runs a test set through the model, without computing measures
+     */
+    void test_results(const APIData &ad, TInputConnectorStrategy &inputc,
+                      TorchDataset &dataset, int batch_size,
+                      TorchTestResults &res);
+
+    /**
+     * \brief computes the measures of a test set, and adds them to out
+     */
+    static void measure_test_results(const TorchTestResults &res,
+                                     APIData &out, size_t test_id,
+                                     const std::string &test_name);
+
+    std::vector<DetectionStats>
+    get_bbox_stats(const at::Tensor &targ_bboxes,
+                   const at::Tensor &targ_labels,
+                   const at::Tensor &bboxes_tensor,
+                   const at::Tensor &labels_tensor,
+                   const at::Tensor &score_tensor, float overlap_threshold);
 
   public:
     unsigned int _nclasses = 0; /**< number of classes*/
@@ -167,6 +195,30 @@ namespace dd
 
     /** print and update model stats */
     void compute_and_print_model_info();
+
+    /**
+     * \brief computes outputs of the frozen traced net once for every training
+     * sample into an on-disk db, reused as long as training set and traced
+     * weights do not change
+     */
+    void build_feature_cache(TInputConnectorStrategy &inputc,
+                             const APIData &ad_input, TorchDataset &features,
+                             int batch_size);
+
+    /**
+     * \brief identifies the training samples, their preprocessing and the
+     * traced weights the feature cache is computed from. Samples are
+     * identified by db or file names, or by their contents when in memory
+     */
+    std::string feature_cache_fingerprint(TInputConnectorStrategy &inputc,
+                                          const APIData &ad_input);
+
+    /**
+     * \brief runs the model on dummy inputs of increasing batch sizes, and
+     * selects the best throughput one whose memory fits in memory_budget_mb
+     */
+    void calibrate_predict_batch_size(int memory_budget_mb,
+                                      int max_batch_size);
   };
 }
 
@@ -354,41 +354,37 @@ namespace dd
         return source.at(_loss_id);
       }
 
-    c10::IValue out_val = source.at(_linear_in);
+    return forward_head(head_input(source));
+  }
 
-    if (_hidden_states)
-      {
-        // out_val is a tuple containing tensors of dimension n_batch *
-        // sequence_length * n_features We want a tensor of size n_batch *
-        // n_features from the last hidden state
-        auto &elems = out_val.toTuple()->elements();
-        out_val = elems.back().toTensor().slice(1, 0, 1).squeeze(1);
-      }
+  c10::IValue TorchModule::forward_backbone(std::vector<c10::IValue> source)
+  {
+    if (!_traced)
+      throw MLLibInternalException(
+          "forward_backbone is only available for traced models");
+    auto output = _traced->forward(source);
+    source = torch_utils::unwrap_c10_vector(output);
+    return head_input(source);
+  }
 
+  c10::IValue TorchModule::forward_head(c10::IValue features)
+  {
     // graph and native modules take only one tensor as input for now
     if (_linear_head)
       {
-        out_val = _linear_head->forward(torch_utils::to_tensor_safe(out_val));
+        features
+            = _linear_head->forward(torch_utils::to_tensor_safe(features));
       }
     else if (_crnn_head)
       {
-        out_val = _crnn_head->forward(torch_utils::to_tensor_safe(out_val));
+        features = _crnn_head->forward(torch_utils::to_tensor_safe(features));
       }
-    return out_val;
+    return features;
   }
 
-  c10::IValue TorchModule::extract(std::vector<c10::IValue> source,
-                                   std::string extract_layer)
+  c10::IValue
+  TorchModule::head_input(const std::vector<c10::IValue> &source) const
   {
-    if (_graph) // native modules take only one tensor as input for now
-      return _graph->extract(torch_utils::to_tensor_safe(source[0]),
-                             extract_layer);
-    if (_native)
-      return _native->extract(torch_utils::to_tensor_safe(source[0]),
-                              extract_layer);
-    auto output = _traced->forward(source);
-    source = torch_utils::unwrap_c10_vector(output);
-
     c10::IValue out_val = source.at(_linear_in);
 
     if (_hidden_states)
@@ -402,6 +398,36 @@ namespace dd
     return out_val;
   }
 
+  bool TorchModule::can_cache_features() const
+  {
+    return _traced && _freeze_traced && _loss_id < 0
+           && (_linear_head || _crnn_head);
+  }
+
+  c10::IValue
+  TorchModule::forward_adaptive(std::vector<c10::IValue> source,
+                                const AdaptiveInferenceParams &params,
+                                AdaptiveInferenceStats &stats)
+  {
+    if (!_native || !_native->supports_adaptive())
+      throw MLLibBadParamException(
+          "early exit and token pruning require a vit or visformer template");
+    return _native->forward_adaptive(torch_utils::to_tensor_safe(source[0]),
+                                     params, stats);
+  }
+
+  c10::IValue TorchModule::extract(std::vector<c10::IValue> source,
+                                   std::string extract_layer)
+  {
+    if (_graph) // native modules take only one tensor as input for now
+      return _graph->extract(torch_utils::to_tensor_safe(source[0]),
+                             extract_layer);
+    if (_native)
+      return _native->extract(torch_utils::to_tensor_safe(source[0]),
+                              extract_layer);
+    return forward_backbone(source);
+  }
+
   bool TorchModule::extractable(std::string extract_layer) const
   {
     if (_graph)
@@ -53,6 +53,32 @@ namespace dd
     c10::IValue forward(std::vector<c10::IValue> source,
                         const std::string &forward_method = "");
 
+    /**
+     * \brief inference pass with early exit and/or token pruning, native
+     * templates only
+     */
+    c10::IValue forward_adaptive(std::vector<c10::IValue> source,
+                                 const AdaptiveInferenceParams &params,
+                                 AdaptiveInferenceStats &stats);
+
+    /**
+     * \brief forward through the traced net only, returns the input of the
+     * linear or crnn head
+     */
+    c10::IValue forward_backbone(std::vector<c10::IValue> source);
+
+    /**
+     * \brief forward through the linear or crnn head only, from features
+     * returned by forward_backbone
+     */
+    c10::IValue forward_head(c10::IValue features);
+
+    /**
+     * \brief whether the head can be trained from precomputed backbone
+     * features, ie traced net is frozen and followed by a linear or crnn head
+     */
+    bool can_cache_features() const;
+
     /**
      * \brief forward (inference) until extract_layer, return value of
      * layer/blob
@@ -238,6 +264,11 @@ namespace dd
   private:
     bool _freeze_traced = false; /**< Freeze weights of the traced module */
 
+    /**
+     * \brief select the head input among traced net outputs
+     */
+    c10::IValue head_input(const std::vector<c10::IValue> &source) const;
+
     /**
      * load graph module from caffe prototxt definition
      */
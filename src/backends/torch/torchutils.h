@@ -35,6 +35,9 @@
 #include <torch/script.h>
 #pragma GCC diagnostic pop
 
+#include <sys/resource.h>
+#include <fstream>
+
 #include <google/protobuf/message.h>
 #include "dd_spdlog.h"
 #include <opencv2/opencv.hpp>
@@ -67,6 +70,67 @@ namespace dd
 #endif
     }
 
+    /**
+     * \brief waits for pending work on device, for timing measurements
+     */
+    inline void synchronize(const torch::Device &device)
+    {
+#if !defined(CPU_ONLY) && !defined(USE_MPS)
+      if (device.is_cuda())
+        torch::cuda::synchronize(device.index());
+#else
+      (void)device;
+#endif
+    }
+
+    /**
+     * \brief resets peak memory statistics of device. On cpu, resets the
+     * peak resident memory of the process where linux allows it (>= 4.0)
+     */
+    inline void reset_peak_memory(const torch::Device &device)
+    {
+#if !defined(CPU_ONLY) && !defined(USE_MPS)
+      if (device.is_cuda())
+        {
+          c10::cuda::CUDACachingAllocator::resetPeakStats(device.index());
+          return;
+        }
+#else
+      (void)device;
+#endif
+      std::ofstream clear_refs("/proc/self/clear_refs");
+      clear_refs << "5";
+    }
+
+    /**
+     * \brief peak memory in bytes allocated on gpu device since last reset.
+     * On cpu, peak resident memory of the process since last reset, or
+     * since the process started when it can't be reset (ru_maxrss)
+     */
+    inline int64_t peak_memory(const torch::Device &device)
+    {
+#if !defined(CPU_ONLY) && !defined(USE_MPS)
+      if (device.is_cuda())
+        {
+          using namespace c10::cuda::CUDACachingAllocator;
+          DeviceStats stats = getDeviceStats(device.index());
+          size_t aggregate = static_cast<size_t>(StatType::AGGREGATE);
+          return stats.allocated_bytes[aggregate].peak;
+        }
+#else
+      (void)device;
+#endif
+      // VmHWM is reset by reset_peak_memory, ru_maxrss may not be
+      std::ifstream status("/proc/self/status");
+      std::string line;
+      while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+          return std::stoll(line.substr(6)) * 1024;
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+    }
+
     inline bool is_gpu_available()
     {
 #if defined(USE_MPS)
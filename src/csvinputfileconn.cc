@@ -22,7 +22,12 @@
 #include "csvinputfileconn.h"
 #include "utils/csv_parser.hpp"
 #include "utils/utils.hpp"
+#include "utils/threadpool.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
 #include <iomanip>
+#include <sstream>
 
 namespace dd
 {
@@ -489,74 +494,284 @@ namespace dd
     std::getline(csv_file, hline); // skip header line
   }
 
-  void CSVInputFileConn::read_csv(const std::string &fname,
-                                  const bool &forbid_shuffle)
+  void CSVInputFileConn::parse_csv_chunk(const std::string &text,
+                                         const std::vector<int> &kept_cols,
+                                         const std::vector<bool> &cat_cols,
+                                         CSVChunk &chunk) const
   {
-    std::ifstream csv_file(fname, std::ios::binary);
-    _logger->info("fname={} / open={}", fname, csv_file.is_open());
-    if (!csv_file.is_open())
-      throw InputConnectorBadParamException("cannot open file " + fname);
-    std::string hline;
-    std::getline(csv_file, hline);
-    read_header(hline);
-
-    // debug
-    /*std::cerr << "found " << _detect_cols << " columns\n";
-    std::cerr << "label size=" << _label.size() << " / label_pos size=" <<
-    _label_pos.size() << std::endl; std::cout << "CSV columns:\n";
-    std::copy(_columns.begin(),_columns.end(),
-              std::ostream_iterator<std::string>(std::cout," "));
-              std::cout << std::endl;*/
-    // debug
-
-    // categorical variables
-    if (_train && !_categoricals.empty())
+    size_t ncols = cat_cols.size();
+    std::istringstream sh(text);
+    aria::csv::CsvParser parser = aria::csv::CsvParser(sh)
+                                      .delimiter(_delim[0]) // default is ,
+                                      .quote(_quote[0]);    // default is"
+    for (auto &row : parser)
       {
-        fillup_categoricals(csv_file);
+        if (row.size() == 1 && row[0].empty()) // empty line
+          continue;
+        if (static_cast<int>(row.size()) > _detect_cols)
+          {
+            chunk._error = "line has more columns than headers";
+            chunk._error_row = chunk._rows;
+            return;
+          }
+        size_t offset = chunk._vals.size();
+        chunk._vals.resize(offset + ncols, 0.0);
+        if (!_id.empty())
+          chunk._ids.emplace_back();
+        for (size_t c = 0; c < row.size(); ++c)
+          {
+            int k = kept_cols[c];
+            if (k < 0)
+              continue;
+            const std::string &col = row[c];
+            if (static_cast<int>(c) == _id_pos)
+              chunk._ids.back() = col;
+            // empty categorical values are a category of their own
+            if (col.empty() && !cat_cols[k])
+              continue;
+            if (!cat_cols[k])
+              {
+                const char *str = col.c_str();
+                char *end = nullptr;
+                double val = std::strtod(str, &end);
+                if (end != str)
+                  {
+                    chunk._vals[offset + k] = val;
+                    continue;
+                  }
+              }
+            chunk._tokens.push_back(
+                { chunk._rows, k, static_cast<int>(c), col });
+          }
+        ++chunk._rows;
       }
+  }
 
-    // scaling to [0,1]
-    int nlines = 0;
-    if (_scale && _scale_type == MINMAX
-        && (_min_vals.empty() || _max_vals.empty()))
+  void CSVInputFileConn::read_csv_values(std::istream &csv_file,
+                                         const bool &test, ColumnStore &store,
+                                         std::vector<std::string> &ids,
+                                         CSVStats *stats, int &nlines)
+  {
+    // stored columns
+    std::vector<int> kept_cols(std::max(_detect_cols, 0), -1);
+    std::vector<bool> cat_cols;
+    std::vector<std::string> col_names;
+    auto lit = _columns.begin();
+    for (int c = 0; c < _detect_cols && lit != _columns.end(); ++c)
       {
-        find_min_max(csv_file);
+        if (_ignored_columns_pos.find(c) != _ignored_columns_pos.end())
+          continue;
+        kept_cols[c] = cat_cols.size();
+        cat_cols.push_back(is_category(*lit));
+        col_names.push_back(*lit);
+        ++lit;
       }
-    if (_scale && _scale_type == ZNORM
-        && (_mean_vals.empty() || _variance_vals.empty()))
+    size_t ncols = cat_cols.size();
+    store.init(ncols);
+    ids.clear();
+    if (stats)
+      stats->init(cat_cols);
+
+    ThreadPool &pool = ThreadPool::instance();
+    size_t max_chunks = 2 * std::max(static_cast<size_t>(1), pool.size());
+    std::string carry;
+    bool eof = false;
+    while (!eof)
       {
-        find_mean(csv_file);
-        find_variance(csv_file, _mean_vals);
+        // read a batch of chunks, each ending on a line boundary
+        std::vector<std::string> texts;
+        while (texts.size() < max_chunks && !eof)
+          {
+            std::string buf(_chunk_bytes, '\0');
+            csv_file.read(&buf[0], buf.size());
+            buf.resize(csv_file.gcount());
+            if (buf.empty())
+              {
+                eof = true;
+                if (!carry.empty())
+                  texts.push_back(std::move(carry));
+                break;
+              }
+            size_t last = buf.rfind('\n');
+            if (last == std::string::npos)
+              {
+                carry += buf;
+                continue;
+              }
+            std::string text = std::move(carry);
+            text.append(buf, 0, last + 1);
+            carry = buf.substr(last + 1);
+            texts.push_back(std::move(text));
+          }
+
+        std::vector<CSVChunk> chunks(texts.size());
+        pool.parallel_for(texts.size(), [&](size_t i) {
+          parse_csv_chunk(texts[i], kept_cols, cat_cols, chunks[i]);
+        });
+        texts.clear();
+
+        // merge in order, so that category and label numbers follow the
+        // order of appearance in the file
+        for (CSVChunk &chunk : chunks)
+          {
+            if (!chunk._error.empty())
+              {
+                _logger->error("line {}: {}", nlines + chunk._error_row + 1,
+                               chunk._error);
+                throw InputConnectorBadParamException(chunk._error);
+              }
+            for (CSVChunk::Token &token : chunk._tokens)
+              {
+                double &val = chunk._vals[token._row * ncols + token._col];
+                const std::string &col_name = col_names[token._col];
+                if (cat_cols[token._col])
+                  {
+                    if (_train && !test)
+                      update_category(col_name, token._str);
+                    int cnum
+                        = _categoricals[col_name].get_cat_num(token._str);
+                    if (cnum < 0)
+                      throw InputConnectorBadParamException(
+                          "unknown category " + token._str + " for variable "
+                          + col_name);
+                    val = cnum;
+                  }
+                else if (token._field == _id_pos)
+                  val = token._field; // string id
+                else if (std::find(_label_pos.begin(), _label_pos.end(),
+                                   token._field)
+                         != _label_pos.end())
+                  {
+                    auto uit = _hcorresp_r.find(token._str);
+                    if (uit != _hcorresp_r.end())
+                      val = (*uit).second;
+                    else if (test)
+                      throw InputConnectorBadParamException(
+                          "label " + token._str
+                          + " found in test set but not in train set");
+                    else
+                      {
+                        int clsn = _hcorresp_r.size();
+                        val = clsn;
+                        _hcorresp_r.insert(
+                            std::pair<std::string, int>(token._str, clsn));
+                        _hcorresp.insert(
+                            std::pair<int, std::string>(clsn, token._str));
+                      }
+                  }
+                else
+                  {
+                    _logger->error(
+                        "line {}: skipping column {} / not a number",
+                        nlines + token._row + 1, col_name);
+                    throw InputConnectorBadParamException(
+                        "column " + col_name
+                        + " is not a number, use categoricals or ignore "
+                          "parameters instead");
+                  }
+              }
+            for (size_t r = 0; r < chunk._rows; ++r)
+              {
+                const double *vals = chunk._vals.data() + r * ncols;
+                if (stats)
+                  stats->add(vals);
+                store.push_row(vals);
+              }
+            ids.insert(ids.end(), std::make_move_iterator(chunk._ids.begin()),
+                       std::make_move_iterator(chunk._ids.end()));
+            nlines += chunk._rows;
+            chunk = CSVChunk();
+          }
       }
+    store.finalize();
+  }
 
-    // read data
-    while (std::getline(csv_file, hline))
+  void CSVInputFileConn::add_csv_values(const ColumnStore &store,
+                                        const std::vector<std::string> &ids,
+                                        const std::vector<bool> &cat_cols,
+                                        const int &test_id,
+                                        const size_t &id_offset,
+                                        CSVCache *cache)
+  {
+    std::vector<int> cat_sizes;
+    auto lit = _columns.begin();
+    for (size_t c = 0; c < cat_cols.size(); ++c, ++lit)
+      cat_sizes.push_back(cat_cols[c] ? _categoricals[*lit]._vals.size() : 0);
+
+    std::vector<double> raw;
+    for (size_t r = 0; r < store.rows(); ++r)
       {
-        hline.erase(std::remove(hline.begin(), hline.end(), '\r'),
-                    hline.end());
+        store.row(r, raw);
         std::vector<double> vals;
-        std::string cid;
-        read_csv_line(hline, _delim, vals, cid, nlines, false);
-        if (_scale)
-          {
-            scale_vals(vals);
-          }
-        if (!_id.empty())
+        vals.reserve(raw.size());
+        for (size_t c = 0; c < raw.size(); ++c)
           {
-            add_train_csvline(cid, vals);
+            if (!cat_cols[c])
+              vals.push_back(raw[c]);
+            else
+              {
+                std::vector<double> ohv
+                    = one_hot_vector(static_cast<int>(raw[c]), cat_sizes[c]);
+                vals.insert(vals.end(), ohv.begin(), ohv.end());
+              }
           }
+        if (_scale)
+          scale_vals(vals);
+        std::string cid
+            = _id.empty() ? std::to_string(id_offset + r + 1) : ids.at(r);
+        if (cache)
+          cache->add_line(cid, vals);
+        if (test_id < 0)
+          add_train_csvline(cid, vals);
         else
-          add_train_csvline(std::to_string(nlines), vals);
+          add_test_csvline(test_id, cid, vals);
+      }
+  }
 
-        // debug
-        /*std::cout << "csv data line #" << nlines << "= " << vals.size() <<
-          std::endl;
-          std::copy(vals.begin(),vals.end(),std::ostream_iterator<double>(std::cout,""));
-          std::cout << std::endl;*/
-        // debug
+  void CSVInputFileConn::read_csv_data(std::istream &csv_file,
+                                       const std::string &fname,
+                                       CSVCache *cache)
+  {
+    // single pass over the data: values, categoricals and scaling statistics
+    ColumnStore store;
+    if (_spill_mb > 0)
+      store.set_spill(_model_repo.empty() ? "." : _model_repo,
+                      static_cast<size_t>(_spill_mb) * 1024 * 1024);
+    std::vector<std::string> ids;
+    CSVStats stats;
+    bool need_min_max = _scale && _scale_type == MINMAX
+                        && (_min_vals.empty() || _max_vals.empty());
+    bool need_mean_variance
+        = _scale && _scale_type == ZNORM
+          && (_mean_vals.empty() || _variance_vals.empty());
+    int nlines = 0;
+    read_csv_values(csv_file, false, store, ids,
+                    need_min_max || need_mean_variance ? &stats : nullptr,
+                    nlines);
+    if (store.spilled())
+      _logger->info("spilled parsed data to a memory mapped file");
+
+    std::vector<bool> cat_cols;
+    std::vector<size_t> cat_sizes;
+    auto lit = _columns.begin();
+    for (size_t c = 0; c < store.cols(); ++c, ++lit)
+      {
+        cat_cols.push_back(is_category(*lit));
+        cat_sizes.push_back(cat_cols.back() ? _categoricals[*lit]._vals.size()
+                                            : 0);
       }
+    if (need_min_max)
+      stats.min_max(cat_sizes, _min_vals, _max_vals);
+    if (need_mean_variance)
+      stats.mean_variance(cat_sizes, _mean_vals, _variance_vals);
+
+    if (cache)
+      cache->begin_table(fname, -1);
+    add_csv_values(store, ids, cat_cols, -1, 0, cache);
+    if (cache)
+      cache->end_table();
+    size_t id_offset = store.rows();
     _logger->info("read {} lines from {}", nlines, fname);
-    csv_file.close();
 
     // test file, if any.
     if (!_csv_test_fnames.empty())
@@ -568,36 +783,83 @@ namespace dd
             std::ifstream csv_test_file(csv_test_fname, std::ios::binary);
             if (!csv_test_file.is_open())
               throw InputConnectorBadParamException("cannot open test file "
-                                                    + fname);
+                                                    + csv_test_fname);
+            std::string hline;
             std::getline(csv_test_file, hline); // skip header line
-            while (std::getline(csv_test_file, hline))
-              {
-                hline.erase(std::remove(hline.begin(), hline.end(), '\r'),
-                            hline.end());
-                std::vector<double> vals;
-                std::string cid;
-                read_csv_line(hline, _delim, vals, cid, nlines, true);
-                if (_scale)
-                  {
-                    scale_vals(vals);
-                  }
-                if (!_id.empty())
-                  add_test_csvline(test_set_id, cid, vals);
-                else
-                  add_test_csvline(test_set_id, std::to_string(nlines), vals);
-
-                // debug
-                /*std::cout << "csv test data line=";
-                  std::copy(vals.begin(),vals.end(),std::ostream_iterator<double>(std::cout,"
-                  ")); std::cout << std::endl;*/
-                // debug
-              }
+            read_csv_values(csv_test_file, true, store, ids, nullptr, nlines);
+            if (cache)
+              cache->begin_table(csv_test_fname, test_set_id);
+            // test ids follow the training ones, so that they do not overlap
+            add_csv_values(store, ids, cat_cols, test_set_id, id_offset,
+                           cache);
+            id_offset += store.rows();
+            if (cache)
+              cache->end_table();
             _logger->info("read {} lines from {}", nlines,
                           _csv_test_fnames[test_set_id]);
             csv_test_file.close();
             test_set_id++;
           }
       }
+  }
+
+  void CSVInputFileConn::read_csv(const std::string &fname,
+                                  const bool &forbid_shuffle)
+  {
+    std::ifstream csv_file(fname, std::ios::binary);
+    _logger->info("fname={} / open={}", fname, csv_file.is_open());
+    if (!csv_file.is_open())
+      throw InputConnectorBadParamException("cannot open file " + fname);
+    std::string hline;
+    std::getline(csv_file, hline);
+    read_header(hline);
+
+    // cache of the parsed data, keyed on the sources and the state before
+    // parsing
+    std::vector<std::string> sources = { fname };
+    sources.insert(sources.end(), _csv_test_fnames.begin(),
+                   _csv_test_fnames.end());
+    std::string cache_fname, fingerprint;
+    if (_csv_cache && !_model_repo.empty())
+      {
+        fingerprint = csv_cache_fingerprint(sources);
+        if (!fingerprint.empty())
+          cache_fname = csv_cache_fname(sources, ".bin");
+      }
+
+    CSVCache cache;
+    if (!cache_fname.empty() && cache.open(cache_fname, fingerprint))
+      {
+        csv_file.close();
+        restore_csv_cache_state(cache);
+        for (const CSVCache::Table &t : cache.tables())
+          {
+            cache.read_table(t, [&](const std::string &id,
+                                    const std::vector<double> &cvals) {
+              std::vector<double> vals(cvals);
+              if (t._group < 0)
+                add_train_csvline(id, vals);
+              else
+                add_test_csvline(t._group, id, vals);
+            });
+            _logger->info("read {} lines from {} cache", t._rows, t._name);
+          }
+      }
+    else
+      {
+        if (!cache_fname.empty())
+          remove_stale_csv_caches(cache_fname);
+        bool write_cache
+            = !cache_fname.empty() && cache.create(cache_fname, sources);
+        read_csv_data(csv_file, fname, write_cache ? &cache : nullptr);
+        csv_file.close();
+        if (write_cache)
+          {
+            save_csv_cache_state(cache);
+            if (!cache.close(fingerprint))
+              _logger->warn("failed writing CSV cache {}", cache_fname);
+          }
+      }
 
     // shuffle before possible test data selection.
     if (!forbid_shuffle)
@@ -625,6 +887,167 @@ namespace dd
     correspf.close();
   }
 
+  std::string
+  CSVInputFileConn::csv_cache_fname(const std::vector<std::string> &sources,
+                                    const std::string &ext) const
+  {
+    std::string cache_dir = _model_repo + "/csv_cache";
+    if (!fileops::dir_exists(cache_dir))
+      fileops::create_dir(cache_dir, 0755);
+    std::string key;
+    for (const std::string &s : sources)
+      key += s + ";";
+    std::ostringstream fname;
+    fname << cache_dir << "/" << std::hex << std::hash<std::string>{}(key)
+          << ext;
+    return fname.str();
+  }
+
+  void CSVInputFileConn::remove_stale_csv_caches(
+      const std::string &cache_fname) const
+  {
+    std::string cache_dir = cache_fname.substr(0, cache_fname.rfind('/'));
+    std::unordered_set<std::string> files;
+    fileops::list_directory(cache_dir, true, false, false, files);
+    for (const std::string &f : files)
+      {
+        std::string name = f.substr(f.rfind('/') + 1);
+        size_t tmp = name.rfind(".tmp");
+        bool stale = false;
+        if (tmp != std::string::npos)
+          {
+            // left over by a process that died while writing
+            pid_t pid = atoi(name.substr(tmp + 4).c_str());
+            stale = pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+          }
+        else
+          // the current sources cache did not match and is rebuilt
+          stale = f == cache_fname || CSVCache::stale(f);
+        if (stale && remove(f.c_str()) == 0)
+          _logger->info("removed stale CSV cache {}", f);
+      }
+  }
+
+  std::string CSVInputFileConn::csv_cache_fingerprint(
+      const std::vector<std::string> &sources) const
+  {
+    std::string files = CSVCache::files_fingerprint(sources);
+    if (files.empty())
+      return "";
+    std::ostringstream fp;
+    fp << std::setprecision(17);
+    fp << "v1|" << files << "|" << _delim << "|" << _quote << "|" << _id
+       << "|";
+    for (const std::string &l : _label)
+      fp << l << ",";
+    fp << "|";
+    std::vector<std::string> ignored(_ignored_columns.begin(),
+                                     _ignored_columns.end());
+    std::sort(ignored.begin(), ignored.end());
+    for (const std::string &c : ignored)
+      fp << c << ",";
+    fp << "|";
+    std::map<std::string, std::map<int, std::string>> cats;
+    for (auto &cit : _categoricals)
+      {
+        std::map<int, std::string> &cat = cats[cit.first];
+        for (auto &vit : cit.second._vals)
+          cat[vit.second] = vit.first;
+      }
+    for (auto &cit : cats)
+      {
+        fp << cit.first << ":";
+        for (auto &vit : cit.second)
+          fp << vit.first << "=" << vit.second << ",";
+        fp << ";";
+      }
+    fp << "|";
+    std::map<int, std::string> labels(_hcorresp.begin(), _hcorresp.end());
+    for (auto &lit : labels)
+      fp << lit.first << "=" << lit.second << ",";
+    fp << "|" << _scale << _scale_type << _dont_scale_labels
+       << _scale_between_minus_half_and_half << "|";
+    for (const std::vector<double> *bounds :
+         { &_min_vals, &_max_vals, &_mean_vals, &_variance_vals })
+      {
+        for (double v : *bounds)
+          fp << v << ",";
+        fp << ";";
+      }
+    return fp.str();
+  }
+
+  void CSVInputFileConn::save_csv_cache_state(CSVCache &cache) const
+  {
+    std::vector<std::string> cat_names;
+    for (auto &cit : _categoricals)
+      {
+        cat_names.push_back(cit.first);
+        std::vector<std::string> cat_vals;
+        std::vector<double> cat_nums;
+        for (auto &vit : cit.second._vals)
+          {
+            cat_vals.push_back(vit.first);
+            cat_nums.push_back(vit.second);
+          }
+        cache.add_list("categorical:" + cit.first, cat_vals);
+        cache.add_values("categorical:" + cit.first, cat_nums);
+      }
+    cache.add_list("categoricals", cat_names);
+
+    std::vector<std::string> label_names;
+    std::vector<double> label_nums;
+    for (auto &hit : _hcorresp)
+      {
+        label_names.push_back(hit.second);
+        label_nums.push_back(hit.first);
+      }
+    cache.add_list("labels", label_names);
+    cache.add_values("labels", label_nums);
+
+    cache.add_values("min_vals", _min_vals);
+    cache.add_values("max_vals", _max_vals);
+    cache.add_values("mean_vals", _mean_vals);
+    cache.add_values("variance_vals", _variance_vals);
+  }
+
+  void CSVInputFileConn::restore_csv_cache_state(const CSVCache &cache)
+  {
+    auto list = [&cache](const std::string &key) {
+      auto lit = cache._lists.find(key);
+      return lit == cache._lists.end() ? std::vector<std::string>()
+                                       : (*lit).second;
+    };
+    auto values = [&cache](const std::string &key) {
+      auto vit = cache._values.find(key);
+      return vit == cache._values.end() ? std::vector<double>()
+                                        : (*vit).second;
+    };
+
+    for (const std::string &c : list("categoricals"))
+      {
+        CCategorical &cc = _categoricals[c];
+        std::vector<std::string> cat_vals = list("categorical:" + c);
+        std::vector<double> cat_nums = values("categorical:" + c);
+        for (size_t i = 0; i < cat_vals.size() && i < cat_nums.size(); ++i)
+          cc._vals[cat_vals[i]] = static_cast<int>(cat_nums[i]);
+      }
+
+    std::vector<std::string> label_names = list("labels");
+    std::vector<double> label_nums = values("labels");
+    for (size_t i = 0; i < label_names.size() && i < label_nums.size(); ++i)
+      {
+        int clsn = static_cast<int>(label_nums[i]);
+        _hcorresp[clsn] = label_names[i];
+        _hcorresp_r[label_names[i]] = clsn;
+      }
+
+    _min_vals = values("min_vals");
+    _max_vals = values("max_vals");
+    _mean_vals = values("mean_vals");
+    _variance_vals = values("variance_vals");
+  }
+
   void CSVInputFileConn::serialize_bounds()
   {
     static int boundsprecision = 15;
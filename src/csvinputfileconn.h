@@ -24,10 +24,13 @@
 
 #include "inputconnectorstrategy.h"
 #include "utils/fileops.hpp"
+#include "utils/colstore.hpp"
+#include "utils/csvcache.hpp"
 #include <fstream>
 #include <istream>
 #include <unordered_set>
 #include <algorithm>
+#include <limits>
 #include <random>
 
 namespace dd
@@ -132,6 +135,142 @@ namespace dd
         _vals; /**< categorical value mapping. */
   };
 
+  /**
+   * \brief CSV data lines parsed from a chunk of a CSV file
+   */
+  struct CSVChunk
+  {
+    /**
+     * \brief non numerical value, resolved once chunks are merged in order
+     */
+    struct Token
+    {
+      size_t _row; /**< row in the chunk */
+      int _col;    /**< column in the stored values */
+      int _field;  /**< column in the file */
+      std::string _str;
+    };
+
+    size_t _rows = 0;
+    std::vector<double> _vals; /**< row major values, one per kept column */
+    std::vector<Token> _tokens;
+    std::vector<std::string> _ids; /**< line ids, if any */
+    std::string _error;            /**< parsing error, if any */
+    size_t _error_row = 0;
+  };
+
+  /**
+   * \brief per column statistics accumulated while reading a CSV file, for
+   * scaling
+   */
+  class CSVStats
+  {
+  public:
+    void init(const std::vector<bool> &cat_cols)
+    {
+      _cat_cols = cat_cols;
+      size_t ncols = cat_cols.size();
+      _min.assign(ncols, std::numeric_limits<double>::max());
+      _max.assign(ncols, std::numeric_limits<double>::lowest());
+      _mean.assign(ncols, 0.0);
+      _m2.assign(ncols, 0.0);
+      _cat_counts.assign(ncols, std::vector<size_t>());
+      _n = 0;
+    }
+
+    void add(const double *vals)
+    {
+      ++_n;
+      for (size_t c = 0; c < _cat_cols.size(); ++c)
+        {
+          double v = vals[c];
+          if (_cat_cols[c])
+            {
+              size_t cnum = static_cast<size_t>(v);
+              if (_cat_counts[c].size() <= cnum)
+                _cat_counts[c].resize(cnum + 1, 0);
+              ++_cat_counts[c][cnum];
+              continue;
+            }
+          _min[c] = std::min(_min[c], v);
+          _max[c] = std::max(_max[c], v);
+          // Welford's online mean and variance
+          double delta = v - _mean[c];
+          _mean[c] += delta / _n;
+          _m2[c] += delta * (v - _mean[c]);
+        }
+    }
+
+    /**
+     * \brief min/max bounds of the values once categorical columns are one
+     * hot encoded, cat_sizes holds the number of categories per column
+     */
+    void min_max(const std::vector<size_t> &cat_sizes,
+                 std::vector<double> &min_vals,
+                 std::vector<double> &max_vals) const
+    {
+      min_vals.clear();
+      max_vals.clear();
+      for (size_t c = 0; c < _cat_cols.size(); ++c)
+        {
+          if (!_cat_cols[c])
+            {
+              min_vals.push_back(_min[c]);
+              max_vals.push_back(_max[c]);
+              continue;
+            }
+          for (size_t k = 0; k < cat_sizes[c]; ++k)
+            {
+              size_t count = cat_count(c, k);
+              min_vals.push_back(count == _n ? 1.0 : 0.0);
+              max_vals.push_back(count > 0 ? 1.0 : 0.0);
+            }
+        }
+    }
+
+    /**
+     * \brief mean and variance of the values once categorical columns are
+     * one hot encoded
+     */
+    void mean_variance(const std::vector<size_t> &cat_sizes,
+                       std::vector<double> &mean_vals,
+                       std::vector<double> &variance_vals) const
+    {
+      mean_vals.clear();
+      variance_vals.clear();
+      for (size_t c = 0; c < _cat_cols.size(); ++c)
+        {
+          if (!_cat_cols[c])
+            {
+              mean_vals.push_back(_mean[c]);
+              variance_vals.push_back(_n > 0 ? _m2[c] / _n : 0.0);
+              continue;
+            }
+          for (size_t k = 0; k < cat_sizes[c]; ++k)
+            {
+              double p = _n > 0 ? cat_count(c, k) / static_cast<double>(_n)
+                                : 0.0;
+              mean_vals.push_back(p);
+              variance_vals.push_back(p * (1.0 - p));
+            }
+        }
+    }
+
+  private:
+    size_t cat_count(const size_t &c, const size_t &k) const
+    {
+      return k < _cat_counts[c].size() ? _cat_counts[c][k] : 0;
+    }
+
+    std::vector<bool> _cat_cols;
+    std::vector<double> _min;
+    std::vector<double> _max;
+    std::vector<double> _mean;
+    std::vector<double> _m2;
+    std::vector<std::vector<size_t>> _cat_counts;
+    size_t _n = 0;
+  };
+
   /**
    * \brief Generic CSV data input connector
    */
@@ -189,6 +328,12 @@ namespace dd
       if (params->test_split != nullptr)
         _test_split = params->test_split;
 
+      if (params->spill_mb != nullptr)
+        _spill_mb = params->spill_mb;
+
+      if (params->csv_cache != nullptr)
+        _csv_cache = params->csv_cache;
+
       // read categorical mapping, if any
       read_categoricals(params);
 
@@ -656,13 +801,91 @@ namespace dd
                        int &nlines, const bool &test);
 
     /**
-     * \brief reads a full CSV data file, calls read_csv_line
+     * \brief reads the data lines of a CSV file in a single pass: chunks of
+     * the file are parsed in parallel, then merged in order to resolve
+     * categorical values and string labels
+     * @param csv_file input stream, past the header line
+     * @param test whether the lines are from a test set
+     * @param store sink for the values, categorical values being stored as
+     *        their category number
+     * @param ids sink for the line ids, when an id column is set
+     * @param stats if not null, accumulates per column statistics
+     * @param nlines line counter
+     */
+    void read_csv_values(std::istream &csv_file, const bool &test,
+                         ColumnStore &store, std::vector<std::string> &ids,
+                         CSVStats *stats, int &nlines);
+
+    /**
+     * \brief parses a chunk of CSV data lines, thread safe
+     * @param text chunk of full lines
+     * @param kept_cols column in the stored values of every file column, -1
+     *        for ignored columns
+     * @param cat_cols whether every stored column is categorical
+     * @param chunk parsed lines
+     */
+    void parse_csv_chunk(const std::string &text,
+                         const std::vector<int> &kept_cols,
+                         const std::vector<bool> &cat_cols,
+                         CSVChunk &chunk) const;
+
+    /**
+     * \brief one hot encodes, scales and adds to the training or test set
+     * the values read by read_csv_values
+     * @param id_offset number of lines before these ones, for line ids when
+     *        no id column is set
+     * @param cache if not null, cache file the resulting lines are written to
+     */
+    void add_csv_values(const ColumnStore &store,
+                        const std::vector<std::string> &ids,
+                        const std::vector<bool> &cat_cols, const int &test_id,
+                        const size_t &id_offset, CSVCache *cache);
+
+    /**
+     * \brief parses a CSV data file and its test files, past the header line
+     * @param cache if not null, cache file the parsed data is written to
+     */
+    void read_csv_data(std::istream &csv_file, const std::string &fname,
+                       CSVCache *cache);
+
+    /**
+     * \brief reads a full CSV data file, calls read_csv_values, or reads the
+     * parsed data from the model repository cache when enabled and up to date
      * @param fname the CSV file name
      * @param forbid_shuffle whether shuffle is forbidden
      */
     void read_csv(const std::string &fname,
                   const bool &forbid_shuffle = false);
 
+    /**
+     * \brief cache file name in the model repository for a set of sources
+     */
+    std::string csv_cache_fname(const std::vector<std::string> &sources,
+                                const std::string &ext) const;
+
+    /**
+     * \brief removes cache files whose sources changed or are gone, along
+     * with cache_fname that is about to be rebuilt
+     */
+    void remove_stale_csv_caches(const std::string &cache_fname) const;
+
+    /**
+     * \brief fingerprint of sources files and of the parameters and state
+     * the parsed data depends upon, empty if a source is missing
+     */
+    std::string
+    csv_cache_fingerprint(const std::vector<std::string> &sources) const;
+
+    /**
+     * \brief writes categoricals, labels and scaling bounds to a cache
+     */
+    void save_csv_cache_state(CSVCache &cache) const;
+
+    /**
+     * \brief restores categoricals, labels and scaling bounds from a cache
+     */
+    void restore_csv_cache_state(const CSVCache &cache);
+
     int batch_size() const
     {
       return _csvdata.size();
@@ -919,6 +1142,12 @@ namespace dd
     std::string _correspname = "corresp.txt";
     std::string _boundsfname
         = "bounds.dat"; /**< variables min/max bounds filename. */
+    int _spill_mb = 0; /**< parsed data size above which it is spilled to a
+                          memory mapped file, 0 for never. */
+    size_t _chunk_bytes
+        = 4 * 1024 * 1024; /**< size of the file chunks parsed in parallel */
+    bool _csv_cache = false; /**< whether parsed data is cached in the model
+                                repository */
 
     // data
     std::vector<CSVline> _csvdata;
@@ -125,9 +125,29 @@ namespace dd
             + " and tests : " + testdirs);
       }
 
+    //- categoricals and bounds from the model repository cache, if up to date
+    std::vector<std::string> sources(allfiles.begin(), allfiles.end());
+    std::sort(sources.begin(), sources.end());
+    std::string cache_fname, fingerprint;
+    if (_cifc->_csv_cache && !_cifc->_model_repo.empty())
+      {
+        fingerprint = _cifc->csv_cache_fingerprint(sources);
+        if (!fingerprint.empty())
+          cache_fname = _cifc->csv_cache_fname(sources, ".state");
+      }
+    CSVCache state_cache;
+    bool cached_state
+        = !cache_fname.empty() && state_cache.open(cache_fname, fingerprint);
+    if (cached_state)
+      {
+        _cifc->restore_csv_cache_state(state_cache);
+        if (_cifc->_scale)
+          _cifc->serialize_bounds();
+      }
+
     //- read categoricals first if any as it affects the number of columns (and
     // thus bounds)
-    if (!_cifc->_categoricals.empty())
+    if (!cached_state && !_cifc->_categoricals.empty())
       {
         std::unordered_map<std::string, CCategorical> categoricals;
         for (auto fname : allfiles)
@@ -146,7 +166,7 @@ namespace dd
       }
 
     //- read bounds across all TS CSV files
-    if (_cifc->_scale)
+    if (!cached_state && _cifc->_scale)
       {
         if (_cifc->_scale_type == MINMAX
             && (_cifc->_min_vals.empty() || _cifc->_max_vals.empty()))
@@ -215,6 +235,17 @@ namespace dd
             _cifc->serialize_bounds();
           }
       }
+    if (!cached_state && !cache_fname.empty())
+      {
+        _cifc->remove_stale_csv_caches(cache_fname);
+        if (state_cache.create(cache_fname, sources))
+          {
+            _cifc->save_csv_cache_state(state_cache);
+            if (!state_cache.close(fingerprint))
+              this->_logger->warn("failed writing CSV cache {}",
+                                  cache_fname);
+          }
+      }
 
     //- read TS CSV data train/test
     for (auto fname : trainfiles) // train data
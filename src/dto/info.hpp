@@ -36,6 +36,32 @@ namespace dd
   {
 #include OATPP_CODEGEN_BEGIN(DTO) ///< Begin DTO codegen section
 
+    class BatchProfile : public oatpp::DTO
+    {
+      DTO_INIT(BatchProfile, DTO /* extends */)
+
+      DTO_FIELD(Int32, batch_size);
+
+      DTO_FIELD_INFO(latency_ms)
+      {
+        info->description = "Duration of a forward pass over the batch";
+      }
+      DTO_FIELD(Float64, latency_ms);
+
+      DTO_FIELD_INFO(throughput)
+      {
+        info->description = "Number of samples processed per second";
+      }
+      DTO_FIELD(Float64, throughput);
+
+      DTO_FIELD_INFO(peak_memory_mb)
+      {
+        info->description
+            = "Peak memory used by the forward pass, on top of the model";
+      }
+      DTO_FIELD(Float64, peak_memory_mb);
+    };
+
     class ServiceModel : public oatpp::DTO
     {
       DTO_INIT(ServiceModel, DTO /* extends */)
@@ -69,6 +95,19 @@ namespace dd
         info->description = "Amount of memory used to store test data";
       }
       DTO_FIELD(Int32, data_mem_test);
+
+      DTO_FIELD_INFO(predict_batch_size)
+      {
+        info->description = "Predict batch size selected by calibration";
+      }
+      DTO_FIELD(Int32, predict_batch_size);
+
+      DTO_FIELD_INFO(batch_profile)
+      {
+        info->description
+            = "Latency and memory measured at each calibrated batch size";
+      }
+      DTO_FIELD(Vector<Object<BatchProfile>>, batch_profile);
     };
 
     class ServiceJob : public oatpp::DTO
@@ -50,6 +50,31 @@ namespace dd
       }
       DTO_FIELD(Int32, timeout) = -1;
 
+      DTO_FIELD_INFO(fetch_host_connections)
+      {
+        info->description = "[image] max number of parallel connections "
+                            "per host when fetching the remote images of a "
+                            "call";
+      }
+      DTO_FIELD(Int32, fetch_host_connections);
+
+      DTO_FIELD_INFO(fetch_deadline)
+      {
+        info->description
+            = "[image] max duration in seconds for fetching all remote images "
+              "of a call: -1 means using timeout";
+      }
+      DTO_FIELD(Int32, fetch_deadline);
+
+      DTO_FIELD_INFO(fetch_cache_mb)
+      {
+        info->description
+            = "[image] size in MB of the cache of remote images in the model "
+              "repository, revalidated with their ETag on later calls. Set at "
+              "service creation, 0 means no cache";
+      }
+      DTO_FIELD(Int32, fetch_cache_mb);
+
       DTO_FIELD(Boolean, shuffle);
       DTO_FIELD(Int32, seed);
       DTO_FIELD(Float64, test_split);
@@ -93,6 +118,23 @@ namespace dd
       DTO_FIELD(Boolean, keep_orig);
       DTO_FIELD(String, interp);
 
+      DTO_FIELD_INFO(reduced_decode)
+      {
+        info->description
+            = "[image] decode jpeg images at 1/2, 1/4 or 1/8 resolution when "
+              "still larger than the resized image, off by default";
+      }
+      DTO_FIELD(Boolean, reduced_decode);
+
+      DTO_FIELD_INFO(img_cache_mb)
+      {
+        info->description
+            = "[image] size in MB of the service cache of preprocessed "
+              "images, keyed by image content and preprocessing parameters, "
+              "0 to disable";
+      }
+      DTO_FIELD(Int32, img_cache_mb);
+
       DTO_FIELD_INFO(bbox)
       {
         info->description = "[training] true if data contains a bbox dataset";
@@ -249,6 +291,24 @@ namespace dd
       }
       DTO_FIELD(DTOApiData, categoricals_mapping);
 
+      DTO_FIELD_INFO(spill_mb)
+      {
+        info->description
+            = "[csv] size in MB of parsed training data above which it is "
+              "spilled to a memory mapped file in the model repository, 0 to "
+              "keep it in memory";
+      }
+      DTO_FIELD(Int32, spill_mb);
+
+      DTO_FIELD_INFO(csv_cache)
+      {
+        info->description
+            = "[csv, csvts] whether to cache parsed data in the model "
+              "repository, reused as long as data files and parameters are "
+              "unchanged";
+      }
+      DTO_FIELD(Boolean, csv_cache);
+
       // Scale vals
       DTO_FIELD_INFO(scale_type)
       {
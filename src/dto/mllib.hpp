@@ -40,9 +40,11 @@ namespace dd
 
       DTO_FIELD_INFO(test_batch_size)
       {
-        info->description = "Testing batch size";
+        info->description
+            = "Testing batch size. Defaults to the batch size selected by "
+              "predict_memory_budget_mb calibration if any, 1 otherwise";
       }
-      DTO_FIELD(Int32, test_batch_size) = 1;
+      DTO_FIELD(Int32, test_batch_size);
     };
 
     class MLLib : public oatpp::DTO
@@ -189,6 +191,23 @@ namespace dd
       }
       DTO_FIELD(Boolean, concurrent_predict) = true;
 
+      DTO_FIELD_INFO(predict_memory_budget_mb)
+      {
+        info->description
+            = "Calibrate the predict batch size at service creation: the "
+              "largest throughput batch size whose inference memory stays "
+              "under this budget (in MB) is used as default test_batch_size. "
+              "0 disables calibration";
+      }
+      DTO_FIELD(Int32, predict_memory_budget_mb) = 0;
+
+      DTO_FIELD_INFO(predict_max_batch_size)
+      {
+        info->description
+            = "Largest batch size tried by predict batch size calibration";
+      }
+      DTO_FIELD(Int32, predict_max_batch_size) = 128;
+
       // Libtorch predict options
       DTO_FIELD_INFO(forward_method)
       {
@@ -198,6 +217,31 @@ namespace dd
       }
       DTO_FIELD(String, forward_method) = "";
 
+      DTO_FIELD_INFO(exit_confidence)
+      {
+        info->description
+            = "[vit, visformer] early exit: a sample stops at the first "
+              "intermediate block where its top class probability reaches "
+              "this value. 0 disables early exit";
+      }
+      DTO_FIELD(Float64, exit_confidence) = 0.0;
+
+      DTO_FIELD_INFO(exit_min_depth)
+      {
+        info->description
+            = "[vit, visformer] number of blocks to run before early exit "
+              "is allowed";
+      }
+      DTO_FIELD(Int32, exit_min_depth) = 1;
+
+      DTO_FIELD_INFO(token_keep_rate)
+      {
+        info->description
+            = "[vit] fraction of patch tokens kept at each of the three "
+              "token pruning stages. 1 disables pruning";
+      }
+      DTO_FIELD(Float64, token_keep_rate) = 1.0;
+
       // =====
       // TensorRT Options
       DTO_FIELD_INFO(calibration)
@@ -46,6 +46,28 @@ namespace dd
       DTO_FIELD(Int32, best);
       DTO_FIELD(Int32, best_bbox) = -1;
       DTO_FIELD(Float32, nms_threshold) = 0.45;
+
+      DTO_FIELD_INFO(nms)
+      {
+        info->description
+            = "Non maximum suppression of detections: greedy, or soft nms "
+              "decaying the confidence of overlapping boxes linearly "
+              "(soft_linear) or with a gaussian (soft_gaussian)";
+      }
+      DTO_FIELD(String, nms) = "greedy";
+
+      DTO_FIELD_INFO(nms_per_class)
+      {
+        info->description
+            = "whether only detections of a same class suppress each other";
+      }
+      DTO_FIELD(Boolean, nms_per_class) = false;
+
+      DTO_FIELD_INFO(nms_sigma)
+      {
+        info->description = "gaussian soft nms parameter";
+      }
+      DTO_FIELD(Float32, nms_sigma) = 0.5;
       DTO_FIELD(Vector<String>, confidences);
       DTO_FIELD(Int32, top_k) = -1;
 
@@ -88,6 +110,23 @@ namespace dd
       }
       DTO_FIELD(Boolean, string_binarized) = false;
 
+      DTO_FIELD_INFO(vals_format)
+      {
+        info->description
+            = "Output values as base64 of little-endian float32 or float16, "
+              "with their shape in vals_shape";
+      }
+      DTO_FIELD(String, vals_format);
+
+      DTO_FIELD_INFO(mask_format)
+      {
+        info->description
+            = "Segmentation masks as a png label image, or as COCO "
+              "compressed run-length encoding per class (rle), instead of "
+              "per-pixel values";
+      }
+      DTO_FIELD(String, mask_format);
+
       /* simsearch (unsupervised) */
       DTO_FIELD(Boolean, index) = false;
       DTO_FIELD(Boolean, build_index) = false;
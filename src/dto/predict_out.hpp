@@ -132,6 +132,24 @@ namespace dd
       DTO_FIELD(String, class_id);
     };
 
+    class RLEMask : public oatpp::DTO
+    {
+      DTO_INIT(RLEMask, DTO)
+
+      DTO_FIELD_INFO(size)
+      {
+        info->description = "Mask height and width";
+      }
+      DTO_FIELD(Vector<UInt32>, size);
+
+      DTO_FIELD_INFO(counts)
+      {
+        info->description
+            = "COCO compressed run-length counts, in column-major order";
+      }
+      DTO_FIELD(String, counts);
+    };
+
     class Prediction : public oatpp::DTO
     {
       DTO_INIT(Prediction, DTO)
@@ -188,10 +206,25 @@ namespace dd
         info->description
             = "[Unsupervised] Array containing model output "
               "values. Can be in different formats: double, "
-              "binarized double, booleans, binarized string, base64 image";
+              "binarized double, booleans, binarized string, base64 image, "
+              "base64 floats";
       }
       DTO_FIELD(Any, vals);
 
+      DTO_FIELD_INFO(vals_format)
+      {
+        info->description = "[Unsupervised] float32 or float16 when vals "
+                            "are base64 encoded binary values";
+      }
+      DTO_FIELD(String, vals_format);
+
+      DTO_FIELD_INFO(vals_shape)
+      {
+        info->description
+            = "[Unsupervised] shape of base64 encoded values, if known";
+      }
+      DTO_FIELD(Vector<Int32>, vals_shape);
+
       DTO_FIELD_INFO(images)
       {
         info->description
@@ -205,6 +238,13 @@ namespace dd
       }
       DTO_FIELD(Object<Dimensions>, imgsize);
 
+      DTO_FIELD_INFO(rle)
+      {
+        info->description = "[Unsupervised] Segmentation masks per class, "
+                            "when requested in rle mask_format";
+      }
+      DTO_FIELD(UnorderedFields<Object<RLEMask>>, rle);
+
       DTO_FIELD_INFO(confidences)
       {
         info->description
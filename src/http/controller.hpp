@@ -178,12 +178,17 @@ public:
   {
     info->summary = "Predict";
     info->addConsumes<Object<dd::DTO::ServicePredict>>("application/json");
+    info->addResponse<String>(Status::CODE_200, "application/json");
+    info->addResponse<String>(Status::CODE_200, "application/cbor");
   }
   ENDPOINT("POST", "predict", predict,
+           REQUEST(std::shared_ptr<IncomingRequest>, request),
            BODY_STRING(oatpp::String, predict_data))
   {
-    auto janswer = _oja->service_predict(predict_data);
-    return _oja->jdoc_to_response(janswer);
+    oatpp::Void body;
+    auto janswer = _oja->service_predict(predict_data, body);
+    return _oja->dto_to_stream_response(std::move(janswer), body,
+                                        request->getHeader("Accept"));
   }
 
   ENDPOINT_INFO(get_train)
@@ -234,10 +239,13 @@ public:
   }
   ENDPOINT("POST", "chain/{chain-name}", create_chain,
            PATH(oatpp::String, chain_name, "chain-name"),
+           REQUEST(std::shared_ptr<IncomingRequest>, request),
            BODY_STRING(oatpp::String, chain_data))
   {
-    auto janswer = _oja->service_chain(chain_name, chain_data);
-    return _oja->jdoc_to_response(janswer);
+    oatpp::Void body;
+    auto janswer = _oja->service_chain(chain_name, chain_data, body);
+    return _oja->dto_to_stream_response(std::move(janswer), body,
+                                        request->getHeader("Accept"));
   }
 
   ENDPOINT_INFO(update_chain)
@@ -247,10 +255,13 @@ public:
   }
   ENDPOINT("PUT", "chain/{chain-name}", update_chain,
            PATH(oatpp::String, chain_name, "chain-name"),
+           REQUEST(std::shared_ptr<IncomingRequest>, request),
            BODY_STRING(oatpp::String, chain_data))
   {
-    auto janswer = _oja->service_chain(chain_name, chain_data);
-    return _oja->jdoc_to_response(janswer);
+    oatpp::Void body;
+    auto janswer = _oja->service_chain(chain_name, chain_data, body);
+    return _oja->dto_to_stream_response(std::move(janswer), body,
+                                        request->getHeader("Accept"));
   }
 
   ENDPOINT_INFO(create_resource)
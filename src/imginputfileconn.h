@@ -43,13 +43,113 @@
 #endif
 #include "ext/base64/base64.h"
 #include "utils/apitools.h"
+#include "utils/threadpool.hpp"
+#include <fstream>
+#include <list>
+#include <mutex>
 #include <random>
+#include <sstream>
+#include <unordered_map>
 
 #include "dto/input_connector.hpp"
 
 namespace dd
 {
 
+  /**
+   * \brief memory bounded LRU cache of preprocessed images, shared by the
+   * predict calls of a service
+   */
+  class ImgCache
+  {
+  public:
+    struct Entry
+    {
+      cv::Mat _img;              /**< preprocessed image */
+      std::pair<int, int> _size; /**< original image size, rows x cols */
+    };
+
+    ImgCache(const size_t &max_bytes) : _max_bytes(max_bytes)
+    {
+    }
+
+    /**
+     * \brief looks up an image, and marks it as most recently used
+     * @return whether the image was found
+     */
+    bool get(const size_t &key, Entry &entry)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto hit = _index.find(key);
+      if (hit == _index.end())
+        {
+          ++_misses;
+          return false;
+        }
+      _entries.splice(_entries.begin(), _entries, hit->second);
+      entry = hit->second->second;
+      ++_hits;
+      return true;
+    }
+
+    /**
+     * \brief adds an image, evicting the least recently used ones as needed
+     */
+    void put(const size_t &key, const Entry &entry)
+    {
+      size_t bytes = entry_bytes(entry);
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (bytes > _max_bytes || _index.find(key) != _index.end())
+        return;
+      _entries.emplace_front(key, entry);
+      _index[key] = _entries.begin();
+      _bytes += bytes;
+      evict();
+    }
+
+    void set_max_bytes(const size_t &max_bytes)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _max_bytes = max_bytes;
+      evict();
+    }
+
+    void to(APIData &stats) const
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      stats.add("img_cache_hits", _hits);
+      stats.add("img_cache_misses", _misses);
+      stats.add("img_cache_entries", static_cast<long int>(_index.size()));
+      stats.add("img_cache_bytes", static_cast<long int>(_bytes));
+    }
+
+  private:
+    static size_t entry_bytes(const Entry &entry)
+    {
+      return entry._img.total() * entry._img.elemSize();
+    }
+
+    void evict()
+    {
+      while (_bytes > _max_bytes && !_entries.empty())
+        {
+          _bytes -= entry_bytes(_entries.back().second);
+          _index.erase(_entries.back().first);
+          _entries.pop_back();
+        }
+    }
+
+    size_t _max_bytes = 0;
+    size_t _bytes = 0;
+    std::list<std::pair<size_t, Entry>> _entries; /**< most recent first */
+    std::unordered_map<size_t,
+                       std::list<std::pair<size_t, Entry>>::iterator>
+        _index;
+    long int _hits = 0;
+    long int _misses = 0;
+    mutable std::mutex _mutex;
+  };
+
   class DDImg
   {
   public:
@@ -315,14 +415,21 @@ namespace dd
 
     /// Apply preprocessing to image and add it to the list of images
     /// img_name: name of the image as displayed in error messages
-    int add_image(const cv::Mat &img, const std::string &img_name)
+    /// orig_size: size of the encoded image, if it was decoded at a reduced
+    /// resolution
+    int add_image(const cv::Mat &img, const std::string &img_name,
+                  const cv::Size &orig_size = cv::Size())
     {
       if (img.empty())
         {
           _logger->error("Could not read image: {}", img_name);
           return -1;
         }
-      _imgs_size.push_back(std::pair<int, int>(img.rows, img.cols));
+      if (orig_size.area() > 0)
+        _imgs_size.push_back(
+            std::pair<int, int>(orig_size.height, orig_size.width));
+      else
+        _imgs_size.push_back(std::pair<int, int>(img.rows, img.cols));
 
 #ifdef USE_CUDA_CV
       if (_cuda)
@@ -367,16 +474,188 @@ namespace dd
     }
 #endif
 
-    // decode image
-    int decode(const std::string &str)
+    /** reads the size of a jpeg image from its header, false if not a jpeg
+     */
+    static bool jpeg_size(const std::string &data, cv::Size &size)
+    {
+      const unsigned char *d
+          = reinterpret_cast<const unsigned char *>(data.data());
+      size_t len = data.size();
+      if (len < 4 || d[0] != 0xFF || d[1] != 0xD8)
+        return false;
+      size_t pos = 2;
+      while (pos + 4 <= len)
+        {
+          if (d[pos] != 0xFF)
+            return false;
+          unsigned char marker = d[pos + 1];
+          if (marker == 0xFF) // fill byte
+            {
+              ++pos;
+              continue;
+            }
+          if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+            {
+              pos += 2;
+              continue;
+            }
+          if (marker == 0xD9 || marker == 0xDA) // no frame header
+            return false;
+          size_t seglen = (d[pos + 2] << 8) | d[pos + 3];
+          // start of frame, except DHT, JPG and DAC markers
+          if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4
+              && marker != 0xC8 && marker != 0xCC)
+            {
+              if (pos + 9 > len)
+                return false;
+              size.height = (d[pos + 5] << 8) | d[pos + 6];
+              size.width = (d[pos + 7] << 8) | d[pos + 8];
+              return size.area() > 0;
+            }
+          pos += 2 + seglen;
+        }
+      return false;
+    }
+
+    /** largest jpeg decoding reduction (1, 2, 4 or 8) that keeps the decoded
+     * image at least as large as prepare() output */
+    int reduced_decode_factor(const cv::Size &orig) const
+    {
+      if (!_reduced_decode || _keep_orig || _unchanged_data
+          || orig.area() == 0)
+        return 1;
+      double max_factor = 1.0;
+      if (_scaled)
+        max_factor = 1.0
+                     / std::min(static_cast<double>(_scale_max)
+                                    / std::max(orig.width, orig.height),
+                                static_cast<double>(_scale_min)
+                                    / std::min(orig.width, orig.height));
+      else if (_width > 0 && _height > 0)
+        max_factor
+            = std::min(static_cast<double>(orig.width) / _width,
+                       static_cast<double>(orig.height) / _height);
+      else if (_width > 0 || _height > 0)
+        max_factor = static_cast<double>(std::max(orig.width, orig.height))
+                     / std::max(_width, _height);
+      int factor = 1;
+      while (factor < 8 && factor * 2 <= max_factor)
+        factor *= 2;
+      return factor;
+    }
+
+    /** decoding flags, factor is the jpeg decoding reduction */
+    int decode_flags(const int &factor = 1) const
+    {
+      if (_unchanged_data)
+        return CV_LOAD_IMAGE_UNCHANGED;
+#if CV_VERSION_MAJOR >= 3
+      if (factor == 2)
+        return _bw ? cv::IMREAD_REDUCED_GRAYSCALE_2
+                   : cv::IMREAD_REDUCED_COLOR_2;
+      if (factor == 4)
+        return _bw ? cv::IMREAD_REDUCED_GRAYSCALE_4
+                   : cv::IMREAD_REDUCED_COLOR_4;
+      if (factor == 8)
+        return _bw ? cv::IMREAD_REDUCED_GRAYSCALE_8
+                   : cv::IMREAD_REDUCED_COLOR_8;
+#else
+      (void)factor;
+#endif
+      return _bw ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
+    }
+
+    /** whether preprocessed images go through the cache */
+    bool use_cache() const
+    {
+#ifdef USE_CUDA_CV
+      if (_cuda)
+        return false;
+#endif
+      return _img_cache && !_keep_orig;
+    }
+
+    /** cache key, from image content and preprocessing parameters */
+    size_t cache_key(const std::string &str) const
+    {
+      std::ostringstream params;
+      params << _width << ' ' << _height << ' ' << _crop_width << ' '
+             << _crop_height << ' ' << _bw << _rgb << _histogram_equalization
+             << _unchanged_data << _scaled << _reduced_decode << ' ' << _scale
+             << ' ' << _scale_min << ' ' << _scale_max << ' ' << _interp;
+      size_t key = std::hash<std::string>{}(str);
+      key ^= std::hash<std::string>{}(params.str()) + 0x9e3779b97f4a7c15ULL
+             + (key << 6) + (key >> 2);
+      return key;
+    }
+
+    // decode image, or fetch it already preprocessed from the cache
+    int decode(const std::string &str,
+               const std::string &img_name = "base64 image")
+    {
+      if (!use_cache())
+        return decode_image(str, img_name);
+
+      size_t key = cache_key(str);
+      ImgCache::Entry entry;
+      if (_img_cache->get(key, entry))
+        {
+          // cached image is never handed out, as callers may modify images
+          // in place
+          _imgs_size.push_back(entry._size);
+          _imgs.push_back(entry._img.clone());
+          return 0;
+        }
+      int ret = decode_image(str, img_name);
+      if (ret == 0)
+        {
+          entry._img = _imgs.back().clone();
+          entry._size = _imgs_size.back();
+          _img_cache->put(key, entry);
+        }
+      return ret;
+    }
+
+    int decode_image(const std::string &str, const std::string &img_name)
     {
+      // jpeg images are decoded in the DCT domain at a reduced resolution
+      // whenever the final resize allows it
+      cv::Size orig_size;
+      int factor = 1;
+#if CV_VERSION_MAJOR >= 3
+      if (jpeg_size(str, orig_size))
+        factor = reduced_decode_factor(orig_size);
+#endif
       std::vector<unsigned char> vdat(str.begin(), str.end());
-      cv::Mat img = cv::Mat(cv::imdecode(
-          cv::Mat(vdat, false),
-          _unchanged_data
-              ? CV_LOAD_IMAGE_UNCHANGED
-              : (_bw ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR)));
-      return add_image(img, "base64 image");
+      cv::Mat img = cv::Mat(
+          cv::imdecode(cv::Mat(vdat, false), decode_flags(factor)));
+      if (factor == 1 || img.empty())
+        return add_image(img, img_name);
+
+      // header size is before exif orientation
+      int w = (orig_size.width + factor - 1) / factor;
+      int h = (orig_size.height + factor - 1) / factor;
+      if (std::abs(img.cols - h) + std::abs(img.rows - w)
+          < std::abs(img.cols - w) + std::abs(img.rows - h))
+        std::swap(orig_size.width, orig_size.height);
+      return add_image(img, img_name, orig_size);
+    }
+
+    // read and decode image file
+    int decode_file(const std::string &fname)
+    {
+      if ((_reduced_decode && !_keep_orig && !_unchanged_data) || use_cache())
+        {
+          std::ifstream in(fname, std::ios::binary);
+          if (in.is_open())
+            {
+              std::string content((std::istreambuf_iterator<char>(in)),
+                                  std::istreambuf_iterator<char>());
+              return decode(content, fname);
+            }
+        }
+      cv::Mat img = cv::imread(fname, decode_flags());
+      return add_image(img, fname);
     }
 
     // deserialize image, independent of format
@@ -397,11 +676,7 @@ namespace dd
     int read_file(const std::string &fname, int test_id)
     {
       (void)test_id;
-      cv::Mat img
-          = cv::imread(fname, _unchanged_data ? CV_LOAD_IMAGE_UNCHANGED
-                                              : (_bw ? CV_LOAD_IMAGE_GRAYSCALE
-                                                     : CV_LOAD_IMAGE_COLOR));
-      return add_image(img, fname);
+      return decode_file(fname);
     }
 
     int read_db(const std::string &fname)
@@ -486,11 +761,7 @@ namespace dd
       _labels.reserve(lfiles.size());
       for (std::pair<std::string, int> &p : lfiles)
         {
-          cv::Mat img = cv::imread(
-              p.first, _unchanged_data ? CV_LOAD_IMAGE_UNCHANGED
-                                       : (_bw ? CV_LOAD_IMAGE_GRAYSCALE
-                                              : CV_LOAD_IMAGE_COLOR));
-          add_image(img, p.first);
+          decode_file(p.first);
           _img_files.push_back(p.first);
           if (p.second >= 0)
             _labels.push_back(p.second);
@@ -535,6 +806,8 @@ namespace dd
     bool _keep_orig = false;
     bool _b64 = false;
     std::string _interp = "cubic";
+    bool _reduced_decode = false; /**< jpeg decoding at reduced resolution */
+    std::shared_ptr<ImgCache> _img_cache; /**< preprocessed images cache */
 #ifdef USE_CUDA_CV
     bool _cuda = false;
     std::vector<cv::cuda::GpuMat> _cuda_imgs;
@@ -559,7 +832,10 @@ namespace dd
           _has_mean_scalar(i._has_mean_scalar), _scale(i._scale),
           _scaled(i._scaled), _scale_min(i._scale_min),
           _scale_max(i._scale_max), _keep_orig(i._keep_orig),
-          _interp(i._interp)
+          _interp(i._interp), _reduced_decode(i._reduced_decode),
+          _img_cache(i._img_cache),
+          _fetch_host_connections(i._fetch_host_connections),
+          _fetch_deadline(i._fetch_deadline), _fetch_cache(i._fetch_cache)
 #ifdef USE_CUDA_CV
           ,
           _cuda(i._cuda)
@@ -572,7 +848,19 @@ namespace dd
 
     void init(const APIData &ad)
     {
-      fillup_parameters(ad);
+      auto params = ad.createSharedDTO<dd::DTO::InputConnector>();
+      fillup_parameters(params);
+
+      // remote images cache, set at service creation only since it writes
+      // into the model repository
+      if (params->fetch_cache_mb && params->fetch_cache_mb > 0
+          && !_model_repo.empty())
+        {
+          size_t max_bytes
+              = static_cast<size_t>(params->fetch_cache_mb) * 1024 * 1024;
+          _fetch_cache = std::make_shared<FetchCache>(
+              _model_repo + "/fetch_cache", max_bytes);
+        }
     }
 
     void fillup_parameters(const APIData &ad)
@@ -673,9 +961,30 @@ namespace dd
       if (params->interp)
         _interp = params->interp;
 
+      // jpeg decoding at reduced resolution
+      if (params->reduced_decode != nullptr)
+        _reduced_decode = params->reduced_decode;
+
+      // preprocessed images cache, shared with the service copies
+      if (params->img_cache_mb)
+        {
+          int cache_mb = std::max(0, static_cast<int>(params->img_cache_mb));
+          size_t max_bytes = static_cast<size_t>(cache_mb) * 1024 * 1024;
+          if (!_img_cache)
+            _img_cache = std::make_shared<ImgCache>(max_bytes);
+          else
+            _img_cache->set_max_bytes(max_bytes);
+        }
+
       // timeout
       this->set_timeout(params);
 
+      // remote images fetching
+      if (params->fetch_host_connections)
+        _fetch_host_connections = params->fetch_host_connections;
+      if (params->fetch_deadline)
+        _fetch_deadline = params->fetch_deadline;
+
 #ifdef USE_CUDA_CV
       // image resizing on GPU
       _cuda |= params->cuda;
@@ -698,6 +1007,8 @@ namespace dd
       dimg._scale_max = _scale_max;
       dimg._keep_orig = _keep_orig;
       dimg._interp = _interp;
+      dimg._reduced_decode = _reduced_decode;
+      dimg._img_cache = _img_cache;
 #ifdef USE_CUDA_CV
       dimg._cuda = _cuda;
       dimg._cuda_stream = _cuda_stream;
@@ -705,6 +1016,12 @@ namespace dd
       dimg._logger = _logger;
     }
 
+    void add_stats(APIData &stats) const
+    {
+      if (_img_cache)
+        _img_cache->to(stats);
+    }
+
     int feature_size() const
     {
       if (_bw || _unchanged_data)
@@ -902,95 +1219,135 @@ namespace dd
       std::vector<std::string> meta_uris;
       std::vector<std::string> index_uris;
       std::vector<std::string> failed_uris;
-#pragma omp parallel for
+
+      // remote images are all fetched at once, over pooled connections
+      std::vector<int> fetched_ids(_uris.size(), -1);
+#ifndef WIN32
+      std::vector<FetchResult> fetched;
+      std::vector<std::string> remote_uris;
       for (size_t i = 0; i < _uris.size(); i++)
+        if (_uris.at(i).rfind("https://", 0) == 0
+            || _uris.at(i).rfind("http://", 0) == 0)
+          {
+            fetched_ids[i] = remote_uris.size();
+            remote_uris.push_back(_uris.at(i));
+          }
+      if (!remote_uris.empty())
         {
-          bool no_img = false;
-          std::string u = _uris.at(i);
-          DataEl<DDImg> dimg(this->_input_timeout);
-          copy_parameters_to(dimg._ctype);
-
+          int deadline = _fetch_deadline;
+          if (deadline == -1)
+            deadline = this->_input_timeout != -1 ? this->_input_timeout
+                                                  : _default_timeout;
           try
             {
-              if (dimg.read_element(u, this->_logger))
-                {
-                  throw InputConnectorBadParamException(
-                      "image could not be read or does not exist: "
-                      + dd_utils::crop_string(u, 200));
-                }
-              if (!dimg._ctype._db_fname.empty())
-                _db_fname = dimg._ctype._db_fname;
+              httpfetcher::instance().fetch(remote_uris, fetched, deadline,
+                                            _fetch_host_connections,
+                                            _fetch_cache.get());
             }
           catch (std::exception &e)
             {
-#pragma omp critical
+              throw InputConnectorBadParamException(e.what());
+            }
+        }
+#endif
+
+      // images are read into per index slots on the shared thread pool, and
+      // gathered in order afterwards
+      std::vector<std::unique_ptr<DataEl<DDImg>>> slots(_uris.size());
+      std::vector<std::string> errors(_uris.size());
+      ThreadPool::instance().parallel_for(_uris.size(), [&](size_t i) {
+        const std::string &u = _uris.at(i);
+        std::unique_ptr<DataEl<DDImg>> dimg(
+            new DataEl<DDImg>(this->_input_timeout));
+        copy_parameters_to(dimg->_ctype);
+        try
+          {
+            int read_failed = 0;
+#ifndef WIN32
+            if (fetched_ids[i] >= 0)
+              read_failed = dimg->read_fetched(fetched.at(fetched_ids[i]),
+                                               this->_logger);
+            else
+#endif
+              read_failed = dimg->read_element(u, this->_logger);
+            if (read_failed)
               {
-                ++catch_read;
-                catch_msg = e.what();
-                failed_uris.push_back(u);
-                no_img = true;
+                throw InputConnectorBadParamException(
+                    "image could not be read or does not exist: "
+                    + dd_utils::crop_string(u, 200));
               }
+            slots[i] = std::move(dimg);
+          }
+        catch (std::exception &e)
+          {
+            errors[i] = e.what();
+          }
+      });
+
+      for (size_t i = 0; i < _uris.size(); i++)
+        {
+          const std::string &u = _uris.at(i);
+          if (!slots[i])
+            {
+              ++catch_read;
+              catch_msg = errors[i];
+              failed_uris.push_back(u);
+              continue;
             }
-          if (no_img)
-            continue;
+          DDImg &dimg = slots[i]->_ctype;
+          if (!dimg._db_fname.empty())
+            _db_fname = dimg._db_fname;
           if (!_db_fname.empty())
             continue;
 
-#pragma omp critical
-          {
 #ifdef USE_CUDA_CV
-            if (_cuda)
-              {
-                _cuda_images.insert(
-                    _cuda_images.end(),
-                    std::make_move_iterator(dimg._ctype._cuda_imgs.begin()),
-                    std::make_move_iterator(dimg._ctype._cuda_imgs.end()));
-                _cuda_orig_images.insert(
-                    _cuda_orig_images.end(),
-                    std::make_move_iterator(
-                        dimg._ctype._cuda_orig_imgs.begin()),
-                    std::make_move_iterator(
-                        dimg._ctype._cuda_orig_imgs.end()));
-              }
-            else
+          if (_cuda)
+            {
+              _cuda_images.insert(
+                  _cuda_images.end(),
+                  std::make_move_iterator(dimg._cuda_imgs.begin()),
+                  std::make_move_iterator(dimg._cuda_imgs.end()));
+              _cuda_orig_images.insert(
+                  _cuda_orig_images.end(),
+                  std::make_move_iterator(dimg._cuda_orig_imgs.begin()),
+                  std::make_move_iterator(dimg._cuda_orig_imgs.end()));
+            }
+          else
 #endif
-              {
-                _images.insert(
-                    _images.end(),
-                    std::make_move_iterator(dimg._ctype._imgs.begin()),
-                    std::make_move_iterator(dimg._ctype._imgs.end()));
-                if (_keep_orig)
-                  _orig_images.insert(
-                      _orig_images.end(),
-                      std::make_move_iterator(dimg._ctype._orig_imgs.begin()),
-                      std::make_move_iterator(dimg._ctype._orig_imgs.end()));
-              }
+            {
+              _images.insert(_images.end(),
+                             std::make_move_iterator(dimg._imgs.begin()),
+                             std::make_move_iterator(dimg._imgs.end()));
+              if (_keep_orig)
+                _orig_images.insert(
+                    _orig_images.end(),
+                    std::make_move_iterator(dimg._orig_imgs.begin()),
+                    std::make_move_iterator(dimg._orig_imgs.end()));
+            }
 
-            _images_size.insert(
-                _images_size.end(),
-                std::make_move_iterator(dimg._ctype._imgs_size.begin()),
-                std::make_move_iterator(dimg._ctype._imgs_size.end()));
-            if (!dimg._ctype._labels.empty())
-              _test_labels.insert(
-                  _test_labels.end(),
-                  std::make_move_iterator(dimg._ctype._labels.begin()),
-                  std::make_move_iterator(dimg._ctype._labels.end()));
-            if (!_ids.empty())
-              uris.push_back(_ids.at(i));
-            else if (!dimg._ctype._b64 && dimg._ctype._imgs.size() == 1)
-              uris.push_back(u);
-            else if (!dimg._ctype._img_files.empty())
-              uris.insert(
-                  uris.end(),
-                  std::make_move_iterator(dimg._ctype._img_files.begin()),
-                  std::make_move_iterator(dimg._ctype._img_files.end()));
-            else
-              uris.push_back(std::to_string(i));
-            if (!_meta_uris.empty())
-              meta_uris.push_back(_meta_uris.at(i));
-            if (!_index_uris.empty())
-              index_uris.push_back(_index_uris.at(i));
-          }
+          _images_size.insert(
+              _images_size.end(),
+              std::make_move_iterator(dimg._imgs_size.begin()),
+              std::make_move_iterator(dimg._imgs_size.end()));
+          if (!dimg._labels.empty())
+            _test_labels.insert(_test_labels.end(),
+                                std::make_move_iterator(dimg._labels.begin()),
+                                std::make_move_iterator(dimg._labels.end()));
+          if (!_ids.empty())
+            uris.push_back(_ids.at(i));
+          else if (!dimg._b64 && dimg._imgs.size() == 1)
+            uris.push_back(u);
+          else if (!dimg._img_files.empty())
+            uris.insert(uris.end(),
+                        std::make_move_iterator(dimg._img_files.begin()),
+                        std::make_move_iterator(dimg._img_files.end()));
+          else
+            uris.push_back(std::to_string(i));
+          if (!_meta_uris.empty())
+            meta_uris.push_back(_meta_uris.at(i));
+          if (!_index_uris.empty())
+            index_uris.push_back(_index_uris.at(i));
+          slots[i].reset();
         }
       if (catch_read)
         {
@@ -1000,8 +1357,8 @@ namespace dd
                                                 + catch_msg);
         }
       _uris = uris;
-      _ids = _uris; // since uris may be in different order than before
-                    // transform
+      _ids = _uris; // since uris may differ from the ones before transform,
+                    // e.g. when reading directories
       _meta_uris = meta_uris;
       _index_uris = index_uris;
       if (!_db_fname.empty())
@@ -1108,6 +1465,15 @@ namespace dd
     int _scale_max = 1000;
     bool _keep_orig = false;
     std::string _interp = "cubic";
+    bool _reduced_decode = false; /**< jpeg decoding at reduced resolution */
+    std::shared_ptr<ImgCache>
+        _img_cache; /**< preprocessed images cache, shared by copies */
+    int _fetch_host_connections
+        = 8; /**< max parallel connections per host for remote images */
+    int _fetch_deadline = -1; /**< deadline for fetching remote images, in
+                                 seconds, -1 means using _input_timeout */
+    std::shared_ptr<FetchCache>
+        _fetch_cache; /**< remote images cache, shared by copies */
 #ifdef USE_CUDA_CV
     bool _cuda = false;
     cv::cuda::Stream *_cuda_stream = &cv::cuda::Stream::Null();
@@ -27,6 +27,7 @@
 #include "dto/service_predict.hpp"
 #ifndef WIN32
 #include "utils/httpclient.hpp"
+#include "utils/httpfetcher.hpp"
 #endif
 #include "dd_spdlog.h"
 #include <exception>
@@ -101,6 +102,23 @@ namespace dd
       return 0;
     }
 
+#ifndef WIN32
+    /**
+     * \brief reads an element already fetched from a remote uri, e.g. by
+     * httpfetcher
+     */
+    int read_fetched(const FetchResult &fetched,
+                     std::shared_ptr<spdlog::logger> &logger)
+    {
+      _ctype._logger = logger;
+      if (!fetched._error.empty())
+        throw std::runtime_error(fetched._error);
+      if (fetched._code != 200)
+        return -1;
+      return _ctype.read_mem(fetched._content);
+    }
+#endif
+
     std::string _content;
     int _timeout = 600; // 10 mins is default
     DDT _ctype;
@@ -194,6 +212,15 @@ namespace dd
      */
     int test_batch_size() const;
 
+    /**
+     * \brief adds connector statistics, if any, to the service stats
+     * @param stats service stats object
+     */
+    void add_stats(APIData &stats) const
+    {
+      (void)stats;
+    }
+
     /**
      * \brief try to acquire the input data from the main 'data' field
      *        that is mandatory for /train and /predict calls
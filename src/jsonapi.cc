@@ -1029,8 +1029,29 @@ namespace dd
     return dd_not_found_404();
   }
 
+  /**
+   * \brief adds a response body left as a DTO to the response
+   */
+  static void add_body(JDoc &jd, const oatpp::Void &body)
+  {
+    if (body == nullptr)
+      return;
+    JVal jbody(rapidjson::kObjectType);
+    oatpp_utils::dtoToJVal(body, jd, jbody);
+    jd.AddMember("body", jbody, jd.GetAllocator());
+  }
+
   JDoc JsonAPI::service_predict(const std::string &jstr)
   {
+    oatpp::Void body;
+    JDoc jpred = service_predict(jstr, body);
+    add_body(jpred, body);
+    return jpred;
+  }
+
+  JDoc JsonAPI::service_predict(const std::string &jstr, oatpp::Void &body)
+  {
+    body = nullptr;
     rapidjson::Document d;
     d.Parse<rapidjson::kParseNanAndInfFlag>(jstr.c_str());
     if (d.HasParseError())
@@ -1114,8 +1135,6 @@ namespace dd
         return dd_internal_mllib_error_1007(e.what());
       }
     JDoc jpred = dd_ok_200();
-    JVal jout(rapidjson::kObjectType);
-    oatpp_utils::dtoToJVal(pred_dto, jpred, jout);
     bool has_measure
         = ad_data.getobj("parameters").getobj("output").has("measure");
     JVal jhead(rapidjson::kObjectType);
@@ -1123,21 +1142,21 @@ namespace dd
     rapidjson::Value service;
     service.SetString(sname.c_str(), jpred.GetAllocator());
     jhead.AddMember("service", service, jpred.GetAllocator());
-    if (!has_measure)
-      jhead.AddMember("time", jout["time"], jpred.GetAllocator());
+    if (!has_measure && pred_dto->time != nullptr)
+      jhead.AddMember("time", JVal(static_cast<double>(pred_dto->time)),
+                      jpred.GetAllocator());
     jpred.AddMember("head", jhead, jpred.GetAllocator());
     if (has_measure)
       {
-        jpred.AddMember("body", jout, jpred.GetAllocator());
+        body = pred_dto;
         return jpred;
       }
-    JVal jbody(rapidjson::kObjectType);
-    if (jout.HasMember("predictions"))
-      jbody.AddMember("predictions", jout["predictions"],
-                      jpred.GetAllocator());
-    if (jout.HasMember("resources"))
-      jbody.AddMember("resources", jout["resources"], jpred.GetAllocator());
-    jpred.AddMember("body", jbody, jpred.GetAllocator());
+    // time is in the head
+    auto pred_body = DTO::PredictBody::createShared();
+    pred_body->predictions = pred_dto->predictions;
+    pred_body->resources = pred_dto->resources;
+    body = pred_body;
+    bool whole = false;
     if (ad_data.getobj("parameters").getobj("output").has("template")
         && ad_data.getobj("parameters")
                    .getobj("output")
@@ -1145,6 +1164,8 @@ namespace dd
                    .get<std::string>()
                != "")
       {
+        whole = true;
+        add_body(jpred, body);
         APIData ad_params = ad_data.getobj("parameters");
         APIData ad_output = ad_params.getobj("output");
         jpred.AddMember(
@@ -1156,6 +1177,9 @@ namespace dd
       }
     if (ad_data.getobj("parameters").getobj("output").has("network"))
       {
+        if (!whole)
+          add_body(jpred, body);
+        whole = true;
         APIData ad_params = ad_data.getobj("parameters");
         APIData ad_output = ad_params.getobj("output");
         APIData ad_net = ad_output.getobj("network");
@@ -1163,6 +1187,8 @@ namespace dd
         ad_net.toJVal(jpred, jnet);
         jpred.AddMember("network", jnet, jpred.GetAllocator());
       }
+    if (whole)
+      body = nullptr;
     return jpred;
   }
 
@@ -1464,6 +1490,16 @@ namespace dd
   JDoc JsonAPI::service_chain(const std::string &cnamein,
                               const std::string &jstr)
   {
+    oatpp::Void body;
+    JDoc jpred = service_chain(cnamein, jstr, body);
+    add_body(jpred, body);
+    return jpred;
+  }
+
+  JDoc JsonAPI::service_chain(const std::string &cnamein,
+                              const std::string &jstr, oatpp::Void &body)
+  {
+    body = nullptr;
     std::string cname(cnamein);
     std::transform(cnamein.begin(), cnamein.end(), cname.begin(), ::tolower);
 
@@ -1541,17 +1577,16 @@ namespace dd
       }
 
     JDoc jpred = dd_ok_200();
-    JVal jout(rapidjson::kObjectType);
-    oatpp_utils::dtoToJVal(chain_body, jpred, jout);
     JVal jhead(rapidjson::kObjectType);
     jhead.AddMember("method", "/chain", jpred.GetAllocator());
-    jhead.AddMember("time", jout["time"], jpred.GetAllocator());
-    jpred.AddMember("head", jhead, jpred.GetAllocator());
-    JVal jbody(rapidjson::kObjectType);
-    if (jout.HasMember("predictions"))
-      jbody.AddMember("predictions", jout["predictions"],
+    if (chain_body->time != nullptr)
+      jhead.AddMember("time", JVal(static_cast<double>(chain_body->time)),
                       jpred.GetAllocator());
-    jpred.AddMember("body", jbody, jpred.GetAllocator());
+    jpred.AddMember("head", jhead, jpred.GetAllocator());
+    // time is in the head
+    auto out_body = DTO::ChainBody::createShared();
+    out_body->predictions = chain_body->predictions;
+    body = out_body;
     return jpred;
   }
 
@@ -101,12 +101,28 @@ namespace dd
     JDoc service_delete(const std::string &sname, const std::string &jstr);
     JDoc service_predict(const std::string &jstr);
 
+    /**
+     * \brief predict call with the response body left as a DTO, e.g. to be
+     * rendered while it is sent
+     * @param body set to the response body on success, in which case it is
+     * not in the returned document. Outputs with a template or a network
+     * call are returned whole
+     */
+    JDoc service_predict(const std::string &jstr, oatpp::Void &body);
+
     JDoc service_train(const std::string &jstr);
     JDoc service_train_status(const std::string &jstr);
     JDoc service_train_delete(const std::string &jstr);
 
     JDoc service_chain(const std::string &cname, const std::string &jstr);
 
+    /**
+     * \brief chain call with the response body left as a DTO, see
+     * service_predict
+     */
+    JDoc service_chain(const std::string &cname, const std::string &jstr,
+                       oatpp::Void &body);
+
     static int store_json_blob(const std::string &model_repo,
                                const std::string &jstr,
                                const std::string &jfilename = "");
@@ -0,0 +1,643 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEASUREACCUMULATOR_H
+#define MEASUREACCUMULATOR_H
+
+#include "apidata.h"
+#include "outputconnectorstrategy.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dd
+{
+  /**
+   * \brief detection results of a single image for a single class, at a
+   * given iou threshold
+   */
+  struct DetectionStats
+  {
+    int _label = 0;
+    std::vector<std::pair<double, int>> _tp; /**< scores, 1 if true pos */
+    std::vector<std::pair<double, int>> _fp; /**< scores, 1 if false pos */
+    int _num_pos = 0;                        /**< number of ground truths */
+
+    DetectionStats()
+    {
+    }
+
+    /**
+     * \brief reads stats in the per sample measure format
+     */
+    DetectionStats(const APIData &ad)
+    {
+      std::vector<double> tp_d = ad.get("tp_d").get<std::vector<double>>();
+      std::vector<int> tp_i = ad.get("tp_i").get<std::vector<int>>();
+      std::vector<double> fp_d = ad.get("fp_d").get<std::vector<double>>();
+      std::vector<int> fp_i = ad.get("fp_i").get<std::vector<int>>();
+      for (size_t k = 0; k < tp_d.size(); ++k)
+        _tp.emplace_back(tp_d.at(k), tp_i.at(k));
+      for (size_t k = 0; k < fp_d.size(); ++k)
+        _fp.emplace_back(fp_d.at(k), fp_i.at(k));
+      _num_pos = ad.get("num_pos").get<int>();
+      _label = ad.get("label").get<int>();
+    }
+
+    /**
+     * \brief stats in the per sample measure format
+     */
+    APIData to_apidata() const
+    {
+      std::vector<double> tp_d, fp_d;
+      std::vector<int> tp_i, fp_i;
+      for (auto &tp : _tp)
+        {
+          tp_d.push_back(tp.first);
+          tp_i.push_back(tp.second);
+        }
+      for (auto &fp : _fp)
+        {
+          fp_d.push_back(fp.first);
+          fp_i.push_back(fp.second);
+        }
+      APIData ad;
+      ad.add("tp_d", tp_d);
+      ad.add("tp_i", tp_i);
+      ad.add("fp_d", fp_d);
+      ad.add("fp_i", fp_i);
+      ad.add("num_pos", _num_pos);
+      ad.add("label", _label);
+      return ad;
+    }
+  };
+
+  /**
+   * \brief dataset level detection results of a single class at a given
+   * iou threshold, as true and false positive counts per score bin
+   * Memory does not depend on the number of detections, scores being
+   * rounded to the bin width.
+   */
+  struct ScoreHistogram
+  {
+    static int nbins()
+    {
+      return 1000;
+    }
+
+    std::vector<uint32_t> _tp = std::vector<uint32_t>(nbins(), 0);
+    std::vector<uint32_t> _fp = std::vector<uint32_t>(nbins(), 0);
+    long _num_pos = 0; /**< number of ground truths */
+
+    void add(const DetectionStats &s)
+    {
+      for (const std::pair<double, int> &d : s._tp)
+        {
+          int bin = std::min(nbins() - 1,
+                             std::max(0, static_cast<int>(d.first * nbins())));
+          if (d.second)
+            ++_tp[bin];
+          else
+            ++_fp[bin];
+        }
+      _num_pos += s._num_pos;
+    }
+
+    /**
+     * \brief COCO style AP, with precision interpolated at 101 recall
+     * points
+     */
+    double ap() const
+    {
+      if (_num_pos == 0)
+        return 0.0;
+      std::vector<double> prec, rec;
+      long tp = 0, fp = 0;
+      for (int b = nbins() - 1; b >= 0; --b)
+        {
+          if (_tp[b] == 0 && _fp[b] == 0)
+            continue;
+          tp += _tp[b];
+          fp += _fp[b];
+          prec.push_back(static_cast<double>(tp) / (tp + fp));
+          rec.push_back(static_cast<double>(tp) / _num_pos);
+        }
+      for (size_t i = prec.size(); i > 1; --i)
+        prec[i - 2] = std::max(prec[i - 2], prec[i - 1]);
+      double sum = 0.0;
+      size_t i = 0;
+      for (int r = 0; r <= 100; ++r)
+        {
+          while (i < rec.size() && rec[i] < r / 100.0)
+            ++i;
+          if (i == rec.size())
+            break;
+          sum += prec[i];
+        }
+      return sum / 101.0;
+    }
+  };
+
+  /**
+   * \brief typed accumulators of test results, updated sample after sample,
+   * from which supervised measures are computed at the end of a test
+   * Memory does not depend on the number of samples, except for auc and
+   * gini that require all predictions.
+   */
+  class MeasureAccumulator
+  {
+  public:
+    enum Task
+    {
+      CLASSIFICATION,
+      REGRESSION,
+      SEGMENTATION,
+      DETECTION
+    };
+
+    MeasureAccumulator()
+    {
+    }
+
+    /**
+     * \brief sets up the accumulators for the requested measures
+     * @param measures requested measures
+     * @param nclasses number of classes, or of regression targets
+     */
+    MeasureAccumulator(const std::vector<std::string> &measures,
+                       const int &nclasses, const Task &task)
+        : _measures(measures), _nclasses(nclasses), _task(task)
+    {
+      for (const std::string &m : measures)
+        {
+          std::vector<std::string> sv = dd_utils::split(m, '-');
+          const std::string &name = sv.empty() ? m : sv.at(0);
+          if (_task == CLASSIFICATION)
+            {
+              if (name == "acc")
+                _topk.push_back(sv.size() == 2 ? std::atoi(sv.at(1).c_str())
+                                               : 1);
+              else if (m == "f1" || m == "f1full" || m == "cmdiag"
+                       || m == "cmfull" || m == "mcc")
+                _conf = true;
+              else if (m == "mcll")
+                _mcll = true;
+              else if (m == "auc")
+                _auc = true;
+              else if (m == "gini")
+                _gini = true;
+              else
+                _supported = false;
+            }
+          else if (_task == REGRESSION)
+            {
+              if (name == "eucll")
+                {
+                  _eucll = true;
+                  if (sv.size() == 2)
+                    _eucll_thres = std::atof(sv.at(1).c_str());
+                }
+              else if (m == "l1")
+                _l1 = true;
+              else if (m == "percent")
+                _percent = true;
+              else if (m == "gini")
+                _gini = true;
+              else
+                _supported = false;
+            }
+          else if (_task == SEGMENTATION)
+            {
+              if (m == "acc")
+                _accv = true;
+              else
+                _supported = false;
+            }
+          else if (m == "map-coco")
+            _coco = true;
+          else if (name != "map")
+            _supported = false;
+        }
+      _topk_hits.resize(_topk.size(), 0.0);
+      if (_conf)
+        _conf_matrix = dMat::Zero(nclasses, nclasses);
+      if (_task == SEGMENTATION)
+        {
+          _class_acc.resize(nclasses, 0.0);
+          _class_acc_count.resize(nclasses, 0.0);
+          _class_iou.resize(nclasses, 0.0);
+          _class_iou_count.resize(nclasses, 0.0);
+        }
+    }
+
+    /**
+     * \brief whether all requested measures can be accumulated, per sample
+     * results being required otherwise
+     */
+    bool supported() const
+    {
+      return _supported;
+    }
+
+    /**
+     * @param probs class probabilities
+     */
+    template <typename T>
+    void add_classification(const T *probs, const double &target)
+    {
+      ++_count;
+      int t = static_cast<int>(target);
+      if (!_topk.empty() || _mcll)
+        {
+          // rank of the target among predictions, ties going to the lowest
+          // class id, as with the best class of acc
+          int rank = 0;
+          for (int c = 0; c < _nclasses; ++c)
+            if (t >= 0 && t < _nclasses
+                && (probs[c] > probs[t] || (probs[c] == probs[t] && c < t)))
+              ++rank;
+          for (size_t k = 0; k < _topk.size(); ++k)
+            if (t >= 0 && t < _nclasses && rank < _topk[k]
+                && _topk[k] <= _nclasses)
+              ++_topk_hits[k];
+          if (_mcll)
+            {
+              if (t < 0 || t >= _nclasses)
+                throw OutputConnectorBadParamException(
+                    "target class has id " + std::to_string(target)
+                    + " out of the number of classes");
+              _log_loss -= std::log(probs[t]);
+            }
+        }
+      int maxpr
+          = std::distance(probs, std::max_element(probs, probs + _nclasses));
+      if (_conf)
+        {
+          if (target < 0)
+            throw OutputConnectorBadParamException(
+                "negative supervised discrete target (e.g. wrong use of "
+                "label_offset ?");
+          else if (target >= _nclasses)
+            throw OutputConnectorBadParamException(
+                "target class has id " + std::to_string(target)
+                + " is higher than the number of classes "
+                + std::to_string(_nclasses)
+                + " (e.g. wrong number of classes specified with nclasses");
+          _conf_matrix(maxpr, t) += 1.0;
+        }
+      if (_auc)
+        {
+          _auc_preds.push_back(probs[1]);
+          _auc_targets.push_back(target);
+        }
+      if (_gini)
+        {
+          _gini_targets.push_back(maxpr);
+          _gini_preds.push_back(0.0);
+        }
+    }
+
+    /**
+     * @param dim number of regression targets
+     */
+    template <typename T>
+    void add_regression(const T *preds, const T *targets, const int &dim)
+    {
+      ++_count;
+      if (_all_eucl.empty())
+        {
+          _all_eucl.resize(dim, 0.0);
+          _all_eucl_thres.resize(dim, 0.0);
+          _all_l1.resize(dim, 0.0);
+          _all_percent.resize(dim, 0.0);
+        }
+      double leucl = 0.0;
+      double leucl_thres = 0.0;
+      for (int j = 0; j < dim; ++j)
+        {
+          double diff = std::fabs(preds[j] - targets[j]);
+          leucl += diff * diff;
+          _all_eucl[j] += diff * diff;
+          if (diff >= _eucll_thres)
+            {
+              leucl_thres += diff * diff;
+              _all_eucl_thres[j] += diff * diff;
+            }
+          _l1_sum += diff / dim;
+          _all_l1[j] += diff;
+          double reldiff = diff / (std::fabs(targets[j]) + 1E-9);
+          _percent_sum += reldiff / dim;
+          _all_percent[j] += reldiff;
+        }
+      _eucl_sum += std::sqrt(leucl) / dim;
+      _eucl_thres_sum += std::sqrt(leucl_thres) / dim;
+      for (int j = 0; j < dim; ++j)
+        {
+          _all_eucl[j] = std::sqrt(_all_eucl[j]);
+          _all_eucl_thres[j] = std::sqrt(_all_eucl_thres[j]);
+        }
+      if (_gini)
+        {
+          _gini_targets.push_back(targets[0]);
+          _gini_preds.push_back(preds[0]);
+        }
+    }
+
+    /**
+     * @param preds predicted class of every pixel
+     * @param targets target class of every pixel
+     */
+    template <typename T>
+    void add_segmentation(const T *preds, const T *targets, const size_t &n)
+    {
+      ++_count;
+      std::vector<double> tp(_nclasses, 0.0);
+      std::vector<double> npred(_nclasses, 0.0);
+      std::vector<double> ntarg(_nclasses, 0.0);
+      double correct = 0.0;
+      for (size_t i = 0; i < n; ++i)
+        {
+          if (preds[i] == targets[i])
+            ++correct;
+          int p = static_cast<int>(preds[i]);
+          int t = static_cast<int>(targets[i]);
+          bool pc = preds[i] == p && p >= 0 && p < _nclasses;
+          bool tc = targets[i] == t && t >= 0 && t < _nclasses;
+          if (pc)
+            ++npred[p];
+          if (tc)
+            ++ntarg[t];
+          if (pc && tc && p == t)
+            ++tp[p];
+        }
+      _acc_sum += correct / static_cast<double>(n);
+      for (int c = 0; c < _nclasses; ++c)
+        {
+          if (ntarg[c] != 0)
+            {
+              _class_acc[c] += tp[c] / ntarg[c];
+              _class_acc_count[c]++;
+              _class_iou_count[c]++;
+            }
+          double fn = ntarg[c] - tp[c];
+          double fp = npred[c] - tp[c];
+          // nothing to predict and nothing predicted counts as zero
+          _class_iou[c] += (tp[c] == 0) ? 0 : tp[c] / (fp + tp[c] + fn);
+        }
+    }
+
+    /**
+     * \brief adds the results of a single image
+     * @param iou_thres iou threshold in percent
+     * @param stats one entry per class
+     */
+    void add_detection(const int &iou_thres,
+                       const std::vector<DetectionStats> &stats)
+    {
+      APSums &sums = _aps[iou_thres];
+      for (const DetectionStats &s : stats)
+        {
+          if (s._tp.size() > 0 || s._fp.size() > 0 || s._num_pos > 0)
+            {
+              double local_ap = compute_ap(s._tp, s._fp, s._num_pos);
+              sums._label_ap[s._label] += local_ap;
+              sums._label_count[s._label] += 1;
+              sums._sum += local_ap;
+              sums._count += 1;
+            }
+          else if (sums._label_ap.find(s._label) == sums._label_ap.end())
+            {
+              sums._label_ap[s._label] = 0.0;
+              sums._label_count[s._label] = 0;
+            }
+        }
+      if (_coco && is_coco_threshold(iou_thres))
+        {
+          std::map<int, ScoreHistogram> &hists = _coco_hists[iou_thres];
+          for (const DetectionStats &s : stats)
+            if (s._tp.size() > 0 || s._num_pos > 0)
+              hists[s._label].add(s);
+        }
+      ++_count;
+    }
+
+    /**
+     * \brief moves in the detection results of another accumulator, filled
+     * at other iou thresholds, e.g. by another thread
+     */
+    void merge_detections(MeasureAccumulator &other)
+    {
+      for (auto &ap : other._aps)
+        _aps[ap.first] = std::move(ap.second);
+      for (auto &hists : other._coco_hists)
+        _coco_hists[hists.first] = std::move(hists.second);
+      _count += other._count;
+      other._aps.clear();
+      other._coco_hists.clear();
+      other._count = 0;
+    }
+
+    /**
+     * \brief iou thresholds of COCO style map, in percent, 50 to 95
+     */
+    static std::vector<int> coco_thresholds()
+    {
+      std::vector<int> thresholds;
+      for (int t = 50; t <= 95; t += 5)
+        thresholds.push_back(t);
+      return thresholds;
+    }
+
+    static bool is_coco_threshold(const int &iou_thres)
+    {
+      return iou_thres >= 50 && iou_thres <= 95 && iou_thres % 5 == 0;
+    }
+
+    /**
+     * \brief dataset level COCO style map at an iou threshold, over the
+     * classes with ground truths
+     */
+    double coco_map(const int &iou_thres) const
+    {
+      auto hit = _coco_hists.find(iou_thres);
+      if (hit == _coco_hists.end())
+        return 0.0;
+      double sum = 0.0;
+      int count = 0;
+      for (auto &h : (*hit).second)
+        if (h.second._num_pos > 0)
+          {
+            sum += h.second.ap();
+            ++count;
+          }
+      return count == 0 ? 0.0 : sum / count;
+    }
+
+    /**
+     * \brief COCO style map, averaged over iou thresholds 50 to 95
+     */
+    double coco_map() const
+    {
+      std::vector<int> thresholds = coco_thresholds();
+      double sum = 0.0;
+      for (int t : thresholds)
+        sum += coco_map(t);
+      return sum / thresholds.size();
+    }
+
+    /**
+     * \brief mean AP over images, and per class
+     * @param APs mean AP of every class
+     */
+    double map(const int &iou_thres, std::map<int, float> &APs) const
+    {
+      auto ait = _aps.find(iou_thres);
+      if (ait == _aps.end())
+        return 0.0;
+      const APSums &sums = (*ait).second;
+      for (auto &lap : sums._label_ap)
+        {
+          int count = sums._label_count.at(lap.first);
+          APs[lap.first] = count == 0 ? 0.0 : lap.second / count;
+        }
+      if (sums._count == 0)
+        return 0.0;
+      return sums._sum / static_cast<double>(sums._count);
+    }
+
+    static void cumsum_pair(const std::vector<std::pair<double, int>> &pairs,
+                            std::vector<int> &cumsum)
+    {
+      // Sort the pairs based on first item of the pair.
+      std::vector<std::pair<double, int>> sort_pairs = pairs;
+      std::stable_sort(sort_pairs.begin(), sort_pairs.end(),
+                       [](const std::pair<double, int> &p1,
+                          const std::pair<double, int> &p2) {
+                         return p1.first > p2.first;
+                       });
+      for (size_t i = 0; i < sort_pairs.size(); ++i)
+        {
+          if (i == 0)
+            cumsum.push_back(sort_pairs[i].second);
+          else
+            cumsum.push_back(cumsum.back() + sort_pairs[i].second);
+        }
+    }
+
+    static double compute_ap(const std::vector<std::pair<double, int>> &tp,
+                             const std::vector<std::pair<double, int>> &fp,
+                             const int &num_pos)
+    {
+      const double eps = 1e-6;
+      const int num = tp.size();
+      if (num == 0 || num_pos == 0)
+        return 0.0;
+      double ap = 0.0;
+      std::vector<int> tp_cumsum;
+      std::vector<int> fp_cumsum;
+      cumsum_pair(tp, tp_cumsum); // tp cumsum
+      cumsum_pair(fp, fp_cumsum); // fp cumsum
+      std::vector<double> prec;   // precision
+      for (int i = 0; i < num; i++)
+        prec.push_back(static_cast<double>(tp_cumsum[i])
+                       / (tp_cumsum[i] + fp_cumsum[i]));
+      std::vector<double> rec; // recall
+      for (int i = 0; i < num; i++)
+        rec.push_back(static_cast<double>(tp_cumsum[i]) / num_pos);
+
+      // voc12, ilsvrc style ap
+      float cur_rec = rec.back();
+      float cur_prec = prec.back();
+      for (int i = num - 2; i >= 0; --i)
+        {
+          cur_prec = std::max<float>(prec[i], cur_prec);
+          if (fabs(cur_rec - rec[i]) > eps)
+            {
+              ap += cur_prec * fabs(cur_rec - rec[i]);
+            }
+          cur_rec = rec[i];
+        }
+      ap += cur_rec * cur_prec;
+      return ap;
+    }
+
+    struct APSums
+    {
+      std::map<int, double> _label_ap;  /**< sum of per image AP */
+      std::map<int, int> _label_count;  /**< number of images with the class */
+      double _sum = 0.0;
+      int _count = 0;
+    };
+
+    std::vector<std::string> _measures; /**< requested measures */
+    int _nclasses = 0;
+    Task _task = CLASSIFICATION;
+    bool _supported = true;
+    size_t _count = 0; /**< number of samples */
+
+    // classification
+    std::vector<int> _topk;         /**< requested acc-k */
+    std::vector<double> _topk_hits; /**< hits for every k */
+    bool _conf = false;
+    dMat _conf_matrix; /**< predicted class x target class counts */
+    bool _mcll = false;
+    double _log_loss = 0.0;
+    bool _auc = false;
+    std::vector<double> _auc_preds;
+    std::vector<double> _auc_targets;
+    bool _gini = false;
+    std::vector<double> _gini_targets;
+    std::vector<double> _gini_preds;
+
+    // regression
+    bool _eucll = false;
+    float _eucll_thres = 0.0;
+    bool _l1 = false;
+    bool _percent = false;
+    double _eucl_sum = 0.0;
+    double _eucl_thres_sum = 0.0;
+    double _l1_sum = 0.0;
+    double _percent_sum = 0.0;
+    std::vector<double> _all_eucl;
+    std::vector<double> _all_eucl_thres;
+    std::vector<double> _all_l1;
+    std::vector<double> _all_percent;
+
+    // segmentation
+    bool _accv = false;
+    double _acc_sum = 0.0;
+    std::vector<double> _class_acc;
+    std::vector<double> _class_acc_count;
+    std::vector<double> _class_iou;
+    std::vector<double> _class_iou_count;
+
+    // detection, by iou threshold
+    std::map<int, APSums> _aps;
+    bool _coco = false;
+    std::map<int, std::map<int, ScoreHistogram>>
+        _coco_hists; /**< by iou threshold, then by class */
+  };
+}
+
+#endif
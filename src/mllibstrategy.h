@@ -76,6 +76,17 @@ namespace dd
     std::string _s;
   };
 
+  /**
+   * \brief predict latency and memory measured at one batch size
+   */
+  struct BatchProfilePoint
+  {
+    int _batch_size = 0;      /**< calibrated batch size */
+    double _latency_ms = 0.0; /**< forward pass duration */
+    double _peak_memory_mb
+        = 0.0; /**< peak memory of the forward pass, on top of the model */
+  };
+
   /**
    * \brief main class for machine learning library encapsulation
    */
@@ -101,7 +112,9 @@ namespace dd
           _tjob_running(mll._tjob_running.load()), _logger(mll._logger),
           _model_flops(mll._model_flops), _model_params(mll._model_params),
           _mem_used_train(mll._mem_used_train),
-          _mem_used_test(mll._mem_used_test)
+          _mem_used_test(mll._mem_used_test),
+          _predict_batch_size(mll._predict_batch_size),
+          _batch_profile(mll._batch_profile)
     {
     }
 
@@ -413,6 +426,10 @@ namespace dd
         = 0; /**< number of frozen parameters in the model. */
     long int _mem_used_train = 0; /**< amount  of memory used. */
     long int _mem_used_test = 0;  /**< amount  of memory used. */
+    int _predict_batch_size
+        = 0; /**< calibrated predict batch size, 0 if not calibrated. */
+    std::vector<BatchProfilePoint>
+        _batch_profile; /**< predict batch size calibration measures. */
 
   protected:
     mutable std::mutex
@@ -237,6 +237,23 @@ namespace dd
       if (this->_mem_used_test != 0)
         serv_dto->model_stats->data_mem_test
             = static_cast<int64_t>(this->_mem_used_test * sizeof(float));
+      if (this->_predict_batch_size != 0)
+        {
+          serv_dto->model_stats->predict_batch_size
+              = this->_predict_batch_size;
+          serv_dto->model_stats->batch_profile = oatpp::Vector<
+              oatpp::Object<DTO::BatchProfile>>::createShared();
+          for (const BatchProfilePoint &point : this->_batch_profile)
+            {
+              auto profile_dto = DTO::BatchProfile::createShared();
+              profile_dto->batch_size = point._batch_size;
+              profile_dto->latency_ms = point._latency_ms;
+              profile_dto->throughput
+                  = 1000.0 * point._batch_size / point._latency_ms;
+              profile_dto->peak_memory_mb = point._peak_memory_mb;
+              serv_dto->model_stats->batch_profile->push_back(profile_dto);
+            }
+        }
       // for legacy
       serv_dto->stats = serv_dto->model_stats;
 
@@ -295,6 +312,7 @@ namespace dd
 
       // stats
       this->_stats.to(serv_dto);
+      this->_inputc.add_stats(*serv_dto->service_stats);
       return serv_dto;
     }
 
@@ -28,10 +28,12 @@
 #include "http/app_component.hpp"
 #include "http/controller.hpp"
 #include "http/access_log.hpp"
+#include "utils/dtostream.hpp"
 
 #include "oatpp/network/Server.hpp"
 #include "oatpp/web/protocol/http/Http.hpp"
 #include "oatpp/web/protocol/http/outgoing/ResponseFactory.hpp"
+#include "oatpp/web/protocol/http/outgoing/StreamingBody.hpp"
 #include "oatpp/web/server/HttpConnectionHandler.hpp"
 #include "oatpp/web/server/HttpRouter.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
@@ -173,8 +175,65 @@ namespace dd
     return buffer.GetString();
   }
 
-  std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
-  OatppJsonAPI::jdoc_to_response(const JDoc &janswer) const
+  /**
+   * \brief reads a response rendered in chunks from its body DTO, for
+   * streamed responses
+   */
+  class DTOReadCallback : public oatpp::data::stream::ReadCallback
+  {
+  public:
+    DTOReadCallback(JDoc &&janswer, const oatpp::Void &body,
+                    const ValueStream::Format &format,
+                    const std::shared_ptr<spdlog::logger> &logger)
+        : _janswer(std::move(janswer)), _body(body),
+          _stream(_janswer, "body", _body, format), _logger(logger)
+    {
+    }
+
+    /**
+     * \brief renders the first chunk, before the response headers are sent
+     * @throw DataConversionException if it can't be rendered
+     */
+    void render_first_chunk()
+    {
+      _first.resize(1 << 16);
+      _first.resize(_stream.read(&_first[0], _first.size()));
+    }
+
+    oatpp::v_io_size read(void *buffer, oatpp::v_buff_size count,
+                          oatpp::async::Action &action) override
+    {
+      (void)action;
+      if (_first_pos < _first.size())
+        {
+          size_t n = std::min(static_cast<size_t>(count),
+                              _first.size() - _first_pos);
+          memcpy(buffer, _first.data() + _first_pos, n);
+          _first_pos += n;
+          return n;
+        }
+      try
+        {
+          return _stream.read(static_cast<char *>(buffer), count);
+        }
+      catch (std::exception &e)
+        {
+          // headers are sent, the response can only be cut short
+          _logger->error("failed rendering response: {}", e.what());
+          return oatpp::IOError::BROKEN_PIPE;
+        }
+    }
+
+  private:
+    JDoc _janswer;
+    oatpp::Void _body;
+    oatpp_utils::DTOStream _stream;
+    std::shared_ptr<spdlog::logger> _logger;
+    std::string _first; /**< first chunk, rendered ahead */
+    size_t _first_pos = 0;
+  };
+
+  void OatppJsonAPI::set_access_log_service(const JDoc &janswer) const
   {
     // NOTE(sileht): Maybe not the best place to do this, but we need DTO in
     // all calls before doing it otherwise
@@ -184,6 +243,12 @@ namespace dd
         if (!service.empty())
           dd::http::setAccessLogServiceName(service);
       }
+  }
+
+  std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+  OatppJsonAPI::jdoc_to_response(const JDoc &janswer) const
+  {
+    set_access_log_service(janswer);
 
     int outcode = janswer["status"]["code"].GetInt();
     std::string stranswer;
@@ -245,6 +310,42 @@ namespace dd
     return response;
   }
 
+  std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+  OatppJsonAPI::dto_to_stream_response(JDoc &&janswer, const oatpp::Void &body,
+                                       const oatpp::String &accept) const
+  {
+    // errors, templates and network calls come rendered whole
+    if (body == nullptr)
+      return jdoc_to_response(janswer);
+    set_access_log_service(janswer);
+
+    int outcode = janswer["status"]["code"].GetInt();
+    ValueStream::Format format = accept == nullptr
+                                     ? ValueStream::JSON
+                                     : ValueStream::accept_format(accept);
+    auto callback = std::make_shared<DTOReadCallback>(std::move(janswer),
+                                                      body, format, _logger);
+    // rendering errors of the first chunk, i.e. of most responses, are
+    // reported before anything is sent, as other failures
+    try
+      {
+        callback->render_first_chunk();
+      }
+    catch (std::exception &e)
+      {
+        _logger->error("failed rendering response: {}", e.what());
+        return jdoc_to_response(dd_internal_error_500(e.what()));
+      }
+    auto streaming_body = std::make_shared<
+        oatpp::web::protocol::http::outgoing::StreamingBody>(callback);
+    auto response = Response::createShared(
+        oatpp::web::protocol::http::Status(outcode, ""), streaming_body);
+    response->putHeader(oatpp::web::protocol::http::Header::CONTENT_TYPE,
+                        format == ValueStream::CBOR ? "application/cbor"
+                                                    : "application/json");
+    return response;
+  }
+
   oatpp::Object<DTO::Status>
   OatppJsonAPI::create_status_dto(const uint32_t &code, const std::string &msg,
                                   const uint32_t &dd_code,
@@ -48,6 +48,18 @@ namespace dd
     uri_query_to_json(oatpp::web::protocol::http::QueryParams queryParams);
     Response_ptr jdoc_to_response(const JDoc &janswer) const;
 
+    /**
+     * \brief response rendered from its body DTO while it is sent, with
+     * chunked transfer encoding, as JSON or as CBOR if preferred by the
+     * client
+     * @param janswer response without its body, rendered whole if body is
+     * null
+     * @param accept value of the request Accept header, if any
+     */
+    Response_ptr dto_to_stream_response(JDoc &&janswer,
+                                        const oatpp::Void &body,
+                                        const oatpp::String &accept) const;
+
     oatpp::Object<DTO::Status>
     create_status_dto(const uint32_t &code, const std::string &msg,
                       const uint32_t &dd_code = 0,
@@ -69,6 +81,9 @@ namespace dd
 
     // dede error responses
     Response_ptr response_resource_already_exists_1015() const;
+
+  private:
+    void set_access_log_service(const JDoc &janswer) const;
   };
 }
 
@@ -25,9 +25,13 @@
 
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <unordered_set>
 
 #include "dto/output_connector.hpp"
 #include "dto/predict_out.hpp"
+#include "measureaccumulator.h"
+#include "utils/threadpool.hpp"
 
 template <typename T>
 bool SortScorePairDescend(const std::pair<double, T> &pair1,
@@ -139,6 +143,24 @@ namespace dd
 #endif
     };
 
+    /**
+     * \brief best classes of results, as flat arrays, filled by backends in
+     * place of per result data objects
+     */
+    struct ClassResults
+    {
+      std::vector<std::string> _uris;
+      std::vector<size_t> _offsets{ 0 }; /**< classes range, per uri */
+      std::vector<double> _probs;
+      std::vector<std::string> _cats;
+      std::unordered_set<std::string> _seen; /**< uris already added */
+
+      size_t size() const
+      {
+        return _uris.size();
+      }
+    };
+
   public:
     /**
      * \brief supervised output connector constructor
@@ -179,17 +201,17 @@ namespace dd
     inline void add_results(const std::vector<APIData> &vrad)
     {
       std::unordered_map<std::string, int>::iterator hit;
-      for (APIData ad : vrad)
+      for (const APIData &ad : vrad)
         {
-          std::string uri = ad.get("uri").get<std::string>();
+          const std::string &uri = ad.get_ref<std::string>("uri");
           std::string index_uri;
 #ifdef USE_SIMSEARCH
           if (ad.has("index_uri"))
             index_uri = ad.get("index_uri").get<std::string>();
 #endif
           double loss = ad.get("loss").get<double>();
-          std::vector<double> probs
-              = ad.get("probs").get<std::vector<double>>();
+          const std::vector<double> &probs
+              = ad.get_ref<std::vector<double>>("probs");
           std::vector<std::string> cats;
           if (ad.has("cats"))
             cats = ad.get("cats").get<std::vector<std::string>>();
@@ -242,6 +264,35 @@ namespace dd
         }
     }
 
+    /**
+     * \brief adds a batch of classes already selected per row, e.g. by a
+     * top-k on the model output
+     * @param uris uri of every row
+     * @param probs row major probabilities, k per row, decreasing
+     * @param indices row major class indices, k per row
+     * @param threshold classes below this probability are not kept
+     * @param cat class name from class index
+     */
+    template <typename T, typename I, typename F>
+    void add_topk_results(const std::vector<std::string> &uris,
+                          const T *probs, const I *indices, const size_t &k,
+                          const double &threshold, F cat)
+    {
+      for (size_t r = 0; r < uris.size(); ++r)
+        {
+          if (!_class_results._seen.insert(uris[r]).second)
+            continue;
+          for (size_t j = r * k; j < (r + 1) * k && probs[j] >= threshold;
+               ++j)
+            {
+              _class_results._probs.push_back(probs[j]);
+              _class_results._cats.push_back(cat(indices[j]));
+            }
+          _class_results._uris.push_back(uris[r]);
+          _class_results._offsets.push_back(_class_results._probs.size());
+        }
+    }
+
     /**
      * \brief best categories selection from results
      * @param ad_out output data object
@@ -438,6 +489,20 @@ namespace dd
       if (output_params->best == nullptr)
         output_params->best = _best;
 
+      if (_class_results.size() > 0)
+        {
+#ifdef USE_SIMSEARCH
+          if (output_params->index || output_params->build_index
+              || output_params->search)
+            class_results_to_sup();
+          else
+#endif
+            {
+              class_results_to_dto(out_dto);
+              return out_dto;
+            }
+        }
+
       if (!timeseries)
         best_cats(bcats, output_params->best, nclasses, has_bbox, has_roi,
                   has_mask);
@@ -721,10 +786,6 @@ namespace dd
                         const std::string test_name = "")
     {
       APIData meas_out;
-      bool tloss = ad_res.has("train_loss");
-      bool lr = ad_res.has("learning_rate");
-      bool loss = ad_res.has("loss");
-      bool iter = ad_res.has("iteration");
       bool regression = ad_res.has("regression");
       bool segmentation = ad_res.has("segmentation");
       bool multilabel = ad_res.has("multilabel");
@@ -837,54 +898,25 @@ namespace dd
 
               if (has_map)
                 {
-                  double sum_map = 0;
-                  std::map<int, float> sum_aps;
-                  int ap_count = 0;
-
-                  // map for each threshold
-                  for (int iou_thres : thresholds)
-                    {
-                      std::map<int, float> aps;
-                      double bmap = ap(ad_res, aps, iou_thres);
-                      std::string map_key = "map";
-                      if (iou_thres != 0)
-                        {
-                          std::stringstream ss;
-                          ss << map_key << "-" << std::setfill('0')
-                             << std::setw(2) << iou_thres;
-                          map_key = ss.str();
-                        }
-                      meas_out.add(map_key, bmap);
-                      for (auto ap : aps)
-                        {
-                          std::string s
-                              = map_key + "_" + std::to_string(ap.first);
-                          meas_out.add(s, static_cast<double>(ap.second));
-                        }
-
-                      sum_map += bmap;
-                      if (sum_aps.size() == 0)
-                        sum_aps = aps;
-                      else
-                        {
-                          for (auto ap : aps)
-                            sum_aps[ap.first] += ap.second;
-                        }
-                      ap_count++;
-                    }
-
-                  // mean of all thresholds
-                  if (thresholds.size() > 0)
-                    {
-                      meas_out.add("map", sum_map / ap_count);
-                      for (auto sum_ap : sum_aps)
-                        {
-                          std::string s
-                              = "map_" + std::to_string(sum_ap.first);
-                          meas_out.add(s, static_cast<double>(sum_ap.second
-                                                              / ap_count));
-                        }
-                    }
+                  // thresholds are independent, and accumulated in
+                  // parallel before being merged in order
+                  MeasureAccumulator macc(measures, 0,
+                                          MeasureAccumulator::DETECTION);
+                  std::vector<MeasureAccumulator> maccs(thresholds.size(),
+                                                        macc);
+                  ThreadPool::instance().parallel_for(
+                      thresholds.size(), [&](size_t t) {
+                        add_detections(ad_res, thresholds[t], maccs[t]);
+                      });
+                  for (MeasureAccumulator &tmacc : maccs)
+                    macc.merge_detections(tmacc);
+                  add_map_measures(
+                      meas_out, thresholds,
+                      [&](int iou_thres, std::map<int, float> &aps) {
+                        return macc.map(iou_thres, aps);
+                      });
+                  if (macc._coco)
+                    add_coco_measures(meas_out, macc);
                 }
 
               bool raw = (std::find(measures.begin(), measures.end(), "raw")
@@ -1033,66 +1065,11 @@ namespace dd
 
           if (!multilabel && !segmentation && !bbox && (bf1 || bf1full))
             {
-              double f1, precision, recall, acc;
-              dMat conf_diag, conf_matrix;
-              dVec precisionV, recallV, f1V;
-              f1 = mf1(ad_res, precision, recall, acc, precisionV, recallV,
-                       f1V, conf_diag, conf_matrix);
-              meas_out.add("f1", f1);
-              meas_out.add("precision", precision);
-              meas_out.add("recall", recall);
-              meas_out.add("accp", acc);
-              if (std::find(measures.begin(), measures.end(), "f1full")
-                  != measures.end())
-                {
-                  std::vector<double> allPrecisions;
-                  std::vector<double> allRecalls;
-                  std::vector<double> allF1s;
-                  for (int i = 0; i < precisionV.size(); ++i)
-                    {
-                      allPrecisions.push_back(precisionV(i));
-                      allRecalls.push_back(recallV(i));
-                      allF1s.push_back(f1V(i));
-                    }
-                  meas_out.add("precisions", allPrecisions);
-                  meas_out.add("recalls", allRecalls);
-                  meas_out.add("f1s", allF1s);
-                  if (std::find(measures.begin(), measures.end(), "cmdiag")
-                      == measures.end())
-                    meas_out.add(
-                        "labels",
-                        ad_res.get("clnames").get<std::vector<std::string>>());
-                }
-
-              if (std::find(measures.begin(), measures.end(), "cmdiag")
-                  != measures.end())
-
-                {
-                  std::vector<double> cmdiagv;
-                  for (int i = 0; i < conf_diag.rows(); i++)
-                    cmdiagv.push_back(conf_diag(i, 0));
-                  meas_out.add("cmdiag", cmdiagv);
-                  meas_out.add(
-                      "labels",
-                      ad_res.get("clnames").get<std::vector<std::string>>());
-                }
-              if (std::find(measures.begin(), measures.end(), "cmfull")
-                  != measures.end())
-                {
-                  std::vector<std::string> clnames
-                      = ad_res.get("clnames").get<std::vector<std::string>>();
-                  std::vector<APIData> cmdata;
-                  for (int i = 0; i < conf_matrix.cols(); i++)
-                    {
-                      std::vector<double> cmrow;
-                      for (int j = 0; j < conf_matrix.rows(); j++)
-                        cmrow.push_back(conf_matrix(j, i));
-                      APIData adrow;
-                      adrow.add(clnames.at(i), cmrow);
-                      cmdata.push_back(adrow);
-                    }
-                  meas_out.add("cmfull", cmdata);
-                }
+              dMat conf_matrix;
+              fill_conf_matrix(ad_res, conf_matrix);
+              add_f1_measures(
+                  meas_out, measures, conf_matrix,
+                  ad_res.get("clnames").get<std::vector<std::string>>());
             }
           if (!multilabel && !segmentation && !bbox && bmcll)
             {
@@ -1347,6 +1324,133 @@ namespace dd
                 }
             }
         }
+      push_measures(ad_res, meas_out, out, test_id, test_name);
+    }
+
+    /**
+     * \brief measures from accumulated test results
+     * \param ad_res test information, e.g. iteration, losses, clnames
+     */
+    static void measure(const MeasureAccumulator &macc, const APIData &ad_res,
+                        APIData &out, size_t test_id = 0,
+                        const std::string test_name = "")
+    {
+      APIData meas_out;
+      const std::vector<std::string> &measures = macc._measures;
+      if (macc._task == MeasureAccumulator::DETECTION)
+        {
+          std::vector<int> thresholds;
+          if (find_ap_iou_thresholds(measures, thresholds))
+            add_map_measures(meas_out, thresholds,
+                             [&](int iou_thres, std::map<int, float> &aps) {
+                               return macc.map(iou_thres, aps);
+                             });
+          if (macc._coco)
+            add_coco_measures(meas_out, macc);
+        }
+      else if (macc._task == MeasureAccumulator::SEGMENTATION)
+        {
+          if (macc._accv)
+            {
+              double meanacc, meaniou;
+              std::vector<double> clacc;
+              std::vector<double> cliou;
+              double accs = acc_v(macc, meanacc, meaniou, clacc, cliou);
+              meas_out.add("acc", accs);
+              meas_out.add("meanacc", meanacc);
+              meas_out.add("meaniou", meaniou);
+              meas_out.add("clacc", clacc);
+              meas_out.add("cliou", cliou);
+            }
+        }
+      else if (macc._task == MeasureAccumulator::CLASSIFICATION)
+        {
+          double count = static_cast<double>(macc._count);
+          for (size_t k = 0; k < macc._topk.size(); ++k)
+            {
+              std::string key = "acc";
+              if (macc._topk[k] > 1)
+                key += "-" + std::to_string(macc._topk[k]);
+              meas_out.add(key, macc._topk_hits[k] / count);
+            }
+          if (macc._conf)
+            {
+              bool bf1 = std::find(measures.begin(), measures.end(), "f1")
+                         != measures.end();
+              bool bf1full
+                  = std::find(measures.begin(), measures.end(), "f1full")
+                    != measures.end();
+              if (bf1 || bf1full)
+                add_f1_measures(
+                    meas_out, measures, macc._conf_matrix,
+                    ad_res.get("clnames").get<std::vector<std::string>>());
+              if (std::find(measures.begin(), measures.end(), "mcc")
+                  != measures.end())
+                meas_out.add("mcc", mcc(macc._conf_matrix));
+            }
+          if (macc._mcll)
+            meas_out.add("mcll", macc._log_loss / count);
+          if (macc._auc)
+            meas_out.add("auc", auc(macc._auc_preds, macc._auc_targets));
+          if (macc._gini)
+            meas_out.add("gini", comp_gini_normalized(macc._gini_targets,
+                                                      macc._gini_preds));
+        }
+      else if (macc._task == MeasureAccumulator::REGRESSION)
+        {
+          double count = static_cast<double>(macc._count);
+          if (macc._eucll)
+            {
+              meas_out.add("eucll", macc._eucl_sum / count);
+              if (macc._all_eucl.size() > 1)
+                for (size_t i = 0; i < macc._all_eucl.size(); ++i)
+                  meas_out.add("eucll_" + std::to_string(i),
+                               macc._all_eucl[i] / count);
+              if (macc._eucll_thres > 0)
+                {
+                  std::string b
+                      = "eucll_no_" + std::to_string(macc._eucll_thres);
+                  meas_out.add(b, macc._eucl_thres_sum / count);
+                  if (macc._all_eucl_thres.size() > 1)
+                    for (size_t i = 0; i < macc._all_eucl_thres.size(); ++i)
+                      meas_out.add("eucll_no_" + std::to_string(i) + "_"
+                                       + std::to_string(macc._eucll_thres),
+                                   macc._all_eucl_thres[i] / count);
+                }
+            }
+          if (macc._l1)
+            {
+              meas_out.add("l1", macc._l1_sum / count);
+              for (size_t i = 0; i < macc._all_l1.size(); ++i)
+                meas_out.add("l1_" + std::to_string(i),
+                             macc._all_l1[i] / count);
+            }
+          if (macc._percent)
+            {
+              meas_out.add("percent", macc._percent_sum * 100.0 / count);
+              for (size_t i = 0; i < macc._all_percent.size(); ++i)
+                meas_out.add("percent_" + std::to_string(i),
+                             macc._all_percent[i] * 100.0 / count);
+            }
+          if (macc._gini)
+            meas_out.add("gini", comp_gini_normalized(macc._gini_targets,
+                                                      macc._gini_preds));
+        }
+      push_measures(ad_res, meas_out, out, test_id, test_name);
+    }
+
+    /**
+     * \brief adds losses and test information to measures, and measures to
+     * the output
+     */
+    static void push_measures(const APIData &ad_res, APIData &meas_out,
+                              APIData &out, size_t test_id,
+                              const std::string &test_name)
+    {
+      bool tloss = ad_res.has("train_loss");
+      bool lr = ad_res.has("learning_rate");
+      bool loss = ad_res.has("loss");
+      bool iter = ad_res.has("iteration");
       if (loss)
         meas_out.add("loss",
                      ad_res.get("loss")
@@ -1358,6 +1462,11 @@ namespace dd
       if (lr)
         meas_out.add("learning_rate",
                      ad_res.get("learning_rate").get<double>());
+      // adaptive inference (early exit / token pruning)
+      for (const std::string &akey :
+           { "exit_depth", "token_ratio", "forward_time_ms_per_sample" })
+        if (ad_res.has(akey))
+          meas_out.add(akey, ad_res.get(akey).get<double>());
 
       meas_out.add("test_id", static_cast<int>(test_id));
       meas_out.add("test_name", test_name);
@@ -1372,6 +1481,125 @@ namespace dd
         out.add("measure", meas_out);
     }
 
+    /**
+     * \brief adds map measures for every iou threshold, and their mean
+     * \param ap_fn computes the map at an iou threshold and per class APs
+     */
+    template <typename F>
+    static void add_map_measures(APIData &meas_out,
+                                 const std::vector<int> &thresholds, F ap_fn)
+    {
+      double sum_map = 0;
+      std::map<int, float> sum_aps;
+      int ap_count = 0;
+
+      // map for each threshold
+      for (int iou_thres : thresholds)
+        {
+          std::map<int, float> aps;
+          double bmap = ap_fn(iou_thres, aps);
+          std::string map_key = "map";
+          if (iou_thres != 0)
+            {
+              std::stringstream ss;
+              ss << map_key << "-" << std::setfill('0') << std::setw(2)
+                 << iou_thres;
+              map_key = ss.str();
+            }
+          meas_out.add(map_key, bmap);
+          for (auto ap : aps)
+            {
+              std::string s = map_key + "_" + std::to_string(ap.first);
+              meas_out.add(s, static_cast<double>(ap.second));
+            }
+
+          sum_map += bmap;
+          if (sum_aps.size() == 0)
+            sum_aps = aps;
+          else
+            {
+              for (auto ap : aps)
+                sum_aps[ap.first] += ap.second;
+            }
+          ap_count++;
+        }
+
+      // mean of all thresholds
+      if (thresholds.size() > 0)
+        {
+          meas_out.add("map", sum_map / ap_count);
+          for (auto sum_ap : sum_aps)
+            {
+              std::string s = "map_" + std::to_string(sum_ap.first);
+              meas_out.add(s, static_cast<double>(sum_ap.second / ap_count));
+            }
+        }
+    }
+
+    /**
+     * \brief adds f1, precision, recall and confusion matrix measures
+     */
+    static void add_f1_measures(APIData &meas_out,
+                                const std::vector<std::string> &measures,
+                                dMat conf_matrix,
+                                const std::vector<std::string> &clnames)
+    {
+      double f1, precision, recall, acc;
+      dMat conf_diag;
+      dVec precisionV, recallV, f1V;
+      f1 = mf1(conf_matrix, precision, recall, acc, precisionV, recallV, f1V,
+               conf_diag);
+      meas_out.add("f1", f1);
+      meas_out.add("precision", precision);
+      meas_out.add("recall", recall);
+      meas_out.add("accp", acc);
+      if (std::find(measures.begin(), measures.end(), "f1full")
+          != measures.end())
+        {
+          std::vector<double> allPrecisions;
+          std::vector<double> allRecalls;
+          std::vector<double> allF1s;
+          for (int i = 0; i < precisionV.size(); ++i)
+            {
+              allPrecisions.push_back(precisionV(i));
+              allRecalls.push_back(recallV(i));
+              allF1s.push_back(f1V(i));
+            }
+          meas_out.add("precisions", allPrecisions);
+          meas_out.add("recalls", allRecalls);
+          meas_out.add("f1s", allF1s);
+          if (std::find(measures.begin(), measures.end(), "cmdiag")
+              == measures.end())
+            meas_out.add("labels", clnames);
+        }
+
+      if (std::find(measures.begin(), measures.end(), "cmdiag")
+          != measures.end())
+
+        {
+          std::vector<double> cmdiagv;
+          for (int i = 0; i < conf_diag.rows(); i++)
+            cmdiagv.push_back(conf_diag(i, 0));
+          meas_out.add("cmdiag", cmdiagv);
+          meas_out.add("labels", clnames);
+        }
+      if (std::find(measures.begin(), measures.end(), "cmfull")
+          != measures.end())
+        {
+          std::vector<APIData> cmdata;
+          for (int i = 0; i < conf_matrix.cols(); i++)
+            {
+              std::vector<double> cmrow;
+              for (int j = 0; j < conf_matrix.rows(); j++)
+                cmrow.push_back(conf_matrix(j, i));
+              APIData adrow;
+              adrow.add(clnames.at(i), cmrow);
+              cmdata.push_back(adrow);
+            }
+          meas_out.add("cmfull", cmdata);
+        }
+    }
+
     /** Reduce metrics over multiple test sets. The aggregated metrics are used
      * to determine the best model. */
     static void aggregate_multiple_testsets(APIData &ad_out)
@@ -1429,16 +1657,16 @@ namespace dd
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> targets_unscaled
-              = bad.get("target_unscaled").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &targets_unscaled
+              = bad.get_ref<std::vector<double>>("target_unscaled");
 
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
-          std::vector<double> predictions_unscaled
-              = bad.get("pred_unscaled").get<std::vector<double>>();
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
+          const std::vector<double> &predictions_unscaled
+              = bad.get_ref<std::vector<double>>("pred_unscaled");
 
           nts += targets.size();
 
@@ -1552,15 +1780,15 @@ namespace dd
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
           /* std::cout << "targets: " ; */
           /* for (double d: targets) */
           /*   std::cout << d << " "; */
           /* std::cout << std::endl; */
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           /* std::cout << "predictions: "; */
           /* for (double d : predictions) */
           /*   std::cout << d << " "; */
@@ -1652,10 +1880,20 @@ namespace dd
               std::vector<std::string> sv = dd_utils::split(s, '-');
               int iou_thres = 0;
 
-              if (sv.size() == 2)
+              if (sv.size() == 2 && sv.at(1) == "coco")
+                {
+                  for (int t : MeasureAccumulator::coco_thresholds())
+                    if (std::find(thresholds.begin(), thresholds.end(), t)
+                        == thresholds.end())
+                      thresholds.push_back(t);
+                }
+              else if (sv.size() == 2)
                 {
                   iou_thres = std::atoi(sv.at(1).c_str());
-                  thresholds.push_back(iou_thres);
+                  if (std::find(thresholds.begin(), thresholds.end(),
+                                iou_thres)
+                      == thresholds.end())
+                    thresholds.push_back(iou_thres);
                 }
             }
         }
@@ -1711,9 +1949,9 @@ namespace dd
           double acc = 0.0;
           for (int i = 0; i < batch_size; i++)
             {
-              APIData bad = ad.getobj(std::to_string(i));
-              std::vector<double> predictions
-                  = bad.get("pred").get<std::vector<double>>();
+              const APIData &bad = ad.getobj_ref(std::to_string(i));
+              const std::vector<double> &predictions
+                  = bad.get_ref<std::vector<double>>("pred");
               if (k - 1 >= static_cast<int>(predictions.size()))
                 continue; // ignore instead of error
               std::vector<int> predk(predictions.size());
@@ -1740,79 +1978,39 @@ namespace dd
     static double acc_v(const APIData &ad, double &meanacc, double &meaniou,
                         std::vector<double> &clacc, std::vector<double> &cliou)
     {
-      int nclasses = ad.get("nclasses").get<int>();
+      MeasureAccumulator macc({ "acc" }, ad.get("nclasses").get<int>(),
+                              MeasureAccumulator::SEGMENTATION);
       int batch_size = ad.get("batch_size").get<int>();
-      std::vector<double> mean_acc(nclasses, 0.0);
-      std::vector<double> mean_acc_bs(nclasses, 0.0);
-      std::vector<double> mean_iou_bs(nclasses, 0.0);
-      std::vector<double> mean_iou(nclasses, 0.0);
-      double acc_v = 0.0;
-      meanacc = 0.0;
-      meaniou = 0.0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>(); // all best-1
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>(); // all targets
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred"); // all best-1
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target"); // all targets
                                                               // against best-1
-          dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
-          dVec dtarg = dVec::Map(&targets.at(0), targets.size());
-          dVec ddiff = dpred - dtarg;
-          double acc = (ddiff.cwiseAbs().array() == 0).count()
-                       / static_cast<double>(dpred.size());
-          acc_v += acc;
-
-          for (int c = 0; c < nclasses; c++)
-            {
-              dVec dpredc
-                  = (dpred.array() == c)
-                        .select(dpred, dVec::Constant(dpred.size(), -2.0));
-              dVec dtargc
-                  = (dtarg.array() == c)
-                        .select(dtarg, dVec::Constant(dtarg.size(), -1.0));
-              dVec ddiffc = dpredc - dtargc;
-              double c_sum = (ddiffc.cwiseAbs().array() == 0).count();
-
-              // mean acc over classes
-              double c_total_targ
-                  = static_cast<double>((dtarg.array() == c).count());
-              if (/* c_sum == 0 || */ c_total_targ == 0)
-                {
-                }
-              else
-                {
-                  double accc = c_sum / c_total_targ;
-                  mean_acc[c] += accc;
-                  mean_acc_bs[c]++;
-                }
-
-              // mean intersection over union
-              double c_false_neg
-                  = static_cast<double>((ddiffc.array() == -2 - c).count());
-              double c_false_pos
-                  = static_cast<double>((ddiffc.array() == c + 1).count());
-              // below corner case where nothing is to predict : put correct
-              // to zero but do not devide by zero
-              double iou = (c_sum == 0)
-                               ? 0
-                               : c_sum / (c_false_pos + c_sum + c_false_neg);
-              mean_iou[c] += iou;
-              // ... and divide one time less when normalizing by batch size
-              if (c_total_targ != 0)
-                mean_iou_bs[c]++;
-              // another possible waywould be to put artificially iou to one
-              // if nothing is to be predicted for class c
-            }
+          macc.add_segmentation(predictions.data(), targets.data(),
+                                predictions.size());
         }
+      return acc_v(macc, meanacc, meaniou, clacc, cliou);
+    }
+
+    static double acc_v(const MeasureAccumulator &macc, double &meanacc,
+                        double &meaniou, std::vector<double> &clacc,
+                        std::vector<double> &cliou)
+    {
+      int nclasses = macc._nclasses;
+      std::vector<double> mean_acc = macc._class_acc;
+      std::vector<double> mean_iou = macc._class_iou;
+      meanacc = 0.0;
+      meaniou = 0.0;
       int c_nclasses = 0;
       for (int c = 0; c < nclasses; c++)
         {
-          if (mean_acc_bs[c] > 0.0)
+          if (macc._class_acc_count[c] > 0.0)
             {
-              mean_acc[c] /= mean_acc_bs[c];
-              mean_iou[c] /= mean_iou_bs[c];
+              mean_acc[c] /= macc._class_acc_count[c];
+              mean_iou[c] /= macc._class_iou_count[c];
               c_nclasses++;
             }
           meanacc += mean_acc[c];
@@ -1827,7 +2025,7 @@ namespace dd
           meanacc /= static_cast<double>(c_nclasses);
           meaniou /= static_cast<double>(c_nclasses);
         }
-      return acc_v / static_cast<double>(batch_size);
+      return macc._acc_sum / static_cast<double>(macc._count);
     }
 
     // multilabel measures
@@ -1844,11 +2042,11 @@ namespace dd
       double count_neg = 0.0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           for (size_t j = 0; j < predictions.size(); j++)
             {
               if (targets.at(j) < 0)
@@ -1890,11 +2088,11 @@ namespace dd
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           double eps = 0.00001;
@@ -1924,11 +2122,11 @@ namespace dd
       long int total_number = 0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           double eps = 0.00001;
@@ -1961,11 +2159,11 @@ namespace dd
       long int total_number = 0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           dVec dif = dtarg - dpred;
@@ -1992,11 +2190,11 @@ namespace dd
       long int total_number = 0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           dVec dif = dtarg - dpred;
@@ -2047,11 +2245,11 @@ namespace dd
 
       for (int i = 0; i < batch_size; ++i)
         {
-          APIData badj = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = badj.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = badj.get("pred").get<std::vector<double>>();
+          const APIData &badj = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = badj.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = badj.get_ref<std::vector<double>>("pred");
 
           care_classes.clear();
           for (int l = 0; l < nclasses; ++l)
@@ -2119,11 +2317,11 @@ namespace dd
       double ssres = 0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           dVec dif = dtarg - dpred;
@@ -2147,11 +2345,11 @@ namespace dd
 
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           dVec temp;
@@ -2179,11 +2377,11 @@ namespace dd
         delta_scores[k] = 0;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> targets
-              = bad.get("target").get<std::vector<double>>();
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &targets
+              = bad.get_ref<std::vector<double>>("target");
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           dVec dpred = dVec::Map(&predictions.at(0), predictions.size());
           dVec dtarg = dVec::Map(&targets.at(0), targets.size());
           dVec dif;
@@ -2219,9 +2417,9 @@ namespace dd
       std::vector<std::vector<double>> logits;
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           double target = bad.get("target").get<double>();
           if (bad.has("logits"))
             logits.push_back(bad.get("logits").get<std::vector<double>>());
@@ -2269,36 +2467,49 @@ namespace dd
       return raw_res;
     }
 
-    // measure: F1
-    static double mf1(const APIData &ad, double &precision, double &recall,
-                      double &acc, dVec &precisionV, dVec &recallV, dVec &f1V,
-                      dMat &conf_diag, dMat &conf_matrix)
+    /**
+     * \brief predicted class x target class counts
+     */
+    static void fill_conf_matrix(const APIData &ad, dMat &conf_matrix)
     {
       int nclasses = ad.get("nclasses").get<int>();
-      double f1 = 0.0;
-      conf_matrix = dMat::Zero(nclasses, nclasses);
+      MeasureAccumulator macc({ "f1" }, nclasses,
+                              MeasureAccumulator::CLASSIFICATION);
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
           std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
-          int maxpr = std::distance(
-              predictions.begin(),
-              std::max_element(predictions.begin(), predictions.end()));
-          double target = bad.get("target").get<double>();
-          if (target < 0)
-            throw OutputConnectorBadParamException(
-                "negative supervised discrete target (e.g. wrong use of "
-                "label_offset ?");
-          else if (target >= nclasses)
-            throw OutputConnectorBadParamException(
-                "target class has id " + std::to_string(target)
-                + " is higher than the number of classes "
-                + std::to_string(nclasses)
-                + " (e.g. wrong number of classes specified with nclasses");
-          conf_matrix(maxpr, static_cast<int>(target)) += 1.0;
+              = bad.get_ref<std::vector<double>>("pred");
+          if (static_cast<int>(predictions.size()) < nclasses)
+            predictions.resize(nclasses,
+                               std::numeric_limits<double>::lowest());
+          macc.add_classification(predictions.data(),
+                                  bad.get("target").get<double>());
         }
+      conf_matrix = macc._conf_matrix;
+    }
+
+    // measure: F1
+    static double mf1(const APIData &ad, double &precision, double &recall,
+                      double &acc, dVec &precisionV, dVec &recallV, dVec &f1V,
+                      dMat &conf_diag, dMat &conf_matrix)
+    {
+      fill_conf_matrix(ad, conf_matrix);
+      return mf1(conf_matrix, precision, recall, acc, precisionV, recallV, f1V,
+                 conf_diag);
+    }
+
+    /**
+     * \param conf_matrix confusion matrix counts, normalized by target class
+     * on return
+     */
+    static double mf1(dMat &conf_matrix, double &precision, double &recall,
+                      double &acc, dVec &precisionV, dVec &recallV, dVec &f1V,
+                      dMat &conf_diag)
+    {
+      int nclasses = conf_matrix.rows();
+      double f1 = 0.0;
       conf_diag = conf_matrix.diagonal();
       dMat conf_csum = conf_matrix.colwise().sum();
       dMat conf_rsum = conf_matrix.rowwise().sum();
@@ -2323,26 +2534,6 @@ namespace dd
     }
 
     // measure: AP, mAP
-    static void cumsum_pair(const std::vector<std::pair<double, int>> &pairs,
-                            std::vector<int> &cumsum)
-    {
-      // Sort the pairs based on first item of the pair.
-      std::vector<std::pair<double, int>> sort_pairs = pairs;
-      std::stable_sort(sort_pairs.begin(), sort_pairs.end(),
-                       SortScorePairDescend<int>);
-      for (size_t i = 0; i < sort_pairs.size(); ++i)
-        {
-          if (i == 0)
-            {
-              cumsum.push_back(sort_pairs[i].second);
-            }
-          else
-            {
-              cumsum.push_back(cumsum.back() + sort_pairs[i].second);
-            }
-        }
-    }
-
     static APIData raw_detection_results(const APIData &ad,
                                          std::vector<std::string> clnames)
     {
@@ -2432,116 +2623,40 @@ namespace dd
                              const std::vector<std::pair<double, int>> &fp,
                              const int &num_pos)
     {
-      const double eps = 1e-6;
-      const int num = tp.size();
-      if (num == 0 || num_pos == 0)
-        return 0.0;
-      double ap = 0.0;
-      std::vector<int> tp_cumsum;
-      std::vector<int> fp_cumsum;
-      cumsum_pair(tp, tp_cumsum); // tp cumsum
-      cumsum_pair(fp, fp_cumsum); // fp cumsum
-      std::vector<double> prec;   // precision
-      for (int i = 0; i < num; i++)
-        prec.push_back(static_cast<double>(tp_cumsum[i])
-                       / (tp_cumsum[i] + fp_cumsum[i]));
-      std::vector<double> rec; // recall
-      for (int i = 0; i < num; i++)
-        rec.push_back(static_cast<double>(tp_cumsum[i]) / num_pos);
-
-      // voc12, ilsvrc style ap
-      float cur_rec = rec.back();
-      float cur_prec = prec.back();
-      for (int i = num - 2; i >= 0; --i)
-        {
-          cur_prec = std::max<float>(prec[i], cur_prec);
-          if (fabs(cur_rec - rec[i]) > eps)
-            {
-              ap += cur_prec * fabs(cur_rec - rec[i]);
-            }
-          cur_rec = rec[i];
-        }
-      ap += cur_rec * cur_prec;
-      return ap;
+      return MeasureAccumulator::compute_ap(tp, fp, num_pos);
     }
 
     /**
-     * Compute AP for all classes and mean AP
-     * \param APs std::map containing AP for each class
-     * \param thres iou threshold for map in percent
+     * \brief adds per sample detection results at an iou threshold to an
+     * accumulator
      */
-    static double ap(const APIData &ad, std::map<int, float> &APs, int thres)
+    static void add_detections(const APIData &ad, const int &thres,
+                               MeasureAccumulator &macc)
     {
-      double mmAP = 0.0;
-      std::map<int, int> APs_count;
-      int APs_count_all = 0;
       // extract tp, fp, labels
-      APIData bad = ad.getobj("0");
+      const APIData &bad0 = ad.getobj_ref("0");
       std::string map_key = "map-" + std::to_string(thres);
-      if (bad.has(map_key))
-        bad = bad.getobj(map_key);
       // else: default threshold (legacy)
+      const APIData &bad = bad0.has(map_key) ? bad0.getobj_ref(map_key) : bad0;
       int pos_count = ad.get("pos_count").get<int>();
       for (int i = 0; i < pos_count; i++)
         {
           std::vector<APIData> vbad = bad.getv(std::to_string(i));
-          for (size_t j = 0; j < vbad.size(); j++)
-            {
-              std::vector<double> tp_d
-                  = vbad.at(j).get("tp_d").get<std::vector<double>>();
-              std::vector<int> tp_i
-                  = vbad.at(j).get("tp_i").get<std::vector<int>>();
-              std::vector<double> fp_d
-                  = vbad.at(j).get("fp_d").get<std::vector<double>>();
-              std::vector<int> fp_i
-                  = vbad.at(j).get("fp_i").get<std::vector<int>>();
-              int num_pos = vbad.at(j).get("num_pos").get<int>();
-              int label = vbad.at(j).get("label").get<int>();
-              std::vector<std::pair<double, int>> tp;
-              std::vector<std::pair<double, int>> fp;
-
-              for (size_t j = 0; j < tp_d.size(); j++)
-                {
-                  tp.push_back(std::pair<double, int>(tp_d.at(j), tp_i.at(j)));
-                }
-              for (size_t j = 0; j < fp_d.size(); j++)
-                {
-                  fp.push_back(std::pair<double, int>(fp_d.at(j), fp_i.at(j)));
-                }
-
-              if (tp.size() > 0 or fp.size() > 0 or num_pos > 0)
-                {
-                  APs_count_all += 1;
-                  double local_ap = compute_ap(tp, fp, num_pos);
-                  if (APs.find(label) == APs.end())
-                    {
-                      APs[label] = local_ap;
-                      APs_count[label] = 1;
-                    }
-                  else
-                    {
-                      APs[label] += local_ap;
-                      APs_count[label] += 1;
-                    }
-                  mmAP += local_ap;
-                }
-              else if (APs.find(label) == APs.end())
-                {
-                  APs[label] = 0.0;
-                  APs_count[label] = 0;
-                }
-            }
+          std::vector<DetectionStats> stats(vbad.begin(), vbad.end());
+          macc.add_detection(thres, stats);
         }
-      for (auto ap : APs)
-        {
-          if (APs_count[ap.first] == 0)
-            APs[ap.first] = 0.0;
-          else
-            APs[ap.first] /= static_cast<float>(APs_count[ap.first]);
-        }
-      if (APs_count_all == 0)
-        return 0.0;
-      return mmAP / static_cast<double>(APs_count_all);
+    }
+
+    /**
+     * \brief adds dataset level COCO style map measures, averaged over iou
+     * thresholds 50 to 95, and at 50 and 75
+     */
+    static void add_coco_measures(APIData &meas_out,
+                                  const MeasureAccumulator &macc)
+    {
+      meas_out.add("map_coco", macc.coco_map());
+      meas_out.add("map_coco-50", macc.coco_map(50));
+      meas_out.add("map_coco-75", macc.coco_map(75));
     }
 
     // measure: AUC
@@ -2552,8 +2667,8 @@ namespace dd
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          pred1.push_back(bad.get("pred").get<std::vector<double>>().at(1));
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          pred1.push_back(bad.get_ref<std::vector<double>>("pred").at(1));
           targets.push_back(bad.get("target").get<double>());
         }
       return auc(pred1, targets);
@@ -2619,9 +2734,9 @@ namespace dd
       int batch_size = ad.get("batch_size").get<int>();
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           double target = bad.get("target").get<double>();
           ll -= std::log(predictions.at(target));
         }
@@ -2631,30 +2746,13 @@ namespace dd
     // measure: Mathew correlation coefficient for binary classes
     static double mcc(const APIData &ad)
     {
-      int nclasses = ad.get("nclasses").get<int>();
-      dMat conf_matrix = dMat::Zero(nclasses, nclasses);
-      int batch_size = ad.get("batch_size").get<int>();
-      for (int i = 0; i < batch_size; i++)
-        {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
-          int maxpr = std::distance(
-              predictions.begin(),
-              std::max_element(predictions.begin(), predictions.end()));
-          double target = bad.get("target").get<double>();
-          if (target < 0)
-            throw OutputConnectorBadParamException(
-                "negative supervised discrete target (e.g. wrong use of "
-                "label_offset ?");
-          else if (target >= nclasses)
-            throw OutputConnectorBadParamException(
-                "target class has id " + std::to_string(target)
-                + " is higher than the number of classes "
-                + std::to_string(nclasses)
-                + " (e.g. wrong number of classes specified with nclasses");
-          conf_matrix(maxpr, static_cast<int>(target)) += 1.0;
-        }
+      dMat conf_matrix;
+      fill_conf_matrix(ad, conf_matrix);
+      return mcc(conf_matrix);
+    }
+
+    static double mcc(const dMat &conf_matrix)
+    {
       double tp = conf_matrix(0, 0);
       double tn = conf_matrix(1, 1);
       double fn = conf_matrix(0, 1);
@@ -2687,9 +2785,9 @@ namespace dd
 
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           std::vector<double> target;
           if (predictions.size() > 1)
             target = bad.get("target").get<std::vector<double>>();
@@ -2771,9 +2869,9 @@ namespace dd
 
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
-          std::vector<double> predictions
-              = bad.get("pred").get<std::vector<double>>();
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
+          const std::vector<double> &predictions
+              = bad.get_ref<std::vector<double>>("pred");
           std::vector<double> target;
           if (predictions.size() > 1)
             target = bad.get("target").get<std::vector<double>>();
@@ -2841,17 +2939,17 @@ namespace dd
       std::vector<double> p(batch_size);
       for (int i = 0; i < batch_size; i++)
         {
-          APIData bad = ad.getobj(std::to_string(i));
+          const APIData &bad = ad.getobj_ref(std::to_string(i));
           a.at(i) = bad.get("target").get<double>();
           if (regression)
-            p.at(i) = bad.get("pred").get<std::vector<double>>().at(
+            p.at(i) = bad.get_ref<std::vector<double>>("pred").at(
                 0); // XXX: could be vector for multi-dimensional regression
                     // ->
                     // TODO: in supervised mode, get best pred index ?
           else
             {
-              std::vector<double> allpreds
-                  = bad.get("pred").get<std::vector<double>>();
+              const std::vector<double> &allpreds
+                  = bad.get_ref<std::vector<double>>("pred");
               a.at(i) = std::distance(
                   allpreds.begin(),
                   std::max_element(allpreds.begin(), allpreds.end()));
@@ -3036,9 +3134,58 @@ namespace dd
         }
     }
 
+    /**
+     * \brief writes class results to the response, without intermediate
+     * data objects
+     */
+    void class_results_to_dto(oatpp::Object<DTO::PredictBody> out) const
+    {
+      for (size_t i = 0; i < _class_results.size(); ++i)
+        {
+          auto pred_dto = DTO::Prediction::createShared();
+          auto v = oatpp::Vector<
+              oatpp::Object<DTO::PredictClass>>::createShared();
+          size_t end = _class_results._offsets[i + 1];
+          for (size_t j = _class_results._offsets[i]; j < end; ++j)
+            {
+              auto cls_dto = DTO::PredictClass::createShared();
+              cls_dto->cat = _class_results._cats[j];
+              cls_dto->prob = _class_results._probs[j];
+              if (j + 1 == end)
+                cls_dto->last = true;
+              v->push_back(cls_dto);
+            }
+          pred_dto->uri = _class_results._uris[i];
+          pred_dto->classes = v;
+          out->predictions->push_back(pred_dto);
+        }
+    }
+
+#ifdef USE_SIMSEARCH
+    /**
+     * \brief moves class results to per uri results, e.g. for indexing
+     */
+    void class_results_to_sup()
+    {
+      for (size_t i = 0; i < _class_results.size(); ++i)
+        {
+          sup_result supres(_class_results._uris[i]);
+          for (size_t j = _class_results._offsets[i];
+               j < _class_results._offsets[i + 1]; ++j)
+            supres.add_cat(_class_results._probs[j],
+                           _class_results._cats[j]);
+          _vcats.insert(std::pair<std::string, int>(supres._label,
+                                                    _vvcats.size()));
+          _vvcats.push_back(supres);
+        }
+      _class_results = ClassResults();
+    }
+#endif
+
     std::unordered_map<std::string, int>
         _vcats;                      /**< batch of results, per uri. */
     std::vector<sup_result> _vvcats; /**< ordered results, per uri. */
+    ClassResults _class_results;     /**< flat class results, if any. */
 
     // options
     int _best = 1;
@@ -20,7 +20,6 @@
  */
 
 #include "svminputfileconn.h"
-#include "utils/utils.hpp"
 
 namespace dd
 {
@@ -48,156 +47,105 @@ namespace dd
   {
     if (!_cifc)
       return -1;
-    std::unordered_map<int, double> vals;
-    int label = -1;
-    // int nlines = 0;
-    _cifc->read_svm_line(content, vals, label);
-    /*if (_cifc->_scale)
+    SVMCSR rows;
+    try
       {
-        if (!_cifc->_train) // in prediction mode, on-the-fly scaling
-          {
-            _cifc->scale_vals(vals);
-          }
-        else // in training mode, collect bounds, then scale in another pass
-      over the data
-          {
-            if (_cifc->_min_vals.empty() && _cifc->_max_vals.empty())
-              _cifc->_min_vals = _cifc->_max_vals = vals;
-            for (size_t j=0;j<vals.size();j++)
-              {
-                _cifc->_min_vals.at(j) =
-      std::min(vals.at(j),_cifc->_min_vals.at(j)); _cifc->_max_vals.at(j) =
-      std::max(vals.at(j),_cifc->_max_vals.at(j));
-              }
-          }
-          }*/
-    _cifc->add_train_svmline(label, vals, 0);
+        // in training mode, all features are kept and added to the
+        // vocabulary
+        SVMParser parser(_cifc->_train ? nullptr : &_cifc->_fids);
+        std::unordered_set<int> seen;
+        parser.parse(content.data(), content.data() + content.size(), rows,
+                     _cifc->_train ? &seen : nullptr);
+        _cifc->add_fids(seen);
+      }
+    catch (std::runtime_error &e)
+      {
+        throw InputConnectorBadParamException(e.what());
+      }
+    _cifc->add_train_svm(rows, _cifc->batch_size());
     return 0;
   }
 
-  void SVMInputFileConn::read_svm_line(const std::string &content,
-                                       std::unordered_map<int, double> &vals,
-                                       int &label)
+  void SVMInputFileConn::add_fids(const std::unordered_set<int> &fids)
   {
-    bool fpos = true;
-    std::string col;
-    std::stringstream sh(content);
-    std::unordered_set<int>::const_iterator fit;
-    while (std::getline(sh, col, ' '))
+    for (int fid : fids)
       {
-        try
-          {
-            if (fpos)
-              {
-                label = std::stod(col);
-                fpos = false;
-              }
-            std::vector<std::string> res = dd_utils::split(col, ':');
-            if (res.size() == 2)
-              {
-                int fid = std::stoi(res.at(0));
-                if ((fit = _fids.find(fid)) != _fids.end())
-                  vals.insert(
-                      std::pair<int, double>(fid, std::stod(res.at(1))));
-              }
-          }
-        catch (std::invalid_argument &e)
-          {
-            throw InputConnectorBadParamException(
-                "invalid argument error reading SVM format line: " + content);
-          }
-        catch (...)
-          {
-            throw InputConnectorBadParamException(
-                "error reading SVM format line: " + content);
-          }
+        if (fid > _max_id)
+          _max_id = fid;
+        _fids.insert(fid);
       }
-    if (vals.empty())
-      throw InputConnectorBadParamException(
-          "Issue while reading svm example (index might be out of bounds)");
   }
 
   void SVMInputFileConn::read_svm(const APIData &ad, const std::string &fname)
   {
-    std::ifstream svm_file(fname, std::ios::binary);
-    _logger->info("SVM fname={} / open={}", fname, svm_file.is_open());
-    if (!svm_file.is_open())
+    SVMParser parser(_train ? nullptr : &_fids);
+    bool open = parser.open(fname);
+    _logger->info("SVM fname={} / open={}", fname, open);
+    if (!open)
       throw InputConnectorBadParamException("cannot open file " + fname);
-    std::string hline;
-
-    // first pass to get max index
-    std::string col;
-    int total_lines = 0;
-    while (std::getline(svm_file, hline))
-      {
-        bool fpos = true;
-        std::stringstream sh(hline);
-        while (std::getline(sh, col, ' '))
-          {
-            if (fpos)
-              {
-                fpos = false;
-                continue;
-              }
-            std::vector<std::string> res = dd_utils::split(col, ':');
-            if (_train && res.size() == 2)
-              {
-                int fid = std::stoi(res.at(0));
-                if (fid > _max_id)
-                  _max_id = fid;
-                _fids.insert(fid);
-              }
-          }
-        ++total_lines;
-      }
-    svm_file.clear();
-    svm_file.seekg(0, std::ios::beg);
-
-    _logger->info("total number of dimensions={}", _fids.size());
 
     int train_lines = 0;
     if (_test_split > 0.0)
       {
-        train_lines = total_lines * (1.0 - _test_split);
+        train_lines = parser.count_lines() * (1.0 - _test_split);
       }
 
-    // read data
+    // read data, window after window, each window being parsed in parallel
     int nlines = 0;
     int tnlines = 0;
-    while (std::getline(svm_file, hline))
+    std::unordered_set<int> seen;
+    try
       {
-        std::unordered_map<int, double> vals;
-        int label;
-        read_svm_line(hline, vals, label);
-        if (train_lines == 0 || (train_lines > 0 && nlines < train_lines))
-          add_train_svmline(label, vals, nlines);
-        else
-          {
-            add_test_svmline(label, vals, tnlines);
-            ++tnlines;
-          }
-        ++nlines;
+        parser.parse_file(
+            [&](SVMCSR &rows) {
+              int ntrain = rows.rows();
+              if (train_lines > 0)
+                ntrain = std::max(0, std::min(ntrain, train_lines - nlines));
+              if (ntrain == static_cast<int>(rows.rows()))
+                add_train_svm(rows, nlines);
+              else
+                {
+                  SVMCSR train_rows, test_rows;
+                  train_rows.append(rows, 0, ntrain);
+                  test_rows.append(rows, ntrain, rows.rows());
+                  int ntest = test_rows.rows();
+                  if (ntrain > 0)
+                    add_train_svm(train_rows, nlines);
+                  add_test_svm(test_rows, tnlines);
+                  tnlines += ntest;
+                }
+              nlines += ntrain;
+            },
+            _train ? &seen : nullptr);
+      }
+    catch (std::runtime_error &e)
+      {
+        throw InputConnectorBadParamException(e.what());
       }
-    svm_file.close();
-    _logger->info("read {} lines from SVM data file", nlines);
+    parser.close();
+    add_fids(seen);
+    _logger->info("total number of dimensions={}", _fids.size());
+    _logger->info("read {} lines from SVM data file", nlines + tnlines);
 
     if (!_svm_test_fname.empty())
       {
-        std::ifstream svm_test_file(_svm_test_fname, std::ios::binary);
-        if (!svm_test_file.is_open())
+        // features unseen in training data are dropped
+        SVMParser test_parser(&_fids);
+        if (!test_parser.open(_svm_test_fname))
           throw InputConnectorBadParamException("cannot open SVM test file "
-                                                + fname);
-        while (std::getline(svm_test_file, hline))
+                                                + _svm_test_fname);
+        try
+          {
+            test_parser.parse_file([&](SVMCSR &rows) {
+              int ntest = rows.rows();
+              add_test_svm(rows, tnlines);
+              tnlines += ntest;
+            });
+          }
+        catch (std::runtime_error &e)
           {
-            hline.erase(std::remove(hline.begin(), hline.end(), '\r'),
-                        hline.end());
-            std::unordered_map<int, double> vals;
-            int label;
-            read_svm_line(hline, vals, label);
-            add_test_svmline(label, vals, tnlines);
-            ++tnlines;
+            throw InputConnectorBadParamException(e.what());
           }
-        svm_test_file.close();
       }
 
     // shuffle before test selection, if any
@@ -207,7 +155,7 @@ namespace dd
       {
         split_data();
         _logger->info("data split test size={} / remaining data size={}",
-                      _svmdata_test.size(), _svmdata.size());
+                      _svmdata_test.rows(), _svmdata.rows());
       }
   }
 
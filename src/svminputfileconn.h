@@ -23,8 +23,10 @@
 #define SVMINPUTFILECONN_H
 
 #include "inputconnectorstrategy.h"
+#include "utils/svmparser.hpp"
 #include <random>
 #include <algorithm>
+#include <numeric>
 
 namespace dd
 {
@@ -55,20 +57,6 @@ namespace dd
     std::shared_ptr<spdlog::logger> _logger;
   };
 
-  class SVMline
-  {
-  public:
-    SVMline(const int &label, const std::unordered_map<int, double> &v)
-        : _label(label), _v(v)
-    {
-    }
-    ~SVMline()
-    {
-    }
-    int _label;                         /**< svm line label. */
-    std::unordered_map<int, double> _v; /**< svm line data */
-  };
-
   class SVMInputFileConn : public InputConnectorStrategy
   {
   public:
@@ -114,7 +102,10 @@ namespace dd
               std::random_device rd;
               g = std::mt19937(rd());
             }
-          std::shuffle(_svmdata.begin(), _svmdata.end(), g);
+          std::vector<size_t> order(_svmdata.rows());
+          std::iota(order.begin(), order.end(), 0);
+          std::shuffle(order.begin(), order.end(), g);
+          _svmdata = _svmdata.gather(order);
         }
     }
 
@@ -122,23 +113,10 @@ namespace dd
     {
       if (_test_split > 0.0)
         {
-          int split_size = std::floor(_svmdata.size() * (1.0 - _test_split));
-          auto chit = _svmdata.begin();
-          auto dchit = chit;
-          int cpos = 0;
-          while (chit != _svmdata.end())
-            {
-              if (cpos == split_size)
-                {
-                  if (dchit == _svmdata.begin())
-                    dchit = chit;
-                  _svmdata_test.push_back((*chit));
-                }
-              else
-                ++cpos;
-              ++chit;
-            }
-          _svmdata.erase(dchit, _svmdata.end());
+          size_t split_size
+              = std::floor(_svmdata.rows() * (1.0 - _test_split));
+          _svmdata_test.append(_svmdata, split_size, _svmdata.rows());
+          _svmdata.resize(split_size);
         }
     }
 
@@ -215,34 +193,43 @@ namespace dd
         throw InputConnectorBadParamException("no data could be found");
     }
 
-    virtual void add_train_svmline(const int &label,
-                                   const std::unordered_map<int, double> &vals,
-                                   const int &count)
+    /**
+     * \brief adds parsed training rows
+     * @param count number of training rows added before these ones
+     */
+    virtual void add_train_svm(SVMCSR &rows, const int &count)
     {
       (void)count;
-      _svmdata.emplace_back(label, std::move(vals));
+      if (_svmdata.empty())
+        std::swap(_svmdata, rows);
+      else
+        _svmdata.append(rows, 0, rows.rows());
     }
 
-    virtual void add_test_svmline(const int &label,
-                                  const std::unordered_map<int, double> &vals,
-                                  const int &count)
+    virtual void add_test_svm(SVMCSR &rows, const int &count)
     {
       (void)count;
-      _svmdata_test.emplace_back(label, std::move(vals));
+      if (_svmdata_test.empty())
+        std::swap(_svmdata_test, rows);
+      else
+        _svmdata_test.append(rows, 0, rows.rows());
     }
 
     void read_svm(const APIData &ad, const std::string &fname);
-    void read_svm_line(const std::string &content,
-                       std::unordered_map<int, double> &vals, int &label);
+
+    /**
+     * \brief adds feature ids to the vocabulary
+     */
+    void add_fids(const std::unordered_set<int> &fids);
 
     int batch_size() const
     {
-      return _svmdata.size();
+      return _svmdata.rows();
     }
 
     int test_batch_size() const
     {
-      return _svmdata_test.size();
+      return _svmdata_test.rows();
     }
 
     int feature_size() const
@@ -261,8 +248,8 @@ namespace dd
     double _test_split = -1;
 
     // data
-    std::vector<SVMline> _svmdata;
-    std::vector<SVMline> _svmdata_test;
+    SVMCSR _svmdata;      /**< training rows, or rows to predict */
+    SVMCSR _svmdata_test; /**< test rows */
     std::unordered_set<int> _fids; /**< feature ids. */
     int _max_id = -1;
     std::string _vocabfname = "vocab.dat";
@@ -22,57 +22,64 @@
 #include "txtinputfileconn.h"
 #include "utils/fileops.hpp"
 #include "utils/utils.hpp"
+#include "utils/threadpool.hpp"
 #include <boost/tokenizer.hpp>
 #include <iostream>
 
 namespace dd
 {
 
-  void WordPieceTokenizer::append_input(const std::string &word)
+  void WordPieceTokenizer::append_input(const char *word, const size_t &len)
   {
-    int start = 0;
-    std::vector<std::string> subtokens;
-    bool is_bad = false;
-
-    while (start < static_cast<int>(word.size()))
+    if (!_tries)
+      return;
+    // greedy longest-match-first, pieces being looked up in place
+    size_t ntokens = _tokens.size();
+    size_t start = 0;
+    while (start < len)
       {
-        int end = word.size();
-        std::string cur_substr = "";
-        while (start < end)
-          {
-            std::string substr = word.substr(start, end - start);
-            if (start > 0)
-              {
-                substr = _suffix_start + substr;
-              }
-            else
-              {
-                substr = _word_start + substr;
-              }
-            if (in_vocab(substr))
-              {
-                cur_substr = substr;
-                break;
-              }
-            --end;
-          }
-        if (cur_substr == "")
+        const VocabTrie &trie = start > 0 ? _tries->_suffix : _tries->_word;
+        int piece = -1;
+        size_t match = trie.longest_match(word + start, len - start, piece);
+        if (match == 0)
           {
-            is_bad = true;
-            break;
+            _tokens.resize(ntokens);
+            _tokens.push_back(_unk_token);
+            return;
           }
-        subtokens.push_back(cur_substr);
-        start = end;
+        _tokens.push_back(_tries->_pieces[piece]);
+        start += match;
       }
+  }
 
-    if (is_bad)
-      {
-        _tokens.push_back(_unk_token);
-      }
-    else
+  void WordPieceTokenizer::update_tries()
+  {
+    if (!_ctfc
+        || (_tries && _tries->_vocab_version == _ctfc->_vocab_version
+            && _tries->_vocab_size == _ctfc->_vocab.size()
+            && _tries->_word_start == _word_start
+            && _tries->_suffix_start == _suffix_start))
+      return;
+
+    auto tries = std::make_shared<VocabTries>();
+    tries->_vocab_version = _ctfc->_vocab_version;
+    tries->_vocab_size = _ctfc->_vocab.size();
+    tries->_word_start = _word_start;
+    tries->_suffix_start = _suffix_start;
+    std::vector<std::pair<std::string, int>> word_keys, suffix_keys;
+    for (auto &v : _ctfc->_vocab)
       {
-        _tokens.insert(_tokens.end(), subtokens.begin(), subtokens.end());
+        const std::string &piece = v.first;
+        int value = tries->_pieces.size();
+        tries->_pieces.push_back(piece);
+        if (piece.compare(0, _word_start.size(), _word_start) == 0)
+          word_keys.emplace_back(piece.substr(_word_start.size()), value);
+        if (piece.compare(0, _suffix_start.size(), _suffix_start) == 0)
+          suffix_keys.emplace_back(piece.substr(_suffix_start.size()), value);
       }
+    tries->_word.build(std::move(word_keys));
+    tries->_suffix.build(std::move(suffix_keys));
+    _tries = tries;
   }
 
   bool WordPieceTokenizer::in_vocab(const std::string &tok)
@@ -216,16 +223,55 @@ namespace dd
       }
 
     // parse content
-    // XXX: parallelize with openmp -> requires thread safe parse_content
-    for (std::pair<std::string, int> &p : lfiles)
+    auto read_txt_file = [](const std::string &fname) {
+      std::ifstream txt_file(fname);
+      if (!txt_file.is_open())
+        throw InputConnectorBadParamException("cannot open file " + fname);
+      std::stringstream buffer;
+      buffer << txt_file.rdbuf();
+      return buffer.str();
+    };
+    if (_ctfc->_generate_vocab && _ctfc->_train && !test_dir)
       {
-        std::ifstream txt_file(p.first);
-        if (!txt_file.is_open())
-          throw InputConnectorBadParamException("cannot open file " + p.first);
-        std::stringstream buffer;
-        buffer << txt_file.rdbuf();
-        std::string ct = buffer.str();
-        _ctfc->parse_content(ct, p.second, test_id);
+        // vocabulary building: files are sharded over threads, each with its
+        // own entries and word counts, merged in files order so that the
+        // vocabulary does not depend on the number of threads
+        if (_ctfc->_wordpiece_tokens)
+          _ctfc->_wordpiece_tokenizer.update_tries();
+        ThreadPool &pool = ThreadPool::instance();
+        size_t nshards = std::min(
+            lfiles.size(), 4 * std::max(static_cast<size_t>(1), pool.size()));
+        std::vector<std::vector<TxtEntry<double> *>> shard_entries(nshards);
+        std::vector<VocabCounts> shard_counts(nshards);
+        try
+          {
+            pool.parallel_for(nshards, [&](size_t s) {
+              WordPieceTokenizer wordpiece = _ctfc->_wordpiece_tokenizer;
+              size_t begin = s * lfiles.size() / nshards;
+              size_t end = (s + 1) * lfiles.size() / nshards;
+              for (size_t f = begin; f < end; ++f)
+                _ctfc->parse_entries(read_txt_file(lfiles[f].first),
+                                     lfiles[f].second, wordpiece,
+                                     shard_entries[s], &shard_counts[s]);
+            });
+          }
+        catch (...)
+          {
+            for (auto &entries : shard_entries)
+              _ctfc->destroy_txt_entries(entries);
+            throw;
+          }
+        for (size_t s = 0; s < nshards; ++s)
+          {
+            _ctfc->merge_vocab_counts(shard_counts[s]);
+            shard_counts[s] = VocabCounts();
+            _ctfc->add_entries(shard_entries[s], test_id);
+          }
+      }
+    else
+      {
+        for (std::pair<std::string, int> &p : lfiles)
+          _ctfc->parse_content(read_txt_file(p.first), p.second, test_id);
       }
 
     // post-processing
@@ -236,7 +282,10 @@ namespace dd
         while (vhit != _ctfc->_vocab.end())
           {
             if ((*vhit).second._total_count < _ctfc->_min_count)
-              vhit = _ctfc->_vocab.erase(vhit);
+              {
+                vhit = _ctfc->_vocab.erase(vhit);
+                ++_ctfc->_vocab_version;
+              }
             else
               ++vhit;
           }
@@ -318,6 +367,21 @@ namespace dd
   /*- TxtInputFileConn -*/
   void TxtInputFileConn::parse_content(const std::string &content,
                                        const float &target, int test_id)
+  {
+    std::vector<TxtEntry<double> *> entries;
+    VocabCounts counts;
+    if (_wordpiece_tokens)
+      _wordpiece_tokenizer.update_tries();
+    parse_entries(content, target, _wordpiece_tokenizer, entries,
+                  _train ? &counts : nullptr);
+    merge_vocab_counts(counts);
+    add_entries(entries, test_id);
+  }
+
+  void TxtInputFileConn::parse_entries(
+      const std::string &content, const float &target,
+      WordPieceTokenizer &wordpiece, std::vector<TxtEntry<double> *> &entries,
+      VocabCounts *counts) const
   {
     if (!_train && content.empty())
       throw InputConnectorBadParamException("no text data found");
@@ -336,37 +400,48 @@ namespace dd
     for (std::string ct : cts)
       {
         if (_lower_case)
-          std::transform(ct.begin(), ct.end(), ct.begin(), ::tolower);
+          {
+            if (_wordpiece_tokens)
+              utf8_lower(ct);
+            else
+              std::transform(ct.begin(), ct.end(), ct.begin(), ::tolower);
+          }
         if (!_characters)
           {
-            std::unordered_map<std::string, Word>::iterator vhit;
             std::vector<std::string> tokens;
+            if (_wordpiece_tokens)
+              wordpiece._tokens.clear();
+            // words are cut in pieces as they are read
+            auto add_token = [&](const char *str, const size_t &len) {
+              if (_wordpiece_tokens)
+                wordpiece.append_input(str, len);
+              else
+                tokens.emplace_back(str, len);
+            };
             if (_punctuation_tokens)
               {
-                boost::char_separator<char> sep("\n\t\f\r ");
-                boost::tokenizer<boost::char_separator<char>> tokenizer(ct,
-                                                                        sep);
-
-                // Split punctuation
+                // Split on spaces and punctuation, punctuation signs being
+                // tokens
                 auto is_punct = [](char i) {
                   return (i >= 33 && i <= 47) || (i >= 58 && i <= 64)
                          || (i >= 91 && i <= 96) || (i >= 123 && i <= 126);
                 };
-                for (std::string token : tokenizer)
+                auto is_space = [](char i) {
+                  return i == '\n' || i == '\t' || i == '\f' || i == '\r'
+                         || i == ' ';
+                };
+                const char *str = ct.data();
+                size_t start = 0;
+                for (size_t i = 0; i <= ct.size(); ++i)
                   {
-                    int start = 0;
-                    for (int i = 0; i < static_cast<int>(token.size()); ++i)
-                      {
-                        if (is_punct(token[i]))
-                          {
-                            if (i != start)
-                              tokens.push_back(token.substr(start, i - start));
-                            tokens.push_back(token.substr(i, 1));
-                            start = i + 1;
-                          }
-                      }
-                    if (start != static_cast<int>(token.size()))
-                      tokens.push_back(token.substr(start));
+                    bool end = i == ct.size();
+                    if (!end && !is_space(str[i]) && !is_punct(str[i]))
+                      continue;
+                    if (i != start)
+                      add_token(str + start, i - start);
+                    if (!end && is_punct(str[i]))
+                      add_token(str + i, 1);
+                    start = i + 1;
                   }
               }
             else
@@ -375,18 +450,13 @@ namespace dd
                     "\n\t\f\r ,.;:`'!?)(-|><^·&\"\\/{}#$–=+");
                 boost::tokenizer<boost::char_separator<char>> tokenizer(ct,
                                                                         sep);
-                tokens.insert(tokens.end(), tokenizer.begin(),
-                              tokenizer.end());
+                for (const std::string &token : tokenizer)
+                  add_token(token.data(), token.size());
               }
             if (_wordpiece_tokens)
               {
-                _wordpiece_tokenizer.reset();
-                for (const std::string &token : tokens)
-                  {
-                    _wordpiece_tokenizer.append_input(token);
-                  }
-                tokens = std::move(_wordpiece_tokenizer._tokens);
-                _wordpiece_tokenizer._tokens = std::vector<std::string>();
+                tokens = std::move(wordpiece._tokens);
+                wordpiece._tokens = std::vector<std::string>();
               }
 
             if (_ordered_words)
@@ -396,11 +466,7 @@ namespace dd
                   {
                     towe->add_word(w);
                   }
-
-                if (test_id < 0)
-                  _txt.push_back(towe);
-                else
-                  _tests_txt[static_cast<size_t>(test_id)].push_back(towe);
+                entries.push_back(towe);
               }
             else
               {
@@ -410,31 +476,12 @@ namespace dd
                     if (static_cast<int>(w.length()) < _min_word_length)
                       continue;
 
-                    // check and fillup vocab.
-                    int pos = -1;
-                    if ((vhit = _vocab.find(w)) == _vocab.end())
-                      {
-                        if (_train)
-                          {
-                            pos = _vocab.size();
-                            _vocab.emplace(std::make_pair(w, Word(pos)));
-                          }
-                      }
-                    else
-                      {
-                        if (_train)
-                          {
-                            (*vhit).second._total_count++;
-                            if (!tbe->has_word(w))
-                              (*vhit).second._total_docs++;
-                          }
-                      }
+                    // count words for the vocab.
+                    if (counts)
+                      counts->add(w, !tbe->has_word(w));
                     tbe->add_word(w, 1.0, _count);
                   }
-                if (test_id < 0)
-                  _txt.push_back(tbe);
-                else
-                  _tests_txt[static_cast<size_t>(test_id)].push_back(tbe);
+                entries.push_back(tbe);
               }
           }
         else // character-level features
@@ -485,11 +532,42 @@ namespace dd
                   }
                 while (str_i < end && seq < _sequence);
               }
-            if (test_id < 0)
-              _txt.push_back(tce);
-            else
-              _tests_txt[static_cast<size_t>(test_id)].push_back(tce);
-            std::cerr << "\rloaded text samples=" << _txt.size();
+            entries.push_back(tce);
+          }
+      }
+  }
+
+  void TxtInputFileConn::add_entries(std::vector<TxtEntry<double> *> &entries,
+                                     int test_id)
+  {
+    std::vector<TxtEntry<double> *> &txt
+        = test_id < 0 ? _txt : _tests_txt[static_cast<size_t>(test_id)];
+    txt.insert(txt.end(), entries.begin(), entries.end());
+    entries.clear();
+    if (_characters)
+      std::cerr << "\rloaded text samples=" << _txt.size();
+  }
+
+  void TxtInputFileConn::merge_vocab_counts(const VocabCounts &counts)
+  {
+    std::vector<const std::pair<const std::string, Word> *> words(
+        counts._words.size());
+    for (auto &w : counts._words)
+      words[w.second._pos] = &w;
+    for (auto w : words)
+      {
+        auto vhit = _vocab.find(w->first);
+        if (vhit == _vocab.end())
+          {
+            _vocab.emplace(w->first,
+                           Word(_vocab.size(), w->second._total_count,
+                                w->second._total_docs));
+            ++_vocab_version;
+          }
+        else
+          {
+            (*vhit).second._total_count += w->second._total_count;
+            (*vhit).second._total_docs += w->second._total_docs;
           }
       }
   }
@@ -505,7 +583,7 @@ namespace dd
                                             + vocabfname);
     for (auto const &p : _vocab)
       {
-        out << p.first << delim << p.second._pos << std::endl;
+        out << p.first << delim << p.second._pos << '\n';
       }
     out.close();
   }
@@ -541,6 +619,7 @@ namespace dd
         int pos = std::atoi(tokens.at(1).c_str());
         _vocab.emplace(std::make_pair(key, Word(pos)));
       }
+    ++_vocab_version;
     _logger->info("loaded vocabulary of size={}", _vocab.size());
   }
 
@@ -25,8 +25,10 @@
 #include "inputconnectorstrategy.h"
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <random>
 #include "utf8.h"
+#include "utils/vocabtrie.hpp"
 
 namespace dd
 {
@@ -73,6 +75,33 @@ namespace dd
     int _total_docs = 1;
   };
 
+  /**
+   * \brief word occurrence and document counts over a set of documents,
+   * word positions being their order of first appearance
+   */
+  class VocabCounts
+  {
+  public:
+    /**
+     * \brief counts an occurrence of a word
+     * @param new_doc whether the word is first seen in the current document
+     */
+    void add(const std::string &w, const bool &new_doc)
+    {
+      auto wit = _words.find(w);
+      if (wit == _words.end())
+        _words.emplace(w, Word(_words.size()));
+      else
+        {
+          (*wit).second._total_count++;
+          if (new_doc)
+            (*wit).second._total_docs++;
+        }
+    }
+
+    std::unordered_map<std::string, Word> _words;
+  };
+
   template <typename T> class TxtEntry
   {
   public:
@@ -270,12 +299,27 @@ namespace dd
     {
     }
 
+    /**
+     * \brief clears tokens, and rebuilds the vocabulary tries if the
+     * vocabulary or the affixes changed
+     */
     void reset()
     {
       _tokens.clear();
+      update_tries();
+    }
+
+    void append_input(const std::string &word)
+    {
+      append_input(word.data(), word.size());
     }
 
-    void append_input(const std::string &word);
+    /**
+     * \brief cuts a word in pieces, appended to _tokens
+     */
+    void append_input(const char *word, const size_t &len);
+
+    void update_tries();
 
   public:
     bool in_vocab(const std::string &tok);
@@ -286,6 +330,24 @@ namespace dd
         = ""; /**< Tokens corresponding to word or word beggining in the
                  vocabulary are prefixed by this */
     std::string _unk_token = "[UNK]";
+
+  private:
+    /**
+     * \brief tries over the word start and suffix pieces of the vocabulary,
+     * without their prefix
+     */
+    struct VocabTries
+    {
+      VocabTrie _word;
+      VocabTrie _suffix;
+      std::vector<std::string> _pieces; /**< vocabulary pieces, by value */
+      size_t _vocab_version = 0;
+      size_t _vocab_size = 0;
+      std::string _word_start;
+      std::string _suffix_start;
+    };
+    std::shared_ptr<const VocabTries>
+        _tries; /**< shared by connector copies */
   };
 
   class TxtInputFileConn : public InputConnectorStrategy
@@ -306,7 +368,7 @@ namespace dd
           _alphabet_str(i._alphabet_str), _alphabet(i._alphabet),
           _sequence(i._sequence), _seq_forward(i._seq_forward),
           _generate_vocab(i._generate_vocab), _vocab(i._vocab),
-          _vocab_sep(i._vocab_sep),
+          _vocab_version(i._vocab_version), _vocab_sep(i._vocab_sep),
           _wordpiece_tokenizer(i._wordpiece_tokenizer), _ndbed(i._ndbed)
     {
       _wordpiece_tokenizer._ctfc = this;
@@ -518,6 +580,29 @@ namespace dd
                                const float &target = -1, int test_id = -1);
     // test -1 for train, 0 ,1  ... for test_id
 
+    /**
+     * \brief text tokenization into entries, thread safe as it leaves the
+     * connector untouched
+     * @param wordpiece tokenizer, with up to date vocabulary tries
+     * @param entries sink for the parsed entries
+     * @param counts if not null, sink for the entries word counts
+     */
+    void parse_entries(const std::string &content, const float &target,
+                       WordPieceTokenizer &wordpiece,
+                       std::vector<TxtEntry<double> *> &entries,
+                       VocabCounts *counts) const;
+
+    /**
+     * \brief adds parsed entries to the training or test set
+     */
+    void add_entries(std::vector<TxtEntry<double> *> &entries, int test_id);
+
+    /**
+     * \brief adds word counts to the vocabulary, new words being appended
+     * in their order of first appearance
+     */
+    void merge_vocab_counts(const VocabCounts &counts);
+
     // serialization of vocabulary
     void serialize_vocab();
     void deserialize_vocab(const bool &required = true);
@@ -561,6 +646,9 @@ namespace dd
     bool _generate_vocab = true;
     std::unordered_map<std::string, Word>
         _vocab; /**< string to word stats, including word */
+    size_t _vocab_version
+        = 0; /**< incremented on every vocabulary change, tokenizer tries
+                being rebuilt on change */
     std::string _vocabfname = "vocab.dat";
     std::string _correspname = "corresp.txt";
     char _vocab_sep = ','; /**< vocabulary separator */
@@ -26,6 +26,7 @@
 #include <map>
 
 #include "dto/predict_out.hpp"
+#include "utils/float_utils.hpp"
 
 namespace dd
 {
@@ -35,6 +36,7 @@ namespace dd
   public:
     oatpp::Object<DTO::Dimensions> _imgsize;
     oatpp::UnorderedFields<DTO::DTOVector<double>> _confidences;
+    oatpp::UnorderedFields<oatpp::Object<DTO::RLEMask>> _rle;
   };
 
   class UnsupervisedResult
@@ -82,6 +84,7 @@ namespace dd
     std::vector<double> _vals;
     std::vector<bool> _bvals;
     std::string _str;
+    std::vector<int> _shape; /**< shape of values, if known */
     std::vector<cv::Mat> _images;
 #ifdef USE_SIMSEARCH
     bool _indexed = false;
@@ -125,6 +128,24 @@ namespace dd
 
       if (ad_out.has("encoding"))
         _image_encoding = ad_out.get("encoding").get<std::string>();
+      // label maps must be encoded losslessly to keep class ids intact
+      if (ad_out.has("mask_format")
+          && ad_out.get("mask_format").get<std::string>() == "png")
+        _image_encoding = ".png";
+      if (ad_out.has("vals_format"))
+        set_vals_format(ad_out.get("vals_format").get<std::string>());
+    }
+
+    /**
+     * \brief sets the binary float format of output values
+     * @param format float32, float16, or empty for decimal values
+     */
+    void set_vals_format(const std::string &format)
+    {
+      if (!format.empty() && float_utils::format_size(format) == 0)
+        throw OutputConnectorBadParamException(
+            "unknown vals_format " + format + ", expects float32 or float16");
+      _vals_format = format;
     }
 
     void set_results(std::vector<UnsupervisedResult> &&results)
@@ -178,12 +199,33 @@ namespace dd
                           DTO::DTOVector<double>(std::move(vec))));
                     }
                 }
+              if (ad.has("rle"))
+                {
+                  extra._rle = oatpp::UnorderedFields<
+                      oatpp::Object<DTO::RLEMask>>::createShared();
+                  const APIData &rle = ad.getobj_ref("rle");
+                  for (const std::string &key : rle.list_keys())
+                    {
+                      const APIData &mask = rle.getobj_ref(key);
+                      auto mask_dto = DTO::RLEMask::createShared();
+                      mask_dto->size
+                          = oatpp::Vector<oatpp::UInt32>::createShared();
+                      mask_dto->size->push_back(mask.get_ref<int>("height"));
+                      mask_dto->size->push_back(mask.get_ref<int>("width"));
+                      mask_dto->counts
+                          = mask.get_ref<std::string>("counts").c_str();
+                      extra._rle->emplace(key.c_str(), mask_dto);
+                    }
+                }
               std::string meta_uri;
               if (ad.has("index_uri"))
                 meta_uri = ad.get("index_uri").get<std::string>();
               else if (ad.has("meta_uri"))
                 meta_uri = ad.get("meta_uri").get<std::string>();
               _vvres.push_back(UnsupervisedResult(uri, vals, extra, meta_uri));
+              if (ad.has("vals_shape"))
+                _vvres.back()._shape
+                    = ad.get("vals_shape").get<std::vector<int>>();
               if (ad.get("vals").is<std::vector<cv::Mat>>())
                 {
                   _vvres.back()._images
@@ -212,6 +254,8 @@ namespace dd
       _binarized = output_params->binarized;
       _bool_binarized = output_params->bool_binarized;
       _string_binarized = output_params->string_binarized;
+      if (output_params->vals_format)
+        set_vals_format(*output_params->vals_format);
 
       if (_binarized)
         {
@@ -340,11 +384,26 @@ namespace dd
                 pred_dto->images->push_back(
                     DTO::VImage{ image, _image_encoding });
             }
+          else if (_vvres.at(i)._extra._rle != nullptr)
+            pred_dto->rle = _vvres.at(i)._extra._rle;
           else if (_bool_binarized)
             pred_dto->vals
                 = DTO::DTOVector<bool>(std::move(_vvres.at(i)._bvals));
           else if (_string_binarized)
             pred_dto->vals = oatpp::String(_vvres.at(i)._str.c_str());
+          else if (!_vals_format.empty())
+            {
+              pred_dto->vals = oatpp::String(
+                  float_utils::to_base64(_vvres.at(i)._vals, _vals_format));
+              pred_dto->vals_format = _vals_format.c_str();
+              if (!_vvres.at(i)._shape.empty())
+                {
+                  pred_dto->vals_shape
+                      = oatpp::Vector<oatpp::Int32>::createShared();
+                  for (int d : _vvres.at(i)._shape)
+                    pred_dto->vals_shape->push_back(d);
+                }
+            }
           else
             pred_dto->vals
                 = DTO::DTOVector<double>(std::move(_vvres.at(i)._vals));
@@ -388,6 +447,8 @@ namespace dd
                                        representation of output values. */
     std::string _image_encoding
         = ".png"; /**< encoding used for output images */
+    std::string _vals_format; /**< binary float format of output values, if
+                                 any */
 #ifdef USE_SIMSEARCH
     int _search_nn = 10; /**< default nearest neighbors per search. */
 #endif
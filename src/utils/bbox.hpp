@@ -22,6 +22,11 @@
 #ifndef DD_UTILS_BBOX_HPP
 #define DD_UTILS_BBOX_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace dd
@@ -52,14 +57,231 @@ namespace dd
         return inter;
     }
 
+    /**
+     * \brief intersection over union of two boxes { xmin, ymin, xmax, ymax }
+     */
+    template <typename T> inline T iou(const T *bbox1, const T *bbox2)
+    {
+      T w = std::max(T(0), std::min(bbox1[2], bbox2[2])
+                               - std::max(bbox1[0], bbox2[0]));
+      T h = std::max(T(0), std::min(bbox1[3], bbox2[3])
+                               - std::max(bbox1[1], bbox2[1]));
+      T ainter = w * h;
+      T a1 = (bbox1[2] - bbox1[0]) * (bbox1[3] - bbox1[1]);
+      T a2 = (bbox2[2] - bbox2[0]) * (bbox2[3] - bbox2[1]);
+      return ainter / (a1 + a2 - ainter);
+    }
+
     template <typename T>
     inline T iou(const std::vector<T> &bbox1, const std::vector<T> &bbox2)
     {
-      auto a1 = area(bbox1);
-      auto a2 = area(bbox2);
-      auto inter = intersect(bbox1, bbox2);
-      auto ainter = area(inter);
-      return ainter / (a1 + a2 - ainter);
+      return iou(bbox1.data(), bbox2.data());
+    }
+
+    /**
+     * \brief boxes stored as one array per coordinate, so that the IoU of a
+     * box against many boxes is a vectorized loop
+     */
+    template <typename T> struct Boxes
+    {
+      void reserve(const size_t &n)
+      {
+        _xmin.reserve(n);
+        _ymin.reserve(n);
+        _xmax.reserve(n);
+        _ymax.reserve(n);
+        _area.reserve(n);
+      }
+
+      void add(const T &xmin, const T &ymin, const T &xmax, const T &ymax)
+      {
+        _xmin.push_back(xmin);
+        _ymin.push_back(ymin);
+        _xmax.push_back(xmax);
+        _ymax.push_back(ymax);
+        _area.push_back((xmax - xmin) * (ymax - ymin));
+      }
+
+      size_t size() const
+      {
+        return _xmin.size();
+      }
+
+      std::vector<T> get(const size_t &i) const
+      {
+        return { _xmin[i], _ymin[i], _xmax[i], _ymax[i] };
+      }
+
+      std::vector<T> _xmin;
+      std::vector<T> _ymin;
+      std::vector<T> _xmax;
+      std::vector<T> _ymax;
+      std::vector<T> _area;
+    };
+
+    /**
+     * \brief IoU of a box { xmin, ymin, xmax, ymax } with boxes [begin, end)
+     * @param ious output, end - begin values
+     */
+    template <typename T>
+    inline void iou_row(const T *bbox, const Boxes<T> &boxes,
+                        const size_t &begin, const size_t &end, T *ious)
+    {
+      const T xmin = bbox[0], ymin = bbox[1], xmax = bbox[2], ymax = bbox[3];
+      const T a = (xmax - xmin) * (ymax - ymin);
+      const T *bxmin = boxes._xmin.data(), *bymin = boxes._ymin.data();
+      const T *bxmax = boxes._xmax.data(), *bymax = boxes._ymax.data();
+      const T *barea = boxes._area.data();
+#pragma omp simd
+      for (size_t j = begin; j < end; ++j)
+        {
+          T w = std::max(T(0),
+                         std::min(xmax, bxmax[j]) - std::max(xmin, bxmin[j]));
+          T h = std::max(T(0),
+                         std::min(ymax, bymax[j]) - std::max(ymin, bymin[j]));
+          T ainter = w * h;
+          ious[j - begin] = ainter / (a + barea[j] - ainter);
+        }
+    }
+
+    /**
+     * \brief IoU of box i with boxes [begin, end) of the same set
+     */
+    template <typename T>
+    inline void iou_row(const Boxes<T> &boxes, const size_t &i,
+                        const size_t &begin, const size_t &end, T *ious)
+    {
+      const T bbox[4]
+          = { boxes._xmin[i], boxes._ymin[i], boxes._xmax[i], boxes._ymax[i] };
+      iou_row(bbox, boxes, begin, end, ious);
+    }
+
+    /**
+     * \brief number of boxes from which nms buckets kept boxes on a grid,
+     * instead of comparing every box to the following ones
+     */
+    inline size_t nms_grid_min_boxes()
+    {
+      return 2048;
+    }
+
+    /**
+     * \brief greedy nms, kept boxes being stored in the grid cells they
+     * overlap, so that a box is only compared to the kept boxes around it
+     * @return false if boxes can't be bucketed, e.g. non finite coordinates
+     */
+    template <typename T>
+    inline bool nms_sorted_bboxes_grid(const Boxes<T> &boxes,
+                                       std::vector<size_t> &picked,
+                                       const T &nms_threshold,
+                                       const std::vector<int> *labels,
+                                       const size_t &max_picked)
+    {
+      const size_t n = boxes.size();
+      T x0 = boxes._xmin[0], y0 = boxes._ymin[0];
+      T x1 = boxes._xmax[0], y1 = boxes._ymax[0];
+      double mean_size = 0.0;
+      for (size_t i = 0; i < n; ++i)
+        {
+          if (!std::isfinite(boxes._xmin[i]) || !std::isfinite(boxes._ymin[i])
+              || !std::isfinite(boxes._xmax[i])
+              || !std::isfinite(boxes._ymax[i]))
+            return false;
+          x0 = std::min(x0, boxes._xmin[i]);
+          y0 = std::min(y0, boxes._ymin[i]);
+          x1 = std::max(x1, boxes._xmax[i]);
+          y1 = std::max(y1, boxes._ymax[i]);
+          mean_size += std::max(boxes._xmax[i] - boxes._xmin[i],
+                                boxes._ymax[i] - boxes._ymin[i]);
+        }
+      // cells about the size of boxes, in a bounded number
+      const size_t max_cells_side = 256;
+      double cell = std::max(mean_size / n, 1e-6);
+      cell = std::max(cell, static_cast<double>(std::max(x1 - x0, y1 - y0))
+                                / max_cells_side);
+      const int cols = static_cast<int>((x1 - x0) / cell) + 1;
+      const int rows = static_cast<int>((y1 - y0) / cell) + 1;
+      auto cell_of = [&](const T &v, const T &origin, const int &count) {
+        return std::min(count - 1,
+                        std::max(0, static_cast<int>((v - origin) / cell)));
+      };
+
+      std::vector<std::vector<size_t>> grid(cols * rows);
+      for (size_t i = 0; i < n; ++i)
+        {
+          const T bbox[4] = { boxes._xmin[i], boxes._ymin[i], boxes._xmax[i],
+                              boxes._ymax[i] };
+          const int cx0 = cell_of(bbox[0], x0, cols);
+          const int cx1 = cell_of(bbox[2], x0, cols);
+          const int cy0 = cell_of(bbox[1], y0, rows);
+          const int cy1 = cell_of(bbox[3], y0, rows);
+          bool keep = true;
+          for (int cy = cy0; keep && cy <= cy1; ++cy)
+            for (int cx = cx0; keep && cx <= cx1; ++cx)
+              for (size_t p : grid[cy * cols + cx])
+                {
+                  if (labels && (*labels)[p] != (*labels)[i])
+                    continue;
+                  const T pbox[4] = { boxes._xmin[p], boxes._ymin[p],
+                                      boxes._xmax[p], boxes._ymax[p] };
+                  if (iou(bbox, pbox) > nms_threshold)
+                    {
+                      keep = false;
+                      break;
+                    }
+                }
+          if (!keep)
+            continue;
+          picked.push_back(i);
+          if (max_picked > 0 && picked.size() >= max_picked)
+            break;
+          for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx)
+              grid[cy * cols + cx].push_back(i);
+        }
+      return true;
+    }
+
+    /**
+     * \brief greedy non maximum suppression
+     * @param boxes boxes sorted by decreasing confidence
+     * @param picked output, indices of the boxes kept by nms
+     * @param labels if not null, only boxes of a same label suppress each
+     * other
+     * @param max_picked maximum number of kept boxes, 0 for no limit
+     */
+    template <typename T>
+    inline void nms_sorted_bboxes(const Boxes<T> &boxes,
+                                  std::vector<size_t> &picked,
+                                  const T &nms_threshold,
+                                  const std::vector<int> *labels = nullptr,
+                                  const size_t &max_picked = 0)
+    {
+      picked.clear();
+      const size_t n = boxes.size();
+      // boxes that don't overlap never suppress each other, unless with a
+      // negative threshold
+      if (n >= nms_grid_min_boxes() && nms_threshold >= T(0)
+          && nms_sorted_bboxes_grid(boxes, picked, nms_threshold, labels,
+                                    max_picked))
+        return;
+      picked.clear();
+
+      std::vector<uint8_t> suppressed(n, 0);
+      std::vector<T> ious(n);
+      for (size_t i = 0; i < n; ++i)
+        {
+          if (suppressed[i])
+            continue;
+          picked.push_back(i);
+          if (max_picked > 0 && picked.size() >= max_picked)
+            break;
+          iou_row(boxes, i, i + 1, n, ious.data());
+          for (size_t j = i + 1; j < n; ++j)
+            if (ious[j - i - 1] > nms_threshold
+                && (!labels || (*labels)[j] == (*labels)[i]))
+              suppressed[j] = 1;
+        }
     }
 
     /** bboxes: list of bboxes in the format { xmin, ymin, xmax, ymax } sorted
@@ -71,66 +293,113 @@ namespace dd
     inline void nms_sorted_bboxes(const std::vector<std::vector<T>> &bboxes,
                                   std::vector<size_t> &picked, T nms_threshold)
     {
-      picked.clear();
-      const size_t n = bboxes.size();
+      Boxes<T> boxes;
+      boxes.reserve(bboxes.size());
+      for (const std::vector<T> &bbox : bboxes)
+        boxes.add(bbox[0], bbox[1], bbox[2], bbox[3]);
+      nms_sorted_bboxes(boxes, picked, nms_threshold);
+    }
 
-      for (size_t i = 0; i < n; i++)
+    /**
+     * \brief Soft-NMS: boxes overlapping a kept box see their score decayed,
+     * linearly above the IoU threshold, or with a gaussian of the IoU
+     * @param scores box scores, decayed in place
+     * @param picked output, indices of kept boxes by decreasing decayed score
+     * @param score_threshold boxes whose score falls below are dropped
+     * @param gaussian gaussian decay of parameter sigma, otherwise linear
+     */
+    template <typename T>
+    inline void soft_nms(const Boxes<T> &boxes, std::vector<T> &scores,
+                         std::vector<size_t> &picked, const T &iou_threshold,
+                         const T &score_threshold, const bool &gaussian,
+                         const T &sigma = T(0.5),
+                         const std::vector<int> *labels = nullptr,
+                         const size_t &max_picked = 0)
+    {
+      picked.clear();
+      const size_t n = boxes.size();
+      std::vector<uint8_t> done(n, 0);
+      std::vector<T> ious(n);
+      while (max_picked == 0 || picked.size() < max_picked)
         {
-          const std::vector<T> &bbox_a = bboxes[i];
-
-          bool keep = true;
-          for (size_t j = 0; j < picked.size(); j++)
+          size_t best = n;
+          for (size_t j = 0; j < n; ++j)
+            if (!done[j] && (best == n || scores[j] > scores[best]))
+              best = j;
+          if (best == n || scores[best] < score_threshold)
+            break;
+          done[best] = 1;
+          picked.push_back(best);
+          iou_row(boxes, best, 0, n, ious.data());
+          for (size_t j = 0; j < n; ++j)
             {
-              const std::vector<T> &bbox_b = bboxes[picked[j]];
-
-              // intersection over union
-              auto iou = bbox_utils::iou(bbox_a, bbox_b);
-              if (iou > nms_threshold)
-                keep = false;
+              if (done[j] || (labels && (*labels)[j] != (*labels)[best]))
+                continue;
+              if (gaussian)
+                scores[j] *= std::exp(-(ious[j] * ious[j]) / sigma);
+              else if (ious[j] > iou_threshold)
+                scores[j] *= T(1) - ious[j];
             }
-
-          if (keep)
-            picked.push_back(i);
         }
     }
 
-    inline void nms_sorted_bboxes(std::vector<APIData> &bboxes,
-                                  std::vector<double> &probs,
-                                  std::vector<std::string> &cats,
-                                  double nms_threshold, int best_bbox)
+    /**
+     * \brief nms of detections, see nms_sorted_bboxes and soft_nms
+     * @param best_bbox maximum number of kept boxes if > 0
+     * @param nms greedy, soft_linear or soft_gaussian
+     * @param per_class whether only boxes of a same category suppress each
+     * other
+     * @param score_threshold soft nms drops boxes whose confidence falls
+     * below
+     */
+    inline void
+    nms_sorted_bboxes(std::vector<APIData> &bboxes, std::vector<double> &probs,
+                      std::vector<std::string> &cats, double nms_threshold,
+                      int best_bbox, const std::string &nms = "greedy",
+                      const bool &per_class = false, const double &sigma = 0.5,
+                      const double &score_threshold = 0.0)
     {
-      std::vector<std::vector<double>> sorted_boxes;
-      std::vector<size_t> picked;
-
+      Boxes<double> boxes;
+      boxes.reserve(bboxes.size());
       for (size_t l = 0; l < bboxes.size(); ++l)
+        boxes.add(bboxes[l].get("xmin").get<double>(),
+                  bboxes[l].get("ymin").get<double>(),
+                  bboxes[l].get("xmax").get<double>(),
+                  bboxes[l].get("ymax").get<double>());
+      std::vector<int> labels;
+      if (per_class)
         {
-          std::vector<double> bbox_vec{ bboxes[l].get("xmin").get<double>(),
-                                        bboxes[l].get("ymin").get<double>(),
-                                        bboxes[l].get("xmax").get<double>(),
-                                        bboxes[l].get("ymax").get<double>() };
-          sorted_boxes.push_back(bbox_vec);
+          std::unordered_map<std::string, int> cat_labels;
+          for (const std::string &cat : cats)
+            labels.push_back(
+                cat_labels.emplace(cat, cat_labels.size()).first->second);
         }
-      // We assume that bboxes are already sorted in model output
+      const std::vector<int> *plabels = per_class ? &labels : nullptr;
+      const size_t max_picked = best_bbox > 0 ? best_bbox : 0;
 
-      bbox_utils::nms_sorted_bboxes(sorted_boxes, picked, nms_threshold);
+      std::vector<size_t> picked;
+      std::vector<double> scores(probs);
+      if (nms == "soft_linear" || nms == "soft_gaussian")
+        soft_nms(boxes, scores, picked, nms_threshold, score_threshold,
+                 nms == "soft_gaussian", sigma, plabels, max_picked);
+      else
+        // We assume that bboxes are already sorted in model output
+        bbox_utils::nms_sorted_bboxes(boxes, picked, nms_threshold, plabels,
+                                      max_picked);
       std::vector<APIData> nbboxes;
       std::vector<double> nprobs;
       std::vector<std::string> ncats;
 
       for (size_t pick : picked)
         {
-          nbboxes.push_back(bboxes.at(pick));
-          nprobs.push_back(probs.at(pick));
-          ncats.push_back(cats.at(pick));
-
-          if (best_bbox > 0
-              && nbboxes.size() >= static_cast<size_t>(best_bbox))
-            break;
+          nbboxes.push_back(std::move(bboxes.at(pick)));
+          nprobs.push_back(scores.at(pick));
+          ncats.push_back(std::move(cats.at(pick)));
         }
 
-      bboxes = nbboxes;
-      probs = nprobs;
-      cats = ncats;
+      bboxes = std::move(nbboxes);
+      probs = std::move(nprobs);
+      cats = std::move(ncats);
     }
   }
 }
@@ -0,0 +1,278 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_COLSTORE_H
+#define DD_COLSTORE_H
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace dd
+{
+  /**
+   * \brief append only table of doubles, stored by blocks of rows, each
+   * block laid out column after column
+   * Once its in-memory size goes above a threshold, full blocks are spilled
+   * to a file that is memory mapped for reading, so that tables larger than
+   * RAM can be built. A store can be written to a file, and read back as a
+   * view over the mapped file.
+   */
+  class ColumnStore
+  {
+  public:
+    ColumnStore(const size_t &ncols = 0, const size_t &block_rows = 4096)
+        : _ncols(ncols), _block_rows(block_rows)
+    {
+    }
+
+    ~ColumnStore()
+    {
+      release();
+    }
+
+    ColumnStore(const ColumnStore &) = delete;
+    ColumnStore &operator=(const ColumnStore &) = delete;
+
+    /**
+     * \brief clears the store and sets its number of columns
+     */
+    void init(const size_t &ncols)
+    {
+      release();
+      _ncols = ncols;
+    }
+
+    /**
+     * \brief spills full blocks to a file in dir once more than max_bytes are
+     * held in memory, 0 to never spill
+     */
+    void set_spill(const std::string &dir, const size_t &max_bytes)
+    {
+      _spill_dir = dir;
+      _spill_bytes = max_bytes;
+    }
+
+    void push_row(const double *vals)
+    {
+      if (_map)
+        throw std::runtime_error("column store is finalized");
+      size_t r = _rows % _block_rows;
+      if (r == 0)
+        _blocks.emplace_back(_ncols * _block_rows, 0.0);
+      double *block = _blocks.back().data();
+      for (size_t c = 0; c < _ncols; ++c)
+        block[c * _block_rows + r] = vals[c];
+      ++_rows;
+      if (r + 1 == _block_rows && _spill_bytes > 0
+          && (_fd >= 0 || mem_bytes() > _spill_bytes))
+        spill();
+    }
+
+    /**
+     * \brief ends appending, maps the spilled blocks if any. Spilled stores
+     * can only be read once finalized
+     */
+    void finalize()
+    {
+      if (_fd < 0 || _map)
+        return;
+      spill();
+      _map_len = _spilled_blocks * block_bytes();
+      void *map = mmap(nullptr, _map_len, PROT_READ, MAP_SHARED, _fd, 0);
+      if (map == MAP_FAILED)
+        throw std::runtime_error("failed mapping column store spill file");
+      _map = static_cast<const double *>(map);
+      madvise(map, _map_len, MADV_SEQUENTIAL);
+    }
+
+    /**
+     * \brief writes the blocks, the last one being cut to its rows, e.g.
+     * to a cache file. Spilled stores must be finalized first
+     */
+    void write(std::ostream &out) const
+    {
+      size_t nblocks = (_rows + _block_rows - 1) / _block_rows;
+      for (size_t b = 0; b < nblocks; ++b)
+        {
+          const double *data = block(b);
+          size_t brows = std::min(_block_rows, _rows - b * _block_rows);
+          for (size_t c = 0; c < _ncols; ++c)
+            out.write(reinterpret_cast<const char *>(data + c * stride(b)),
+                      brows * sizeof(double));
+        }
+    }
+
+    /**
+     * \brief size in bytes of write() output
+     */
+    static size_t data_bytes(const size_t &rows, const size_t &ncols)
+    {
+      return rows * ncols * sizeof(double);
+    }
+
+    /**
+     * \brief read only view over data laid out by write(), that must outlive
+     * the store, e.g. a memory mapped file
+     */
+    void view(const double *data, const size_t &rows)
+    {
+      release();
+      _map = data;
+      _rows = rows;
+      _view = true;
+    }
+
+    size_t rows() const
+    {
+      return _rows;
+    }
+
+    size_t cols() const
+    {
+      return _ncols;
+    }
+
+    double at(const size_t &row, const size_t &col) const
+    {
+      size_t b = row / _block_rows;
+      return block(b)[col * stride(b) + row % _block_rows];
+    }
+
+    /**
+     * \brief copies a row into vals
+     */
+    void row(const size_t &row, std::vector<double> &vals) const
+    {
+      const double *b = block(row / _block_rows);
+      size_t s = stride(row / _block_rows);
+      size_t r = row % _block_rows;
+      vals.resize(_ncols);
+      for (size_t c = 0; c < _ncols; ++c)
+        vals[c] = b[c * s + r];
+    }
+
+    bool spilled() const
+    {
+      return _fd >= 0;
+    }
+
+  private:
+    const double *block(const size_t &b) const
+    {
+      if (_map)
+        return _map + b * _ncols * _block_rows;
+      return _blocks.at(b - _spilled_blocks).data();
+    }
+
+    /**
+     * \brief distance between columns in a block, views having their last
+     * block cut to its rows
+     */
+    size_t stride(const size_t &b) const
+    {
+      if (_view && (b + 1) * _block_rows > _rows)
+        return _rows - b * _block_rows;
+      return _block_rows;
+    }
+
+    size_t block_bytes() const
+    {
+      return _ncols * _block_rows * sizeof(double);
+    }
+
+    size_t mem_bytes() const
+    {
+      return _blocks.size() * block_bytes();
+    }
+
+    /**
+     * \brief moves in-memory blocks to the spill file
+     */
+    void spill()
+    {
+      if (_fd < 0)
+        {
+          std::string fname = _spill_dir + "/colstore_XXXXXX";
+          std::vector<char> tmpl(fname.begin(), fname.end());
+          tmpl.push_back('\0');
+          _fd = mkstemp(tmpl.data());
+          if (_fd < 0)
+            throw std::runtime_error("failed creating column store file in "
+                                     + _spill_dir);
+          // file lives as long as the descriptor
+          unlink(tmpl.data());
+        }
+      for (size_t b = 0; b < _blocks.size(); ++b)
+        {
+          const char *data
+              = reinterpret_cast<const char *>(_blocks.at(b).data());
+          size_t left = block_bytes();
+          while (left > 0)
+            {
+              ssize_t w = ::write(_fd, data, left);
+              if (w < 0)
+                throw std::runtime_error(
+                    "failed writing column store spill file");
+              data += w;
+              left -= w;
+            }
+        }
+      _spilled_blocks += _blocks.size();
+      _blocks.clear();
+    }
+
+    void release()
+    {
+      if (_map && !_view)
+        munmap(const_cast<double *>(_map), _map_len);
+      if (_fd >= 0)
+        close(_fd);
+      _map = nullptr;
+      _map_len = 0;
+      _fd = -1;
+      _blocks.clear();
+      _spilled_blocks = 0;
+      _rows = 0;
+      _view = false;
+    }
+
+    size_t _ncols = 0;
+    size_t _block_rows = 4096;
+    size_t _rows = 0;
+    std::vector<std::vector<double>> _blocks; /**< in-memory blocks */
+    std::string _spill_dir = ".";
+    size_t _spill_bytes = 0;    /**< in-memory size limit, 0 for no limit */
+    int _fd = -1;               /**< spill file descriptor */
+    size_t _spilled_blocks = 0; /**< number of blocks in the spill file */
+    const double *_map = nullptr;
+    size_t _map_len = 0;
+    bool _view = false; /**< whether _map is borrowed, see view() */
+  };
+}
+
+#endif
@@ -0,0 +1,504 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_CSVCACHE_H
+#define DD_CSVCACHE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "colstore.hpp"
+
+namespace dd
+{
+  /**
+   * \brief binary cache of parsed CSV data
+   * A cache file holds tables of lines, each line being an id and a fixed
+   * number of values, along with named lists of strings and of values for
+   * the connector state (categoricals, labels, scaling bounds). Table values
+   * are column stores, see ColumnStore::write, and the file ends with a
+   * footer that describes its content, along with the source files and a
+   * fingerprint of the source data and parameters.
+   *
+   * File layout: table values and ids, footer, footer offset (uint64),
+   * magic.
+   */
+  class CSVCache
+  {
+  public:
+    static const char *magic()
+    {
+      return "DDCSVC02";
+    }
+
+    /**
+     * \brief in-memory size of a table above which it is spilled next to the
+     * cache file while being written
+     */
+    static size_t spill_bytes()
+    {
+      return 256 * 1024 * 1024;
+    }
+
+    struct Table
+    {
+      std::string _name;
+      int _group = -1; /**< -1 for training data, test set id otherwise */
+      uint64_t _rows = 0;
+      uint64_t _cols = 0;
+      uint64_t _data_offset = 0; /**< offset of the values */
+      uint64_t _ids_offset = 0;  /**< offset of the '\0' terminated ids */
+      uint64_t _ids_bytes = 0;
+    };
+
+    CSVCache()
+    {
+    }
+
+    ~CSVCache()
+    {
+      close_map();
+      if (_out.is_open())
+        {
+          _out.close();
+          std::remove(_tmp_fname.c_str());
+        }
+    }
+
+    CSVCache(const CSVCache &) = delete;
+    CSVCache &operator=(const CSVCache &) = delete;
+
+    /**
+     * \brief fingerprint of source files: path, size and modification time
+     */
+    static std::string files_fingerprint(const std::vector<std::string> &files)
+    {
+      std::string fp;
+      for (const std::string &f : files)
+        {
+          struct stat st;
+          if (stat(f.c_str(), &st) != 0)
+            return "";
+          fp += f + ":" + std::to_string(st.st_size) + ":"
+                + std::to_string(st.st_mtime) + ";";
+        }
+      return fp;
+    }
+
+    /*- reading -*/
+
+    /**
+     * \brief maps a cache file, false if it does not exist, is invalid or
+     * does not match the fingerprint
+     */
+    bool open(const std::string &fname, const std::string &fingerprint)
+    {
+      if (!open_map(fname))
+        return false;
+      if (_fingerprint != fingerprint)
+        {
+          close_map();
+          return false;
+        }
+      madvise(const_cast<char *>(_map), _map_len, MADV_SEQUENTIAL);
+      return true;
+    }
+
+    /**
+     * \brief whether a cache file is invalid or its source files changed
+     * since it was written
+     */
+    static bool stale(const std::string &fname)
+    {
+      CSVCache cache;
+      if (!cache.open_map(fname))
+        return true;
+      return files_fingerprint(cache._sources) != cache._files_fingerprint;
+    }
+
+    const std::vector<Table> &tables() const
+    {
+      return _tables;
+    }
+
+    /**
+     * \brief reads all lines of a table
+     * @param fn called with the id and values of every line, in order
+     */
+    template <typename F> void read_table(const Table &t, F fn) const
+    {
+      ColumnStore store(t._cols);
+      store.view(reinterpret_cast<const double *>(_map + t._data_offset),
+                 t._rows);
+      const char *id = _map + t._ids_offset;
+      const char *ids_end = id + t._ids_bytes;
+      std::vector<double> vals;
+      for (uint64_t r = 0; r < t._rows; ++r)
+        {
+          const char *id_end
+              = static_cast<const char *>(memchr(id, '\0', ids_end - id));
+          if (!id_end)
+            throw std::runtime_error("truncated cache ids");
+          std::string sid(id, id_end);
+          id = id_end + 1;
+          store.row(r, vals);
+          fn(sid, vals);
+        }
+    }
+
+    /*- writing -*/
+
+    /**
+     * \brief starts writing a cache file, written aside and renamed on
+     * close
+     * @param sources data files the cache is built from, see stale()
+     */
+    bool create(const std::string &fname,
+                const std::vector<std::string> &sources)
+    {
+      _fname = fname;
+      _sources = sources;
+      _files_fingerprint = files_fingerprint(sources);
+      _tmp_fname = fname + ".tmp" + std::to_string(getpid());
+      std::string dir = fname.substr(0, fname.find_last_of('/') + 1);
+      _store.set_spill(dir.empty() ? "." : dir, spill_bytes());
+      _out.open(_tmp_fname, std::ios::binary | std::ios::trunc);
+      _failed = !_out.is_open();
+      return !_failed;
+    }
+
+    void begin_table(const std::string &name, const int &group)
+    {
+      Table t;
+      t._name = name;
+      t._group = group;
+      // blocks of doubles are kept aligned
+      uint64_t offset = _out.tellp();
+      for (; offset % sizeof(double) != 0; ++offset)
+        _out.put('\0');
+      t._data_offset = offset;
+      _tables.push_back(t);
+      _ids.clear();
+      _store.init(0);
+    }
+
+    void add_line(const std::string &id, const std::vector<double> &vals)
+    {
+      if (_failed)
+        return;
+      Table &t = _tables.back();
+      if (t._rows == 0)
+        {
+          t._cols = vals.size();
+          _store.init(t._cols);
+        }
+      if (vals.size() != t._cols || id.find('\0') != std::string::npos)
+        {
+          // lines of varying sizes are not cached
+          _failed = true;
+          return;
+        }
+      _store.push_row(vals.data());
+      _ids.append(id);
+      _ids.push_back('\0');
+      ++t._rows;
+    }
+
+    void end_table()
+    {
+      if (_failed)
+        return;
+      Table &t = _tables.back();
+      _store.finalize();
+      _store.write(_out);
+      _store.init(0);
+      t._ids_offset = _out.tellp();
+      t._ids_bytes = _ids.size();
+      _out.write(_ids.data(), _ids.size());
+      _ids.clear();
+    }
+
+    void add_list(const std::string &key,
+                  const std::vector<std::string> &list)
+    {
+      _lists[key] = list;
+    }
+
+    void add_values(const std::string &key, const std::vector<double> &values)
+    {
+      _values[key] = values;
+    }
+
+    /**
+     * \brief writes the footer and moves the file in place
+     * @return false if writing failed, in which case no file is left
+     */
+    bool close(const std::string &fingerprint)
+    {
+      if (!_out.is_open())
+        return false;
+      if (!_failed)
+        {
+          uint64_t footer = _out.tellp();
+          write_string(fingerprint);
+          write_string(_files_fingerprint);
+          write_u64(_sources.size());
+          for (const std::string &s : _sources)
+            write_string(s);
+          write_u64(_lists.size());
+          for (auto &l : _lists)
+            {
+              write_string(l.first);
+              write_u64(l.second.size());
+              for (const std::string &s : l.second)
+                write_string(s);
+            }
+          write_u64(_values.size());
+          for (auto &v : _values)
+            {
+              write_string(v.first);
+              write_u64(v.second.size());
+              _out.write(reinterpret_cast<const char *>(v.second.data()),
+                         v.second.size() * sizeof(double));
+            }
+          write_u64(_tables.size());
+          for (const Table &t : _tables)
+            {
+              write_string(t._name);
+              write_u64(static_cast<uint64_t>(static_cast<int64_t>(t._group)));
+              write_u64(t._rows);
+              write_u64(t._cols);
+              write_u64(t._data_offset);
+              write_u64(t._ids_offset);
+              write_u64(t._ids_bytes);
+            }
+          write_u64(footer);
+          _out.write(magic(), strlen(magic()));
+        }
+      _out.close();
+      if (_failed || !_out.good())
+        {
+          std::remove(_tmp_fname.c_str());
+          return false;
+        }
+      return std::rename(_tmp_fname.c_str(), _fname.c_str()) == 0;
+    }
+
+    std::map<std::string, std::vector<std::string>> _lists;
+    std::map<std::string, std::vector<double>> _values;
+
+  private:
+    /**
+     * \brief maps a cache file and reads its footer, checking that all
+     * tables lie within the file
+     */
+    bool open_map(const std::string &fname)
+    {
+      close_map();
+      int fd = ::open(fname.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      size_t magic_len = strlen(magic());
+      if (fstat(fd, &st) != 0
+          || static_cast<size_t>(st.st_size) < magic_len + sizeof(uint64_t))
+        {
+          ::close(fd);
+          return false;
+        }
+      _map_len = st.st_size;
+      void *map = mmap(nullptr, _map_len, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (map == MAP_FAILED)
+        {
+          _map_len = 0;
+          return false;
+        }
+      _map = static_cast<const char *>(map);
+
+      try
+        {
+          const char *end = _map + _map_len;
+          if (memcmp(end - magic_len, magic(), magic_len) != 0)
+            throw std::runtime_error("bad magic");
+          uint64_t footer;
+          memcpy(&footer, end - magic_len - sizeof(uint64_t),
+                 sizeof(uint64_t));
+          if (footer > _map_len - magic_len - sizeof(uint64_t))
+            throw std::runtime_error("bad footer offset");
+          _cursor = footer;
+          _fingerprint = read_string();
+          _files_fingerprint = read_string();
+          uint64_t n = read_u64();
+          for (uint64_t i = 0; i < n; ++i)
+            _sources.push_back(read_string());
+          n = read_u64();
+          for (uint64_t i = 0; i < n; ++i)
+            {
+              std::string key = read_string();
+              std::vector<std::string> &list = _lists[key];
+              uint64_t m = read_u64();
+              for (uint64_t j = 0; j < m; ++j)
+                list.push_back(read_string());
+            }
+          n = read_u64();
+          for (uint64_t i = 0; i < n; ++i)
+            {
+              std::string key = read_string();
+              uint64_t m = read_u64();
+              if (m > (_map_len - _cursor) / sizeof(double))
+                throw std::runtime_error("truncated cache file");
+              std::vector<double> &values = _values[key];
+              values.resize(m);
+              read_bytes(values.data(), m * sizeof(double));
+            }
+          n = read_u64();
+          for (uint64_t i = 0; i < n; ++i)
+            {
+              Table t;
+              t._name = read_string();
+              t._group = static_cast<int>(static_cast<int64_t>(read_u64()));
+              t._rows = read_u64();
+              t._cols = read_u64();
+              t._data_offset = read_u64();
+              t._ids_offset = read_u64();
+              t._ids_bytes = read_u64();
+              check_table(t, footer);
+              _tables.push_back(t);
+            }
+        }
+      catch (std::exception &e)
+        {
+          close_map();
+          return false;
+        }
+      return true;
+    }
+
+    /**
+     * \brief throws if the values or ids of a table are not within the
+     * data part of the file, or ids do not match the number of lines
+     */
+    void check_table(const Table &t, const uint64_t &footer) const
+    {
+      if (t._data_offset % sizeof(double) != 0 || t._data_offset > footer)
+        throw std::runtime_error("bad table offset");
+      if (t._rows > 0
+          && (t._cols == 0
+              || t._cols > (footer - t._data_offset) / sizeof(double)
+              || t._rows > (footer - t._data_offset) / sizeof(double)
+                               / t._cols))
+        throw std::runtime_error("truncated table");
+      if (t._data_offset + ColumnStore::data_bytes(t._rows, t._cols)
+          > t._ids_offset)
+        throw std::runtime_error("overlapping table");
+      if (t._ids_offset > footer || t._ids_bytes > footer - t._ids_offset)
+        throw std::runtime_error("truncated table ids");
+      const char *ids = _map + t._ids_offset;
+      if (static_cast<uint64_t>(std::count(ids, ids + t._ids_bytes, '\0'))
+              != t._rows
+          || (t._ids_bytes > 0 && ids[t._ids_bytes - 1] != '\0'))
+        throw std::runtime_error("bad table ids");
+    }
+
+    void write_u64(const uint64_t &v)
+    {
+      _out.write(reinterpret_cast<const char *>(&v), sizeof(uint64_t));
+    }
+
+    void write_string(const std::string &s)
+    {
+      write_u64(s.size());
+      _out.write(s.data(), s.size());
+    }
+
+    void read_bytes(void *dst, const size_t &n)
+    {
+      if (n > _map_len - _cursor)
+        throw std::runtime_error("truncated cache file");
+      if (n > 0)
+        memcpy(dst, _map + _cursor, n);
+      _cursor += n;
+    }
+
+    uint64_t read_u64()
+    {
+      uint64_t v;
+      read_bytes(&v, sizeof(uint64_t));
+      return v;
+    }
+
+    std::string read_string()
+    {
+      uint64_t n = read_u64();
+      if (n > _map_len - _cursor)
+        throw std::runtime_error("truncated cache file");
+      std::string s(_map + _cursor, n);
+      _cursor += n;
+      return s;
+    }
+
+    void close_map()
+    {
+      if (_map)
+        munmap(const_cast<char *>(_map), _map_len);
+      _map = nullptr;
+      _map_len = 0;
+      _tables.clear();
+      _lists.clear();
+      _values.clear();
+      _sources.clear();
+      _fingerprint.clear();
+      _files_fingerprint.clear();
+    }
+
+    std::vector<Table> _tables;
+    std::vector<std::string> _sources;
+    std::string _files_fingerprint; /**< of _sources, see stale() */
+
+    // reading
+    const char *_map = nullptr;
+    size_t _map_len = 0;
+    size_t _cursor = 0;
+    std::string _fingerprint;
+
+    // writing
+    std::string _fname;
+    std::string _tmp_fname;
+    std::ofstream _out;
+    bool _failed = false;
+    ColumnStore _store; /**< values of the table being written */
+    std::string _ids;
+  };
+}
+
+#endif
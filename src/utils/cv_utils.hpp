@@ -22,6 +22,7 @@
 #ifndef DD_UTILS_CVUTILS_HPP
 #define DD_UTILS_CVUTILS_HPP
 
+#include <map>
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include "ext/base64/base64.h"
@@ -73,6 +74,82 @@ namespace dd
         throw std::runtime_error("Image could not be encoded");
       return encoded;
     }
+
+    /**
+     * \brief COCO run-length encodings of a label map, one per label
+     * Pixels are scanned in column-major order, and counts alternate between
+     * runs of other labels and runs of the label, starting with the former.
+     * @param labels single channel label map, of 8, 16 or 32 bit integers
+     */
+    inline std::map<int, std::vector<uint32_t>>
+    labels_to_rle(const cv::Mat &labels)
+    {
+      cv::Mat lt;
+      cv::transpose(labels, lt); // so that columns are contiguous
+      if (lt.type() != CV_32SC1)
+        lt.convertTo(lt, CV_32S);
+      if (!lt.isContinuous())
+        lt = lt.clone();
+      const int *l = lt.ptr<int>();
+      const uint32_t total = lt.total();
+
+      std::map<int, std::vector<uint32_t>> rles;
+      std::map<int, uint32_t> ends; // end of the last run of each label
+      uint32_t p = 0;
+      while (p < total)
+        {
+          uint32_t q = p + 1;
+          while (q < total && l[q] == l[p])
+            ++q;
+          std::vector<uint32_t> &counts = rles[l[p]];
+          counts.push_back(p - ends[l[p]]);
+          counts.push_back(q - p);
+          ends[l[p]] = q;
+          p = q;
+        }
+      for (auto &r : rles)
+        if (ends[r.first] < total)
+          r.second.push_back(total - ends[r.first]);
+      return rles;
+    }
+
+    /**
+     * \brief COCO run-length encoding of a binary mask, of non-zero pixels
+     */
+    inline std::vector<uint32_t> mask_to_rle(const cv::Mat &mask)
+    {
+      cv::Mat bin = mask != 0;
+      auto rles = labels_to_rle(bin);
+      auto rit = rles.find(255);
+      if (rit == rles.end())
+        return std::vector<uint32_t>{ static_cast<uint32_t>(mask.total()) };
+      return rit->second;
+    }
+
+    /**
+     * \brief compressed string of COCO run-length counts, as in pycocotools
+     */
+    inline std::string rle_to_string(const std::vector<uint32_t> &counts)
+    {
+      std::string s;
+      for (size_t i = 0; i < counts.size(); ++i)
+        {
+          long x = counts[i];
+          if (i > 2)
+            x -= static_cast<long>(counts[i - 2]);
+          bool more = true;
+          while (more)
+            {
+              char c = x & 0x1f;
+              x >>= 5;
+              more = (c & 0x10) ? x != -1 : x != 0;
+              if (more)
+                c |= 0x20;
+              s.push_back(c + 48);
+            }
+        }
+      return s;
+    }
   }
 }
 
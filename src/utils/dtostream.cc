@@ -0,0 +1,247 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dtostream.hpp"
+
+#include "dto/ddtypes.hpp"
+
+namespace dd
+{
+  namespace oatpp_utils
+  {
+    static oatpp::Void unwrapAny(oatpp::Void polymorph)
+    {
+      while (polymorph != nullptr
+             && polymorph.getValueType() == oatpp::Any::Class::getType())
+        {
+          auto anyHandle
+              = static_cast<oatpp::data::mapping::type::AnyHandle *>(
+                  polymorph.get());
+          polymorph = oatpp::Void(anyHandle->ptr, anyHandle->type);
+        }
+      return polymorph;
+    }
+
+    DTOStream::DTOStream(const JVal &envelope, const std::string &key,
+                         const oatpp::Void &dto, const Format &format)
+        : ValueStream(format)
+    {
+      Frame root;
+      root._object = true;
+      for (auto m = envelope.MemberBegin(); m != envelope.MemberEnd(); ++m)
+        root._members.push_back(
+            Member{ std::string(m->name.GetString(),
+                                m->name.GetStringLength()),
+                    nullptr, &m->value });
+      if (unwrapAny(dto) != nullptr)
+        root._members.push_back(Member{ key, dto, nullptr });
+      root._size = root._members.size();
+      _stack.push_back(std::move(root));
+    }
+
+    void DTOStream::step()
+    {
+      Frame &f = _stack.back();
+      if (!f._open)
+        {
+          f._open = true;
+          if (f._object)
+            open_object(f._size);
+          else
+            open_array(f._size);
+        }
+      if (f._i == f._size)
+        {
+          if (f._object)
+            close_object();
+          else
+            close_array();
+          _stack.pop_back();
+          return;
+        }
+      if (f._vector != nullptr)
+        {
+          vector_elements(f);
+          return;
+        }
+      if (f._i > 0)
+        separator();
+      // the frame may be moved by value()
+      Member m = std::move(f._members.at(f._i++));
+      if (f._object)
+        key(JVal(rapidjson::StringRef(m._name.c_str(), m._name.size())));
+      if (m._jval)
+        append(JValStream(*m._jval, _format).str());
+      else
+        value(m._dto);
+    }
+
+    void DTOStream::vector_elements(Frame &f)
+    {
+      // a batch of elements per step, vectors being possibly large
+      size_t begin = f._i;
+      size_t end = std::min(f._size, f._i + 1024);
+      auto render = [&](const auto &vec) {
+        for (size_t i = begin; i < end; ++i)
+          {
+            if (i > 0)
+              separator();
+            scalar(JVal(vec->at(i)));
+          }
+      };
+      auto type = f._vector.getValueType();
+      if (type == DTO::DTOVector<double>::Class::getType())
+        render(f._vector.cast<DTO::DTOVector<double>>());
+      else if (type == DTO::DTOVector<uint8_t>::Class::getType())
+        render(f._vector.cast<DTO::DTOVector<uint8_t>>());
+      else
+        {
+          auto vec = f._vector.cast<DTO::DTOVector<bool>>();
+          for (size_t i = begin; i < end; ++i)
+            {
+              if (i > 0)
+                separator();
+              scalar(JVal(bool(vec->at(i))));
+            }
+        }
+      f._i = end;
+    }
+
+    void DTOStream::value(const oatpp::Void &dto)
+    {
+      oatpp::Void polymorph = unwrapAny(dto);
+      if (polymorph == nullptr)
+        {
+          scalar(JVal());
+          return;
+        }
+      auto type = polymorph.getValueType();
+      auto class_id = type->classId.id;
+      if (type == oatpp::String::Class::getType())
+        scalar(JVal(rapidjson::StringRef(
+            polymorph.cast<oatpp::String>()->c_str())));
+      else if (type == oatpp::Int32::Class::getType())
+        scalar(JVal(static_cast<int32_t>(polymorph.cast<oatpp::Int32>())));
+      else if (type == oatpp::UInt32::Class::getType())
+        scalar(JVal(static_cast<uint32_t>(polymorph.cast<oatpp::UInt32>())));
+      else if (type == oatpp::Int64::Class::getType())
+        scalar(JVal(static_cast<int64_t>(polymorph.cast<oatpp::Int64>())));
+      else if (type == oatpp::UInt64::Class::getType())
+        scalar(JVal(static_cast<uint64_t>(polymorph.cast<oatpp::UInt64>())));
+      else if (type == oatpp::Float32::Class::getType())
+        scalar(JVal(static_cast<double>(
+            static_cast<float>(polymorph.cast<oatpp::Float32>()))));
+      else if (type == oatpp::Float64::Class::getType())
+        scalar(JVal(static_cast<double>(polymorph.cast<oatpp::Float64>())));
+      else if (type == oatpp::Boolean::Class::getType())
+        scalar(JVal(static_cast<bool>(polymorph.cast<oatpp::Boolean>())));
+      else if (type == DTO::DTOVector<double>::Class::getType()
+               || type == DTO::DTOVector<uint8_t>::Class::getType()
+               || type == DTO::DTOVector<bool>::Class::getType())
+        {
+          Frame f;
+          f._vector = polymorph;
+          if (type == DTO::DTOVector<double>::Class::getType())
+            f._size = polymorph.cast<DTO::DTOVector<double>>()->size();
+          else if (type == DTO::DTOVector<uint8_t>::Class::getType())
+            f._size = polymorph.cast<DTO::DTOVector<uint8_t>>()->size();
+          else
+            f._size = polymorph.cast<DTO::DTOVector<bool>>()->size();
+          _stack.push_back(std::move(f));
+        }
+      else if (type == DTO::DTOApiData::Class::getType()
+               || type == DTO::GpuIds::Class::getType()
+               || type == DTO::DTOImage::Class::getType())
+        {
+          // small values, or rendered whole anyway
+          JDoc jd;
+          dtoToJVal(polymorph, jd, jd);
+          append(JValStream(jd, _format).str());
+        }
+      else if (class_id == oatpp::data::mapping::type::__class::
+                               AbstractVector::CLASS_ID.id
+               || class_id == oatpp::data::mapping::type::__class::
+                                  AbstractList::CLASS_ID.id)
+        {
+          auto poly_dispatch
+              = static_cast<const oatpp::data::mapping::type::__class::
+                                Collection::PolymorphicDispatcher *>(
+                  type->polymorphicDispatcher);
+          Frame f;
+          for (auto it = poly_dispatch->beginIteration(polymorph);
+               !it->finished(); it->next())
+            f._members.push_back(Member{ "", it->get(), nullptr });
+          f._size = f._members.size();
+          _stack.push_back(std::move(f));
+        }
+      else if (class_id == oatpp::data::mapping::type::__class::
+                               AbstractPairList::CLASS_ID.id)
+        {
+          Frame f;
+          f._object = true;
+          auto fields = staticCast<oatpp::AbstractFields>(polymorph);
+          for (auto const &field : *fields)
+            if (unwrapAny(field.second) != nullptr)
+              f._members.push_back(
+                  Member{ field.first->c_str(), field.second, nullptr });
+          f._size = f._members.size();
+          _stack.push_back(std::move(f));
+        }
+      else if (class_id == oatpp::data::mapping::type::__class::
+                               AbstractUnorderedMap::CLASS_ID.id)
+        {
+          Frame f;
+          f._object = true;
+          auto fields = staticCast<oatpp::AbstractUnorderedFields>(polymorph);
+          for (auto const &field : *fields)
+            if (unwrapAny(field.second) != nullptr)
+              f._members.push_back(
+                  Member{ field.first->c_str(), field.second, nullptr });
+          f._size = f._members.size();
+          _stack.push_back(std::move(f));
+        }
+      else if (class_id == oatpp::data::mapping::type::__class::
+                               AbstractObject::CLASS_ID.id)
+        {
+          Frame f;
+          f._object = true;
+          auto dispatcher
+              = static_cast<const oatpp::data::mapping::type::__class::
+                                AbstractObject::PolymorphicDispatcher *>(
+                  type->polymorphicDispatcher);
+          auto object = static_cast<oatpp::BaseObject *>(polymorph.get());
+          for (auto const &field : dispatcher->getProperties()->getList())
+            {
+              auto val = field->get(object);
+              if (unwrapAny(val) != nullptr)
+                f._members.push_back(Member{ field->name, val, nullptr });
+            }
+          f._size = f._members.size();
+          _stack.push_back(std::move(f));
+        }
+      else
+        {
+          std::string type_name = type->classId.name;
+          throw std::runtime_error("DTOStream: \"" + type_name
+                                   + "\": type not recognised");
+        }
+    }
+  }
+}
@@ -0,0 +1,89 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_DTOSTREAM_H
+#define DD_DTOSTREAM_H
+
+#include "apidata.h"
+#include "utils/jsonstream.hpp"
+#include "utils/oatpp.hpp"
+
+namespace dd
+{
+  namespace oatpp_utils
+  {
+    /**
+     * \brief renders a DTO in chunks, as rendering the document filled by
+     * dtoToJVal would, without building the document. Null members are
+     * left out.
+     */
+    class DTOStream : public ValueStream
+    {
+    public:
+      /**
+       * @param envelope object whose members are rendered first, e.g. the
+       * status and head of a response, that must outlive the stream
+       * @param key name of the DTO member, rendered after the envelope ones
+       */
+      DTOStream(const JVal &envelope, const std::string &key,
+                const oatpp::Void &dto, const Format &format);
+
+    protected:
+      bool done() const override
+      {
+        return _stack.empty();
+      }
+
+      void step() override;
+
+    private:
+      struct Member
+      {
+        std::string _name;
+        oatpp::Void _dto;
+        const JVal *_jval = nullptr; /**< envelope member, if not a DTO */
+      };
+
+      struct Frame
+      {
+        bool _object = false;
+        std::vector<Member> _members; /**< members, or elements of arrays */
+        oatpp::Void _vector; /**< vector of numbers or booleans, if any */
+        size_t _size = 0;
+        size_t _i = 0;      /**< next element or member */
+        bool _open = false; /**< whether the array or object was opened */
+      };
+
+      /**
+       * \brief renders a scalar, or pushes a frame for containers
+       */
+      void value(const oatpp::Void &polymorph);
+
+      /**
+       * \brief renders the next elements of a vector of numbers or booleans
+       */
+      void vector_elements(Frame &f);
+
+      std::vector<Frame> _stack;
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_FLOAT_UTILS_H
+#define DD_FLOAT_UTILS_H
+
+#include "ext/base64/base64.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace dd
+{
+  namespace float_utils
+  {
+    /**
+     * \brief IEEE half precision value of a float, rounded to nearest even
+     */
+    inline uint16_t float_to_half(const float &f)
+    {
+      uint32_t x;
+      memcpy(&x, &f, sizeof(x));
+      uint16_t sign = (x >> 16) & 0x8000;
+      uint32_t exp = (x >> 23) & 0xff;
+      uint32_t mant = x & 0x7fffff;
+
+      if (exp == 0xff) // inf and nan
+        return sign | 0x7c00 | (mant ? 0x200 | (mant >> 13) : 0);
+      int e = static_cast<int>(exp) - 127 + 15;
+      if (e >= 0x1f) // overflow
+        return sign | 0x7c00;
+      if (e <= 0)
+        {
+          // subnormal half, or zero
+          if (e < -10)
+            return sign;
+          mant |= 0x800000;
+          int shift = 14 - e;
+          uint32_t h = mant >> shift;
+          uint32_t rem = mant & ((1u << shift) - 1);
+          uint32_t halfway = 1u << (shift - 1);
+          if (rem > halfway || (rem == halfway && (h & 1)))
+            ++h;
+          return sign | h;
+        }
+      uint32_t h = (e << 10) | (mant >> 13);
+      uint32_t rem = mant & 0x1fff;
+      // a carry into the exponent rounds up to the next power of two, or inf
+      if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        ++h;
+      return sign | h;
+    }
+
+    /**
+     * \brief float value of an IEEE half precision value
+     */
+    inline float half_to_float(const uint16_t &h)
+    {
+      uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+      uint32_t exp = (h >> 10) & 0x1f;
+      uint32_t mant = h & 0x3ff;
+      uint32_t x;
+      if (exp == 0x1f)
+        x = sign | 0x7f800000 | (mant << 13);
+      else if (exp != 0)
+        x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+      else if (mant == 0)
+        x = sign;
+      else
+        {
+          // subnormal half, normalized in single precision
+          int e = -1;
+          do
+            {
+              ++e;
+              mant <<= 1;
+            }
+          while (!(mant & 0x400));
+          x = sign | ((127 - 15 - e) << 23) | ((mant & 0x3ff) << 13);
+        }
+      float f;
+      memcpy(&f, &x, sizeof(f));
+      return f;
+    }
+
+    /**
+     * \brief size in bytes of a binary float format, 0 if unknown
+     * @param format float32 or float16
+     */
+    inline size_t format_size(const std::string &format)
+    {
+      if (format == "float32")
+        return 4;
+      if (format == "float16")
+        return 2;
+      return 0;
+    }
+
+    /**
+     * \brief base64 of values as little-endian float32 or float16
+     */
+    inline std::string to_base64(const std::vector<double> &vals,
+                                 const std::string &format)
+    {
+      size_t fsize = format_size(format);
+      if (fsize == 0)
+        throw std::invalid_argument("unknown float format " + format);
+      std::string bytes(vals.size() * fsize, '\0');
+      for (size_t i = 0; i < vals.size(); ++i)
+        {
+          float f = static_cast<float>(vals[i]);
+          uint32_t bits;
+          if (fsize == 4)
+            memcpy(&bits, &f, sizeof(bits));
+          else
+            bits = float_to_half(f);
+          for (size_t b = 0; b < fsize; ++b)
+            bytes[i * fsize + b] = static_cast<char>((bits >> (8 * b)) & 0xff);
+        }
+      std::string encoded(Base64::EncodedLength(bytes.size()), '\0');
+      Base64::Encode(bytes.data(), bytes.size(), &encoded[0], encoded.size());
+      return encoded;
+    }
+  }
+}
+
+#endif
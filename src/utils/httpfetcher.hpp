@@ -0,0 +1,488 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_HTTPFETCHER_H
+#define DD_HTTPFETCHER_H
+
+#include <curl/curl.h>
+
+#include <strings.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "utils/fileops.hpp"
+#include "utils/httpclient.hpp"
+
+namespace dd
+{
+  /**
+   * \brief outcome of a single url fetch
+   */
+  struct FetchResult
+  {
+    int _code = -1;       /**< http response code, -1 if transfer failed */
+    std::string _content; /**< response body */
+    std::string _error;   /**< transfer error message, if any */
+    bool _cached = false; /**< whether content comes from the local cache */
+  };
+
+  /**
+   * \brief size bounded on-disk cache of fetched responses, by url and ETag
+   * Files are <key>.data and <key>.etag, the latter holding the url and its
+   * ETag on two lines. Least recently used entries are removed first.
+   */
+  class FetchCache
+  {
+  public:
+    /**
+     * \brief opens a cache directory, and indexes the entries it already
+     * holds, oldest last
+     */
+    FetchCache(const std::string &dir, const size_t &max_bytes)
+        : _dir(dir), _max_bytes(max_bytes)
+    {
+      if (!fileops::file_exists(_dir))
+        fileops::create_dir(_dir, 0755);
+      std::unordered_set<std::string> lfiles;
+      fileops::list_directory(_dir, true, false, false, lfiles);
+      std::vector<std::pair<long int, std::string>> datas;
+      for (const std::string &f : lfiles)
+        {
+          std::string name = f.substr(f.find_last_of('/') + 1);
+          if (name.size() > 5
+              && name.compare(name.size() - 5, 5, ".data") == 0)
+            datas.emplace_back(fileops::file_last_modif(f),
+                               name.substr(0, name.size() - 5));
+        }
+      std::sort(datas.begin(), datas.end());
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto &d : datas)
+        {
+          std::ifstream in(_dir + "/" + d.second + ".data",
+                           std::ios::binary | std::ios::ate);
+          insert(d.second, in ? static_cast<size_t>(in.tellg()) : 0);
+        }
+      evict();
+    }
+
+    /**
+     * \brief prefix of the cache files of an url
+     */
+    std::string base(const std::string &url) const
+    {
+      return _dir + "/" + key(url);
+    }
+
+    /**
+     * \brief marks the entry of an url as most recently used
+     */
+    void touch(const std::string &url)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto hit = _index.find(key(url));
+      if (hit != _index.end())
+        _entries.splice(_entries.begin(), _entries, hit->second);
+    }
+
+    /**
+     * \brief records a written entry, evicting the least recently used ones
+     * as needed
+     */
+    void add(const std::string &url, const size_t &bytes)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      insert(key(url), bytes);
+      evict();
+    }
+
+    void set_max_bytes(const size_t &max_bytes)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _max_bytes = max_bytes;
+      evict();
+    }
+
+    size_t bytes() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _bytes;
+    }
+
+  private:
+    static std::string key(const std::string &url)
+    {
+      std::ostringstream key;
+      key << std::hex << std::hash<std::string>{}(url);
+      return key.str();
+    }
+
+    void insert(const std::string &key, const size_t &bytes)
+    {
+      auto hit = _index.find(key);
+      if (hit != _index.end())
+        {
+          _bytes -= hit->second->second;
+          _entries.erase(hit->second);
+        }
+      _entries.emplace_front(key, bytes);
+      _index[key] = _entries.begin();
+      _bytes += bytes;
+    }
+
+    void evict()
+    {
+      while (_bytes > _max_bytes && !_entries.empty())
+        {
+          const std::string &key = _entries.back().first;
+          fileops::remove_file(_dir, key + ".data");
+          fileops::remove_file(_dir, key + ".etag");
+          _bytes -= _entries.back().second;
+          _index.erase(key);
+          _entries.pop_back();
+        }
+    }
+
+    std::string _dir;
+    size_t _max_bytes = 0;
+    size_t _bytes = 0;
+    std::list<std::pair<std::string, size_t>>
+        _entries; /**< key and size, most recent first */
+    std::unordered_map<std::string,
+                       std::list<std::pair<std::string, size_t>>::iterator>
+        _index;
+    mutable std::mutex _mutex;
+  };
+
+  /**
+   * \brief concurrent url fetcher
+   * All urls of a call are transferred in parallel over a curl multi handle.
+   * Multi handles are pooled, a call taking one that no other call uses,
+   * so that their connections are kept alive for later calls to the same
+   * hosts. DNS and TLS sessions are shared by all calls.
+   */
+  class httpfetcher
+  {
+  public:
+    /**
+     * \brief process wide fetcher, owner of the connection pool
+     */
+    static httpfetcher &instance()
+    {
+      static httpfetcher fetcher;
+      return fetcher;
+    }
+
+    /**
+     * \brief fetches urls concurrently
+     * \param urls urls to fetch
+     * \param results one result per url, in urls order
+     * \param deadline max duration of the whole call, in seconds
+     * \param max_host_connections max number of parallel connections per
+     * host within this call
+     * \param cache if not null, cache where responses with an ETag are
+     * stored, and revalidated with If-None-Match on later fetches
+     */
+    void fetch(const std::vector<std::string> &urls,
+               std::vector<FetchResult> &results,
+               const int &deadline = _default_timeout,
+               const int &max_host_connections = 8,
+               FetchCache *cache = nullptr)
+    {
+      if (deadline > _max_timeout)
+        throw std::runtime_error(
+            "timeout value is above max default timeout ("
+            + std::to_string(_max_timeout) + ")");
+
+      results.clear();
+      results.resize(urls.size());
+      std::vector<Transfer> transfers(urls.size());
+
+      CURLM *multi = acquire_multi();
+      curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                        static_cast<long>(max_host_connections));
+
+      for (size_t i = 0; i < urls.size(); ++i)
+        {
+          Transfer &t = transfers[i];
+          t._url = urls[i];
+          t._result = &results[i];
+          if (cache)
+            {
+              t._cache = cache;
+              t._cache_base = cache->base(urls[i]);
+              read_cached_etag(t);
+            }
+
+          t._easy = curl_easy_init();
+          curl_easy_setopt(t._easy, CURLOPT_URL, urls[i].c_str());
+          curl_easy_setopt(t._easy, CURLOPT_SHARE, _share);
+          curl_easy_setopt(t._easy, CURLOPT_PRIVATE, &t);
+          curl_easy_setopt(t._easy, CURLOPT_WRITEFUNCTION, write_cb);
+          curl_easy_setopt(t._easy, CURLOPT_WRITEDATA, &t._result->_content);
+          curl_easy_setopt(t._easy, CURLOPT_HEADERFUNCTION, header_cb);
+          curl_easy_setopt(t._easy, CURLOPT_HEADERDATA, &t);
+          curl_easy_setopt(t._easy, CURLOPT_FOLLOWLOCATION, 1L);
+          curl_easy_setopt(t._easy, CURLOPT_NOSIGNAL, 1L);
+          curl_easy_setopt(t._easy, CURLOPT_TIMEOUT,
+                           static_cast<long>(deadline));
+          if (!t._cached_etag.empty())
+            {
+              t._headers = curl_slist_append(
+                  t._headers, ("If-None-Match: " + t._cached_etag).c_str());
+              curl_easy_setopt(t._easy, CURLOPT_HTTPHEADER, t._headers);
+            }
+          curl_multi_add_handle(multi, t._easy);
+        }
+
+      auto deadline_time = std::chrono::steady_clock::now()
+                           + std::chrono::seconds(deadline);
+      int running = 0;
+      do
+        {
+          if (curl_multi_perform(multi, &running) != CURLM_OK)
+            break;
+
+          CURLMsg *msg = nullptr;
+          int msgs_left = 0;
+          while ((msg = curl_multi_info_read(multi, &msgs_left)))
+            {
+              if (msg->msg != CURLMSG_DONE)
+                continue;
+              char *priv = nullptr;
+              curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+              complete(*reinterpret_cast<Transfer *>(priv),
+                       msg->data.result);
+            }
+
+          if (running == 0
+              || std::chrono::steady_clock::now() >= deadline_time)
+            break;
+          curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+        }
+      while (true);
+
+      for (Transfer &t : transfers)
+        {
+          if (!t._done)
+            {
+              t._result->_code = -1;
+              t._result->_content.clear();
+              t._result->_error = "deadline exceeded";
+            }
+          curl_multi_remove_handle(multi, t._easy);
+          curl_easy_cleanup(t._easy);
+          curl_slist_free_all(t._headers);
+        }
+      release_multi(multi);
+    }
+
+  private:
+    /**
+     * \brief state of a single transfer within a fetch call
+     */
+    struct Transfer
+    {
+      CURL *_easy = nullptr;
+      curl_slist *_headers = nullptr;
+      FetchResult *_result = nullptr;
+      std::string _url;
+      FetchCache *_cache = nullptr;
+      std::string _etag;        /**< ETag sent back by the server */
+      std::string _cache_base;  /**< cache files prefix, empty if no cache */
+      std::string _cached_etag; /**< ETag of the cached content, if any */
+      bool _done = false;
+    };
+
+    httpfetcher()
+    {
+      curl_global_init(CURL_GLOBAL_DEFAULT);
+      _share = curl_share_init();
+      curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, lock_cb);
+      curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+      curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+      // the connection cache cannot be shared by multi handles in use at the
+      // same time, it is kept by each pooled multi handle instead
+      curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    ~httpfetcher()
+    {
+      for (CURLM *multi : _idle_multis)
+        curl_multi_cleanup(multi);
+      curl_share_cleanup(_share);
+    }
+
+    /**
+     * \brief takes an idle multi handle from the pool, or a new one
+     */
+    CURLM *acquire_multi()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_multis_mutex);
+        if (!_idle_multis.empty())
+          {
+            CURLM *multi = _idle_multis.back();
+            _idle_multis.pop_back();
+            return multi;
+          }
+      }
+      return curl_multi_init();
+    }
+
+    void release_multi(CURLM *multi)
+    {
+      std::lock_guard<std::mutex> lock(_multis_mutex);
+      _idle_multis.push_back(multi);
+    }
+
+    httpfetcher(const httpfetcher &) = delete;
+    httpfetcher &operator=(const httpfetcher &) = delete;
+
+    void complete(Transfer &t, CURLcode code)
+    {
+      t._done = true;
+      FetchResult &res = *t._result;
+      if (code != CURLE_OK)
+        {
+          res._error = curl_easy_strerror(code);
+          res._content.clear();
+          return;
+        }
+      long rcode = 0;
+      curl_easy_getinfo(t._easy, CURLINFO_RESPONSE_CODE, &rcode);
+      res._code = static_cast<int>(rcode);
+
+      if (res._code == 304 && !t._cached_etag.empty())
+        {
+          std::ifstream in(t._cache_base + ".data", std::ios::binary);
+          std::ostringstream content;
+          content << in.rdbuf();
+          if (in.good() || in.eof())
+            {
+              res._content = content.str();
+              res._code = 200;
+              res._cached = true;
+              t._cache->touch(t._url);
+            }
+          else
+            {
+              // evicted in between
+              res._code = -1;
+              res._error = "cached content could not be read";
+            }
+        }
+      else if (res._code == 200 && !t._cache_base.empty()
+               && !t._etag.empty())
+        write_cache(t, res._content);
+    }
+
+    static void read_cached_etag(Transfer &t)
+    {
+      if (!fileops::file_exists(t._cache_base + ".data"))
+        return;
+      std::ifstream in(t._cache_base + ".etag");
+      std::string cached_url, etag;
+      if (std::getline(in, cached_url) && std::getline(in, etag)
+          && cached_url == t._url)
+        t._cached_etag = etag;
+    }
+
+    static void write_cache(const Transfer &t, const std::string &content)
+    {
+      // written aside then renamed, so that concurrent readers never see a
+      // partial file
+      std::string tmp = t._cache_base + ".tmp"
+                        + std::to_string(reinterpret_cast<uintptr_t>(&t));
+      {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(content.data(), content.size());
+        if (!out.good())
+          return;
+      }
+      std::rename(tmp.c_str(), (t._cache_base + ".data").c_str());
+      {
+        std::ofstream etag_out(t._cache_base + ".etag");
+        etag_out << t._url << "\n" << t._etag << "\n";
+      }
+      t._cache->add(t._url, content.size());
+    }
+
+    static size_t write_cb(char *ptr, size_t size, size_t nmemb,
+                           void *userdata)
+    {
+      static_cast<std::string *>(userdata)->append(ptr, size * nmemb);
+      return size * nmemb;
+    }
+
+    static size_t header_cb(char *buffer, size_t size, size_t nitems,
+                            void *userdata)
+    {
+      size_t len = size * nitems;
+      std::string header(buffer, len);
+      if (header.size() > 5 && strncasecmp(header.c_str(), "etag:", 5) == 0)
+        {
+          std::string etag = header.substr(5);
+          size_t start = etag.find_first_not_of(" \t");
+          size_t end = etag.find_last_not_of(" \t\r\n");
+          Transfer *t = static_cast<Transfer *>(userdata);
+          t->_etag = start == std::string::npos
+                         ? ""
+                         : etag.substr(start, end - start + 1);
+        }
+      return len;
+    }
+
+    static void lock_cb(CURL *handle, curl_lock_data data,
+                        curl_lock_access access, void *userptr)
+    {
+      (void)handle;
+      (void)access;
+      static_cast<httpfetcher *>(userptr)->_locks[data].lock();
+    }
+
+    static void unlock_cb(CURL *handle, curl_lock_data data, void *userptr)
+    {
+      (void)handle;
+      static_cast<httpfetcher *>(userptr)->_locks[data].unlock();
+    }
+
+    CURLSH *_share = nullptr; /**< dns and tls session pool */
+    std::mutex _locks[CURL_LOCK_DATA_LAST]; /**< one lock per shared data */
+    std::vector<CURLM *>
+        _idle_multis; /**< multi handles not used by a call, with their
+                         kept alive connections */
+    std::mutex _multis_mutex;
+  };
+}
+
+#endif
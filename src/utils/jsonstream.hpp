@@ -0,0 +1,414 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_JSONSTREAM_H
+#define DD_JSONSTREAM_H
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "apidata.h"
+
+namespace dd
+{
+  /**
+   * \brief renders a value in chunks, as JSON or CBOR, so that a response is
+   * written while it is sent instead of being rendered whole
+   * Derived streams walk their value one token per step(), with the
+   * encoding helpers below. JSON scalars are rendered by a rapidjson
+   * Writer, so that output is the same as rendering a whole document.
+   */
+  class ValueStream
+  {
+  public:
+    enum Format
+    {
+      JSON,
+      CBOR
+    };
+
+    virtual ~ValueStream()
+    {
+    }
+
+    /**
+     * \brief format requested by an HTTP Accept header, CBOR only when it
+     * is preferred to JSON
+     */
+    static Format accept_format(const std::string &accept)
+    {
+      // quality of the most specific media range matching each type
+      double cbor_q = 0.0, json_q = 0.0;
+      int cbor_match = 0, json_match = 0;
+      size_t start = 0;
+      while (start <= accept.size())
+        {
+          size_t end = accept.find(',', start);
+          if (end == std::string::npos)
+            end = accept.size();
+          std::string range = accept.substr(start, end - start);
+          start = end + 1;
+
+          double q = 1.0;
+          size_t semi = range.find(';');
+          std::string type = trim_lower(range.substr(0, semi));
+          while (semi != std::string::npos)
+            {
+              size_t next = range.find(';', semi + 1);
+              std::string param = trim_lower(range.substr(
+                  semi + 1, next == std::string::npos ? std::string::npos
+                                                      : next - semi - 1));
+              if (param.compare(0, 2, "q=") == 0)
+                q = std::atof(param.c_str() + 2);
+              semi = next;
+            }
+          auto match = [&](const std::string &mtype, double &mq, int &level) {
+            int l = 0;
+            if (type == mtype)
+              l = 3;
+            else if (type == "application/*")
+              l = 2;
+            else if (type == "*/*")
+              l = 1;
+            if (l > level)
+              {
+                level = l;
+                mq = q;
+              }
+          };
+          match("application/cbor", cbor_q, cbor_match);
+          match("application/json", json_q, json_match);
+        }
+      return cbor_q > 0.0 && cbor_q > json_q ? CBOR : JSON;
+    }
+
+    /**
+     * \brief fills a buffer with the next bytes of the output
+     * @return number of bytes written, 0 at the end of the output
+     * @throw DataConversionException if a value can't be rendered
+     */
+    size_t read(char *buf, const size_t &count)
+    {
+      size_t n = 0;
+      while (n < count)
+        {
+          if (_pos == _pending.size())
+            {
+              _pending.clear();
+              _pos = 0;
+              while (!done() && _pending.size() < chunk_size())
+                step();
+              if (_pending.empty())
+                break;
+            }
+          size_t m = std::min(count - n, _pending.size() - _pos);
+          memcpy(buf + n, _pending.data() + _pos, m);
+          n += m;
+          _pos += m;
+        }
+      return n;
+    }
+
+    /**
+     * \brief renders the whole output
+     */
+    std::string str()
+    {
+      std::string out;
+      char buf[4096];
+      size_t n;
+      while ((n = read(buf, sizeof(buf))) > 0)
+        out.append(buf, n);
+      return out;
+    }
+
+  protected:
+    ValueStream(const Format &format) : _format(format), _writer(_sb)
+    {
+    }
+
+    ValueStream(const ValueStream &) = delete;
+    ValueStream &operator=(const ValueStream &) = delete;
+
+    static size_t chunk_size()
+    {
+      return 1 << 16;
+    }
+
+    /**
+     * \brief whether the whole value has been rendered
+     */
+    virtual bool done() const = 0;
+
+    /**
+     * \brief renders the next token of the value
+     */
+    virtual void step() = 0;
+
+    void open_array(const size_t &size)
+    {
+      if (_format == JSON)
+        _pending.push_back('[');
+      else
+        cbor_head(4, size);
+    }
+
+    void close_array()
+    {
+      if (_format == JSON)
+        _pending.push_back(']');
+    }
+
+    void open_object(const size_t &size)
+    {
+      if (_format == JSON)
+        _pending.push_back('{');
+      else
+        cbor_head(5, size);
+    }
+
+    void close_object()
+    {
+      if (_format == JSON)
+        _pending.push_back('}');
+    }
+
+    /**
+     * \brief before an element or member that is not the first one
+     */
+    void separator()
+    {
+      if (_format == JSON)
+        _pending.push_back(',');
+    }
+
+    void key(const rapidjson::Value &name)
+    {
+      scalar(name);
+      if (_format == JSON)
+        _pending.push_back(':');
+    }
+
+    void scalar(const rapidjson::Value &v)
+    {
+      if (_format == JSON)
+        {
+          _sb.Clear();
+          _writer.Reset(_sb);
+          if (!v.Accept(_writer))
+            throw DataConversionException("JSON rendering failed");
+          _pending.append(_sb.GetString(), _sb.GetSize());
+          return;
+        }
+      if (v.IsNull())
+        _pending.push_back(static_cast<char>(0xf6));
+      else if (v.IsBool())
+        _pending.push_back(static_cast<char>(v.GetBool() ? 0xf5 : 0xf4));
+      else if (v.IsUint64())
+        cbor_head(0, v.GetUint64());
+      else if (v.IsInt64())
+        cbor_head(1, static_cast<uint64_t>(-(v.GetInt64() + 1)));
+      else if (v.IsNumber())
+        {
+          // floats that are exact in single precision take half the space
+          double d = v.GetDouble();
+          float f = static_cast<float>(d);
+          if (static_cast<double>(f) == d || std::isnan(d))
+            {
+              uint32_t bits;
+              memcpy(&bits, &f, sizeof(bits));
+              _pending.push_back(static_cast<char>(0xfa));
+              put_be(bits, 4);
+            }
+          else
+            {
+              uint64_t bits;
+              memcpy(&bits, &d, sizeof(bits));
+              _pending.push_back(static_cast<char>(0xfb));
+              put_be(bits, 8);
+            }
+        }
+      else if (v.IsString())
+        {
+          cbor_head(3, v.GetStringLength());
+          _pending.append(v.GetString(), v.GetStringLength());
+        }
+      else
+        throw DataConversionException("CBOR rendering failed");
+    }
+
+    /**
+     * \brief appends an already rendered value
+     */
+    void append(const std::string &rendered)
+    {
+      _pending.append(rendered);
+    }
+
+    Format _format;
+
+  private:
+    static std::string trim_lower(const std::string &s)
+    {
+      size_t b = s.find_first_not_of(" \t");
+      if (b == std::string::npos)
+        return "";
+      size_t e = s.find_last_not_of(" \t");
+      std::string t = s.substr(b, e - b + 1);
+      std::transform(t.begin(), t.end(), t.begin(), ::tolower);
+      return t;
+    }
+
+    /**
+     * \brief CBOR major type and argument, e.g. length or integer value
+     */
+    void cbor_head(const uint8_t &major, const uint64_t &arg)
+    {
+      uint8_t mt = major << 5;
+      if (arg < 24)
+        _pending.push_back(static_cast<char>(mt | arg));
+      else if (arg <= 0xff)
+        {
+          _pending.push_back(static_cast<char>(mt | 24));
+          put_be(arg, 1);
+        }
+      else if (arg <= 0xffff)
+        {
+          _pending.push_back(static_cast<char>(mt | 25));
+          put_be(arg, 2);
+        }
+      else if (arg <= 0xffffffff)
+        {
+          _pending.push_back(static_cast<char>(mt | 26));
+          put_be(arg, 4);
+        }
+      else
+        {
+          _pending.push_back(static_cast<char>(mt | 27));
+          put_be(arg, 8);
+        }
+    }
+
+    void put_be(const uint64_t &v, const int &bytes)
+    {
+      for (int b = bytes - 1; b >= 0; --b)
+        _pending.push_back(static_cast<char>((v >> (8 * b)) & 0xff));
+    }
+
+    std::string _pending; /**< rendered bytes not read yet */
+    size_t _pos = 0;      /**< read position in pending bytes */
+    rapidjson::StringBuffer _sb;
+    rapidjson::Writer<rapidjson::StringBuffer, rapidjson::UTF8<>,
+                      rapidjson::UTF8<>, rapidjson::CrtAllocator,
+                      rapidjson::kWriteNanAndInfFlag>
+        _writer; /**< renders JSON scalars */
+  };
+
+  /**
+   * \brief renders a rapidjson value in chunks
+   * The value is walked with an explicit stack, and must outlive the
+   * stream.
+   */
+  class JValStream : public ValueStream
+  {
+  public:
+    JValStream(const rapidjson::Value &root, const Format &format)
+        : ValueStream(format)
+    {
+      _stack.push_back(Frame{ &root, 0, false });
+    }
+
+  protected:
+    bool done() const override
+    {
+      return _stack.empty();
+    }
+
+    void step() override
+    {
+      Frame &f = _stack.back();
+      const rapidjson::Value &v = *f._val;
+      if (v.IsArray())
+        {
+          if (!f._open)
+            {
+              f._open = true;
+              open_array(v.Size());
+            }
+          if (f._i < v.Size())
+            {
+              if (f._i > 0)
+                separator();
+              const rapidjson::Value *child = &v[f._i++];
+              _stack.push_back(Frame{ child, 0, false });
+              return;
+            }
+          close_array();
+          _stack.pop_back();
+          return;
+        }
+      if (v.IsObject())
+        {
+          if (!f._open)
+            {
+              f._open = true;
+              open_object(v.MemberCount());
+            }
+          if (f._i < v.MemberCount())
+            {
+              auto m = v.MemberBegin() + f._i;
+              if (f._i > 0)
+                separator();
+              ++f._i;
+              key(m->name);
+              _stack.push_back(Frame{ &m->value, 0, false });
+              return;
+            }
+          close_object();
+          _stack.pop_back();
+          return;
+        }
+      scalar(v);
+      _stack.pop_back();
+    }
+
+  private:
+    struct Frame
+    {
+      const rapidjson::Value *_val;
+      size_t _i;  /**< next element or member */
+      bool _open; /**< whether the array or object has been opened */
+    };
+
+    std::vector<Frame> _stack;
+  };
+}
+
+#endif
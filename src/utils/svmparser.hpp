@@ -0,0 +1,507 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_SVMPARSER_H
+#define DD_SVMPARSER_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "utils/threadpool.hpp"
+
+namespace dd
+{
+  /**
+   * \brief sparse rows in compressed sparse row format
+   * Features of row r are _indices and _values in [_indptr[r],
+   * _indptr[r+1]), in the order they appear in the data.
+   */
+  struct SVMCSR
+  {
+    std::vector<int> _labels;
+    std::vector<size_t> _indptr = { 0 }; /**< rows() + 1 offsets */
+    std::vector<int> _indices;
+    std::vector<double> _values;
+
+    size_t rows() const
+    {
+      return _labels.size();
+    }
+
+    size_t nnz() const
+    {
+      return _indices.size();
+    }
+
+    size_t row_nnz(const size_t &r) const
+    {
+      return _indptr[r + 1] - _indptr[r];
+    }
+
+    bool empty() const
+    {
+      return _labels.empty();
+    }
+
+    void clear()
+    {
+      _labels.clear();
+      _indptr.assign(1, 0);
+      _indices.clear();
+      _values.clear();
+    }
+
+    /**
+     * \brief keeps the first nrows rows
+     */
+    void resize(const size_t &nrows)
+    {
+      if (nrows >= rows())
+        return;
+      _labels.resize(nrows);
+      _indptr.resize(nrows + 1);
+      _indices.resize(_indptr.back());
+      _values.resize(_indptr.back());
+    }
+
+    /**
+     * \brief appends rows [begin, end) of src
+     */
+    void append(const SVMCSR &src, const size_t &begin, const size_t &end)
+    {
+      size_t base = _indices.size();
+      size_t first = src._indptr[begin];
+      _labels.insert(_labels.end(), src._labels.begin() + begin,
+                     src._labels.begin() + end);
+      for (size_t r = begin; r < end; ++r)
+        _indptr.push_back(base + src._indptr[r + 1] - first);
+      _indices.insert(_indices.end(), src._indices.begin() + first,
+                      src._indices.begin() + src._indptr[end]);
+      _values.insert(_values.end(), src._values.begin() + first,
+                     src._values.begin() + src._indptr[end]);
+    }
+
+    /**
+     * \brief appends all rows of parts, in order, copying in parallel
+     */
+    void append(const std::vector<SVMCSR> &parts)
+    {
+      std::vector<size_t> row_off(parts.size() + 1, rows());
+      std::vector<size_t> nnz_off(parts.size() + 1, nnz());
+      for (size_t p = 0; p < parts.size(); ++p)
+        {
+          row_off[p + 1] = row_off[p] + parts[p].rows();
+          nnz_off[p + 1] = nnz_off[p] + parts[p].nnz();
+        }
+      _labels.resize(row_off.back());
+      _indptr.resize(row_off.back() + 1);
+      _indices.resize(nnz_off.back());
+      _values.resize(nnz_off.back());
+      ThreadPool::instance().parallel_for(parts.size(), [&](size_t p) {
+        const SVMCSR &part = parts[p];
+        std::copy(part._labels.begin(), part._labels.end(),
+                  _labels.begin() + row_off[p]);
+        for (size_t r = 0; r < part.rows(); ++r)
+          _indptr[row_off[p] + r + 1] = nnz_off[p] + part._indptr[r + 1];
+        std::copy(part._indices.begin(), part._indices.end(),
+                  _indices.begin() + nnz_off[p]);
+        std::copy(part._values.begin(), part._values.end(),
+                  _values.begin() + nnz_off[p]);
+      });
+    }
+
+    /**
+     * \brief rows in the given order
+     */
+    SVMCSR gather(const std::vector<size_t> &order) const
+    {
+      SVMCSR g;
+      g._labels.reserve(order.size());
+      g._indptr.reserve(order.size() + 1);
+      g._indices.reserve(nnz());
+      g._values.reserve(nnz());
+      for (size_t r : order)
+        g.append(*this, r, r + 1);
+      return g;
+    }
+  };
+
+  /**
+   * \brief libSVM format parser, filling CSR arrays directly
+   * Lines are 'label index:value ...', with optional '#' comments. Large
+   * inputs are cut at line boundaries into chunks that are parsed in
+   * parallel. Numbers are parsed in place, strtod being only used for values
+   * that cannot be converted exactly from their decimal digits.
+   */
+  class SVMParser
+  {
+  public:
+    /**
+     * @param fids if not null, features whose index is not in fids are
+     * dropped
+     */
+    SVMParser(const std::unordered_set<int> *fids = nullptr) : _fids(fids)
+    {
+    }
+
+    ~SVMParser()
+    {
+      close();
+    }
+
+    SVMParser(const SVMParser &) = delete;
+    SVMParser &operator=(const SVMParser &) = delete;
+
+    /**
+     * \brief maps a file for parse_file
+     */
+    bool open(const std::string &fname)
+    {
+      close();
+      int fd = ::open(fname.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+        {
+          ::close(fd);
+          return false;
+        }
+      _map_len = st.st_size;
+      if (_map_len > 0)
+        {
+          void *map = mmap(nullptr, _map_len, PROT_READ, MAP_SHARED, fd, 0);
+          if (map == MAP_FAILED)
+            {
+              ::close(fd);
+              _map_len = 0;
+              return false;
+            }
+          _map = static_cast<const char *>(map);
+          madvise(const_cast<char *>(_map), _map_len, MADV_SEQUENTIAL);
+        }
+      ::close(fd);
+      return true;
+    }
+
+    void close()
+    {
+      if (_map)
+        munmap(const_cast<char *>(_map), _map_len);
+      _map = nullptr;
+      _map_len = 0;
+    }
+
+    /**
+     * \brief number of lines of the mapped file
+     */
+    size_t count_lines() const
+    {
+      if (_map_len == 0)
+        return 0;
+      size_t n = std::count(_map, _map + _map_len, '\n');
+      if (_map[_map_len - 1] != '\n')
+        ++n;
+      return n;
+    }
+
+    /**
+     * \brief parses the mapped file by windows of about window bytes
+     * @param fn called with the rows of every window, in order
+     * @param seen if not null, filled up with the feature indices
+     */
+    template <typename F>
+    void parse_file(F fn, std::unordered_set<int> *seen = nullptr,
+                    const size_t &window = size_t(1) << 28) const
+    {
+      const char *end = _map + _map_len;
+      const char *start = _map;
+      while (start < end)
+        {
+          const char *stop = end;
+          if (static_cast<size_t>(end - start) > window)
+            {
+              const char *nl = static_cast<const char *>(
+                  memchr(start + window, '\n', end - start - window));
+              if (nl)
+                stop = nl + 1;
+            }
+          SVMCSR csr;
+          parse(start, stop, csr, seen);
+          fn(csr);
+          start = stop;
+        }
+    }
+
+    /**
+     * \brief parses [begin, end), in parallel for large inputs, and appends
+     * the rows to csr
+     */
+    void parse(const char *begin, const char *end, SVMCSR &csr,
+               std::unordered_set<int> *seen = nullptr) const
+    {
+      size_t len = end - begin;
+      size_t nchunks = std::min<size_t>(ThreadPool::instance().size() * 4,
+                                        len / (size_t(1) << 20) + 1);
+      std::vector<const char *> starts(nchunks + 1, end);
+      starts[0] = begin;
+      for (size_t c = 1; c < nchunks; ++c)
+        {
+          const char *s = std::max(begin + len * c / nchunks, starts[c - 1]);
+          const char *nl
+              = static_cast<const char *>(memchr(s, '\n', end - s));
+          starts[c] = nl ? nl + 1 : end;
+        }
+
+      std::vector<SVMCSR> parts(nchunks);
+      std::vector<std::unordered_set<int>> parts_seen(seen ? nchunks : 0);
+      ThreadPool::instance().parallel_for(nchunks, [&](size_t c) {
+        parse_chunk(starts[c], starts[c + 1], parts[c],
+                    seen ? &parts_seen[c] : nullptr);
+      });
+      csr.append(parts);
+      for (auto &ps : parts_seen)
+        seen->insert(ps.begin(), ps.end());
+    }
+
+    /**
+     * \brief parses full lines in [begin, end), sequentially
+     */
+    void parse_chunk(const char *begin, const char *end, SVMCSR &csr,
+                     std::unordered_set<int> *seen) const
+    {
+      const char *line = begin;
+      while (line < end)
+        {
+          const char *eol
+              = static_cast<const char *>(memchr(line, '\n', end - line));
+          if (!eol)
+            eol = end;
+          const char *p = skip_space(line, eol);
+          if (p == eol || *p == '#')
+            {
+              line = eol + 1;
+              continue;
+            }
+
+          double label = 0.0;
+          if (!parse_double(p, eol, label) || !token_end(p, eol))
+            bad_line(line, eol);
+
+          size_t row_start = csr._indices.size();
+          while ((p = skip_space(p, eol)) < eol && *p != '#')
+            {
+              const char *tok = p;
+              int fid = 0;
+              double val = 0.0;
+              if (parse_int(p, eol, fid) && p < eol && *p == ':')
+                {
+                  ++p;
+                  if (!parse_double(p, eol, val) || !token_end(p, eol))
+                    bad_line(line, eol);
+                  if (seen)
+                    seen->insert(fid);
+                  if (!_fids || _fids->count(fid))
+                    {
+                      csr._indices.push_back(fid);
+                      csr._values.push_back(val);
+                    }
+                  continue;
+                }
+              // tokens with no index, e.g. qid:<n>, are errors, and those
+              // with no ':' are ignored
+              p = tok;
+              while (p < eol && !is_space(*p))
+                if (*p++ == ':')
+                  bad_line(line, eol);
+            }
+          if (csr._indices.size() == row_start)
+            throw std::runtime_error("Issue while reading svm example (index "
+                                     "might be out of bounds)");
+          csr._labels.push_back(static_cast<int>(label));
+          csr._indptr.push_back(csr._indices.size());
+          line = eol + 1;
+        }
+    }
+
+  private:
+    static bool is_space(const char &c)
+    {
+      return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char *skip_space(const char *p, const char *end)
+    {
+      while (p < end && is_space(*p))
+        ++p;
+      return p;
+    }
+
+    static bool token_end(const char *p, const char *end)
+    {
+      return p == end || is_space(*p);
+    }
+
+    [[noreturn]] static void bad_line(const char *line, const char *eol)
+    {
+      throw std::runtime_error("error reading SVM format line: "
+                               + std::string(line, eol));
+    }
+
+    static bool parse_int(const char *&p, const char *end, int &v)
+    {
+      bool neg = false;
+      if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+      const char *digits = p;
+      int64_t n = 0;
+      while (p < end && *p >= '0' && *p <= '9')
+        {
+          n = n * 10 + (*p++ - '0');
+          if (n > std::numeric_limits<int>::max())
+            return false;
+        }
+      if (p == digits)
+        return false;
+      v = static_cast<int>(neg ? -n : n);
+      return true;
+    }
+
+    /**
+     * \brief decimal values with at most 19 significant digits and a power
+     * of ten within double precision are converted exactly, others go
+     * through strtod
+     */
+    static bool parse_double(const char *&p, const char *end, double &v)
+    {
+      static const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                      1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                      1e18, 1e19, 1e20, 1e21, 1e22 };
+      const char *start = p;
+      bool neg = false;
+      if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+      uint64_t mant = 0;
+      int ndigits = 0;
+      int exp10 = 0;
+      bool any = false;
+      bool exact = true;
+      while (p < end && *p >= '0' && *p <= '9')
+        {
+          any = true;
+          if (ndigits < 19)
+            {
+              mant = mant * 10 + (*p - '0');
+              if (mant != 0)
+                ++ndigits;
+            }
+          else
+            {
+              ++exp10;
+              exact = false;
+            }
+          ++p;
+        }
+      if (p < end && *p == '.')
+        {
+          ++p;
+          while (p < end && *p >= '0' && *p <= '9')
+            {
+              any = true;
+              if (ndigits < 19)
+                {
+                  mant = mant * 10 + (*p - '0');
+                  if (mant != 0)
+                    ++ndigits;
+                  --exp10;
+                }
+              else
+                exact = false;
+              ++p;
+            }
+        }
+      if (any && p < end && (*p == 'e' || *p == 'E'))
+        {
+          const char *e = p + 1;
+          bool eneg = false;
+          if (e < end && (*e == '-' || *e == '+'))
+            eneg = *e++ == '-';
+          if (e < end && *e >= '0' && *e <= '9')
+            {
+              int ev = 0;
+              while (e < end && *e >= '0' && *e <= '9')
+                {
+                  if (ev < 10000)
+                    ev = ev * 10 + (*e - '0');
+                  ++e;
+                }
+              exp10 += eneg ? -ev : ev;
+              p = e;
+            }
+        }
+      if (!any)
+        {
+          // inf, nan
+          p = start;
+          while (p < end && !is_space(*p) && *p != ':')
+            ++p;
+          return fallback(start, p, v);
+        }
+      if (exact && mant <= (uint64_t(1) << 53) && exp10 >= -22
+          && exp10 <= 22)
+        {
+          v = exp10 < 0 ? mant / pow10[-exp10] : mant * pow10[exp10];
+          if (neg)
+            v = -v;
+          return true;
+        }
+      return fallback(start, p, v);
+    }
+
+    static bool fallback(const char *start, const char *stop, double &v)
+    {
+      if (start == stop)
+        return false;
+      std::string tok(start, stop);
+      char *tend = nullptr;
+      v = std::strtod(tok.c_str(), &tend);
+      return tend == tok.c_str() + tok.size();
+    }
+
+    const std::unordered_set<int> *_fids = nullptr;
+    const char *_map = nullptr;
+    size_t _map_len = 0;
+  };
+}
+
+#endif
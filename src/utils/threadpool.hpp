@@ -0,0 +1,190 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_THREADPOOL_H
+#define DD_THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dd
+{
+  /**
+   * \brief process wide pool of worker threads
+   * Loops submitted by concurrent callers are queued as jobs. Idle workers
+   * and the calling thread itself pick indices of a job one at a time, so
+   * that the number of threads stays bounded whatever the number of
+   * concurrent callers, and that nested loops cannot deadlock.
+   */
+  class ThreadPool
+  {
+  public:
+    /**
+     * \brief pool shared by the whole process, with one worker per core
+     */
+    static ThreadPool &instance()
+    {
+      static ThreadPool pool(
+          std::max(1u, std::thread::hardware_concurrency()));
+      return pool;
+    }
+
+    ThreadPool(const unsigned int &nthreads)
+    {
+      for (unsigned int t = 0; t < nthreads; ++t)
+        _workers.emplace_back([this]() { work(); });
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _cv.notify_all();
+      for (std::thread &worker : _workers)
+        worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const
+    {
+      return _workers.size();
+    }
+
+    /**
+     * \brief runs fn(i) for i in [0,n), returns once all calls are done
+     * The first exception thrown by fn, if any, is rethrown.
+     */
+    void parallel_for(const size_t &n, const std::function<void(size_t)> &fn)
+    {
+      if (n == 0)
+        return;
+      if (n == 1 || _workers.empty())
+        {
+          for (size_t i = 0; i < n; ++i)
+            fn(i);
+          return;
+        }
+
+      auto job = std::make_shared<Job>(n, fn);
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(job);
+      }
+      _cv.notify_all();
+
+      run(*job);
+      remove(job);
+      {
+        std::unique_lock<std::mutex> lock(job->_mutex);
+        job->_cv.wait(lock, [&job]() { return job->_done == job->_n; });
+      }
+      if (job->_error)
+        std::rethrow_exception(job->_error);
+    }
+
+  private:
+    struct Job
+    {
+      Job(const size_t &n, const std::function<void(size_t)> &fn)
+          : _n(n), _fn(fn)
+      {
+      }
+
+      const size_t _n;
+      const std::function<void(size_t)> &_fn;
+      std::atomic<size_t> _next{ 0 }; /**< next index to process */
+      std::atomic<size_t> _done{ 0 }; /**< number of processed indices */
+      std::exception_ptr _error;
+      std::mutex _mutex;
+      std::condition_variable _cv;
+    };
+
+    void work()
+    {
+      while (true)
+        {
+          std::shared_ptr<Job> job;
+          {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+            if (_stop)
+              return;
+            job = _jobs.front();
+          }
+          run(*job);
+          remove(job);
+        }
+    }
+
+    static void run(Job &job)
+    {
+      size_t i = 0;
+      while ((i = job._next++) < job._n)
+        {
+          try
+            {
+              job._fn(i);
+            }
+          catch (...)
+            {
+              std::lock_guard<std::mutex> lock(job._mutex);
+              if (!job._error)
+                job._error = std::current_exception();
+            }
+          if (++job._done == job._n)
+            {
+              std::lock_guard<std::mutex> lock(job._mutex);
+              job._cv.notify_all();
+            }
+        }
+    }
+
+    /**
+     * \brief removes a job whose indices are all taken from the queue
+     */
+    void remove(const std::shared_ptr<Job> &job)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto jit = std::find(_jobs.begin(), _jobs.end(), job);
+      if (jit != _jobs.end())
+        _jobs.erase(jit);
+    }
+
+    std::vector<std::thread> _workers;
+    std::deque<std::shared_ptr<Job>> _jobs; /**< jobs with indices left */
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+  };
+}
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ * DeepDetect
+ * Copyright (c) 2024 Jolibrain SASU
+ *
+ * This file is part of deepdetect.
+ *
+ * deepdetect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * deepdetect is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with deepdetect.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DD_VOCABTRIE_H
+#define DD_VOCABTRIE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dd
+{
+  /**
+   * \brief static byte trie over a set of strings, for longest prefix
+   * matching without building candidate strings
+   * Nodes and edges are stored in flat arrays, the edges of a node being
+   * contiguous and sorted by byte, and the root node having a direct table.
+   */
+  class VocabTrie
+  {
+  public:
+    VocabTrie()
+    {
+    }
+
+    /**
+     * \brief builds the trie
+     * @param keys strings and their value, values being >= 0
+     */
+    void build(std::vector<std::pair<std::string, int>> keys)
+    {
+      _nodes.clear();
+      _edges.clear();
+      std::fill(_root, _root + 256, -1);
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end(),
+                             [](const std::pair<std::string, int> &a,
+                                const std::pair<std::string, int> &b) {
+                               return a.first == b.first;
+                             }),
+                 keys.end());
+      _nodes.emplace_back();
+      build_node(0, keys, 0, keys.size(), 0);
+      for (int e = _nodes[0]._edges_begin; e < _nodes[0]._edges_end; ++e)
+        _root[_edges[e]._byte] = _edges[e]._child;
+    }
+
+    /**
+     * \brief longest prefix of [str, str + len) that is a key
+     * @param value value of the matched key
+     * @return length of the match, 0 if no prefix is a key
+     */
+    size_t longest_match(const char *str, const size_t &len, int &value) const
+    {
+      if (_nodes.empty() || len == 0)
+        return 0;
+      size_t best = 0;
+      int node = _root[static_cast<uint8_t>(str[0])];
+      for (size_t i = 1; node >= 0; ++i)
+        {
+          const Node &n = _nodes[node];
+          if (n._value >= 0)
+            {
+              best = i;
+              value = n._value;
+            }
+          if (i == len)
+            break;
+          node = child(n, static_cast<uint8_t>(str[i]));
+        }
+      return best;
+    }
+
+    bool empty() const
+    {
+      return _nodes.size() <= 1;
+    }
+
+  private:
+    struct Node
+    {
+      int _edges_begin = 0;
+      int _edges_end = 0;
+      int _value = -1; /**< value of the key ending at this node, if any */
+    };
+
+    struct Edge
+    {
+      uint8_t _byte = 0;
+      int _child = -1;
+    };
+
+    int child(const Node &n, const uint8_t &byte) const
+    {
+      auto first = _edges.begin() + n._edges_begin;
+      auto last = _edges.begin() + n._edges_end;
+      auto eit = std::lower_bound(
+          first, last, byte,
+          [](const Edge &e, const uint8_t &b) { return e._byte < b; });
+      if (eit == last || (*eit)._byte != byte)
+        return -1;
+      return (*eit)._child;
+    }
+
+    /**
+     * \brief builds the subtree of keys [lo, hi), that share their first
+     * depth bytes
+     * node is passed by value, edges growing while children are built
+     */
+    void build_node(const int node,
+                    const std::vector<std::pair<std::string, int>> &keys,
+                    size_t lo, const size_t &hi, const size_t &depth)
+    {
+      if (lo < hi && keys[lo].first.size() == depth)
+        {
+          _nodes[node]._value = keys[lo].second;
+          ++lo;
+        }
+
+      // one edge per distinct next byte
+      std::vector<std::pair<size_t, size_t>> ranges;
+      for (size_t k = lo; k < hi;)
+        {
+          uint8_t byte = static_cast<uint8_t>(keys[k].first[depth]);
+          size_t end = k + 1;
+          while (end < hi
+                 && static_cast<uint8_t>(keys[end].first[depth]) == byte)
+            ++end;
+          ranges.emplace_back(k, end);
+          k = end;
+        }
+      _nodes[node]._edges_begin = _edges.size();
+      for (auto &r : ranges)
+        {
+          Edge e;
+          e._byte = static_cast<uint8_t>(keys[r.first].first[depth]);
+          e._child = _nodes.size();
+          _nodes.emplace_back();
+          _edges.push_back(e);
+        }
+      _nodes[node]._edges_end = _edges.size();
+      for (size_t r = 0; r < ranges.size(); ++r)
+        build_node(_edges[_nodes[node]._edges_begin + r]._child, keys,
+                   ranges[r].first, ranges[r].second, depth + 1);
+    }
+
+    std::vector<Node> _nodes;
+    std::vector<Edge> _edges;
+    int _root[256]; /**< root children, by byte */
+  };
+
+  /**
+   * \brief lower cases UTF-8 text in place, for ASCII, Latin-1, Latin
+   * Extended-A, Greek and Cyrillic letters, whose lower case has the same
+   * encoded length. U+0130, whose lower case is i with a combining dot, is
+   * left as is
+   */
+  inline void utf8_lower(std::string &s)
+  {
+    for (size_t i = 0; i < s.size(); ++i)
+      {
+        uint8_t c = static_cast<uint8_t>(s[i]);
+        if (c < 0x80)
+          {
+            if (c >= 'A' && c <= 'Z')
+              s[i] = static_cast<char>(c + 32);
+            continue;
+          }
+        if ((c & 0xE0) != 0xC0 || i + 1 >= s.size()
+            || (static_cast<uint8_t>(s[i + 1]) & 0xC0) != 0x80)
+          continue; // longer sequences and invalid bytes are left as is
+        uint32_t cp
+            = ((c & 0x1F) << 6) | (static_cast<uint8_t>(s[i + 1]) & 0x3F);
+        uint32_t lc = cp;
+        if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)
+          lc = cp + 0x20;
+        else if ((cp >= 0x100 && cp <= 0x137 && cp != 0x130)
+                 || (cp >= 0x14A && cp <= 0x177))
+          lc = cp | 1;
+        else if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E))
+          lc = cp + (cp & 1);
+        else if (cp == 0x178)
+          lc = 0xFF;
+        else if (cp == 0x386)
+          lc = 0x3AC;
+        else if (cp >= 0x388 && cp <= 0x38A)
+          lc = cp + 0x25;
+        else if (cp == 0x38C)
+          lc = 0x3CC;
+        else if (cp == 0x38E || cp == 0x38F)
+          lc = cp + 0x3F;
+        else if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2)
+          lc = cp + 0x20;
+        else if (cp >= 0x400 && cp <= 0x40F)
+          lc = cp + 0x50;
+        else if (cp >= 0x410 && cp <= 0x42F)
+          lc = cp + 0x20;
+        else if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF)
+                 || (cp >= 0x4D0 && cp <= 0x4FF))
+          lc = cp | 1;
+        else if (cp >= 0x4C1 && cp <= 0x4CE)
+          lc = cp + (cp & 1);
+        else if (cp == 0x4C0)
+          lc = 0x4CF;
+        if (lc != cp)
+          {
+            s[i] = static_cast<char>(0xC0 | (lc >> 6));
+            s[i + 1] = static_cast<char>(0x80 | (lc & 0x3F));
+          }
+        ++i;
+      }
+  }
+}
+
+#endif
@@ -21,6 +21,9 @@
 
 #include "apidata.h"
 #include "jsonapi.h"
+#include "utils/jsonstream.hpp"
+#include "utils/dtostream.hpp"
+#include "dto/predict_out.hpp"
 #include <gtest/gtest.h>
 #include <iostream>
 
@@ -127,3 +130,141 @@ TEST(apidata, to_from_json)
   ASSERT_TRUE(njd["classes"][0]["cat"].GetString() == std::string("car"));
   ASSERT_EQ(prob1, njd["classes"][0]["prob"].GetDouble());
 }
+
+TEST(apidata, get_ref)
+{
+  APIData ad;
+  std::vector<double> vd = { 1.1, 2.2, 3.3 };
+  ad.add("vdouble", std::move(vd));
+  const std::vector<double> &rvd = ad.get_ref<std::vector<double>>("vdouble");
+  ASSERT_EQ(3, rvd.size());
+  ASSERT_EQ(2.2, rvd.at(1));
+  ASSERT_EQ(rvd.data(),
+            ad.get_ref<std::vector<double>>("vdouble").data()); // no copy
+  ASSERT_THROW(ad.get_ref<std::vector<double>>("none"),
+               DataConversionException);
+
+  APIData tad;
+  tad.add("test", 1);
+  ad.add("tad", tad);
+  std::vector<APIData> vad = { tad };
+  ad.add("vad", vad);
+  ASSERT_EQ(1, ad.getobj_ref("tad").get_ref<int>("test"));
+  ASSERT_EQ(1, ad.getobj_ref("vad").get_ref<int>("test"));
+  ASSERT_TRUE(ad.getobj_ref("none").empty());
+
+  // many keys, replaced and erased
+  for (int i = 0; i < 100; ++i)
+    ad.add(std::to_string(i), i);
+  ad.add("50", std::string("fifty"));
+  ad.erase("10");
+  ASSERT_EQ(103, ad.size());
+  ASSERT_FALSE(ad.has("10"));
+  ASSERT_EQ("fifty", ad.get("50").get<std::string>());
+  ASSERT_EQ(99, ad.get("99").get<int>());
+  ASSERT_EQ(2.2, ad.get_ref<std::vector<double>>("vdouble").at(1));
+}
+
+TEST(apidata, jdoc_stream)
+{
+  APIData ad;
+  ad.add("string", std::string("string"));
+  ad.add("double", 2.3);
+  ad.add("float", 0.5);
+  ad.add("int", -3);
+  ad.add("bool", true);
+  std::vector<double> vd(10000, 1.1);
+  ad.add("vdouble", vd);
+  APIData tad;
+  tad.add("test", 1);
+  ad.add("tad", tad);
+  JDoc jd;
+  jd.SetObject();
+  ad.toJDoc(jd);
+
+  // JSON, read in small chunks
+  JValStream js(jd, JValStream::JSON);
+  std::string out;
+  char buf[7];
+  size_t n;
+  while ((n = js.read(buf, sizeof(buf))) > 0)
+    out.append(buf, n);
+  ASSERT_EQ(dd_utils::jrender(jd), out);
+  ASSERT_EQ(0, js.read(buf, sizeof(buf)));
+
+  // CBOR
+  JDoc cd;
+  cd.SetObject();
+  cd.AddMember("f", 0.5, cd.GetAllocator());
+  cd.AddMember("i", -3, cd.GetAllocator());
+  JVal ja(rapidjson::kArrayType);
+  ja.PushBack(true, cd.GetAllocator());
+  ja.PushBack(1000, cd.GetAllocator());
+  cd.AddMember("a", ja, cd.GetAllocator());
+  std::string cbor = JValStream(cd, JValStream::CBOR).str();
+  const unsigned char expected[]
+      = { 0xa3, 0x61, 'f',  0xfa, 0x3f, 0x00, 0x00, 0x00, 0x61, 'i',
+          0x22, 0x61, 'a',  0x82, 0xf5, 0x19, 0x03, 0xe8 };
+  ASSERT_EQ(sizeof(expected), cbor.size());
+  ASSERT_EQ(0, memcmp(expected, cbor.data(), cbor.size()));
+}
+
+TEST(apidata, accept_format)
+{
+  ASSERT_EQ(ValueStream::JSON, ValueStream::accept_format(""));
+  ASSERT_EQ(ValueStream::JSON, ValueStream::accept_format("*/*"));
+  ASSERT_EQ(ValueStream::CBOR,
+            ValueStream::accept_format("Application/CBOR"));
+  ASSERT_EQ(ValueStream::JSON, ValueStream::accept_format(
+                                   "application/json, application/cbor"));
+  ASSERT_EQ(ValueStream::JSON,
+            ValueStream::accept_format("application/cbor;q=0"));
+  ASSERT_EQ(ValueStream::JSON,
+            ValueStream::accept_format("application/cbor-seq"));
+  ASSERT_EQ(ValueStream::CBOR,
+            ValueStream::accept_format(
+                "application/json;q=0.5, application/cbor"));
+  ASSERT_EQ(ValueStream::CBOR,
+            ValueStream::accept_format("*/*;q=0.1, application/cbor"));
+}
+
+TEST(apidata, dto_stream)
+{
+  auto body = DTO::PredictBody::createShared();
+  body->predictions
+      = oatpp::Vector<oatpp::Object<DTO::Prediction>>::createShared();
+  for (int i = 0; i < 3; ++i)
+    {
+      auto pred = DTO::Prediction::createShared();
+      pred->uri = std::to_string(i);
+      auto cls = DTO::PredictClass::createShared();
+      cls->cat = "cat";
+      cls->prob = 0.25f * i;
+      cls->vals
+          = DTO::DTOVector<double>(std::vector<double>(3000, 1.1 * i));
+      pred->classes->push_back(cls);
+      body->predictions->push_back(pred);
+    }
+  JDoc envelope;
+  envelope.SetObject();
+  envelope.AddMember("status", 200, envelope.GetAllocator());
+
+  // same document as dtoToJVal, without building it
+  JDoc jd;
+  jd.CopyFrom(envelope, jd.GetAllocator());
+  JVal jbody(rapidjson::kObjectType);
+  oatpp_utils::dtoToJVal(body, jd, jbody);
+  jd.AddMember("body", jbody, jd.GetAllocator());
+
+  oatpp_utils::DTOStream ds(envelope, "body", body, ValueStream::JSON);
+  std::string out;
+  char buf[1000];
+  size_t n;
+  while ((n = ds.read(buf, sizeof(buf))) > 0)
+    out.append(buf, n);
+  ASSERT_EQ(dd_utils::jrender(jd), out);
+
+  ASSERT_EQ(JValStream(jd, ValueStream::CBOR).str(),
+            oatpp_utils::DTOStream(envelope, "body", body, ValueStream::CBOR)
+                .str());
+}
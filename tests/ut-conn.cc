@@ -23,11 +23,22 @@
 #include "imginputfileconn.h"
 #include "csvinputfileconn.h"
 #include "csvtsinputfileconn.h"
+#include "svminputfileconn.h"
 #include "txtinputfileconn.h"
 #include "outputconnectorstrategy.h"
 #include "jsonapi.h"
+#include "utils/bbox.hpp"
+#include "utils/cv_utils.hpp"
 #include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
 #include <iostream>
+#include <random>
+#include <set>
+#include <thread>
 
 using namespace dd;
 
@@ -284,6 +295,323 @@ TEST(outputconn, cmfull)
       "696539702293474e308,2.696539702293474e308,2.696539702293474e308]}]"));
 }
 
+TEST(outputconn, measure_accumulator)
+{
+  std::vector<double> targets = { 0, 0, 1, 1, 1 };
+  std::vector<std::vector<double>> preds = {
+    { 0.7, 0.3 }, { 0.4, 0.6 }, { 0.1, 0.9 }, { 0.2, 0.8 }, { 0.6, 0.4 }
+  };
+  std::vector<std::string> measures
+      = { "acc", "acc-2", "f1", "mcc", "mcll", "auc" };
+  APIData res_ad;
+  res_ad.add("nclasses", 2);
+  res_ad.add("batch_size", static_cast<int>(targets.size()));
+  MeasureAccumulator macc(measures, 2, MeasureAccumulator::CLASSIFICATION);
+  ASSERT_TRUE(macc.supported());
+  for (size_t i = 0; i < targets.size(); i++)
+    {
+      APIData bad;
+      bad.add("pred", preds.at(i));
+      bad.add("target", targets.at(i));
+      std::vector<APIData> vad = { bad };
+      res_ad.add(std::to_string(i), vad);
+      macc.add_classification(preds.at(i).data(), targets.at(i));
+    }
+  APIData ad_out;
+  ad_out.add("measure", measures);
+  APIData out;
+  SupervisedOutput::measure(res_ad, ad_out, out);
+  APIData macc_out;
+  SupervisedOutput::measure(macc, res_ad, macc_out);
+  APIData meas = out.getobj("measure");
+  APIData macc_meas = macc_out.getobj("measure");
+  for (std::string k : { "acc", "acc-2", "f1", "precision", "recall", "accp",
+                         "mcc", "mcll", "auc" })
+    ASSERT_NEAR(meas.get(k).get<double>(), macc_meas.get(k).get<double>(),
+                1e-9)
+        << k;
+  ASSERT_EQ(0.6, macc_meas.get("acc").get<double>());
+
+  // segmentation
+  MeasureAccumulator sacc({ "acc" }, 2, MeasureAccumulator::SEGMENTATION);
+  std::vector<double> spred = { 0.0, 1.0 };
+  std::vector<double> starg1 = { 0.0, 1.0 };
+  std::vector<double> starg2 = { 0.0, 0.0 };
+  sacc.add_segmentation(spred.data(), starg1.data(), 2);
+  sacc.add_segmentation(spred.data(), starg2.data(), 2);
+  double meanacc = 0.0, meaniou = 0.0;
+  std::vector<double> clacc;
+  std::vector<double> cliou;
+  double acc = SupervisedOutput::acc_v(sacc, meanacc, meaniou, clacc, cliou);
+  ASSERT_EQ(0.75, acc);
+  ASSERT_EQ(0.875, meaniou);
+}
+
+TEST(outputconn, measure_accumulator_ties)
+{
+  // tied classes are ranked by class id, so a tied target is a top-1 hit
+  // only when it has the lowest id
+  std::vector<double> targets = { 0, 1, 1 };
+  std::vector<std::vector<double>> preds
+      = { { 0.4, 0.4, 0.2 }, { 0.4, 0.4, 0.2 }, { 0.2, 0.4, 0.4 } };
+  std::vector<std::string> measures = { "acc", "acc-2" };
+  APIData res_ad;
+  res_ad.add("nclasses", 3);
+  res_ad.add("batch_size", static_cast<int>(targets.size()));
+  MeasureAccumulator macc(measures, 3, MeasureAccumulator::CLASSIFICATION);
+  for (size_t i = 0; i < targets.size(); i++)
+    {
+      APIData bad;
+      bad.add("pred", preds.at(i));
+      bad.add("target", targets.at(i));
+      std::vector<APIData> vad = { bad };
+      res_ad.add(std::to_string(i), vad);
+      macc.add_classification(preds.at(i).data(), targets.at(i));
+    }
+  APIData ad_out;
+  ad_out.add("measure", measures);
+  APIData out;
+  SupervisedOutput::measure(res_ad, ad_out, out);
+  APIData macc_out;
+  SupervisedOutput::measure(macc, res_ad, macc_out);
+  APIData macc_meas = macc_out.getobj("measure");
+  ASSERT_NEAR(2.0 / 3.0, macc_meas.get("acc").get<double>(), 1e-9);
+  ASSERT_NEAR(out.getobj("measure").get("acc").get<double>(),
+              macc_meas.get("acc").get<double>(), 1e-9);
+  ASSERT_NEAR(1.0, macc_meas.get("acc-2").get<double>(), 1e-9);
+}
+
+TEST(outputconn, png_label_map_encoding)
+{
+  // png label maps stay lossless whatever the requested image encoding
+  APIData ad, pad, pout;
+  pout.add("encoding", std::string(".jpg"));
+  std::vector<APIData> vpout = { pout };
+  pad.add("output", vpout);
+  std::vector<APIData> vpad = { pad };
+  ad.add("parameters", vpad);
+  UnsupervisedOutput uout;
+  uout.init(ad);
+  ASSERT_EQ(".jpg", uout._image_encoding);
+
+  pout.add("mask_format", std::string("png"));
+  vpout = { pout };
+  pad.add("output", vpout);
+  vpad = { pad };
+  ad.add("parameters", vpad);
+  UnsupervisedOutput uout_mask;
+  uout_mask.init(ad);
+  ASSERT_EQ(".png", uout_mask._image_encoding);
+}
+
+TEST(outputconn, coco_map)
+{
+  MeasureAccumulator macc({ "map-coco" }, 2, MeasureAccumulator::DETECTION);
+  ASSERT_TRUE(macc.supported());
+  std::vector<DetectionStats> stats(2);
+  stats[0]._label = 0;
+  stats[0]._tp = { { 0.9, 1 }, { 0.8, 0 }, { 0.7, 1 } };
+  stats[0]._num_pos = 2;
+  stats[1]._label = 1; // no ground truth, not counted
+  stats[1]._tp = { { 0.6, 0 } };
+  macc.add_detection(50, stats);
+  macc.add_detection(75, stats);
+
+  // precision is 1 up to recall 0.5, then 2/3
+  double ap = (51 + 50 * 2.0 / 3.0) / 101.0;
+  ASSERT_NEAR(ap, macc.coco_map(50), 1e-6);
+  ASSERT_NEAR(ap, macc.coco_map(75), 1e-6);
+  ASSERT_EQ(0.0, macc.coco_map(95));
+  ASSERT_NEAR(ap / 5.0, macc.coco_map(), 1e-6);
+
+  std::vector<int> thresholds;
+  ASSERT_TRUE(SupervisedOutput::find_ap_iou_thresholds(
+      { "map-50", "map-coco" }, thresholds));
+  ASSERT_EQ(10, thresholds.size());
+}
+
+TEST(outputconn, merge_detections)
+{
+  std::vector<DetectionStats> stats(1);
+  stats[0]._label = 0;
+  stats[0]._tp = { { 0.9, 1 }, { 0.8, 0 } };
+  stats[0]._fp = { { 0.9, 0 }, { 0.8, 1 } };
+  stats[0]._num_pos = 1;
+
+  // thresholds accumulated apart give the same map as a single accumulator
+  MeasureAccumulator macc({ "map-coco" }, 1, MeasureAccumulator::DETECTION);
+  MeasureAccumulator macc50 = macc, macc75 = macc, ref = macc;
+  macc50.add_detection(50, stats);
+  macc75.add_detection(75, stats);
+  ref.add_detection(50, stats);
+  ref.add_detection(75, stats);
+  macc.merge_detections(macc50);
+  macc.merge_detections(macc75);
+
+  std::map<int, float> aps, ref_aps;
+  ASSERT_DOUBLE_EQ(ref.map(50, ref_aps), macc.map(50, aps));
+  ASSERT_DOUBLE_EQ(ref.map(75, ref_aps), macc.map(75, aps));
+  ASSERT_DOUBLE_EQ(ref.coco_map(), macc.coco_map());
+  ASSERT_EQ(0.0, macc50.coco_map(50));
+}
+
+TEST(outputconn, topk_results)
+{
+  // two best classes per row, as returned by a top-k
+  std::vector<float> probs = { 0.6, 0.3, 0.5, 0.24 };
+  std::vector<int64_t> indices = { 1, 2, 0, 2 };
+  std::vector<std::string> clnames = { "zero", "one", "two" };
+  SupervisedOutput so;
+  so.add_topk_results(std::vector<std::string>{ "a", "b" }, probs.data(),
+                      indices.data(), 2, 0.25,
+                      [&](int i) { return clnames.at(i); });
+  // duplicate uris are ignored
+  so.add_topk_results(std::vector<std::string>{ "a" }, probs.data(),
+                      indices.data(), 2, 0.25,
+                      [&](int i) { return clnames.at(i); });
+  OutputConnectorConfig conf;
+  conf._nclasses = 3;
+  auto out = so.finalize(DTO::OutputConnector::createShared(), conf, nullptr);
+  ASSERT_EQ(2, out->predictions->size());
+  auto pred = out->predictions->at(0);
+  ASSERT_EQ(2, pred->classes->size());
+  ASSERT_EQ("one", *pred->classes->at(0)->cat);
+  ASSERT_EQ("two", *pred->classes->at(1)->cat);
+  pred = out->predictions->at(1);
+  ASSERT_EQ(1, pred->classes->size());
+  ASSERT_EQ("zero", *pred->classes->at(0)->cat);
+  ASSERT_FLOAT_EQ(0.5, pred->classes->at(0)->prob);
+}
+
+TEST(outputconn, unsupervised_vals_format)
+{
+  std::vector<APIData> vrad(1);
+  vrad[0].add("uri", std::string("a"));
+  vrad[0].add("vals", std::vector<double>{ 1.0, -2.0, 0.5, 65504.0 });
+  vrad[0].add("vals_shape", std::vector<int>{ 2, 2 });
+  UnsupervisedOutput uo;
+  uo.add_results(vrad);
+  auto params = DTO::OutputConnector::createShared();
+  params->vals_format = "float16";
+  auto out = uo.finalize(params, OutputConnectorConfig(), nullptr);
+  auto pred = out->predictions->at(0);
+  ASSERT_EQ("float16", *pred->vals_format);
+  ASSERT_EQ(2, pred->vals_shape->size());
+  // little-endian 0x3c00, 0xc000, 0x3800, 0x7bff
+  ASSERT_EQ("ADwAwAA4/3s=", *pred->vals.retrieve<oatpp::String>());
+
+  std::vector<double> vals = { 1.0, -2.0 };
+  ASSERT_EQ("AACAPwAAAMA=", float_utils::to_base64(vals, "float32"));
+  ASSERT_EQ(0x7c00, float_utils::float_to_half(1e6));
+  ASSERT_EQ(0x0001, float_utils::float_to_half(std::pow(2.0, -24)));
+  ASSERT_EQ(-2.0, float_utils::half_to_float(0xc000));
+  ASSERT_THROW(uo.set_vals_format("float64"),
+               OutputConnectorBadParamException);
+}
+
+TEST(outputconn, mask_rle)
+{
+  // column-major order is 0 0 2 1 1 1
+  cv::Mat labels = (cv::Mat_<uchar>(3, 2) << 0, 1, 0, 1, 2, 1);
+  auto rles = cv_utils::labels_to_rle(labels);
+  ASSERT_EQ(3, rles.size());
+  ASSERT_EQ(std::vector<uint32_t>({ 0, 2, 4 }), rles[0]);
+  ASSERT_EQ(std::vector<uint32_t>({ 3, 3 }), rles[1]);
+  ASSERT_EQ(std::vector<uint32_t>({ 2, 1, 3 }), rles[2]);
+  ASSERT_EQ(rles[1], cv_utils::mask_to_rle(labels == 1));
+  ASSERT_EQ(std::vector<uint32_t>({ 6 }),
+            cv_utils::mask_to_rle(cv::Mat::zeros(3, 2, CV_8U)));
+
+  // counts after the second one are stored as differences
+  ASSERT_EQ("024", cv_utils::rle_to_string(rles[0]));
+  ASSERT_EQ("5:7:", cv_utils::rle_to_string({ 5, 10, 7, 20 }));
+  ASSERT_EQ("5:7I", cv_utils::rle_to_string({ 5, 10, 7, 3 }));
+}
+
+TEST(bbox_utils, nms)
+{
+  bbox_utils::Boxes<double> boxes;
+  boxes.add(0, 0, 10, 10);
+  boxes.add(1, 1, 11, 11);
+  boxes.add(50, 50, 60, 60);
+  std::vector<size_t> picked;
+  bbox_utils::nms_sorted_bboxes(boxes, picked, 0.5);
+  ASSERT_EQ(std::vector<size_t>({ 0, 2 }), picked);
+
+  // boxes of different labels don't suppress each other
+  std::vector<int> labels = { 1, 2, 1 };
+  bbox_utils::nms_sorted_bboxes(boxes, picked, 0.5, &labels);
+  ASSERT_EQ(std::vector<size_t>({ 0, 1, 2 }), picked);
+  bbox_utils::nms_sorted_bboxes(boxes, picked, 0.5, &labels, 2);
+  ASSERT_EQ(std::vector<size_t>({ 0, 1 }), picked);
+
+  // soft nms decays the score of the overlapping box
+  std::vector<double> scores = { 0.9, 0.8, 0.7 };
+  bbox_utils::soft_nms(boxes, scores, picked, 0.3, 0.1, false);
+  ASSERT_EQ(std::vector<size_t>({ 0, 2, 1 }), picked);
+  ASSERT_LT(scores[1], 0.3);
+
+  // detections, as output by backends
+  auto detections = [&](std::vector<APIData> &bboxes,
+                        std::vector<double> &probs,
+                        std::vector<std::string> &cats) {
+    bboxes.clear();
+    for (size_t i = 0; i < boxes.size(); ++i)
+      {
+        APIData ad_bbox;
+        ad_bbox.add("xmin", boxes._xmin[i]);
+        ad_bbox.add("ymin", boxes._ymin[i]);
+        ad_bbox.add("xmax", boxes._xmax[i]);
+        ad_bbox.add("ymax", boxes._ymax[i]);
+        bboxes.push_back(ad_bbox);
+      }
+    probs = { 0.9, 0.8, 0.7 };
+    cats = { "cat", "dog", "cat" };
+  };
+  std::vector<APIData> bboxes;
+  std::vector<double> probs;
+  std::vector<std::string> cats;
+  detections(bboxes, probs, cats);
+  bbox_utils::nms_sorted_bboxes(bboxes, probs, cats, 0.5, -1);
+  ASSERT_EQ(std::vector<std::string>({ "cat", "cat" }), cats);
+  detections(bboxes, probs, cats);
+  bbox_utils::nms_sorted_bboxes(bboxes, probs, cats, 0.5, -1, "greedy", true);
+  ASSERT_EQ(std::vector<std::string>({ "cat", "dog", "cat" }), cats);
+  detections(bboxes, probs, cats);
+  bbox_utils::nms_sorted_bboxes(bboxes, probs, cats, 0.3, -1, "soft_linear",
+                                false, 0.5, 0.1);
+  ASSERT_EQ(std::vector<std::string>({ "cat", "cat", "dog" }), cats);
+  ASSERT_EQ(0.7, probs.at(1));
+  ASSERT_LT(probs.at(2), 0.3);
+  ASSERT_EQ(1.0, bboxes.at(2).get("xmin").get<double>());
+
+  // many boxes, bucketed on a grid
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> pos(0.0, 1000.0);
+  std::uniform_real_distribution<double> size(2.0, 80.0);
+  std::vector<std::vector<double>> vboxes;
+  bbox_utils::Boxes<double> many;
+  for (size_t i = 0; i < 2 * bbox_utils::nms_grid_min_boxes(); ++i)
+    {
+      double x = pos(gen), y = pos(gen);
+      std::vector<double> b = { x, y, x + size(gen), y + size(gen) };
+      vboxes.push_back(b);
+      many.add(b[0], b[1], b[2], b[3]);
+    }
+  std::vector<size_t> expected;
+  for (size_t i = 0; i < vboxes.size(); ++i)
+    {
+      bool keep = true;
+      for (size_t p : expected)
+        if (bbox_utils::iou(vboxes[i], vboxes[p]) > 0.45)
+          keep = false;
+      if (keep)
+        expected.push_back(i);
+    }
+  bbox_utils::nms_sorted_bboxes(many, picked, 0.45);
+  ASSERT_EQ(expected, picked);
+}
+
 TEST(inputconn, img_histogram_bw)
 {
   std::string voc_roi_repo = "../examples/caffe/voc_roi";
@@ -449,6 +777,131 @@ TEST(inputconn, img)
                 == 0); // the two images must be identical
 }
 
+TEST(inputconn, img_reduced_decode)
+{
+  // 1416x1920 jpeg, decoded at 1/4 resolution for a 224x224 output
+  std::string voc_roi_repo = "../examples/caffe/voc_roi";
+  cv::Mat small = cv::imread(voc_roi_repo + "/000010_bw.jpg");
+  cv::Mat large;
+  cv::resize(small, large, cv::Size(), 4.0, 4.0, cv::INTER_CUBIC);
+  std::string large_fname = "img_reduced_decode.jpg";
+  cv::imwrite(large_fname, large);
+  std::vector<std::string> uris = { large_fname };
+
+  // opt-in, as pixels differ from a full decode
+  ASSERT_FALSE(ImgInputFileConn()._reduced_decode);
+
+  std::vector<cv::Mat> imgs;
+  for (bool reduced_decode : { true, false })
+    {
+      APIData ad, pad, pinp;
+      ad.add("data", uris);
+      pinp.add("width", 224);
+      pinp.add("height", 224);
+      pinp.add("reduced_decode", reduced_decode);
+      pad.add("input", std::vector<APIData>{ pinp });
+      ad.add("parameters", std::vector<APIData>{ pad });
+      ImgInputFileConn iifc;
+      iifc._logger = spdlog::stdout_logger_mt(
+          "test_img_reduced_decode_" + std::to_string(reduced_decode));
+      iifc.transform(ad);
+      ASSERT_EQ(1, iifc._images.size());
+      ASSERT_EQ(224, iifc._images.at(0).cols);
+      ASSERT_EQ(224, iifc._images.at(0).rows);
+      // original size is reported, e.g. for bbox rescaling
+      ASSERT_EQ(1920, iifc._images_size.at(0).first);
+      ASSERT_EQ(1416, iifc._images_size.at(0).second);
+      imgs.push_back(iifc._images.at(0));
+    }
+
+  cv::Mat diff;
+  cv::absdiff(imgs.at(0), imgs.at(1), diff);
+  ASSERT_LT(cv::mean(diff)[0], 8.0);
+  remove(large_fname.c_str());
+}
+
+TEST(inputconn, img_cache)
+{
+  std::string voc_roi_repo = "../examples/caffe/voc_roi";
+  std::vector<std::string> uris = { voc_roi_repo + "/000010_bw.jpg" };
+  ImgInputFileConn iifc_service;
+  iifc_service._logger = spdlog::stdout_logger_mt("test_img_cache");
+  APIData ad_init;
+  ad_init.add("img_cache_mb", 1);
+  iifc_service.init(ad_init);
+
+  std::vector<cv::Mat> imgs;
+  for (int width : { 64, 64, 32 })
+    {
+      // predict calls work on copies of the service connector
+      ImgInputFileConn iifc(iifc_service);
+      APIData ad, pad, pinp;
+      ad.add("data", uris);
+      pinp.add("width", width);
+      pinp.add("height", width);
+      pad.add("input", std::vector<APIData>{ pinp });
+      ad.add("parameters", std::vector<APIData>{ pad });
+      iifc.transform(ad);
+      ASSERT_EQ(1, iifc._images.size());
+      ASSERT_EQ(width, iifc._images.at(0).cols);
+      ASSERT_EQ(480, iifc._images_size.at(0).first);
+      ASSERT_EQ(354, iifc._images_size.at(0).second);
+      imgs.push_back(iifc._images.at(0));
+    }
+  cv::Mat diff;
+  cv::absdiff(imgs.at(0), imgs.at(1), diff);
+  ASSERT_EQ(0, cv::countNonZero(diff.reshape(1)));
+
+  // second call is a hit, third one has different preprocessing parameters
+  APIData stats;
+  iifc_service.add_stats(stats);
+  ASSERT_EQ(1, stats.get("img_cache_hits").get<long int>());
+  ASSERT_EQ(2, stats.get("img_cache_misses").get<long int>());
+  ASSERT_EQ(2, stats.get("img_cache_entries").get<long int>());
+}
+
+TEST(inputconn, img_concurrent_transforms)
+{
+  // concurrent predicts share the same bounded thread pool, and images are
+  // returned in input order
+  std::string voc_roi_repo = "../examples/caffe/voc_roi";
+  std::vector<std::string> uris = { voc_roi_repo + "/000010_bw.jpg" };
+  std::shared_ptr<spdlog::logger> logger
+      = spdlog::stdout_logger_mt("test_img_concurrent");
+  std::vector<std::thread> callers;
+  std::atomic<int> failures{ 0 };
+  for (int c = 0; c < 8; ++c)
+    callers.emplace_back(
+        [&, c]()
+        {
+          std::vector<std::string> c_uris;
+          std::vector<std::string> ids;
+          for (int k = 0; k < 16; ++k)
+            {
+              c_uris.push_back(uris.at(k % uris.size()));
+              ids.push_back(std::to_string(c) + "_" + std::to_string(k));
+            }
+          APIData ad, pad, pinp;
+          ad.add("data", c_uris);
+          ad.add("ids", ids);
+          pinp.add("width", 32 + c);
+          pinp.add("height", 32);
+          pad.add("input", std::vector<APIData>{ pinp });
+          ad.add("parameters", std::vector<APIData>{ pad });
+          ImgInputFileConn iifc;
+          iifc._logger = logger;
+          iifc.transform(ad);
+          if (iifc._images.size() != 16 || iifc._ids != ids
+              || iifc._images.at(0).cols != 32 + c)
+            ++failures;
+        });
+  for (std::thread &caller : callers)
+    caller.join();
+  ASSERT_EQ(0, failures.load());
+  ASSERT_LE(ThreadPool::instance().size(),
+            std::max(1u, std::thread::hardware_concurrency()));
+}
+
 TEST(inputconn, img_error)
 { // test error
   APIData ad;
@@ -471,6 +924,194 @@ TEST(inputconn, img_error)
       << "Reading this image should not be possible";
 }
 
+/**
+ * local keep-alive http server stand-in, serving files from a directory with
+ * an ETag, and never answering in time on /slow
+ */
+class LocalHttpServer
+{
+public:
+  LocalHttpServer(const std::string &root) : _root(root)
+  {
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    listen(_fd, 64);
+    socklen_t len = sizeof(addr);
+    getsockname(_fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    _port = ntohs(addr.sin_port);
+    _accept_thread = std::thread([this]() { accept_loop(); });
+  }
+
+  ~LocalHttpServer()
+  {
+    shutdown(_fd, SHUT_RDWR);
+    close(_fd);
+    _accept_thread.join();
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int cfd : _conn_fds)
+      shutdown(cfd, SHUT_RDWR);
+    for (std::thread &t : _conn_threads)
+      t.join();
+  }
+
+  std::string url(const std::string &path) const
+  {
+    return "http://127.0.0.1:" + std::to_string(_port) + "/" + path;
+  }
+
+  std::atomic<int> _connections{ 0 };
+  std::atomic<int> _requests{ 0 };
+  std::atomic<int> _not_modified{ 0 };
+
+private:
+  void accept_loop()
+  {
+    while (true)
+      {
+        int cfd = accept(_fd, nullptr, nullptr);
+        if (cfd < 0)
+          break;
+        ++_connections;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _conn_fds.push_back(cfd);
+        _conn_threads.emplace_back([this, cfd]() { serve(cfd); });
+      }
+  }
+
+  void serve(int cfd)
+  {
+    std::string buf;
+    char chunk[4096];
+    while (true)
+      {
+        size_t end;
+        while ((end = buf.find("\r\n\r\n")) == std::string::npos)
+          {
+            ssize_t n = recv(cfd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+              {
+                close(cfd);
+                return;
+              }
+            buf.append(chunk, n);
+          }
+        std::string req = buf.substr(0, end);
+        buf.erase(0, end + 4);
+        ++_requests;
+
+        std::string path = req.substr(req.find(' ') + 1);
+        path = path.substr(0, path.find_first_of(" ?"));
+        if (path == "/slow")
+          {
+            std::this_thread::sleep_for(std::chrono::seconds(3));
+            continue;
+          }
+        std::ifstream in(_root + path, std::ios::binary);
+        std::ostringstream body;
+        body << in.rdbuf();
+        std::string etag = "\"" + path + "-v1\"";
+        std::string resp;
+        if (!in.good())
+          resp = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        else if (req.find("If-None-Match: " + etag) != std::string::npos)
+          {
+            ++_not_modified;
+            resp = "HTTP/1.1 304 Not Modified\r\nETag: " + etag
+                   + "\r\nContent-Length: 0\r\n\r\n";
+          }
+        else
+          resp = "HTTP/1.1 200 OK\r\nETag: " + etag + "\r\nContent-Length: "
+                 + std::to_string(body.str().size()) + "\r\n\r\n"
+                 + body.str();
+        send(cfd, resp.data(), resp.size(), MSG_NOSIGNAL);
+      }
+  }
+
+  std::string _root;
+  int _fd = -1;
+  int _port = 0;
+  std::thread _accept_thread;
+  std::mutex _mutex;
+  std::vector<int> _conn_fds;
+  std::vector<std::thread> _conn_threads;
+};
+
+TEST(inputconn, httpfetcher)
+{
+  LocalHttpServer server("../examples/caffe/mnist");
+  std::string cache_dir = "httpfetcher_cache";
+  FetchCache cache(cache_dir, 1024 * 1024);
+  std::vector<std::string> urls;
+  for (int i = 0; i < 32; ++i)
+    urls.push_back(server.url("sample_digit.png?i=" + std::to_string(i)));
+  urls.push_back(server.url("missing.png"));
+
+  std::ifstream in("../examples/caffe/mnist/sample_digit.png",
+                   std::ios::binary);
+  std::ostringstream content;
+  content << in.rdbuf();
+
+  // at most 4 connections, kept alive from one call to the next
+  std::vector<FetchResult> results;
+  httpfetcher::instance().fetch(urls, results, 10, 4, &cache);
+  ASSERT_EQ(urls.size(), results.size());
+  for (int i = 0; i < 32; ++i)
+    {
+      ASSERT_EQ(200, results[i]._code);
+      ASSERT_EQ(content.str(), results[i]._content);
+      ASSERT_FALSE(results[i]._cached);
+    }
+  ASSERT_EQ(404, results.back()._code);
+  ASSERT_TRUE(server._connections <= 4);
+
+  // revalidated from the local cache
+  urls.pop_back();
+  httpfetcher::instance().fetch(urls, results, 10, 4, &cache);
+  for (int i = 0; i < 32; ++i)
+    {
+      ASSERT_EQ(200, results[i]._code);
+      ASSERT_EQ(content.str(), results[i]._content);
+      ASSERT_TRUE(results[i]._cached);
+    }
+  ASSERT_EQ(32, server._not_modified);
+  ASSERT_TRUE(server._connections <= 4);
+  ASSERT_EQ(32 * content.str().size(), cache.bytes());
+
+  // least recently used entries are evicted past the size bound
+  httpfetcher::instance().fetch({ urls.back() }, results, 10, 4, &cache);
+  cache.set_max_bytes(content.str().size());
+  ASSERT_EQ(content.str().size(), cache.bytes());
+  httpfetcher::instance().fetch({ urls.back() }, results, 10, 4, &cache);
+  ASSERT_TRUE(results.at(0)._cached);
+  httpfetcher::instance().fetch({ urls.front() }, results, 10, 4, &cache);
+  ASSERT_FALSE(results.at(0)._cached);
+  FetchCache reopened(cache_dir, 1024 * 1024);
+  ASSERT_EQ(content.str().size(), reopened.bytes());
+
+  // deadline
+  httpfetcher::instance().fetch({ server.url("slow") }, results, 1, 4);
+  ASSERT_EQ(-1, results.at(0)._code);
+  ASSERT_FALSE(results.at(0)._error.empty());
+
+  // image connector
+  APIData ad;
+  ad.add("data", std::vector<std::string>{ server.url("sample_digit.png"),
+                                           server.url("sample_digit.png") });
+  ImgInputFileConn iifc;
+  iifc._logger = spdlog::stdout_logger_mt("test_img_fetch");
+  iifc.transform(ad);
+  ASSERT_EQ(2, iifc._images.size());
+
+  fileops::clear_directory(cache_dir);
+  fileops::remove_dir(cache_dir);
+}
+
 // TODO: test csv scale, separator, categorical, ...
 TEST(inputconn, csv_mem1)
 {
@@ -578,6 +1219,203 @@ TEST(inputconn, csv_znorm)
   ASSERT_EQ(10, cifc._csvdata[1]._v[3]); // labels are not scaled as a default
 }
 
+TEST(inputconn, csv_file_chunks)
+{
+  std::string fname = "csv_file_chunks.csv";
+  {
+    std::ofstream out(fname);
+    out << "id,val,color,label\n";
+    std::vector<std::string> colors = { "red", "green", "blue" };
+    for (int i = 0; i < 100000; ++i)
+      out << "r" << i << "," << i % 100 << "," << colors[i % 3] << ","
+          << (i % 2 ? "yes" : "no") << "\n";
+  }
+  APIData ad;
+  ad.add("data", std::vector<std::string>{ fname });
+  APIData pad, pinp;
+  pinp.add("id", std::string("id"));
+  pinp.add("label", std::string("label"));
+  pinp.add("categoricals", std::vector<std::string>{ "color" });
+  pinp.add("scale", true);
+  pinp.add("spill_mb", 1); // spilled once over 1MB
+  pad.add("input", std::vector<APIData>{ pinp });
+  ad.add("parameters", std::vector<APIData>{ pad });
+  CSVInputFileConn cifc;
+  cifc._logger = spdlog::stdout_logger_mt("test_csv_file_chunks");
+  cifc._model_repo = ".";
+  cifc._train = true;
+  cifc._chunk_bytes = 1024; // many chunks, parsed in parallel
+  cifc.transform(ad);
+
+  ASSERT_EQ(100000, cifc._csvdata.size());
+  ASSERT_EQ(2, cifc._hcorresp.size());
+  ASSERT_EQ(3, cifc._categoricals["color"]._vals.size());
+  ASSERT_EQ(6, cifc._min_vals.size());
+  ASSERT_EQ(99, cifc._max_vals.at(1));
+
+  // lines keep the file order, categories and labels are numbered in order
+  // of appearance
+  const CSVline &line = cifc._csvdata.at(5);
+  ASSERT_EQ("r5", line._str);
+  std::vector<double> expected = { 0, 5 / 99.0, 0, 0, 1, 1 };
+  ASSERT_EQ(expected.size(), line._v.size());
+  for (size_t j = 0; j < expected.size(); ++j)
+    ASSERT_NEAR(expected[j], line._v[j], 1e-6);
+
+  remove(fname.c_str());
+  remove("corresp.txt");
+}
+
+TEST(inputconn, csv_file_categories)
+{
+  std::string fname = "csv_file_categories.csv";
+  std::string test_fname = "csv_file_categories_test.csv";
+  std::string pred_fname = "csv_file_categories_pred.csv";
+  {
+    std::ofstream out(fname);
+    out << "val,color,label\n16777217,red,yes\n1,,no\n2,blue,yes\n";
+    std::ofstream test_out(test_fname);
+    test_out << "val,color,label\n3,red,no\n4,,yes\n";
+    std::ofstream pred_out(pred_fname);
+    pred_out << "val,color,label\n5,purple,yes\n";
+  }
+  APIData ad;
+  ad.add("data", std::vector<std::string>{ fname, test_fname });
+  APIData pad, pinp;
+  pinp.add("label", std::string("label"));
+  pinp.add("categoricals", std::vector<std::string>{ "color" });
+  pad.add("input", std::vector<APIData>{ pinp });
+  ad.add("parameters", std::vector<APIData>{ pad });
+  CSVInputFileConn cifc;
+  cifc._logger = spdlog::stdout_logger_mt("test_csv_file_categories");
+  cifc._model_repo = ".";
+  cifc._train = true;
+  cifc.transform(ad);
+
+  // empty values are a category of their own, values are kept as doubles
+  ASSERT_EQ(3, cifc._categoricals["color"]._vals.size());
+  ASSERT_EQ(1, cifc._categoricals["color"].get_cat_num(""));
+  ASSERT_EQ(3, cifc._csvdata.size());
+  ASSERT_EQ(1, cifc._csvdata_tests.size());
+  std::set<std::string> ids;
+  for (const CSVline &line : cifc._csvdata)
+    {
+      ids.insert(line._str);
+      if (line._str == "1")
+        ASSERT_EQ(16777217.0, line._v.at(0));
+    }
+  // test ids follow the training ones
+  for (const CSVline &line : cifc._csvdata_tests.at(0))
+    ASSERT_TRUE(ids.insert(line._str).second);
+  ASSERT_EQ(5, ids.size());
+
+  // predict files do not add categories
+  CSVInputFileConn pcifc;
+  pcifc._logger = spdlog::stdout_logger_mt("test_csv_file_categories_pred");
+  pcifc._model_repo = ".";
+  pcifc._train = false;
+  pcifc.fillup_parameters(pinp);
+  pcifc._categoricals = cifc._categoricals;
+  ASSERT_THROW(pcifc.read_csv(pred_fname), InputConnectorBadParamException);
+  ASSERT_EQ(3, pcifc._categoricals["color"]._vals.size());
+
+  remove(fname.c_str());
+  remove(test_fname.c_str());
+  remove(pred_fname.c_str());
+  remove("corresp.txt");
+}
+
+TEST(inputconn, csv_file_cache)
+{
+  std::string repo = "csv_file_cache_repo";
+  std::string fname = repo + "/data.csv";
+  fileops::create_dir(repo, 0777);
+  {
+    std::ofstream out(fname);
+    out << "id,val,color,label\n";
+    std::vector<std::string> colors = { "red", "green", "blue" };
+    for (int i = 0; i < 10000; ++i)
+      out << "r" << i << "," << i % 100 << "," << colors[i % 3] << ","
+          << (i % 2 ? "yes" : "no") << "\n";
+  }
+  auto read = [&](CSVInputFileConn &cifc, const std::string &name) {
+    APIData ad;
+    ad.add("data", std::vector<std::string>{ fname });
+    APIData pad, pinp;
+    pinp.add("id", std::string("id"));
+    pinp.add("label", std::string("label"));
+    pinp.add("categoricals", std::vector<std::string>{ "color" });
+    pinp.add("scale", true);
+    pinp.add("csv_cache", true);
+    pad.add("input", std::vector<APIData>{ pinp });
+    ad.add("parameters", std::vector<APIData>{ pad });
+    cifc._logger = spdlog::stdout_logger_mt(name);
+    cifc._model_repo = repo;
+    cifc._train = true;
+    cifc.transform(ad);
+  };
+
+  CSVInputFileConn cifc;
+  read(cifc, "test_csv_file_cache");
+  std::unordered_set<std::string> cache_files;
+  fileops::list_directory(repo + "/csv_cache", true, false, false,
+                          cache_files);
+  ASSERT_EQ(1, cache_files.size());
+
+  // second read from the cache
+  CSVInputFileConn cifc2;
+  read(cifc2, "test_csv_file_cache2");
+  ASSERT_EQ(cifc._csvdata.size(), cifc2._csvdata.size());
+  for (size_t i = 0; i < cifc._csvdata.size(); ++i)
+    {
+      ASSERT_EQ(cifc._csvdata[i]._str, cifc2._csvdata[i]._str);
+      ASSERT_EQ(cifc._csvdata[i]._v, cifc2._csvdata[i]._v);
+    }
+  ASSERT_EQ(cifc._categoricals["color"]._vals,
+            cifc2._categoricals["color"]._vals);
+  ASSERT_EQ(cifc._hcorresp, cifc2._hcorresp);
+  ASSERT_EQ(cifc._min_vals, cifc2._min_vals);
+  ASSERT_EQ(cifc._max_vals, cifc2._max_vals);
+
+  // truncated cache is parsed again
+  std::string cache_fname = *cache_files.begin();
+  {
+    std::ifstream in(cache_fname, std::ios::binary);
+    std::string cache_data((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out(cache_fname, std::ios::binary | std::ios::trunc);
+    out.write(cache_data.data(), cache_data.size() / 2);
+  }
+  ASSERT_TRUE(CSVCache::stale(cache_fname));
+  CSVInputFileConn cifc4;
+  read(cifc4, "test_csv_file_cache4");
+  ASSERT_EQ(cifc._csvdata.size(), cifc4._csvdata.size());
+  ASSERT_EQ(cifc._csvdata.back()._v, cifc4._csvdata.back()._v);
+  ASSERT_FALSE(CSVCache::stale(cache_fname));
+
+  // modified data is parsed again, replacing the stale cache
+  {
+    std::ofstream out(fname, std::ios::app);
+    out << "r10000,100,blue,yes\n";
+  }
+  ASSERT_TRUE(CSVCache::stale(cache_fname));
+  CSVInputFileConn cifc3;
+  read(cifc3, "test_csv_file_cache3");
+  ASSERT_EQ(10001, cifc3._csvdata.size());
+  ASSERT_EQ(100, cifc3._max_vals.at(1));
+  cache_files.clear();
+  fileops::list_directory(repo + "/csv_cache", true, false, false,
+                          cache_files);
+  ASSERT_EQ(1, cache_files.size());
+  ASSERT_FALSE(CSVCache::stale(*cache_files.begin()));
+
+  fileops::clear_directory(repo + "/csv_cache");
+  fileops::remove_dir(repo + "/csv_cache");
+  fileops::clear_directory(repo);
+  fileops::remove_dir(repo);
+}
+
 TEST(inputconn, csv_copy)
 {
   std::string header = "id,val1,val2,val3,val4,val5";
@@ -842,6 +1680,96 @@ TEST(inputconn, csvts_error)
   fileops::remove_dir("csvts");
 }
 
+TEST(inputconn, svm_file)
+{
+  std::string fname = "svm_file.svm";
+  std::ofstream out(fname);
+  for (int i = 0; i < 100; ++i)
+    {
+      out << (i % 2) << " " << i % 7 << ":" << 0.5 * i << " 100:1e-2";
+      if (i % 10 == 0)
+        out << " # comment";
+      out << "\n";
+    }
+  out.close();
+
+  SVMInputFileConn sifc;
+  sifc._logger = spdlog::stdout_logger_mt("test_svm_file");
+  sifc._train = true;
+  sifc._test_split = 0.2;
+  APIData ad;
+  sifc.read_svm(ad, fname);
+  ASSERT_EQ(8, sifc._fids.size());
+  ASSERT_EQ(101, sifc.feature_size());
+  ASSERT_EQ(64, sifc._svmdata.rows()); // tail lines, then split again
+  ASSERT_EQ(36, sifc._svmdata_test.rows());
+  ASSERT_EQ(2 * sifc._svmdata.rows(), sifc._svmdata.nnz());
+  ASSERT_EQ(1, sifc._svmdata._labels[3]);
+  ASSERT_EQ(3, sifc._svmdata._indices[6]);
+  ASSERT_EQ(1.5, sifc._svmdata._values[6]);
+  ASSERT_EQ(100, sifc._svmdata._indices[7]);
+  ASSERT_EQ(0.01, sifc._svmdata._values[7]);
+
+  // unknown features are dropped in prediction
+  SVMInputFileConn psifc(sifc);
+  psifc._train = false;
+  psifc._fids = { 3 };
+  DDSvm dsvm;
+  dsvm._cifc = &psifc;
+  dsvm.read_mem("0 3:2.5 4:1\n1 3:-1e3 5:1");
+  ASSERT_EQ(2, psifc._svmdata.rows());
+  ASSERT_EQ(2, psifc._svmdata.nnz());
+  ASSERT_EQ(-1000.0, psifc._svmdata._values[1]);
+  ASSERT_THROW(dsvm.read_mem("1 4:1"), InputConnectorBadParamException);
+  ASSERT_THROW(dsvm.read_mem("1 3:x"), InputConnectorBadParamException);
+
+  remove(fname.c_str());
+}
+
+TEST(inputconn, txt_vocab_parallel)
+{
+  std::string dir = "txt_vocab";
+  fileops::create_dir(dir + "/a", 0777);
+  fileops::create_dir(dir + "/b", 0777);
+  for (int i = 0; i < 200; ++i)
+    {
+      std::ofstream outa(dir + "/a/" + std::to_string(i) + ".txt");
+      outa << "worda" << i % 10 << " commonword worda" << i % 10;
+      std::ofstream outb(dir + "/b/" + std::to_string(i) + ".txt");
+      outb << "rareb" << i << " commonword";
+    }
+
+  TxtInputFileConn tifc;
+  tifc._logger = spdlog::stdout_logger_mt("test_txt_vocab_parallel");
+  tifc._model_repo = dir;
+  tifc._train = true;
+  tifc._min_count = 30;
+  DDTxt dtxt;
+  dtxt._ctfc = &tifc;
+  dtxt._logger = tifc._logger;
+  dtxt.read_dir(dir, -1);
+
+  ASSERT_EQ(400, tifc._txt.size());
+  ASSERT_EQ(11, tifc._vocab.size()); // rare words are pruned
+  ASSERT_EQ(400, tifc._vocab["commonword"]._total_count);
+  ASSERT_EQ(400, tifc._vocab["commonword"]._total_docs);
+  ASSERT_EQ(40, tifc._vocab["worda3"]._total_count);
+  ASSERT_EQ(20, tifc._vocab["worda3"]._total_docs);
+  std::set<int> pos;
+  for (auto &w : tifc._vocab)
+    pos.insert(w.second._pos);
+  ASSERT_EQ(11, pos.size());
+  ASSERT_EQ(0, *pos.begin());
+  ASSERT_EQ(10, *pos.rbegin());
+
+  fileops::clear_directory(dir + "/a");
+  fileops::clear_directory(dir + "/b");
+  fileops::remove_dir(dir + "/a");
+  fileops::remove_dir(dir + "/b");
+  fileops::clear_directory(dir);
+  fileops::remove_dir(dir);
+}
+
 /*TEST(inputconn,txt_parse_content)
 {
   std::string str = "everything runs fine, right?";
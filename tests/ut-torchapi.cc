@@ -36,6 +36,8 @@
 #include "txtinputfileconn.h"
 #include "utils/cv_utils.hpp"
 #include "backends/torch/native/templates/nbeats.h"
+#include "backends/torch/native/templates/vit.h"
+#include "backends/torch/native/templates/visformer.h"
 
 using namespace dd;
 
@@ -213,6 +215,52 @@ TEST(torchapi, service_predict)
   ASSERT_EQ(cl_dog, "n02096051 Airedale, Airedale terrier");
 }
 
+TEST(torchapi, service_predict_batch_calibration)
+{
+  // create service with a predict memory budget
+  JsonAPI japi;
+  std::string sname = "imgserv";
+  std::string jstr
+      = "{\"mllib\":\"torch\",\"description\":\"resnet-50\",\"type\":"
+        "\"supervised\",\"model\":{\"repository\":\""
+        + incept_repo
+        + "\"},\"parameters\":{\"input\":{\"connector\":\"image\",\"height\":"
+          "224,\"width\":224,\"rgb\":true,\"scale\":0.0039},\"mllib\":{"
+          "\"nclasses\":1000,\"predict_memory_budget_mb\":2048,"
+          "\"predict_max_batch_size\":8}}}";
+  std::string joutstr = japi.jrender(japi.service_create(sname, jstr));
+  ASSERT_EQ(created_str, joutstr);
+
+  // profile in service info
+  joutstr = japi.jrender(japi.service_status(sname));
+  std::cout << "joutstr=" << joutstr << std::endl;
+  JDoc jd;
+  jd.Parse<rapidjson::kParseNanAndInfFlag>(joutstr.c_str());
+  ASSERT_TRUE(!jd.HasParseError());
+  auto &model_stats = jd["body"]["model_stats"];
+  ASSERT_TRUE(model_stats.HasMember("predict_batch_size"));
+  int predict_batch_size = model_stats["predict_batch_size"].GetInt();
+  ASSERT_TRUE(predict_batch_size >= 1 && predict_batch_size <= 8);
+  ASSERT_TRUE(model_stats["batch_profile"].IsArray());
+  ASSERT_TRUE(model_stats["batch_profile"].Size() >= 1);
+  ASSERT_TRUE(model_stats["batch_profile"].Size() <= 4);
+  ASSERT_EQ(model_stats["batch_profile"][0]["batch_size"].GetInt(), 1);
+  ASSERT_TRUE(model_stats["batch_profile"][0]["latency_ms"].GetDouble() > 0.0);
+
+  // predict with calibrated batch size
+  std::string jpredictstr
+      = "{\"service\":\"imgserv\",\"parameters\":{\"input\":{\"height\":224,"
+        "\"width\":224},\"output\":{\"best\":1}},\"data\":[\""
+        + incept_repo + "cat.jpg\",\"" + incept_repo + "dog.jpg\"]}";
+  joutstr = japi.jrender(japi.service_predict(jpredictstr));
+  jd = JDoc();
+  std::cout << "joutstr=" << joutstr << std::endl;
+  jd.Parse<rapidjson::kParseNanAndInfFlag>(joutstr.c_str());
+  ASSERT_TRUE(!jd.HasParseError());
+  ASSERT_EQ(200, jd["status"]["code"]);
+  ASSERT_EQ(jd["body"]["predictions"].Size(), 2);
+}
+
 TEST(torchapi, service_predict_native_bw)
 {
   // Predict greyscale image with native model should work
@@ -560,6 +608,61 @@ TEST(inputconn, txt_tokenize_ordered_words)
   ASSERT_EQ(tokens, towe._v);
 }
 
+TEST(inputconn, txt_tokenize_wordpiece_unicode)
+{
+  std::string str = "Éclairs, UNAFFABLE xyz";
+  TxtInputFileConn tifc;
+  tifc._ordered_words = true;
+  tifc._wordpiece_tokens = true;
+  tifc._punctuation_tokens = true;
+  tifc._lower_case = true;
+
+  tifc._vocab["éclair"] = Word();
+  tifc._vocab["##s"] = Word();
+  tifc._vocab["un"] = Word();
+  tifc._vocab["##aff"] = Word();
+  tifc._vocab["##able"] = Word();
+  tifc._vocab[","] = Word();
+
+  tifc.parse_content(str, 1);
+  TxtOrderedWordsEntry &towe
+      = *dynamic_cast<TxtOrderedWordsEntry *>(tifc._txt.at(0));
+  std::vector<std::string> tokens{ "éclair", "##s",    ",",    "un",
+                                   "##aff",  "##able", "[UNK]" };
+  ASSERT_EQ(tokens, towe._v);
+
+  // vocabulary changes are taken into account
+  tifc._vocab["xyz"] = Word();
+  tifc.parse_content(str, 1);
+  TxtOrderedWordsEntry &towe2
+      = *dynamic_cast<TxtOrderedWordsEntry *>(tifc._txt.at(1));
+  ASSERT_EQ("xyz", towe2._v.back());
+
+  // reloaded vocabulary of the same size
+  std::string repo = "txt_tokenize_wordpiece_unicode_repo";
+  fileops::create_dir(repo, 0777);
+  {
+    std::ofstream out(repo + "/vocab.dat");
+    for (const std::string &w :
+         { "éclair", "##s", "un", "##aff", "##able", ",", "xy" })
+      out << w << ",0\n";
+  }
+  tifc._model_repo = repo;
+  tifc._vocab.clear();
+  tifc.deserialize_vocab();
+  tifc.parse_content(str, 1);
+  TxtOrderedWordsEntry &towe3
+      = *dynamic_cast<TxtOrderedWordsEntry *>(tifc._txt.at(2));
+  ASSERT_EQ(tokens, towe3._v);
+  fileops::clear_directory(repo);
+  fileops::remove_dir(repo);
+
+  // dotted capital I has no lower case of the same length
+  std::string dotted = "\u0130I\u00c9";
+  utf8_lower(dotted);
+  ASSERT_EQ("\u0130i\u00e9", dotted);
+}
+
 TEST(torchapi, load_weights_native_model)
 {
   APIData template_params;
@@ -654,6 +757,80 @@ TEST(torchapi, load_weights_native_model)
   fileops::remove_file(".", mlmodel._native);
 }
 
+TEST(torchapi, adaptive_inference)
+{
+  torch::manual_seed(0);
+  torch::NoGradGuard no_grad;
+  // 16 patches plus the class token, 8 blocks
+  ViT vit(32, 8, 3, 4, 64, 8, 4);
+  vit.eval();
+  torch::Tensor x = torch::randn({ 4, 3, 32, 32 });
+
+  // disabled adaptation is the plain forward
+  AdaptiveInferenceParams params;
+  AdaptiveInferenceStats stats;
+  ASSERT_FALSE(params.enabled());
+  ASSERT_TRUE(
+      torch::allclose(vit.forward(x), vit.forward_adaptive(x, params, stats)));
+  ASSERT_EQ(8, stats._depth);
+  for (size_t i = 0; i < 4; ++i)
+    {
+      ASSERT_EQ(8, stats._exit_depths[i]);
+      ASSERT_NEAR(1.0, stats._token_ratios[i], 1e-6);
+    }
+
+  // top probability is at least 1/4, so every sample exits as soon as
+  // allowed
+  params._exit_confidence = 0.1;
+  params._exit_min_depth = 2;
+  torch::Tensor out = vit.forward_adaptive(x, params, stats);
+  ASSERT_EQ(4, out.size(0));
+  ASSERT_EQ(4, out.size(1));
+  for (size_t i = 0; i < 4; ++i)
+    {
+      ASSERT_EQ(2, stats._exit_depths[i]);
+      ASSERT_NEAR(2.0 / 8, stats._token_ratios[i], 1e-6);
+    }
+
+  // half the patch tokens are kept after blocks 2, 4 and 6: 17, 9, 5 then 3
+  // tokens, two blocks each
+  params._exit_confidence = 0.0;
+  params._token_keep_rate = 0.5;
+  out = vit.forward_adaptive(x, params, stats);
+  ASSERT_EQ(4, out.size(0));
+  for (size_t i = 0; i < 4; ++i)
+    {
+      ASSERT_EQ(8, stats._exit_depths[i]);
+      ASSERT_NEAR((2 * 17 + 2 * 9 + 2 * 5 + 2 * 3) / (17.0 * 8),
+                  stats._token_ratios[i], 1e-6);
+    }
+
+  // visformer exits in its last stage only
+  ImgTorchInputFileConn inputc;
+  inputc._width = inputc._height = 64;
+  APIData ad_params;
+  ad_params.add("nclasses", 4);
+  Visformer visformer(inputc, ad_params);
+  visformer.eval();
+  x = torch::randn({ 2, 3, 64, 64 });
+  AdaptiveInferenceParams vparams;
+  ASSERT_TRUE(torch::allclose(visformer.forward(x),
+                              visformer.forward_adaptive(x, vparams, stats)));
+  int depth = stats._depth;
+  vparams._exit_confidence = 0.1;
+  visformer.forward_adaptive(x, vparams, stats);
+  for (size_t i = 0; i < 2; ++i)
+    {
+      ASSERT_TRUE(stats._exit_depths[i] <= depth);
+      ASSERT_EQ(stats._exit_depths[0], stats._exit_depths[i]);
+      ASSERT_NEAR(static_cast<double>(stats._exit_depths[i]) / depth,
+                  stats._token_ratios[i], 1e-6);
+    }
+  vparams._token_keep_rate = 0.5;
+  ASSERT_THROW(visformer.forward_adaptive(x, vparams, stats),
+               MLLibBadParamException);
+}
+
 TEST(torchapi, compute_bbox_stats)
 {
   TorchModel torchmodel;
@@ -970,6 +1147,75 @@ TEST(torchapi, service_train_images)
   fileops::remove_dir(resnet50_train_repo + "test_0.lmdb");
 }
 
+TEST(torchapi, service_train_images_feature_cache)
+{
+  setenv("CUBLAS_WORKSPACE_CONFIG", ":4096:8", true);
+  torch::manual_seed(torch_seed);
+  at::globalContext().setDeterministicCuDNN(true);
+
+  // Create service
+  JsonAPI japi;
+  std::string sname = "imgserv";
+  std::string jstr
+      = "{\"mllib\":\"torch\",\"description\":\"image\",\"type\":"
+        "\"supervised\",\"model\":{\"repository\":\""
+        + resnet50_train_repo
+        + "\"},\"parameters\":{\"input\":{\"connector\":\"image\","
+          "\"width\":224,\"height\":224,\"db\":true},\"mllib\":{\"nclasses\":"
+          "2,\"finetuning\":true,\"freeze_traced\":true,\"gpu\":true}}}";
+  std::string joutstr = japi.jrender(japi.service_create(sname, jstr));
+  ASSERT_EQ(created_str, joutstr);
+
+  // Train twice, second training reuses the features cache
+  std::string jtrainstr
+      = "{\"service\":\"imgserv\",\"async\":false,\"parameters\":{"
+        "\"mllib\":{\"solver\":{\"iterations\":"
+        + iterations_resnet50 + ",\"base_lr\":" + torch_lr
+        + ",\"solver_type\":\"ADAM\",\"test_interval\":200},\"net\":{"
+          "\"batch_size\":4},\"resume\":false,\"feature_cache\":true},"
+          "\"input\":{\"seed\":12345,\"db\":true,\"shuffle\":true},"
+          "\"output\":{\"measure\":[\"f1\",\"acc\"]}},\"data\":[\""
+        + resnet50_train_data + "\",\"" + resnet50_test_data + "\"]}";
+  for (int i = 0; i < 2; ++i)
+    {
+      joutstr = japi.jrender(japi.service_train(jtrainstr));
+      JDoc jd;
+      std::cout << "joutstr=" << joutstr << std::endl;
+      jd.Parse<rapidjson::kParseNanAndInfFlag>(joutstr.c_str());
+      ASSERT_TRUE(!jd.HasParseError());
+      ASSERT_EQ(201, jd["status"]["code"]);
+      ASSERT_TRUE(jd["body"]["measure"]["acc"].GetDouble() <= 1)
+          << "accuracy";
+      ASSERT_TRUE(jd["body"]["measure"]["acc"].GetDouble() >= 0.49)
+          << "accuracy good";
+      ASSERT_TRUE(
+          fileops::file_exists(resnet50_train_repo + "train_features.lmdb"));
+      // a rebuilt cache would not keep the marker
+      std::string marker
+          = resnet50_train_repo + "train_features.lmdb/cache_marker";
+      if (i == 0)
+        std::ofstream(marker) << "cached" << std::endl;
+      else
+        ASSERT_TRUE(fileops::file_exists(marker)) << "features cache hit";
+    }
+
+  std::unordered_set<std::string> lfiles;
+  fileops::list_directory(resnet50_train_repo, true, false, false, lfiles);
+  for (std::string ff : lfiles)
+    {
+      if (ff.find("checkpoint") != std::string::npos
+          || ff.find("solver") != std::string::npos
+          || ff.find("fingerprint") != std::string::npos)
+        remove(ff.c_str());
+    }
+  fileops::clear_directory(resnet50_train_repo + "train.lmdb");
+  fileops::clear_directory(resnet50_train_repo + "test_0.lmdb");
+  fileops::clear_directory(resnet50_train_repo + "train_features.lmdb");
+  fileops::remove_dir(resnet50_train_repo + "train.lmdb");
+  fileops::remove_dir(resnet50_train_repo + "test_0.lmdb");
+  fileops::remove_dir(resnet50_train_repo + "train_features.lmdb");
+}
+
 TEST(torchapi, service_train_resume)
 {
   setenv("CUBLAS_WORKSPACE_CONFIG", ":4096:8", true);
@@ -1993,6 +2239,70 @@ TEST(torchapi, service_train_images_multiple_testsets)
   fileops::remove_dir(resnet50_test_cats_data);
 }
 
+TEST(torchapi, db_build_resume)
+{
+  std::string repo = "db_build_resume_repo";
+  fileops::create_dir(repo, 0777);
+  std::unordered_set<std::string> lfiles;
+  fileops::list_directory(resnet50_train_data + "cats/", true, false, false,
+                          lfiles);
+  std::vector<std::string> images(lfiles.begin(), lfiles.end());
+  std::sort(images.begin(), images.end());
+  images.resize(6);
+
+  ImgTorchInputFileConn inputc;
+  inputc._dataset.set_logger(DD_SPDLOG_LOGGER("db_build_resume"));
+  inputc._dataset.set_db_params(true, "lmdb", repo + "/train");
+  inputc._dataset.set_db_build_params(2, 1);
+  std::string dbname = repo + "/train.lmdb";
+
+  // the first half of the list can't be read, so that a db built from
+  // scratch has half its elements. A build interrupted after the first
+  // half is simulated by a db of the first images and its progress file.
+  std::vector<std::pair<std::string, int>> half, list;
+  for (size_t i = 0; i < images.size() / 2; ++i)
+    {
+      half.push_back({ images[i], 0 });
+      list.push_back({ repo + "/missing_" + std::to_string(i) + ".jpg", 0 });
+    }
+  for (size_t i = images.size() / 2; i < images.size(); ++i)
+    list.push_back({ images[i], 0 });
+  std::vector<std::string> uris;
+  for (auto &l : list)
+    uris.push_back(l.first);
+
+  auto build = [&](long progress_seed, long seed) {
+    fileops::clear_directory(dbname);
+    fileops::remove_dir(dbname);
+    inputc._dataset.set_db_list_seed(0);
+    inputc._dataset.add_image_files_db(half);
+    inputc._dataset.db_finalize();
+    std::ofstream progressf(dbname + ".progress");
+    progressf << TorchDataset::db_list_fingerprint(uris, progress_seed) << " "
+              << half.size() << std::endl;
+    progressf.close();
+
+    inputc._dataset.set_db_list_seed(seed);
+    inputc._dataset.add_image_files_db(list);
+    inputc._dataset.db_finalize();
+    EXPECT_TRUE(TorchDataset::db_complete(dbname));
+    std::unique_ptr<db::DB> db(db::GetDB("lmdb"));
+    db->Open(dbname, db::READ);
+    size_t count = db->Count() / 2;
+    db->Close();
+    return count;
+  };
+
+  // resumed on the same list and seed
+  ASSERT_EQ(images.size(), build(12345, 12345));
+  // rebuilt on another seed, or without a seed
+  ASSERT_EQ(images.size() / 2, build(12345, 54321));
+  ASSERT_EQ(images.size() / 2, build(-1, -1));
+
+  fileops::clear_directory(repo);
+  fileops::remove_dir(repo);
+}
+
 TEST(torchapi, service_train_images_multiple_testsets_db)
 {
   torch::manual_seed(torch_seed);
@@ -3131,6 +3441,74 @@ TEST(torchapi, service_train_txt_lm)
   ASSERT_TRUE(!fileops::file_exists(bert_train_repo + "solver-3.pt"));
 }
 
+TEST(torchapi, service_train_txt_lm_packing)
+{
+  setenv("CUBLAS_WORKSPACE_CONFIG", ":4096:8", true);
+  torch::manual_seed(torch_seed);
+  at::globalContext().setDeterministicCuDNN(true);
+
+  JsonAPI japi;
+  std::string jtrainstr
+      = "{\"service\":\"txtserv\",\"async\":false,\"parameters\":{"
+        "\"mllib\":{\"solver\":{\"iterations\":3,\"base_lr\":"
+        + torch_lr
+        + ",\"iter_size\":2,\"solver_type\":\"ADAM\"},\"net\":{"
+          "\"batch_size\":2}},\"input\":{\"shuffle\":true,"
+          "\"test_split\":0.25,\"sequence_packing\":true},\"output\":{"
+          "\"measure\":[\"acc\"]}},\"data\":[\""
+        + bert_train_data + "\"]}";
+
+  // packing is refused for supervised training, it would drop the targets
+  std::string jstr
+      = "{\"mllib\":\"torch\",\"description\":\"bert\",\"type\":"
+        "\"supervised\",\"model\":{\"repository\":\""
+        + bert_train_repo
+        + "\"},\"parameters\":{\"input\":{\"connector\":\"txt\","
+          "\"ordered_words\":true,\"wordpiece_tokens\":true,"
+          "\"punctuation_tokens\":true,\"sequence\":512},\"mllib\":{"
+          "\"template\":\"bert\",\"nclasses\":2,\"finetuning\":true,"
+          "\"gpu\":true}}}";
+  ASSERT_EQ(created_str, japi.jrender(japi.service_create("txtserv", jstr)));
+  std::string joutstr = japi.jrender(japi.service_train(jtrainstr));
+  std::cout << "joutstr=" << joutstr << std::endl;
+  JDoc jd;
+  jd.Parse<rapidjson::kParseNanAndInfFlag>(joutstr.c_str());
+  ASSERT_TRUE(!jd.HasParseError());
+  ASSERT_EQ(400, jd["status"]["code"]);
+  ASSERT_EQ(1005, jd["status"]["dd_code"]);
+  japi.service_delete("txtserv", "");
+
+  // masked lm training on packed sequences
+  jstr = "{\"mllib\":\"torch\",\"description\":\"bert\",\"type\":"
+         "\"supervised\",\"model\":{\"repository\":\""
+         + bert_train_repo
+         + "\"},\"parameters\":{\"input\":{\"connector\":\"txt\","
+           "\"ordered_words\":true,\"wordpiece_tokens\":true,"
+           "\"punctuation_tokens\":true,\"sequence\":512},\"mllib\":{"
+           "\"template\":\"bert\",\"self_supervised\":\"mask\","
+           "\"finetuning\":true,\"gpu\":true}}}";
+  ASSERT_EQ(created_str, japi.jrender(japi.service_create("txtserv", jstr)));
+  joutstr = japi.jrender(japi.service_train(jtrainstr));
+  std::cout << "joutstr=" << joutstr << std::endl;
+  jd = JDoc();
+  jd.Parse<rapidjson::kParseNanAndInfFlag>(joutstr.c_str());
+  ASSERT_TRUE(!jd.HasParseError());
+  ASSERT_EQ(201, jd["status"]["code"]);
+  ASSERT_TRUE(jd["body"]["measure"]["iteration"] == 3) << "iterations";
+  ASSERT_TRUE(jd["body"]["measure"]["acc"].GetDouble() <= 1) << "accuracy";
+
+  std::unordered_set<std::string> lfiles;
+  fileops::list_directory(bert_train_repo, true, false, false, lfiles);
+  for (std::string ff : lfiles)
+    {
+      if (ff.find("checkpoint") != std::string::npos
+          || ff.find("solver") != std::string::npos)
+        remove(ff.c_str());
+    }
+  ASSERT_TRUE(!fileops::file_exists(bert_train_repo + "checkpoint-3.pt"));
+  ASSERT_TRUE(!fileops::file_exists(bert_train_repo + "solver-3.pt"));
+}
+
 TEST(torchapi, service_train_txt_classification)
 {
   setenv("CUBLAS_WORKSPACE_CONFIG", ":4096:8", true);